@@ -22,9 +22,18 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
-#include "w211_can_c.h"
-#include "w211_can_b.h"
+#include <driver/ledc.h>
+#include <esp_sleep.h>
+#include "can_registry.h"
+#include "canbus.h"
+#include "can_driver.h"
+#include "can_freshness.h"
+#include "config_store.h"
+#include "control.h"
 #include "crypto.h"
+#include "key_combo.h"
+#include "metrics.h"
+#include "w211_signals.h"
 
 // reserved
 #define LED_BUILTIN GPIO_NUM_2
@@ -59,16 +68,16 @@
 #define PWM3 GPIO_NUM_14 // NHRS1
 #define PWM4 GPIO_NUM_27 // NHLS1
 
-// CAN IDs Motor CAN-C
-#define CANID_0 0x0240 // ECU: EZS, NAME: EZS_240h, ID: 0x0240, MSG COUNT: 31
-#define CANID_1 0x0340 // ECU: LF_ABC, NAME: FS_340h, ID: 0x0340, MSG COUNT: 16
+// DAC output update rate, see Output.ino
+#define OUTPUT_RATE 100 // Hz
 
-// CAN IDs Interior CAN-B
-#define CANID_2 0x01CA // ECU: KOMBI, NAME: KOMBI_A5, ID: 0x01CA, MSG COUNT: 25
-#define CANID_3 0x001A // ECU: UBF, NAME: UBF_A1, ID: 0x001A, MSG COUNT: 9
+// CAN trace trigger events, see Trace.ino
+#define TRACE_ON_MODE  0x01
+#define TRACE_ON_SLEEP 0x02
+#define TRACE_ON_USER  0x04
 
-// copy CAN_message into bit field decoder
-#define copyMsg(ptr) importMsg(#ptr, ptr, sizeof(*(ptr)), id, msg, len)
+// copy CAN_message into payload snapshot
+#define copyMsg(snap) importMsg(#snap, snap, id, msg, len)
 
 // helper macros for creating unique variable names
 #define CONCAT_IMPL(x, y) x##y
@@ -89,84 +98,152 @@ struct BlinkCmd {
   unsigned int ontime;
 };
 
-// CAN Frames Motor CAN-C
-struct EZS_240h_t EZS_240h; // ECU: EZS, NAME: EZS_240h, ID: 0x0240, MSG COUNT: 31
-struct FS_340h_t FS_340h;   // ECU: LF_ABC, NAME: FS_340h, ID: 0x0340, MSG COUNT: 16
+// CAN Frames Motor CAN-C and Interior CAN-B, see CAN_MESSAGES in can_registry.h
+#define CAN_MSG_SNAPSHOT(bus, id, name, period) Snapshot<name##_t> name;
+CAN_MESSAGES(CAN_MSG_SNAPSHOT)
+#undef CAN_MSG_SNAPSHOT
 
-// CAN Frames Interior CAN-B
-struct KOMBI_A5_t KOMBI_A5; // ECU: KOMBI, NAME: KOMBI_A5, ID: 0x01CA, MSG COUNT: 25
-struct UBF_A1_t UBF_A1;     // ECU: UBF, NAME: UBF_A1, ID: 0x001A, MSG COUNT: 9
-
-// CAN message buffer
-struct can_frame canMsg0;
-struct can_frame canMsg1;
+// CAN message queue CAN task -> loop()
+FrameQueue<CanFrame, CAN_QUEUE_LEN> canQueue0; // Motor CAN-C
+FrameQueue<CanFrame, CAN_QUEUE_LEN> canQueue1; // Interior CAN-B
 
 // Chip select
 MCP2515 Can0(CS0); // CS -> GPIO5
 MCP2515 Can1(CS1); // CS -> GPIO15
 
+// receive path on the shared VSPI bus, see can_driver.h
+CanDriver CanRx0(CAN_C, CS0);
+CanDriver CanRx1(CAN_B, CS1);
+
 // PWM default value
-const int freq = 4000; // 4 kHz
-const uint8_t res = 8; // resolution 255
+const int freq = 19500; // 19.5 kHz, highest for 12 bit on the 80 MHz APB clock, less ripple behind the LM2902 filter
 uint8_t duty = 115; // default 45% / adjust here if reference zero position for offset drifts away
+uint8_t slew = 20; // mm/s offset ramp of the output task, 0 = step / adjust here
 int8_t calib_vl = 0; // NVLS1 calibration
 int8_t calib_vr = 0; // NVRS1 calibration
 int8_t calib_hr = 0; // NHRS1 calibration
 int8_t calib_hl = 0; // NHLS1 calibration
 
-String configJson;
-String mode = "default";
+// POST /config command, queued by the web server and run by the WiFi task, see Wireless.ino
+struct ConfigCmd {
+  uint32_t id;                // reply of the POST, GET /config/result?id=N
+  uint8_t type;               // ?update=N
+  String body;                // JSON of the client, may be empty
+  int status;                 // HTTP status of the result
+  const char* result;
+};
+
+// result of a finished command until the client collected it, guarded by mux_config
+struct ConfigResult {
+  uint32_t id;
+  int status;
+  const char* result;
+};
+Mode mode = MODE_DEFAULT;
 const char* config = "/config.json";
 int8_t offset_nv = 0; // mm front axle level custom offset
 int8_t offset_nh = 0; // mm rear axle level custom offset
-float factor = (float) duty * 2.0 / 100.0;
+
+// messages the offsets depend on (mode, level), any of them stale: outputs ramp to neutral
+const uint32_t canCritical = (1UL << MSG_EZS_240h) | (1UL << MSG_FS_340h);
+bool outputNeutral = false; // offsets ignored, duty + calibration only
+
+// precomputed PWM duty per output in PWM_RES bits, recomputed in loop() when one of the inputs changes, ramped to by the output task
+volatile uint32_t pwmDuty_vl = 0;
+volatile uint32_t pwmDuty_vr = 0;
+volatile uint32_t pwmDuty_hr = 0;
+volatile uint32_t pwmDuty_hl = 0;
+volatile int32_t pwmSlewStep = 0; // max change per output tick, 1/256 count
+uint64_t pwmInputs = ~0ULL; // duty, calibration and offsets the values above were computed from
+
+// offset gain per output in 1/256 (GAIN_ONE), fitted by the level feedback, see Level.ino
+int16_t pwmGain[CALIB_COUNT] = {GAIN_ONE, GAIN_ONE, GAIN_ONE, GAIN_ONE};
+uint8_t pwmGainVersion = 0; // bumped on every pwmGain change
+
+// web server, defined in Wireless.ino, Replay.ino and Trace.ino register their handlers on it
+extern AsyncWebServer server;
 
 volatile bool wifiConnected = false;
+volatile bool wifiActive = true; // access point running, cleared when the WiFi task stops it
 volatile unsigned long timer1 = 0; // millis()
 volatile unsigned long timer2 = 0;
 
 volatile bool canDown = true;
-volatile bool canInterruptFlag0 = false;
-volatile bool canInterruptFlag1 = false;
+volatile bool canWake[CAN_BUSES] = {false}; // first drain after light sleep, see Power.ino
+volatile uint32_t canWakeTime = 0;           // esp_timer_get_time() at resume, us
+volatile bool replayActive = false; // CAN replay benchmark running, see Replay.ino
+CanRxStats canStats0;
+CanRxStats canStats1;
+CanFreshness canFreshness; // per message deadlines, bus load
 
-portMUX_TYPE mux_can0 = portMUX_INITIALIZER_UNLOCKED;
-portMUX_TYPE mux_can1 = portMUX_INITIALIZER_UNLOCKED;
 portMUX_TYPE mux_awake = portMUX_INITIALIZER_UNLOCKED;
 
-TaskHandle_t canTask0; // Motor CAN-C
-TaskHandle_t canTask1; // Interior CAN-B
+TaskHandle_t canTask0 = NULL; // Motor CAN-C
+TaskHandle_t canTask1 = NULL; // Interior CAN-B
 
 TaskHandle_t wifiTask;
 
 TaskHandle_t blinkTask;
 QueueHandle_t blinkQueue;
 
-// import CAN_message into bit field decoder
-void importMsg(const char* name, void* dest, size_t destSize, unsigned int id, const uint8_t* msg, uint8_t len) {
-  if (len <= destSize) {
-    memcpy(dest, msg, len);
+TaskHandle_t traceTask = NULL; // CAN trace writer, see Trace.ino
+
+// steering wheel key combos, index = row of keyComboTable
+enum KeyComboId : uint8_t {
+  KEY_FRONT_UP,
+  KEY_FRONT_DN,
+  KEY_REAR_UP,
+  KEY_REAR_DN,
+  KEY_FRONT_SET,
+  KEY_REAR_SET,
+  KEY_FRONT_RESET,
+  KEY_REAR_RESET,
+  KEY_COMBO_COUNT
+};
+
+const KeyCombo keyComboTable[KEY_COMBO_COUNT] = {
+  // buttons             actions                debounce repeat delay, interval  long press
+  {BTN_NEXT | BTN_PLUS,  KEY_PRESS | KEY_REPEAT, 40,     1400, 600,              0},    // front + higher
+  {BTN_NEXT | BTN_MINUS, KEY_PRESS | KEY_REPEAT, 40,     1400, 600,              0},    // front + lower
+  {BTN_PREV | BTN_PLUS,  KEY_PRESS | KEY_REPEAT, 40,     1400, 600,              0},    // rear + higher
+  {BTN_PREV | BTN_MINUS, KEY_PRESS | KEY_REPEAT, 40,     1400, 600,              0},    // rear + lower
+  {BTN_NEXT | BTN_SEND,  KEY_LONG,               40,     0,    0,                1400}, // front + save
+  {BTN_PREV | BTN_SEND,  KEY_LONG,               40,     0,    0,                1400}, // rear + save
+  {BTN_NEXT | BTN_END,   KEY_PRESS,              40,     0,    0,                0},    // front + cancel
+  {BTN_PREV | BTN_END,   KEY_PRESS,              40,     0,    0,                0},    // rear + cancel
+};
+
+void keyAction(uint8_t combo, uint8_t action, uint32_t time);
+KeyComboEngine keyCombos(keyComboTable, KEY_COMBO_COUNT, keyAction);
+
+// import CAN_message into payload snapshot
+template <typename T>
+void importMsg(const char* name, Snapshot<T>& dest, unsigned int id, const uint8_t* msg, uint8_t len) {
+  if (len <= sizeof(T)) {
+    dest.write(msg, len);
   } else {
-    Serial.printf("WARNING: CANID 0x%04X (%s): frame too long, struct size is %d bytes\r\n", id, name, (int)destSize);
+    Serial.printf("WARNING: CANID 0x%04X (%s): frame too long, struct size is %d bytes\r\n", id, name, (int)sizeof(T));
     delay(100);
   }
 }
 
-// export CAN_message into bit field decoder
-void exportMsg(unsigned int id, const uint8_t *msg, uint8_t len)
+// payload snapshot per registry index
+#define CAN_MSG_DECODER(bus, canid, name, period) [](unsigned int id, const uint8_t *msg, uint8_t len) { copyMsg(name); },
+void (*const canDecoders[CAN_MSG_COUNT])(unsigned int id, const uint8_t *msg, uint8_t len) = {
+  CAN_MESSAGES(CAN_MSG_DECODER)
+};
+#undef CAN_MSG_DECODER
+
+// export CAN_message into payload snapshot, time = us of reception
+void exportMsg(CanBus bus, unsigned int id, const uint8_t *msg, uint8_t len, uint32_t time)
 {
-  switch(id) {
-    case CANID_0:
-      copyMsg(&EZS_240h); // ECU: EZS, NAME: EZS_240h, ID: 0x0240, MSG COUNT: 31
-      break;
-    case CANID_1:
-      copyMsg(&FS_340h); // ECU: LF_ABC, NAME: FS_340h, ID: 0x0340, MSG COUNT: 16
-      break;
-    case CANID_2:
-      copyMsg(&KOMBI_A5); // ECU: KOMBI, NAME: KOMBI_A5, ID: 0x01CA, MSG COUNT: 25
-      break;
-    case CANID_3:
-      copyMsg(&UBF_A1); // ECU: UBF, NAME: UBF_A1, ID: 0x001A, MSG COUNT: 9
-      break;
+  uint8_t index = canMsgIndex(bus, id);
+  canFreshness.frame(bus, index, id, len, time);
+  if (index != CAN_MSG_NONE) {
+    metrics.frames[index].inc();
+    canDecoders[index](id, msg, len);
+  } else if (bus < CAN_BUSES) {
+    metrics.unregistered[bus].inc();
   }
 }
 
@@ -215,13 +292,23 @@ void blinkTaskFunc(void *param) {
   }
 }
 
-// Watchdog output pulse
+// Watchdog output pulse, clocked from RTC8M so it keeps running in light sleep (see Power.ino)
 void startWatchdog(gpio_num_t wpin, const unsigned long wfreq) {
-  const unsigned char wchn = 8;  // Group 1, Channel 0, Timer 0
-  const unsigned char wres = 11; // resolution 2048
-  const unsigned long wduty = (1 << wres) / 2; // 50%
-  ledcAttachChannel(wpin, wfreq, wres, wchn);
-  ledcWrite(wpin, wduty);
+  const ledc_timer_bit_t wres = LEDC_TIMER_14_BIT; // resolution 16384, 1 Hz from 8 MHz needs >= 13 bit
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = LEDC_LOW_SPEED_MODE; // Group 1, Timer 0
+  timer.duty_resolution = wres;
+  timer.timer_num = LEDC_TIMER_0;
+  timer.freq_hz = wfreq;
+  timer.clk_cfg = LEDC_USE_RTC8M_CLK;
+  ledc_timer_config(&timer);
+  ledc_channel_config_t channel = {};
+  channel.gpio_num = wpin;
+  channel.speed_mode = LEDC_LOW_SPEED_MODE;
+  channel.channel = LEDC_CHANNEL_0; // Group 1, Channel 0, not used by ledcAttach() of the DAC outputs
+  channel.timer_sel = LEDC_TIMER_0;
+  channel.duty = (1 << wres) / 2; // 50%
+  ledc_channel_config(&channel);
 }
 
 // blink function
@@ -231,195 +318,85 @@ void blink(gpio_num_t pin, unsigned int ontime) {
   xQueueSend(blinkQueue, &cmd, 0);
 }
 
-// debounce key input
-class GetKeyEvent {
-  private:
-    const bool* btn1;
-    const bool* btn2;
-    bool lastState = false;
-    bool stableState = false;
-    bool justPressed = false;
-    bool repeating = false;
-    unsigned long lastChange = 0;
-    unsigned long lastRepeat = 0;
-    const unsigned long debounceTime = 40;
-    const unsigned long repeatDelay = 800;
-    const unsigned long repeatInterval = 600;
-  public:
-    GetKeyEvent(const bool* b1, const bool* b2)
-      : btn1(b1), btn2(b2) {}
-    void read() {
-      bool combined = (*btn1) & (*btn2);
-      unsigned long time = millis();
-      if (combined != lastState) {
-        lastState = combined;
-        lastChange = time;
-      }
-      if ((time - lastChange) > debounceTime) {
-        if (combined != stableState) {
-          stableState = combined;
-          if (stableState) {
-            justPressed = true;
-            lastRepeat = time;
-            repeating = false;
-          } else {
-            repeating = false;
-          }
-        }
-      }
-      if (stableState && !repeating && (time - lastRepeat) > repeatDelay) {
-        repeating = true;
-        lastRepeat = time;
-      }
-    }
-    bool pressed() {
-      if (justPressed) {
-        justPressed = false;
-        return true;
-      }
-      return false;
-    }
-    bool repeated() {
-      if (repeating) {
-        unsigned long time = millis();
-        if ((time - lastRepeat) > repeatInterval) {
-          lastRepeat = time;
-          return true;
-        }
-      }
-      return false;
-    }
-    bool isDown() const {
-      return stableState;
-    }
-};
-
 // for safety purposes - do not change
 void limitOffset(int8_t* off) {
   *off = *off < -MAX_OFF ? -MAX_OFF : *off; // max suspension lowering
   *off = *off > MAX_OFF ? MAX_OFF : *off;   // max suspension height
 }
 
-// read config.json file from LittleFS
-JsonDocument readConfig() {
-  JsonDocument doc;
-  File file = LittleFS.open(config, "r");
-  if (!file) {
-    Serial.print("LittleFS: cannot access '");
-    Serial.print(config);
-    Serial.println("': No such file or directory");
-    configJson = "{}";
-    return doc;
-  }
-  DeserializationError err = deserializeJson(doc, file);
-  file.seek(0);
-  configJson = file.readString();
-  file.close();
-  if (err) {
-    Serial.print("Cannot deserialize the current JSON object: ");
-    Serial.println(err.c_str());
-  }
-  return doc;
-}
-
-// write config.json file to LittleFS
-void saveConfig(const JsonDocument& doc) {
-  File file = LittleFS.open(config, "w");
-  if (!file) {
-    Serial.print("LittleFS: ");
-    Serial.print(config);
-    Serial.println(": Read-only file system");
-    return;
+void getCalibration() {
+  calib_vl = configStore.getCalibration(CALIB_VL);
+  calib_vr = configStore.getCalibration(CALIB_VR);
+  calib_hl = configStore.getCalibration(CALIB_HL);
+  calib_hr = configStore.getCalibration(CALIB_HR);
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    pwmGain[c] = configStore.getGain((CalibChannel) c);
   }
-  serializeJson(doc, file);
-  file.close();
+  pwmGainVersion++;
 }
 
-void getCalibration() {
-  JsonDocument doc = readConfig();
-  calib_vl = 0;
-  calib_vr = 0;
-  calib_hl = 0;
-  calib_hr = 0;
-  if (!doc.containsKey("calibration")) return;
-  JsonObject obj = doc["calibration"];
-  if (obj.containsKey("calib_vl")) calib_vl = obj["calib_vl"];
-  if (obj.containsKey("calib_vr")) calib_vr = obj["calib_vr"];
-  if (obj.containsKey("calib_hl")) calib_hl = obj["calib_hl"];
-  if (obj.containsKey("calib_hr")) calib_hr = obj["calib_hr"];
-}
-
-void updateCalibration(const String& key, int8_t value) {
-  JsonDocument doc = readConfig();
-  JsonObject calibObj;
-  if (doc.containsKey("calibration")) {
-    calibObj = doc["calibration"];
-  } else {
-    calibObj = doc.createNestedObject("calibration");
-  }
-  calibObj[key] = value;
-  saveConfig(doc);
+void updateCalibration(CalibChannel ch, int8_t value) {
+  configStore.setCalibration(ch, value);
 }
 
 // read table
-void getSettings(const String& mode) {
-  JsonDocument doc = readConfig();
-  offset_nv = 0;
-  offset_nh = 0;
-  if (!doc.containsKey(mode)) return;
-  JsonObject obj = doc[mode];
-  if (obj.containsKey("offset_nv")) offset_nv = obj["offset_nv"];
-  if (obj.containsKey("offset_nh")) offset_nh = obj["offset_nh"];
+void getSettings(Mode m) {
+  offset_nv = configStore.getOffset(m, AXLE_NV);
+  offset_nh = configStore.getOffset(m, AXLE_NH);
 }
 
 // write table
-void updateSettings(const String& mode, const String& offset, int8_t value) {
-  JsonDocument doc = readConfig();
-  JsonObject modeObj;
-  if (doc.containsKey(mode)) {
-    modeObj = doc[mode];
-  } else {
-    modeObj = doc.createNestedObject(mode);
-  }
-  modeObj[offset] = value;
-  saveConfig(doc);
+void updateSettings(Mode m, Axle axle, int8_t value) {
+  configStore.setOffset(m, axle, value);
 }
 
-// read wifi credentials from config.json file
+// recompute PWM duties only when duty, calibration, offsets or gains changed
+void updatePwmDuty() {
+  int8_t nv = outputNeutral ? 0 : offset_nv;
+  int8_t nh = outputNeutral ? 0 : offset_nh;
+  uint64_t inputs = (uint64_t)duty
+    | (uint64_t)(uint8_t)calib_vl << 8
+    | (uint64_t)(uint8_t)calib_vr << 16
+    | (uint64_t)(uint8_t)calib_hr << 24
+    | (uint64_t)(uint8_t)calib_hl << 32
+    | (uint64_t)(uint8_t)nv << 40
+    | (uint64_t)(uint8_t)nh << 48
+    | (uint64_t)pwmGainVersion << 56;
+  if (inputs == pwmInputs) return;
+  pwmInputs = inputs;
+  pwmDuty_vl = pwmValue(duty, calib_vl, nv, pwmGain[CALIB_VL]);
+  pwmDuty_vr = pwmValue(duty, calib_vr, -nv, pwmGain[CALIB_VR]); // inverted, requires negative offset
+  pwmDuty_hr = pwmValue(duty, calib_hr, nh, pwmGain[CALIB_HR]);
+  pwmDuty_hl = pwmValue(duty, calib_hl, nh, pwmGain[CALIB_HL]);
+  pwmSlewStep = rampStep(slew, duty, OUTPUT_RATE);
+}
+
+// read wifi credentials from config store
 void getWifi(String &hash_old, String &seed_old) {
-  JsonDocument doc = readConfig();
-  hash_old = "";
-  seed_old = "";
-  if (!doc.containsKey("wifi")) return;
-  JsonObject obj = doc["wifi"];
-  if (obj.containsKey("hash")) hash_old = obj["hash"].as<String>();
-  if (obj.containsKey("seed")) seed_old = obj["seed"].as<String>();
+  configStore.getWifi(hash_old, seed_old);
 }
 
-// write wifi credentials to config.json file
+// write wifi credentials to config store
 void updateWifi(const String &hash_new, const String &seed_new) {
-  JsonDocument doc = readConfig();
-  JsonObject wifiObj;
-  if (doc.containsKey("wifi")) {
-    wifiObj = doc["wifi"];
-  } else {
-    wifiObj = doc.createNestedObject("wifi");
-  }
-  wifiObj["hash"].set(hash_new);
-  wifiObj["seed"].set(seed_new);
-  saveConfig(doc);
+  configStore.setWifi(hash_new, seed_new);
 }
 
-// Interrupt based CanRx
+// Interrupt based CanRx: wake the owning CAN task
 void IRAM_ATTR onCanInterrupt0() {
-  portENTER_CRITICAL_ISR(&mux_can0);
-  canInterruptFlag0 = true;
-  portEXIT_CRITICAL_ISR(&mux_can0);
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  canStats0.irqTime = (uint32_t) esp_timer_get_time();
+  vTaskNotifyGiveFromISR(canTask0, &xHigherPriorityTaskWoken);
+  if (xHigherPriorityTaskWoken) {
+    portYIELD_FROM_ISR();
+  }
 }
 void IRAM_ATTR onCanInterrupt1() {
-  portENTER_CRITICAL_ISR(&mux_can1);
-  canInterruptFlag1 = true;
-  portEXIT_CRITICAL_ISR(&mux_can1);
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  canStats1.irqTime = (uint32_t) esp_timer_get_time();
+  vTaskNotifyGiveFromISR(canTask1, &xHigherPriorityTaskWoken);
+  if (xHigherPriorityTaskWoken) {
+    portYIELD_FROM_ISR();
+  }
 }
 
 // power down no CAN traffic
@@ -432,6 +409,7 @@ void go_to_sleep(unsigned int timeout) {
     portEXIT_CRITICAL(&mux_awake);
     digitalWrite(LED_BUILTIN, LOW);
     Serial.println("Can: timeout ... no traffic");
+    traceTrigger(TRACE_ON_SLEEP, "sleep");
     // put TJA1055 into go-to-sleep
     if (!wifiConnected) {
       digitalWrite(STB, LOW);
@@ -490,25 +468,15 @@ void setup() {
   Can0.setBitrate(CAN_500KBPS, MCP_8MHZ); // Motor CAN-C High speed
   Can1.setBitrate(CAN_83K3BPS, MCP_16MHZ); // Interior CAN-B Low speed
 
-  // Filters for Receive Buffer RXB0 (uses MASK0, filters RXF0 and RXF1)
-  Can0.setFilterMask(MCP2515::MASK0, false, 0x7FF); // Standard ID mask = 11 bits
-  Can0.setFilter(MCP2515::RXF0, false, CANID_0); // ECU: EZS, NAME: EZS_240h, ID: 0x0240, MSG COUNT: 31
-  Can0.setFilter(MCP2515::RXF1, false, CANID_1); // ECU: LF_ABC, NAME: FS_340h, ID: 0x0340, MSG COUNT: 16
-
-  // Filters for Receive Buffer RXB1 (uses MASK1, filters RXF2 to RXF5)
-  Can0.setFilterMask(MCP2515::MASK1, false, 0x7FF); // Standard ID mask = 11 bits
-  Can0.setFilter(MCP2515::RXF2, false, CANID_0); // ECU: EZS, NAME: EZS_240h, ID: 0x0240, MSG COUNT: 31
-  Can0.setFilter(MCP2515::RXF3, false, CANID_1); // ECU: LF_ABC, NAME: FS_340h, ID: 0x0340, MSG COUNT: 16
-
-  // Filters for Receive Buffer RXB0 (uses MASK0, filters RXF0 and RXF1)
-  Can1.setFilterMask(MCP2515::MASK0, false, 0x7FF); // Standard ID mask = 11 bits
-  Can1.setFilter(MCP2515::RXF0, false, CANID_2); // ECU: KOMBI, NAME: KOMBI_A5, ID: 0x01CA, MSG COUNT: 25
-  Can1.setFilter(MCP2515::RXF1, false, CANID_3); // ECU: UBF, NAME: UBF_A1, ID: 0x001A, MSG COUNT: 9
-
-  // Filters for Receive Buffer RXB1 (uses MASK1, filters RXF2 to RXF5)
-  Can1.setFilterMask(MCP2515::MASK1, false, 0x7FF); // Standard ID mask = 11 bits
-  Can1.setFilter(MCP2515::RXF2, false, CANID_2); // ECU: KOMBI, NAME: KOMBI_A5, ID: 0x01CA, MSG COUNT: 25
-  Can1.setFilter(MCP2515::RXF3, false, CANID_3); // ECU: UBF, NAME: UBF_A1, ID: 0x001A, MSG COUNT: 9
+  // Filters for Receive Buffers RXB0 (MASK0, RXF0-RXF1) and RXB1 (MASK1, RXF2-RXF5) from CAN_MESSAGES
+  setCanFilters(Can0, CAN_C);
+  setCanFilters(Can1, CAN_B);
+  for (int bus = 0; bus < CAN_BUSES; bus++) {
+    if (canFilters[bus].admitted > canFilters[bus].wanted) {
+      Serial.printf("MCP2515: %u unregistered IDs pass the filters of bus %d, dropped in software\r\n",
+        canFilters[bus].admitted - canFilters[bus].wanted, bus);
+    }
+  }
 
   if (Can0.setListenOnlyMode() == MCP2515::ERROR_OK) {
     Serial.println("MCP2515 initialized");
@@ -521,11 +489,9 @@ void setup() {
     Serial.println("WARNING: MCP2515 not initialized");
   }
 
-  // MCP2515 Interrupts
-  pinMode(INT0, INPUT);
-  pinMode(INT1, INPUT);
-  attachInterrupt(digitalPinToInterrupt(INT0), onCanInterrupt0, FALLING);
-  attachInterrupt(digitalPinToInterrupt(INT1), onCanInterrupt1, FALLING);
+  // RXB0 -> RXB1 rollover, SPI arbiter
+  CanRx0.begin();
+  CanRx1.begin();
 
   // create a task that will be executed along the loop() function, with priority 3 and executed on core 0
   xTaskCreatePinnedToCore(
@@ -547,7 +513,15 @@ void setup() {
     &canTask1,     // Task handle to keep track of created task
     1);            // pin task to core 1
 
-  (void) readConfig();
+  // MCP2515 Interrupts / attach after the tasks exist, the ISR notifies them
+  pinMode(INT0, INPUT);
+  pinMode(INT1, INPUT);
+  attachInterrupt(digitalPinToInterrupt(INT0), onCanInterrupt0, FALLING);
+  attachInterrupt(digitalPinToInterrupt(INT1), onCanInterrupt1, FALLING);
+
+  // newest config record (config.json migrated on first boot), later reads and writes go through the cache
+  configStore.begin(config);
+  getCalibration();
   wifiSetup();
 
   // create a task that will be executed along the loop() function, with priority 1
@@ -559,6 +533,15 @@ void setup() {
     1,             // priority of the task
     &wifiTask);    // Task handle to keep track of created task
 
+  // create a task that will be executed along the loop() function, with priority 1
+  xTaskCreate(
+    traceTaskFunc, // Task function
+    "Trace",       // name of task
+    4096,          // Stack size of task
+    NULL,          // parameter of the task
+    1,             // priority of the task
+    &traceTask);   // Task handle to keep track of created task
+
   // create a task that will be executed along the loop() function, with priority 1
   blinkQueue = xQueueCreate(1, sizeof(BlinkCmd));
   xTaskCreate(
@@ -576,183 +559,207 @@ void setup() {
   // Watchdog output 1 Hz
   startWatchdog(WO, 1);
 
-  // DAC offset voltage generator 4 kHz
-  ledcAttach(PWM1, freq, res);
-  ledcAttach(PWM2, freq, res);
-  ledcAttach(PWM3, freq, res);
-  ledcAttach(PWM4, freq, res);
+  // DAC offset voltage generator 19.5 kHz, 12 bit
+  ledcAttach(PWM1, freq, PWM_RES); // resolution 4095, see control.h
+  ledcAttach(PWM2, freq, PWM_RES);
+  ledcAttach(PWM3, freq, PWM_RES);
+  ledcAttach(PWM4, freq, PWM_RES);
+  updatePwmDuty(); // the output task starts at the target, ramps from there
+  outputSetup();
 
   Serial.println("full source code available at -> github.com/aiecxs/w211-airmatic");
 }
 
 
-void loop() {
+// print and reset CAN receive path statistics
+void reportCanStats(const char* name, CanRxStats& stats, unsigned long span) {
+  uint32_t frames = stats.frames;
+  Serial.printf("%s: %u wakeups/s, %u frames/s, ISR to decoded avg %u us, max %u us, SPI %u bytes/frame\r\n", name,
+    (unsigned int)(stats.wakeups * 1000UL / span), (unsigned int)(frames * 1000UL / span),
+    frames ? stats.latencySum / frames : 0, stats.latencyMax, frames ? stats.spiBytes / frames : 0);
+  stats.wakeups = 0;
+  stats.frames = 0;
+  stats.latencySum = 0;
+  stats.latencyMax = 0;
+  stats.spiBytes = 0;
+}
 
-  static uint8_t ic_stat = 0;
-  static String lastMode = mode;
-  static unsigned long timeMs = millis();
-
-  // temp buttons: map bitfield bools into regular bools
-  static bool button0 = 0; // MSG NAME: BUTTON_4_2 - Telefon End, OFFSET 8, LENGTH 1
-  static bool button1 = 0; // MSG NAME: BUTTON_4_1 - Telefon Send, OFFSET 9, LENGTH 1
-  static bool button2 = 0; // MSG NAME: BUTTON_3_2 - Taste "-", OFFSET 10, LENGTH 1
-  static bool button3 = 0; // MSG NAME: BUTTON_3_1 - Taste "+", OFFSET 11, LENGTH 1
-//  static bool button4 = 0; // MSG NAME: BUTTON_2_2 - Reserve, OFFSET 12, LENGTH 1
-//  static bool button5 = 0; // MSG NAME: BUTTON_2_1 - Reserve, OFFSET 13, LENGTH 1
-  static bool button6 = 0; // MSG NAME: BUTTON_1_2 - Vorheriges Display, OFFSET 14, LENGTH 1
-  static bool button7 = 0; // MSG NAME: BUTTON_1_1 - Nächstes Display, OFFSET 15, LENGTH 1
-
-  // declare key combinations
-  static GetKeyEvent keyComboRearReset(&button0, &button6);
-  static GetKeyEvent keyComboFrontReset(&button0, &button7);
-  static GetKeyEvent keyComboRearSet(&button1, &button6);
-  static GetKeyEvent keyComboFrontSet(&button1, &button7);
-  static GetKeyEvent keyComboRearDn(&button2, &button6);
-  static GetKeyEvent keyComboFrontDn(&button2, &button7);
-  static GetKeyEvent keyComboRearUp(&button3, &button6);
-  static GetKeyEvent keyComboFrontUp(&button3, &button7);
 
-  // main loop
-  if (EZS_240h.KL_15) {
-    if (FS_340h.FS_ID == 2) {
-
-      // todo: check the KOMBI_A9 IPS Mode (Comfort/Sport)
-      mode = "comfort";
-
-    } else if (FS_340h.FS_ID == 1) {
-      // check the AIRmatic mode (Offroad/Comfort/Sport1/Sport2)
-      if (FS_340h.ST2_LED_DL) {
-        mode = "offroad";
-      } else if (FS_340h.ST3_LEDR_DL) {
-        mode = "sport2";
-      } else if (FS_340h.ST3_LEDL_DL) {
-        mode = "sport1";
-      } else {
-        mode = "comfort";
-      }
-    }
-  } else {
-    mode = "default";
+// print bus load and per message interval / jitter / deadline misses
+void reportCanTiming() {
+  Serial.printf("Can: load CAN-C %u.%02u%% %u frames/s, CAN-B %u.%02u%% %u frames/s,",
+    canFreshness.load(CAN_C) / 100, canFreshness.load(CAN_C) % 100, canFreshness.rate(CAN_C),
+    canFreshness.load(CAN_B) / 100, canFreshness.load(CAN_B) % 100, canFreshness.rate(CAN_B));
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    Serial.printf(" %s %u/%u us %u%s", canMessages[i].name, canFreshness.interval(i), canFreshness.jitter(i),
+      canFreshness.misses(i), canFreshness.stale() & (1UL << i) ? " stale" : "");
   }
+  Serial.println();
+}
 
-  // read offsets from table
-  if (mode != lastMode) {
-    lastMode = mode;
-    // on table: apply offsets
-    getSettings(mode);
-    limitOffset(&offset_nv);
-    limitOffset(&offset_nh);
-    Serial.print("mode = "); Serial.println(mode);
-    Serial.print("offset_nv = "); Serial.print(offset_nv, DEC); Serial.println(" mm front axle level custom offset");
-    Serial.print("offset_nh = "); Serial.print(offset_nh, DEC); Serial.println(" mm rear axle level custom offset");
-    blink(LED_BUILTIN, 100);
-  }
 
-  // check display is in phone mode
-  if (KOMBI_A5.KI_STAT) {
-    ic_stat = KOMBI_A5.KI_STAT;
-  }
-  if (ic_stat == 5) {
-    // get keyevents
-    // FRONT + HIGHER
-    button7 = KOMBI_A5.BUTTON_1_1;
-    button3 = KOMBI_A5.BUTTON_3_1;
-    keyComboFrontUp.read();
-    if (keyComboFrontUp.pressed() || keyComboFrontUp.repeated()) {
+// key combinations from KOMBI_A5 steering wheel buttons, evaluated on every frame
+void keyAction(uint8_t combo, uint8_t action, uint32_t time) {
+  switch (combo) {
+    case KEY_FRONT_UP:
       offset_nv += 5; // increase
       limitOffset(&offset_nv);
       Serial.print("offset_nv = "); Serial.print(offset_nv, DEC); Serial.println(" mm front axle level custom offset");
-      blink(LED_BUILTIN, 100);
-    }
-    // FRONT + LOWER
-    button7 = KOMBI_A5.BUTTON_1_1;
-    button2 = KOMBI_A5.BUTTON_3_2;
-    keyComboFrontDn.read();
-    if (keyComboFrontDn.pressed() || keyComboFrontDn.repeated()) {
+      break;
+    case KEY_FRONT_DN:
       offset_nv -= 5; // decrease
       limitOffset(&offset_nv);
       Serial.print("offset_nv = "); Serial.print(offset_nv, DEC); Serial.println(" mm front axle level custom offset");
-      blink(LED_BUILTIN, 100);
-    }
-    // REAR + HIGHER
-    button6 = KOMBI_A5.BUTTON_1_2;
-    button3 = KOMBI_A5.BUTTON_3_1;
-    keyComboRearUp.read();
-    if (keyComboRearUp.pressed() || keyComboRearUp.repeated()) {
+      break;
+    case KEY_REAR_UP:
       offset_nh += 5; // increase
       limitOffset(&offset_nh);
       Serial.print("offset_nh = "); Serial.print(offset_nh, DEC); Serial.println(" mm rear axle level custom offset");
-      blink(LED_BUILTIN, 100);
-    }
-    // REAR + LOWER
-    button6 = KOMBI_A5.BUTTON_1_2;
-    button2 = KOMBI_A5.BUTTON_3_2;
-    keyComboRearDn.read();
-    if (keyComboRearDn.pressed() || keyComboRearDn.repeated()) {
+      break;
+    case KEY_REAR_DN:
       offset_nh -= 5; // decrease
       limitOffset(&offset_nh);
       Serial.print("offset_nh = "); Serial.print(offset_nh, DEC); Serial.println(" mm rear axle level custom offset");
-      blink(LED_BUILTIN, 100);
-    }
+      break;
     // on confirm: write offsets to table
-    // FRONT + SAVE
-    button7 = KOMBI_A5.BUTTON_1_1;
-    button1 = KOMBI_A5.BUTTON_4_1;
-    keyComboFrontSet.read();
-    if (keyComboFrontSet.repeated()) {
+    case KEY_FRONT_SET:
       Serial.print("offset_nv = "); Serial.print(offset_nv, DEC); Serial.println(" mm front axle -> SET");
-      updateSettings(mode, "offset_nv", offset_nv);
-      blink(LED_BUILTIN, 100);
-    }
-    // REAR + SAVE
-    button6 = KOMBI_A5.BUTTON_1_2;
-    button1 = KOMBI_A5.BUTTON_4_1;
-    keyComboRearSet.read();
-    if (keyComboRearSet.repeated()) {
+      updateSettings(mode, AXLE_NV, offset_nv);
+      break;
+    case KEY_REAR_SET:
       Serial.print("offset_nh = "); Serial.print(offset_nh, DEC); Serial.println(" mm rear axle -> SET");
-      updateSettings(mode, "offset_nh", offset_nh);
-      blink(LED_BUILTIN, 100);
-    }
-    // FRONT + CANCEL
-    button7 = KOMBI_A5.BUTTON_1_1;
-    button0 = KOMBI_A5.BUTTON_4_2;
-    keyComboFrontReset.read();
-    if (keyComboFrontReset.pressed()) {
+      updateSettings(mode, AXLE_NH, offset_nh);
+      break;
+    case KEY_FRONT_RESET:
       offset_nv = 0;
       Serial.print("offset_nv = "); Serial.print(offset_nv, DEC); Serial.println(" mm front axle -> SET");
-      updateSettings(mode, "offset_nv", offset_nv);
-      blink(LED_BUILTIN, 100);
-    }
-    // REAR + CANCEL
-    button6 = KOMBI_A5.BUTTON_1_2;
-    button0 = KOMBI_A5.BUTTON_4_2;
-    keyComboRearReset.read();
-    if (keyComboRearReset.pressed()) {
+      updateSettings(mode, AXLE_NV, offset_nv);
+      break;
+    case KEY_REAR_RESET:
       offset_nh = 0;
       Serial.print("offset_nh = "); Serial.print(offset_nh, DEC); Serial.println(" mm rear axle -> SET");
-      updateSettings(mode, "offset_nh", offset_nh);
-      blink(LED_BUILTIN, 100);
+      updateSettings(mode, AXLE_NH, offset_nh);
+      break;
+  }
+  blink(LED_BUILTIN, 100);
+}
+
+// KOMBI_A5 frame -> key combos, buttons only count while the display is in phone mode
+void keyEvents(const CanFrame& rx) {
+  static uint8_t ic_stat = 0;
+  if (rx.frame.can_dlc < w211::KOMBI_A5::DLC) return;
+  uint8_t stat = w211::KOMBI_A5::KI_STAT(rx.frame.data);
+  if (stat) ic_stat = stat;
+  bool phone = ic_stat == (uint8_t) w211::KOMBI_A5::KI_STAT_e::TEL;
+  keyCombos.update(phone ? kombiButtons(rx.frame.data) : 0, rx.time);
+}
+
+
+void loop() {
+
+  static Mode lastMode = mode;
+  static uint32_t lastDrops = 0;
+  static uint32_t lastLoop = 0;
+  CanFrame rx;
+
+  uint32_t now = (uint32_t) esp_timer_get_time();
+  if (lastLoop) metrics.loopPeriod.record(now - lastLoop);
+  lastLoop = now;
+
+  // Motor CAN-C frames received since last loop
+  bool chassis = false;
+  while (canQueue0.pop(rx)) {
+    replayConsumed(rx.time);
+    chassis = true;
+    if (rx.frame.can_id == CANID_FS_340h) {
+      levelHistoryFrame(rx); // every level sample, the snapshot only keeps the newest
+    }
+  }
+
+  // main loop
+  if (chassis) {
+    mode = detectMode(mode, EZS_240h.read(), FS_340h.read());
+  }
+
+  // read offsets from table
+  if (mode != lastMode) {
+    lastMode = mode;
+    // on table: apply offsets
+    getSettings(mode);
+    limitOffset(&offset_nv);
+    limitOffset(&offset_nh);
+    replayModeApplied();
+    traceTrigger(TRACE_ON_MODE, "mode");
+    Serial.print("mode = "); Serial.println(modeNames[mode]);
+    Serial.print("offset_nv = "); Serial.print(offset_nv, DEC); Serial.println(" mm front axle level custom offset");
+    Serial.print("offset_nh = "); Serial.print(offset_nh, DEC); Serial.println(" mm rear axle level custom offset");
+    blink(LED_BUILTIN, 100);
+  }
+
+  // Interior CAN-B frames: every KOMBI_A5 frame is a key sample timed at reception, none is skipped
+  while (canQueue1.pop(rx)) {
+    replayConsumed(rx.time);
+    if (rx.frame.can_id == CANID_KOMBI_A5) {
+      keyEvents(rx);
+    }
+  }
+  keyCombos.poll((uint32_t) esp_timer_get_time()); // repeat and long press between frames
+
+  // per message deadlines: stale mode or level data -> neutral offsets, ramped by the output task
+  uint32_t stale = canFreshness.check(now);
+  bool neutral = (stale & canCritical) != 0;
+  if (neutral != outputNeutral) {
+    outputNeutral = neutral;
+    if (neutral) levelStale();
+    if (!canDown) {
+      Serial.print("Can: ");
+      for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+        if (canCritical & (1UL << i)) Serial.printf("%s %s ", canMessages[i].name, stale & (1UL << i) ? "stale" : "ok");
+      }
+      Serial.println(neutral ? "-> outputs neutral" : "-> offsets applied");
     }
   }
 
-  // DAC offset voltage output
-  ledcWrite(PWM1, duty + calib_vl + offset_nv * factor); // NVLS1
-  ledcWrite(PWM2, duty + calib_vr - offset_nv * factor); // NVRS1 / inverted, requires negative offset
-  ledcWrite(PWM3, duty + calib_hr + offset_nh * factor); // NHRS1
-//  ledcWrite(PWM4, duty + calib_hl + offset_nh * factor); // NHLS1 / not available for 211/219
+  // CAN receive path statistics
+  static unsigned long statsMs = millis();
+  if (millis() - statsMs > 10000) {
+    unsigned long span = millis() - statsMs;
+    statsMs = millis();
+    reportCanStats("Can0", canStats0, span);
+    reportCanStats("Can1", canStats1, span);
+    reportOutputStats(span);
+    reportCanTiming();
+  }
+
+  // report lost CAN frames
+  uint32_t drops = canQueue0.dropped() + canQueue1.dropped();
+  if (drops != lastDrops) {
+    lastDrops = drops;
+    Serial.printf("Can: queue overrun, dropped %u (CAN-C) %u (CAN-B) frames, FS_340h overwritten %u\r\n",
+      canQueue0.dropped(), canQueue1.dropped(), FS_340h.overwritten());
+  }
+
+  // "metrics" on the serial console dumps /metrics
+  metricsSerial();
+
+  // level feedback: closed loop gain trim, auto-calibration
+  levelUpdate(chassis && !outputNeutral);
+
+  // DAC offset voltage, written by the output task
+  updatePwmDuty();
+  replayOutput();
 
   // put TJA1055 into go-to-sleep / TJA1055 does the rest and will switch off TLE4271 automatically
   go_to_sleep(10000); // 10 sec
 
-  // Watchdog output pulse
-  if ( millis() - timeMs > 500 ) {
-    timeMs = millis();
-// from startWatchdog()
-//    digitalWrite(WO, !digitalRead(WO));
-  }
+  // bus quiet and WiFi off: light sleep until a MCP2515 interrupt
+  if (canDown) powerIdle();
+
+  // coalesced config write
+  configStore.flush();
 
-  // reset ESP32 once a week
-  if (timeMs > 600000000) {
+  // reset ESP32 once a week, the watchdog output runs on LEDC, see startWatchdog()
+  if (millis() > 600000000) {
     ESP.restart();
   }
   delay(10);
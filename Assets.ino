@@ -0,0 +1,84 @@
+/*
+ * Precompressed static assets
+ *
+ * tools/build_assets.py gzips the compressible files in data/ and writes
+ * the manifest /assets.json:
+ *
+ *   {"/two.min.js": {"file": "/two.min.js.gz", "mime": "application/javascript",
+ *                    "size": 52311, "hash": "9f2c61d0a4be7e13", "gzip": true}, ...}
+ *
+ * The manifest is loaded into a hash table at boot. Listed assets are served
+ * without LittleFS.exists() probing, with Content-Encoding: gzip, a strong
+ * ETag from the content hash and immutable caching (html: revalidate).
+ * Without manifest the former file server path is used.
+ */
+
+#include <unordered_map>
+#include <string>
+
+const char* assetManifest = "/assets.json";
+
+struct Asset {
+  String file;   // LittleFS path of the stored (compressed) file
+  String mime;
+  String etag;   // quoted content hash
+  uint32_t size; // stored size
+  bool html;     // revalidate instead of immutable
+};
+
+std::unordered_map<std::string, Asset> assets;
+
+
+// load the asset manifest into the route table
+void assetsSetup() {
+  assets.clear();
+  File f = LittleFS.open(assetManifest, "r");
+  if (!f) {
+    Serial.print("LittleFS: cannot access '");
+    Serial.print(assetManifest);
+    Serial.println("': No such file or directory");
+    return;
+  }
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  if (err) {
+    Serial.print("Cannot deserialize the current JSON object: ");
+    Serial.println(err.c_str());
+    return;
+  }
+  uint32_t total = 0;
+  for (JsonPairConst kv : doc.as<JsonObjectConst>()) {
+    JsonObjectConst entry = kv.value();
+    Asset asset;
+    asset.file = entry["file"].as<String>();
+    asset.mime = entry["mime"].as<String>();
+    asset.etag = "\"" + entry["hash"].as<String>() + "\"";
+    asset.size = entry["size"] | 0;
+    asset.html = asset.mime == "text/html";
+    total += asset.size;
+    assets[kv.key().c_str()] = asset;
+  }
+  Serial.printf("Assets: %u files, %u bytes from %s\r\n", assets.size(), total, assetManifest);
+}
+
+// serve path from the manifest, false if not listed
+bool sendAsset(AsyncWebServerRequest *request, const char* path) {
+  auto it = assets.find(path);
+  if (it == assets.end()) return false;
+  const Asset& asset = it->second;
+
+  AsyncWebServerResponse *response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag) {
+    response = request->beginResponse(304);
+  } else {
+    File file = LittleFS.open(asset.file, "r");
+    if (!file) return false;
+    // a *.gz file sent under its original path gets Content-Encoding: gzip
+    response = request->beginResponse(file, path, asset.mime);
+  }
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", asset.html ? "no-cache" : "public, max-age=31536000, immutable");
+  request->send(response);
+  return true;
+}
@@ -1,47 +1,68 @@
+// export CAN_message into payload snapshot and hand it to loop()
+void receiveFrame(CanBus bus, const CanFrame& rx, FrameQueue<CanFrame, CAN_QUEUE_LEN>& queue) {
+  // replay owns the decoders and queues while active
+  if (replayActive) return;
+  exportMsg(bus, rx.frame.can_id, rx.frame.data, rx.frame.can_dlc, rx.time);
+  queue.push(rx);
+  traceFrame(bus, rx);
+}
+
+// read MCP2515 receive buffers until RX0IF and RX1IF are both clear
+void drainCan(CanDriver& can, CanBus bus, gpio_num_t intPin, FrameQueue<CanFrame, CAN_QUEUE_LEN>& queue, CanRxStats& stats) {
+  CanFrame rx;
+  CanPoll poll;
+  uint32_t irqTime = stats.irqTime;
+  uint8_t spurious = 0;
+  bool waking = canWake[bus];
+  bool first = true;
+  canWake[bus] = false;
+  do {
+    // error flags only when INT is low without a pending frame, saves the CANINTF read per frame
+    // after light sleep also on the last step: overflows while asleep are frames lost at wake
+    can.poll(poll, spurious > 0 || waking);
+    stats.spiBytes += poll.bytes;
+    metrics.spiBytes[bus].add(poll.bytes);
+    for (uint8_t i = 0; i < poll.count; i++) {
+      rx.frame = poll.frame[i];
+      rx.time = (uint32_t) esp_timer_get_time();
+      receiveFrame(bus, rx, queue);
+      stats.frames++;
+      uint32_t latency = (uint32_t) esp_timer_get_time() - irqTime;
+      stats.latencySum += latency;
+      if (latency > stats.latencyMax) stats.latencyMax = latency;
+      metrics.canLatency[bus].record(latency);
+      if (waking && first) metrics.wakeLatency.record(rx.time - canWakeTime);
+      first = false;
+    }
+    if (waking && (poll.eflg & (MCP2515::EFLG_RX0OVR | MCP2515::EFLG_RX1OVR))) metrics.wakeOverflow[bus].inc();
+    if (poll.intf & MCP2515::CANINTF_ERRIF) metrics.errorIrq[bus].inc();
+    if (poll.intf & MCP2515::CANINTF_MERRF) metrics.messageError[bus].inc();
+    if (poll.eflg & (MCP2515::EFLG_RX0OVR | MCP2515::EFLG_RX1OVR)) metrics.rxOverflow[bus].inc();
+    if (poll.eflg & (MCP2515::EFLG_RXEP | MCP2515::EFLG_TXEP)) metrics.errorPassive[bus].inc();
+    if (poll.eflg & MCP2515::EFLG_TXBO) metrics.busOff[bus].inc();
+    irqTime = stats.irqTime;
+    // INT still low: a frame arrived while draining and no new falling edge will follow
+  } while (poll.count || (digitalRead(intPin) == LOW && ++spurious < 4));
+}
+
 void canEvent0(void *pvParameters) {
   while (true) {
-    if (canInterruptFlag0) {
-      canInterruptFlag0 = false;
-      uint8_t irq = Can0.getInterrupts();
-      if (irq & MCP2515::CANINTF_RX0IF) {
-        if (Can0.readMessage(MCP2515::RXB0, &canMsg0) == MCP2515::ERROR_OK) {
-          // export CAN_message into bit field decoder
-          exportMsg(canMsg0.can_id, canMsg0.data, canMsg0.can_dlc);
-        }
-      }
-      if (irq & MCP2515::CANINTF_RX1IF) {
-        if (Can0.readMessage(MCP2515::RXB1, &canMsg0) == MCP2515::ERROR_OK) {
-          // export CAN_message into bit field decoder
-          exportMsg(canMsg0.can_id, canMsg0.data, canMsg0.can_dlc);
-        }
-      }
-      Can0.clearInterrupts();
+    // block until onCanInterrupt0() notifies, poll INT as fallback for a missed edge
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) || digitalRead(INT0) == LOW) {
+      canStats0.wakeups++;
+      drainCan(CanRx0, CAN_C, INT0, canQueue0, canStats0);
       awake(100); // prevent idle timeout
     }
-    delay_us(1000);
   }
 }
 
 void canEvent1(void *pvParameters) {
   while (true) {
-    if (canInterruptFlag1) {
-      canInterruptFlag1 = false;
-      uint8_t irq = Can1.getInterrupts();
-      if (irq & MCP2515::CANINTF_RX0IF) {
-        if (Can1.readMessage(MCP2515::RXB0, &canMsg1) == MCP2515::ERROR_OK) {
-          // export CAN_message into bit field decoder
-          exportMsg(canMsg1.can_id, canMsg1.data, canMsg1.can_dlc);
-        }
-      }
-      if (irq & MCP2515::CANINTF_RX1IF) {
-        if (Can1.readMessage(MCP2515::RXB1, &canMsg1) == MCP2515::ERROR_OK) {
-          // export CAN_message into bit field decoder
-          exportMsg(canMsg1.can_id, canMsg1.data, canMsg1.can_dlc);
-        }
-      }
-      Can1.clearInterrupts();
+    // block until onCanInterrupt1() notifies, poll INT as fallback for a missed edge
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) || digitalRead(INT1) == LOW) {
+      canStats1.wakeups++;
+      drainCan(CanRx1, CAN_B, INT1, canQueue1, canStats1);
       awake(100); // prevent idle timeout
     }
-    delay_us(1000);
   }
-}
\ No newline at end of file
+}
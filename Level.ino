@@ -0,0 +1,447 @@
+/*
+ * Level feedback
+ *
+ * FS_340h reports the vehicle level FZGN_* as the AIRmatic control unit sees
+ * it, i.e. including the offset voltage added by this module. An offset of
+ * +n mm lowers the reported level by n mm until the control unit re-levels,
+ * which takes seconds. Both functions below only evaluate that short window.
+ *
+ * Closed loop: after every offset step of at least levelMinStep mm the level
+ * change between levelSettleMs and levelWindowMs is compared with the
+ * commanded step, the gain of each output is trimmed by a rate limited
+ * integrator (at most levelTrimStep per step).
+ *
+ * Auto-calibration (vehicle standing on level ground): offsets are held at 0,
+ * the duty of each driven output is swept around its zero point, a line is
+ * fitted through the mean levels. The slope gives the gain, calib_* is moved
+ * so that VL/VR read their mean and HR reads HL (NHLS1 has no output).
+ *
+ * POST /config?update=8|7 (CMD_LEVEL_CLOSED / OPEN) switches the closed loop,
+ * update=9 (CMD_LEVEL_CALIBRATE) starts the calibration, GET /level returns
+ * the status.
+ *
+ * History (level_history.h): every FS_340h frame is added with its reception
+ * time and the mode. GET /level/history?window=600&points=100 returns per
+ * wheel [ms before now, mean, min, max] of the finest ring covering the
+ * window, reduced to points, and the mode changes in it. GET /level/stats
+ * returns min / max / mean / stddev per mode and since the last mode change.
+ */
+
+#include "level_history.h"
+
+const uint32_t levelSettleMs = 500;   // ignore the first samples after a step
+const uint32_t levelWindowMs = 1500;  // end of the step measurement
+const int8_t levelMinStep = 3;        // mm, smaller steps are not evaluated
+const int16_t levelTrimStep = 8;      // max gain change per step, 1/256
+const int16_t levelGainMin = GAIN_ONE / 2;
+const int16_t levelGainMax = GAIN_ONE * 2;
+const int8_t levelSweep[] = { -8, -4, 0, 4, 8 }; // duty counts around zero
+const uint8_t levelSweepPoints = sizeof(levelSweep) / sizeof(levelSweep[0]);
+const int8_t levelCalibMax = 40;      // max |calib_*| from the fit
+
+// driven outputs, PWM4 (NHLS1) is not available for 211/219
+const CalibChannel levelChannels[] = { CALIB_VL, CALIB_VR, CALIB_HR };
+const uint8_t levelChannelCount = sizeof(levelChannels) / sizeof(levelChannels[0]);
+
+enum LevelCalState : uint8_t {
+  LEVEL_CAL_IDLE,
+  LEVEL_CAL_REFERENCE, // mean levels at the current calibration
+  LEVEL_CAL_SWEEP,     // duty steps on one output
+  LEVEL_CAL_DONE,
+  LEVEL_CAL_FAILED
+};
+
+volatile bool levelClosedLoop = false;
+volatile bool levelCalRequest = false;
+volatile LevelCalState levelCalState = LEVEL_CAL_IDLE;
+const char* levelCalResult = "";
+
+// closed loop step measurement
+bool levelStepActive = false;
+unsigned long levelStepTime = 0;
+int8_t levelLastOffset[AXLE_COUNT] = {0};
+int8_t levelStepDelta[AXLE_COUNT] = {0};
+int32_t levelBase[CALIB_COUNT] = {0};   // level before the step, 1/16 mm
+int32_t levelSum[CALIB_COUNT] = {0};
+uint32_t levelSamples = 0;
+int16_t levelRatio[CALIB_COUNT] = {0};  // last measured / commanded, 1/256
+bool levelBaseValid = false;
+
+// calibration
+Mode levelCalMode = MODE_DEFAULT;
+uint8_t levelCalChannel = 0;
+uint8_t levelCalPoint = 0;
+unsigned long levelCalTime = 0;
+int8_t levelCalSaved[CALIB_COUNT] = {0};
+int8_t levelCalOffset[AXLE_COUNT] = {0};
+float levelCalRef[CALIB_COUNT] = {0};
+float levelCalMean[levelSweepPoints] = {0};
+float levelCalSlope[CALIB_COUNT] = {0}; // mm per duty count
+
+// history, written by loop(), read by the web server
+static_assert(MODE_COUNT <= LEVEL_MODES, "level history holds every mode");
+const char* const levelWheelNames[LEVEL_WHEELS] = { "fzgn_vl", "fzgn_vr", "fzgn_hl", "fzgn_hr" };
+const char* const levelTierNames[LEVEL_TIER_COUNT] = { "raw", "1s", "1min" };
+const size_t levelModeChangesMax = 16;
+LevelHistory levelHistory;
+SemaphoreHandle_t levelHistoryLock = NULL;
+LevelPoint levelChart[LEVEL_WHEELS][LEVEL_POINTS_MAX]; // query result, web server only
+
+
+uint8_t levelOf(const FS_340h_t& fs, uint8_t ch) {
+  switch (ch) {
+    case CALIB_VL: return w211::FS_340h::FZGN_VL(fs.data);
+    case CALIB_VR: return w211::FS_340h::FZGN_VR(fs.data);
+    case CALIB_HL: return w211::FS_340h::FZGN_HL(fs.data);
+    default:       return w211::FS_340h::FZGN_HR(fs.data);
+  }
+}
+
+int8_t* calibOf(uint8_t ch) {
+  switch (ch) {
+    case CALIB_VL: return &calib_vl;
+    case CALIB_VR: return &calib_vr;
+    case CALIB_HL: return &calib_hl;
+    default:       return &calib_hr;
+  }
+}
+
+Axle axleOf(uint8_t ch) {
+  return ch == CALIB_VL || ch == CALIB_VR ? AXLE_NV : AXLE_NH;
+}
+
+// sign of the offset term in updatePwmDuty()
+int8_t signOf(uint8_t ch) {
+  return ch == CALIB_VR ? -1 : 1;
+}
+
+void levelSetGain(uint8_t ch, int16_t gain) {
+  gain = gain < levelGainMin ? levelGainMin : gain > levelGainMax ? levelGainMax : gain;
+  if (pwmGain[ch] == gain) return;
+  pwmGain[ch] = gain;
+  pwmGainVersion++;
+}
+
+// closed loop: evaluate the level change after an offset step
+void levelTrack(const FS_340h_t& fs, unsigned long now) {
+  int8_t offset[AXLE_COUNT] = { offset_nv, offset_nh };
+
+  // new step: remember the level before it
+  if (offset[AXLE_NV] != levelLastOffset[AXLE_NV] || offset[AXLE_NH] != levelLastOffset[AXLE_NH]) {
+    for (uint8_t a = 0; a < AXLE_COUNT; a++) {
+      levelStepDelta[a] = offset[a] - levelLastOffset[a];
+      levelLastOffset[a] = offset[a];
+    }
+    levelStepActive = levelBaseValid;
+    levelStepTime = now;
+    levelSamples = 0;
+    memset(levelSum, 0x00, sizeof(levelSum));
+    return;
+  }
+
+  if (!levelStepActive) {
+    // level between steps, exponential mean in 1/16 mm
+    for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+      int32_t level = (int32_t) levelOf(fs, c) << 4;
+      levelBase[c] = levelBaseValid ? levelBase[c] + (level - levelBase[c]) / 8 : level;
+    }
+    levelBaseValid = true;
+    return;
+  }
+
+  if (now - levelStepTime < levelSettleMs) return;
+  if (now - levelStepTime < levelWindowMs) {
+    for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+      levelSum[c] += levelOf(fs, c);
+    }
+    levelSamples++;
+    return;
+  }
+
+  // end of window: measured shift vs commanded step
+  levelStepActive = false;
+  if (!levelSamples) return;
+  for (uint8_t i = 0; i < levelChannelCount; i++) {
+    uint8_t c = levelChannels[i];
+    int8_t step = levelStepDelta[axleOf(c)];
+    if (step > -levelMinStep && step < levelMinStep) continue;
+    int32_t after = (levelSum[c] << 4) / (int32_t) levelSamples;
+    int32_t shift = -(after - levelBase[c]); // 1/16 mm, positive offset lowers the level
+    levelRatio[c] = shift * GAIN_ONE / 16 / step;
+    if (!levelClosedLoop) continue;
+    // integrator on the relative error, half a step at most levelTrimStep
+    int32_t trim = (int32_t) pwmGain[c] * (GAIN_ONE - levelRatio[c]) / GAIN_ONE / 2;
+    trim = trim < -levelTrimStep ? -levelTrimStep : trim > levelTrimStep ? levelTrimStep : trim;
+    levelSetGain(c, pwmGain[c] + trim);
+  }
+  // restart the base from the current level
+  levelBaseValid = false;
+}
+
+void levelCalStart(unsigned long now) {
+  levelCalMode = mode;
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    levelCalSaved[c] = *calibOf(c);
+    levelCalRef[c] = 0;
+  }
+  levelCalOffset[AXLE_NV] = offset_nv;
+  levelCalOffset[AXLE_NH] = offset_nh;
+  offset_nv = 0;
+  offset_nh = 0;
+  levelCalChannel = 0;
+  levelCalPoint = 0;
+  levelCalTime = now;
+  levelSamples = 0;
+  memset(levelSum, 0x00, sizeof(levelSum));
+  levelCalState = LEVEL_CAL_REFERENCE;
+  Serial.println("Level: calibration started, keep the vehicle standing");
+}
+
+void levelCalFinish(uint8_t state, const char* result) {
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    *calibOf(c) = levelCalSaved[c];
+  }
+  offset_nv = levelCalOffset[AXLE_NV];
+  offset_nh = levelCalOffset[AXLE_NH];
+  levelCalResult = result;
+  levelCalState = (LevelCalState) state;
+  Serial.print("Level: calibration "); Serial.println(result);
+}
+
+// least squares slope through the sweep means
+float levelFitSlope() {
+  float mx = 0, my = 0;
+  for (uint8_t i = 0; i < levelSweepPoints; i++) {
+    mx += levelSweep[i];
+    my += levelCalMean[i];
+  }
+  mx /= levelSweepPoints;
+  my /= levelSweepPoints;
+  float sxy = 0, sxx = 0;
+  for (uint8_t i = 0; i < levelSweepPoints; i++) {
+    sxy += (levelSweep[i] - mx) * (levelCalMean[i] - my);
+    sxx += (levelSweep[i] - mx) * (levelSweep[i] - mx);
+  }
+  return sxy / sxx;
+}
+
+// apply fitted gains and calibration, persisted by the config store
+void levelCalApply() {
+  const float counts = duty * 2.0f / 100.0f; // nominal duty counts per mm
+  float target[CALIB_COUNT];
+  target[CALIB_VL] = (levelCalRef[CALIB_VL] + levelCalRef[CALIB_VR]) / 2;
+  target[CALIB_VR] = target[CALIB_VL];
+  target[CALIB_HR] = levelCalRef[CALIB_HL];
+
+  int16_t gain[CALIB_COUNT];
+  int8_t calib[CALIB_COUNT];
+  for (uint8_t i = 0; i < levelChannelCount; i++) {
+    uint8_t c = levelChannels[i];
+    float slope = levelCalSlope[c];
+    if (slope > -0.05f && slope < 0.05f) {
+      levelCalFinish(LEVEL_CAL_FAILED, "failed: no level response");
+      return;
+    }
+    // +1 mm offset should lower the level by 1 mm
+    gain[c] = (int16_t) lroundf(-signOf(c) * GAIN_ONE / (slope * counts));
+    int32_t cal = levelCalSaved[c] + lroundf((target[c] - levelCalRef[c]) / slope);
+    if (gain[c] < levelGainMin || gain[c] > levelGainMax || cal < -levelCalibMax || cal > levelCalibMax) {
+      levelCalFinish(LEVEL_CAL_FAILED, "failed: fit out of range");
+      return;
+    }
+    calib[c] = cal;
+  }
+
+  levelCalFinish(LEVEL_CAL_DONE, "done");
+  for (uint8_t i = 0; i < levelChannelCount; i++) {
+    uint8_t c = levelChannels[i];
+    *calibOf(c) = calib[c];
+    updateCalibration((CalibChannel) c, calib[c]);
+    configStore.setGain((CalibChannel) c, gain[c]);
+    levelSetGain(c, gain[c]);
+    Serial.printf("Level: %s = %d, %s = %d (%.3f mm/count)\r\n", calibNames[c], calib[c], gainNames[c], gain[c], levelCalSlope[c]);
+  }
+}
+
+// calibration state machine, one sample per FS_340h
+void levelCalibrate(const FS_340h_t& fs, bool kl15, unsigned long now) {
+  if (mode != levelCalMode || !kl15) {
+    levelCalFinish(LEVEL_CAL_FAILED, "aborted: mode changed");
+    return;
+  }
+  if (now - levelCalTime < levelSettleMs) return;
+  if (now - levelCalTime < levelWindowMs) {
+    for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+      levelSum[c] += levelOf(fs, c);
+    }
+    levelSamples++;
+    return;
+  }
+  if (!levelSamples) {
+    levelCalFinish(LEVEL_CAL_FAILED, "failed: no FS_340h");
+    return;
+  }
+
+  uint8_t c = levelChannels[levelCalChannel];
+  if (levelCalState == LEVEL_CAL_REFERENCE) {
+    for (uint8_t i = 0; i < CALIB_COUNT; i++) {
+      levelCalRef[i] = (float) levelSum[i] / levelSamples;
+    }
+    levelCalState = LEVEL_CAL_SWEEP;
+  } else {
+    levelCalMean[levelCalPoint++] = (float) levelSum[c] / levelSamples;
+    if (levelCalPoint == levelSweepPoints) {
+      levelCalSlope[c] = levelFitSlope();
+      *calibOf(c) = levelCalSaved[c];
+      levelCalPoint = 0;
+      if (++levelCalChannel == levelChannelCount) {
+        levelCalApply();
+        return;
+      }
+      c = levelChannels[levelCalChannel];
+    }
+  }
+
+  // next sweep point
+  *calibOf(c) = levelCalSaved[c] + levelSweep[levelCalPoint];
+  levelCalTime = now;
+  levelSamples = 0;
+  memset(levelSum, 0x00, sizeof(levelSum));
+}
+
+// loop(): outputs went neutral on stale CAN data, a running step is no longer measurable
+void levelStale() {
+  levelStepActive = false;
+  levelBaseValid = false;
+}
+
+// loop(): after mode detection, before updatePwmDuty()
+void levelUpdate(bool chassis) {
+  unsigned long now = millis();
+  if (levelCalRequest) {
+    levelCalRequest = false;
+    if (levelCalState != LEVEL_CAL_REFERENCE && levelCalState != LEVEL_CAL_SWEEP) {
+      levelCalStart(now);
+      levelStepActive = false;
+      levelBaseValid = false;
+    }
+  }
+  if (!chassis) return;
+  FS_340h_t fs = FS_340h.read();
+  if (levelCalState == LEVEL_CAL_REFERENCE || levelCalState == LEVEL_CAL_SWEEP) {
+    levelCalibrate(fs, w211::EZS_240h::KL_15(EZS_240h.read().data), now);
+    levelLastOffset[AXLE_NV] = offset_nv;
+    levelLastOffset[AXLE_NH] = offset_nh;
+    return;
+  }
+  levelTrack(fs, now);
+}
+
+// loop(): every FS_340h frame, in reception order
+void levelHistoryFrame(const CanFrame& rx) {
+  if (rx.frame.can_dlc < 6 || !levelHistoryLock) return;
+  const uint8_t* d = rx.frame.data;
+  uint8_t level[LEVEL_WHEELS] = { w211::FS_340h::FZGN_VL(d), w211::FS_340h::FZGN_VR(d),
+    w211::FS_340h::FZGN_HL(d), w211::FS_340h::FZGN_HR(d) };
+  // reception time on the millis() clock
+  uint32_t time = millis() - ((uint32_t) esp_timer_get_time() - rx.time) / 1000;
+  xSemaphoreTake(levelHistoryLock, portMAX_DELAY);
+  levelHistory.add(time, level, mode);
+  xSemaphoreGive(levelHistoryLock);
+}
+
+// "key":{"n":..,"min":..,"max":..,"mean":..,"sd":..}
+void levelWriteStats(Print& out, const char* key, const LevelStats& st) {
+  out.printf("\"%s\":{\"n\":%u,\"min\":%u,\"max\":%u,\"mean\":%.2f,\"sd\":%.2f}",
+    key, st.count, st.min, st.max, st.mean(), st.stddev());
+}
+
+void levelSetup() {
+  levelHistoryLock = xSemaphoreCreateMutex();
+
+  // chart data, before /level which also matches /level/*
+  server.on("/level/history", HTTP_GET, [](AsyncWebServerRequest *request) {
+    uint32_t window = (request->hasParam("window") ? request->getParam("window")->value().toInt() : 60) * 1000;
+    size_t points = request->hasParam("points") ? request->getParam("points")->value().toInt() : 100;
+    points = points < 3 ? 3 : points > LEVEL_POINTS_MAX ? LEVEL_POINTS_MAX : points;
+    size_t count[LEVEL_WHEELS];
+    uint32_t modeTime[levelModeChangesMax];
+    uint8_t modeIndex[levelModeChangesMax];
+
+    // copy out under the lock, format without it
+    uint32_t now = millis();
+    xSemaphoreTake(levelHistoryLock, portMAX_DELAY);
+    uint8_t tier = levelHistory.tierFor(now, window);
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+      count[w] = levelHistory.query(tier, w, now - window, levelChart[w], points);
+    }
+    size_t changes = levelHistory.modeChanges(tier, now - window, modeTime, modeIndex, levelModeChangesMax);
+    xSemaphoreGive(levelHistoryLock);
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->printf("{\"tier\":\"%s\",\"window\":%u,\"modes\":[", levelTierNames[tier], window / 1000);
+    for (size_t i = 0; i < changes; i++) {
+      response->printf("%s[%d,\"%s\"]", i ? "," : "", (int32_t)(modeTime[i] - now), modeNames[modeIndex[i]]);
+    }
+    response->print("]");
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+      response->printf(",\"%s\":[", levelWheelNames[w]);
+      for (size_t i = 0; i < count[w]; i++) {
+        const LevelPoint& p = levelChart[w][i];
+        response->printf("%s[%d,%u.%02u,%u,%u]", i ? "," : "", (int32_t)(p.time - now),
+          p.mean >> 8, ((p.mean & 0xFF) * 100) >> 8, p.min, p.max);
+      }
+      response->print("]");
+    }
+    response->print("}");
+    request->send(response);
+  });
+
+  server.on("/level/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    LevelStats stats[MODE_COUNT][LEVEL_WHEELS];
+    LevelStats since[LEVEL_WHEELS];
+    uint32_t now = millis();
+    xSemaphoreTake(levelHistoryLock, portMAX_DELAY);
+    for (uint8_t m = 0; m < MODE_COUNT; m++) {
+      for (uint8_t w = 0; w < LEVEL_WHEELS; w++) stats[m][w] = levelHistory.stats(m, w);
+    }
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) since[w] = levelHistory.sinceSwitch(w);
+    uint8_t current = levelHistory.currentMode();
+    uint32_t switched = levelHistory.switchedAt();
+    xSemaphoreGive(levelHistoryLock);
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->printf("{\"mode\":\"%s\",\"since\":%u,\"current\":{", modeNames[current], now - switched);
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+      if (w) response->print(",");
+      levelWriteStats(*response, levelWheelNames[w], since[w]);
+    }
+    response->print("}");
+    for (uint8_t m = 0; m < MODE_COUNT; m++) {
+      if (!stats[m][0].count) continue;
+      response->printf(",\"%s\":{", modeNames[m]);
+      for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+        if (w) response->print(",");
+        levelWriteStats(*response, levelWheelNames[w], stats[m][w]);
+      }
+      response->print("}");
+    }
+    response->print("}");
+    request->send(response);
+  });
+
+  server.on("/level", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const char* states[] = { "idle", "reference", "sweep", "done", "failed" };
+    char buf[320];
+    snprintf(buf, sizeof(buf),
+      "closed loop %s, calibration %s %s\n"
+      "gain vl %d vr %d hr %d (1/256), last step ratio vl %d vr %d hr %d (1/256)\n"
+      "calib vl %d vr %d hr %d, slope vl %.3f vr %.3f hr %.3f mm/count\n",
+      levelClosedLoop ? "on" : "off", states[levelCalState], levelCalResult,
+      pwmGain[CALIB_VL], pwmGain[CALIB_VR], pwmGain[CALIB_HR],
+      levelRatio[CALIB_VL], levelRatio[CALIB_VR], levelRatio[CALIB_HR],
+      calib_vl, calib_vr, calib_hr,
+      levelCalSlope[CALIB_VL], levelCalSlope[CALIB_VR], levelCalSlope[CALIB_HR]);
+    request->send(200, "text/plain", buf);
+  });
+}
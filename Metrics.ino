@@ -0,0 +1,51 @@
+/*
+ * Runtime metrics export
+ *
+ * GET /metrics returns the counters and histograms of metrics.h and the
+ * message deadlines and bus load of can_freshness.h in the Prometheus text
+ * format:
+ *
+ *   airmatic_can_frames_total{bus="can_c",id="0x340",name="FS_340h"} 5012
+ *   airmatic_can_latency_us_bucket{bus="can_c",le="127"} 4981
+ *   airmatic_can_stale{bus="can_c",id="0x340",name="FS_340h"} 0
+ *   airmatic_task_stack_free_bytes{task="can0"} 2236
+ *
+ * Typing "metrics" on the serial console prints the same text.
+ */
+
+const char* metricsCommand = "metrics";
+
+
+// serial console: dump on "metrics" + newline
+void metricsSerial() {
+  static uint8_t matched = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (matched == strlen(metricsCommand)) {
+        metrics.write(Serial);
+        canFreshness.write(Serial);
+      }
+      matched = 0;
+    } else if (matched < strlen(metricsCommand) && c == metricsCommand[matched]) {
+      matched++;
+    } else {
+      matched = 0xFF; // no match until the next line
+    }
+  }
+}
+
+void metricsSetup() {
+  metrics.watchTask("can0", &canTask0);
+  metrics.watchTask("can1", &canTask1);
+  metrics.watchTask("wifi", &wifiTask);
+  metrics.watchTask("blink", &blinkTask);
+  metrics.watchTask("trace", &traceTask);
+
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    metrics.write(*response);
+    canFreshness.write(*response);
+    request->send(response);
+  });
+}
@@ -0,0 +1,255 @@
+/*
+ * Compressed, resumable OTA upload
+ *
+ * tools/ota_upload.py sends a gzip or heatshrink compressed firmware or
+ * LittleFS image in chunks of up to 8 KB, each with its CRC-32:
+ *
+ *   POST /image/begin?target=app|fs&codec=gzip|hs|raw&size=N&image=N&md5=HEX[&window=W&lookahead=L]
+ *   POST /image/chunk?offset=N&crc=HEX   body = compressed bytes from offset
+ *   GET  /image                          session status
+ *
+ * size is the compressed, image the decompressed length, md5 of the image.
+ * A chunk is only applied when complete, at the expected offset and with a
+ * matching CRC. It is decompressed (ota_stream.h) straight into the partition
+ * by Update.write() before the reply, like the ElegantOTA upload handler.
+ * Every reply carries the next offset. After a dropped connection the client
+ * begins the same image again and continues at that offset, the session
+ * stays in RAM until it completes, fails, another image is begun or reboot.
+ * Update.end() checks the MD5 of the written image before the boot partition
+ * is switched. A LittleFS image unmounts LittleFS for the upload: config
+ * writes are held, trace, replay and the file server skip LittleFS while
+ * otaFsBusy(), and a session without a chunk for otaStallMs is aborted and
+ * LittleFS mounted again. /ota/* is taken by ElegantOTA.
+ */
+
+#include <Update.h>
+#include "ota_stream.h"
+
+const size_t otaChunkMax = 8192;
+const uint32_t otaStallMs = 60000; // no chunk for this long: the client is gone
+
+OtaStream otaStream;
+bool otaActive = false;
+bool otaDone = false;       // written, reboot pending
+bool otaFs = false;         // LittleFS partition, app otherwise
+OtaCodec otaCodec = OTA_RAW;
+uint32_t otaSize = 0;       // compressed
+uint32_t otaImage = 0;      // decompressed
+uint32_t otaOffset = 0;     // compressed bytes applied
+uint32_t otaStart = 0;      // millis()
+uint32_t otaLast = 0;       // millis() of the last begin or chunk
+SemaphoreHandle_t otaLock = NULL; // async_tcp handlers against the stall check of the WiFi task
+String otaMd5;
+const char* otaError = "";
+
+
+// LittleFS unmounted for an image being written, or written and the reboot pending
+bool otaFsBusy() {
+  return otaFs && (otaActive || otaDone);
+}
+
+size_t otaSink(uint8_t* data, size_t len) {
+  return Update.write(data, len);
+}
+
+// next offset and progress, also the body of error replies
+void otaReply(AsyncWebServerRequest *request, int status) {
+  uint32_t elapsed = millis() - otaStart;
+  char buf[160];
+  snprintf(buf, sizeof(buf), "{\"active\":%s,\"offset\":%u,\"size\":%u,\"written\":%u,\"image\":%u,\"rate\":%u,\"error\":\"%s\"}",
+    otaActive ? "true" : "false", otaOffset, otaSize, otaStream.output(), otaImage,
+    elapsed ? (unsigned int)((uint64_t) otaOffset * 1000 / elapsed) : 0, otaError);
+  request->send(status, "application/json", buf);
+}
+
+// stop the session, the boot partition stays unchanged
+void otaAbort(const char* reason) {
+  otaError = reason;
+  Serial.printf("OTA: %s, aborted at %u of %u bytes\r\n", reason, otaOffset, otaSize);
+  Update.abort();
+  otaStream.end();
+  otaActive = false;
+  if (otaFs) {
+    LittleFS.begin(true);
+    configStore.hold(false);
+  }
+  onOTAEnd(false);
+}
+
+void otaBegin(AsyncWebServerRequest *request) {
+  if (!request->hasParam("size") || !request->hasParam("image") || !request->hasParam("md5")) {
+    request->send(400, "text/plain", "size, image and md5 required");
+    return;
+  }
+  bool fs = request->hasParam("target") && request->getParam("target")->value() == "fs";
+  String codecName = request->hasParam("codec") ? request->getParam("codec")->value() : "raw";
+  OtaCodec codec = codecName == "gzip" ? OTA_GZIP : codecName == "hs" ? OTA_HEATSHRINK : OTA_RAW;
+  uint32_t size = request->getParam("size")->value().toInt();
+  uint32_t image = request->getParam("image")->value().toInt();
+  String md5 = request->getParam("md5")->value();
+  uint8_t window = request->hasParam("window") ? request->getParam("window")->value().toInt() : 0;
+  uint8_t lookahead = request->hasParam("lookahead") ? request->getParam("lookahead")->value().toInt() : 0;
+
+  // same image: resume, or the reply of the last chunk was lost
+  if ((otaActive || otaDone) && fs == otaFs && codec == otaCodec && size == otaSize && image == otaImage && md5 == otaMd5) {
+    Serial.printf("OTA: resumed at %u of %u bytes\r\n", otaOffset, otaSize);
+    otaLast = millis();
+    otaReply(request, 200);
+    return;
+  }
+  if (otaActive) otaAbort("replaced by a new upload");
+  if (otaDone) {
+    request->send(409, "text/plain", "rebooting");
+    return;
+  }
+  if (fs && traceBusy()) {
+    request->send(409, "text/plain", "trace recording");
+    return;
+  }
+  if (fs && replayActive) {
+    request->send(409, "text/plain", "replay running");
+    return;
+  }
+  if (md5.length() != 32 || !size || !image) {
+    request->send(400, "text/plain", "bad size or md5");
+    return;
+  }
+
+  if (fs) {
+    configStore.hold(true); // waits for a slot write in progress
+    LittleFS.end();
+  }
+  if (!Update.begin(image, fs ? U_SPIFFS : U_FLASH) || !Update.setMD5(md5.c_str())) {
+    request->send(500, "text/plain", Update.errorString());
+    Update.abort();
+    if (fs) {
+      LittleFS.begin(true);
+      configStore.hold(false);
+    }
+    return;
+  }
+  OtaResult result = otaStream.begin(codec, otaSink, window, lookahead);
+  if (result != OTA_OK) {
+    request->send(result == OTA_NO_MEMORY ? 507 : 400, "text/plain", result == OTA_NO_MEMORY ? "no memory" : "bad window or lookahead");
+    Update.abort();
+    otaStream.end();
+    if (fs) {
+      LittleFS.begin(true);
+      configStore.hold(false);
+    }
+    return;
+  }
+  otaActive = true;
+  otaFs = fs;
+  otaCodec = codec;
+  otaSize = size;
+  otaImage = image;
+  otaMd5 = md5;
+  otaOffset = 0;
+  otaStart = millis();
+  otaLast = otaStart;
+  otaError = "";
+  onOTAStart();
+  Serial.printf("OTA: %s image, %u bytes %s, %u bytes to flash\r\n", fs ? "LittleFS" : "firmware", size, codecName.c_str(), image);
+  otaReply(request, 200);
+}
+
+// complete chunk in request->_tempObject
+void otaChunk(AsyncWebServerRequest *request) {
+  if (!otaActive) {
+    otaReply(request, 409);
+    return;
+  }
+  size_t len = request->contentLength();
+  uint8_t* data = (uint8_t*) request->_tempObject;
+  if (len > otaChunkMax) {
+    request->send(413, "text/plain", "chunk too large");
+    return;
+  }
+  uint32_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+  uint32_t crc = request->hasParam("crc") ? strtoul(request->getParam("crc")->value().c_str(), nullptr, 16) : 0;
+  // wrong offset: the client continues at the one in the reply, bad CRC: sends again
+  if (offset != otaOffset) {
+    otaReply(request, 409);
+    return;
+  }
+  if (!data || !len || offset + len > otaSize || otaCrc32(0, data, len) != crc) {
+    otaReply(request, 400);
+    return;
+  }
+
+  OtaResult result = otaStream.write(data, len);
+  otaOffset += len;
+  otaLast = millis();
+  if (result == OTA_OK || result == OTA_DONE) {
+    if (otaOffset < otaSize) {
+      onOTAProgress(otaOffset, otaSize);
+      otaReply(request, 200);
+      return;
+    }
+    result = otaStream.finish();
+  }
+  if (result != OTA_DONE) {
+    otaAbort(result == OTA_SINK_ERROR ? Update.errorString() : "corrupt image");
+    otaReply(request, 500);
+    return;
+  }
+  if (otaStream.output() != otaImage) {
+    otaAbort("image size mismatch");
+    otaReply(request, 500);
+    return;
+  }
+  otaStream.end();
+  if (!Update.end()) {
+    otaAbort(Update.errorString()); // MD5 mismatch
+    otaReply(request, 500);
+    return;
+  }
+  uint32_t elapsed = millis() - otaStart;
+  Serial.printf("OTA: %u bytes received, %u bytes written in %u ms (%u bytes/s received, %u bytes/s to flash)\r\n",
+    otaSize, otaImage, elapsed, (unsigned int)((uint64_t) otaSize * 1000 / (elapsed ? elapsed : 1)),
+    (unsigned int)((uint64_t) otaImage * 1000 / (elapsed ? elapsed : 1)));
+  otaActive = false;
+  otaDone = true;
+  onOTAEnd(true);
+  otaReply(request, 200);
+  scheduleReboot(2000);
+}
+
+// WiFi task: abort a session without a chunk for otaStallMs, or any session when the server stops
+void otaPoll(bool stopping) {
+  xSemaphoreTake(otaLock, portMAX_DELAY);
+  if (otaActive && (stopping || millis() - otaLast > otaStallMs)) otaAbort(stopping ? "WiFi stopped" : "stalled");
+  xSemaphoreGive(otaLock);
+}
+
+void otaSetup() {
+  otaLock = xSemaphoreCreateMutex();
+
+  server.on("/image", HTTP_GET, [](AsyncWebServerRequest *request) {
+    otaReply(request, 200);
+  });
+
+  server.on("/image/begin", HTTP_POST, [](AsyncWebServerRequest *request) {
+    xSemaphoreTake(otaLock, portMAX_DELAY);
+    otaBegin(request);
+    xSemaphoreGive(otaLock);
+  });
+
+  server.on(
+    "/image/chunk",
+    HTTP_POST,
+    [](AsyncWebServerRequest *request) {
+      xSemaphoreTake(otaLock, portMAX_DELAY);
+      otaChunk(request);
+      xSemaphoreGive(otaLock);
+    },
+    NULL,
+    [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+      // collect the chunk, freed with the request
+      if (total > otaChunkMax) return;
+      if (index == 0) request->_tempObject = malloc(total);
+      if (request->_tempObject && index + len <= total) memcpy((uint8_t*) request->_tempObject + index, data, len);
+    }
+  );
+}
@@ -0,0 +1,141 @@
+/*
+ * Fixed-rate DAC offset output
+ *
+ * A periodic esp_timer releases the output task every 1/OUTPUT_RATE s. The
+ * task only writes the duties precomputed by loop() with ledcWrite, flash,
+ * JSON and logging stay in loop() and the WiFi task. Each output ramps to its
+ * target at `slew` mm/s (pwmSlewStep per tick, 1/256 count accumulator), so
+ * an offset change is a 12 bit staircase below the LM2902 filter time
+ * constant instead of a step the control unit reacts to. It measures its own
+ * timing, reported with the CAN statistics every 10 s:
+ *
+ *   period min/max   time between two activations
+ *   release max      timer tick -> task running
+ *   wcet             longest output step
+ *   misses           ticks not served before the next one
+ */
+
+struct OutputStats {
+  volatile uint32_t runs;
+  volatile uint32_t periodMin;  // us
+  volatile uint32_t periodMax;
+  volatile uint32_t releaseMax; // timer tick -> task running, us
+  volatile uint32_t wcet;       // us
+  volatile uint32_t misses;     // deadline misses since boot
+  void clear() {
+    runs = 0;
+    periodMin = UINT32_MAX;
+    periodMax = 0;
+    releaseMax = 0;
+    wcet = 0;
+  }
+};
+
+OutputStats outputStats;
+TaskHandle_t outputTask = NULL;
+esp_timer_handle_t outputTimer = NULL;
+volatile uint32_t outputTick = 0; // time of last timer tick
+int32_t outputLevel[3] = {0};       // ramp position per output, 1/256 count, see control.h
+
+
+// esp_timer task: release the output task
+void onOutputTimer(void *arg) {
+  outputTick = (uint32_t) esp_timer_get_time();
+  xTaskNotifyGive(outputTask);
+}
+
+void outputTaskFunc(void *param) {
+  const uint32_t period = 1000000UL / OUTPUT_RATE;
+  uint32_t last = 0;
+  bool started = false;
+  while (true) {
+    uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint32_t start = (uint32_t) esp_timer_get_time();
+    uint32_t tick = outputTick;
+
+    // DAC offset voltage output, first tick jumps to the target
+    int32_t step = started ? pwmSlewStep : 0;
+    started = true;
+    outputLevel[0] = outputRamp(outputLevel[0], rampLevel(pwmDuty_vl), step);
+    outputLevel[1] = outputRamp(outputLevel[1], rampLevel(pwmDuty_vr), step);
+    outputLevel[2] = outputRamp(outputLevel[2], rampLevel(pwmDuty_hr), step);
+    ledcWrite(PWM1, rampDuty(outputLevel[0])); // NVLS1
+    ledcWrite(PWM2, rampDuty(outputLevel[1])); // NVRS1 / inverted, requires negative offset
+    ledcWrite(PWM3, rampDuty(outputLevel[2])); // NHRS1
+//    ledcWrite(PWM4, pwmDuty_hl); // NHLS1 / not available for 211/219
+    replayWritten();
+
+    uint32_t end = (uint32_t) esp_timer_get_time();
+    OutputStats& s = outputStats;
+    if (last) {
+      uint32_t dt = start - last;
+      if (dt < s.periodMin) s.periodMin = dt;
+      if (dt > s.periodMax) s.periodMax = dt;
+      metrics.outputPeriod.record(dt);
+    }
+    last = start;
+    if (start - tick > s.releaseMax) s.releaseMax = start - tick;
+    if (end - start > s.wcet) s.wcet = end - start;
+    // ticks merged while waiting, or output finished after the next tick
+    if (ticks > 1) s.misses += ticks - 1;
+    if (end - tick > period) s.misses++;
+    s.runs++;
+  }
+}
+
+// before light sleep: the LEDC counters stop with the APB clock, a running PWM output would
+// freeze high or low and the filtered DAC voltage drift to 0 V or Vref. Duty 0 is a constant
+// low that holds without a clock, ON low switches the offset stage off first.
+void outputSuspend() {
+  esp_timer_stop(outputTimer);
+  delay(1); // a step released just before the stop runs to its end, the output task preempts loop()
+  digitalWrite(ON, LOW);
+  ledcWrite(PWM1, 0);
+  ledcWrite(PWM2, 0);
+  ledcWrite(PWM3, 0);
+  delayMicroseconds(100); // LEDC takes a new duty at the end of the running period, 51 us
+}
+
+// after light sleep: the duties of the last step, then the offset stage and the ramp
+void outputResume() {
+  ledcWrite(PWM1, rampDuty(outputLevel[0]));
+  ledcWrite(PWM2, rampDuty(outputLevel[1]));
+  ledcWrite(PWM3, rampDuty(outputLevel[2]));
+  delayMicroseconds(100);
+  digitalWrite(ON, HIGH);
+  esp_timer_start_periodic(outputTimer, 1000000ULL / OUTPUT_RATE);
+}
+
+void reportOutputStats(unsigned long span) {
+  OutputStats& s = outputStats;
+  uint32_t runs = s.runs;
+  Serial.printf("Output: %u Hz, period min %u us, max %u us, release max %u us, wcet %u us, %u deadline misses\r\n",
+    (unsigned int)(runs * 1000UL / span), runs ? s.periodMin : 0, s.periodMax, s.releaseMax, s.wcet, s.misses);
+  s.clear();
+}
+
+void outputSetup() {
+  outputStats.clear();
+  outputStats.misses = 0;
+
+  // create a task that will be executed along the loop() function, with priority 5 and executed on core 1
+  xTaskCreatePinnedToCore(
+    outputTaskFunc, // Task function
+    "Output",       // name of task
+    2048,           // Stack size of task
+    NULL,           // parameter of the task
+    5,              // priority of the task
+    &outputTask,    // Task handle to keep track of created task
+    1);             // pin task to core 1
+  metrics.watchTask("output", &outputTask);
+
+  const esp_timer_create_args_t args = {
+    .callback = onOutputTimer,
+    .arg = NULL,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "output",
+    .skip_unhandled_events = true
+  };
+  esp_timer_create(&args, &outputTimer);
+  esp_timer_start_periodic(outputTimer, 1000000ULL / OUTPUT_RATE);
+}
@@ -0,0 +1,71 @@
+/*
+ * Low power idle
+ *
+ * Once go_to_sleep() has timed out and the WiFi access point is stopped,
+ * loop() puts the ESP32 into light sleep instead of polling every 10 ms:
+ *
+ *   DAC outputs    output timer stopped, ON low, PWM duty 0. LEDC runs on
+ *                  the APB clock, which light sleep gates: a PWM output
+ *                  would freeze high or low (see outputSuspend())
+ *   CPU            80 MHz, APB stays at 80 MHz for SPI and LEDC
+ *   wake           MCP2515 INT0 / INT1 low level
+ *   watchdog       TLE4271 pulse keeps running, its LEDC timer is clocked
+ *                  from RTC8M which stays on (see startWatchdog())
+ *
+ * The MCP2515 keeps receiving while the ESP32 sleeps, the frame that woke it
+ * waits in RXB0 with RXB1 as rollover. On resume the CPU clock and the
+ * outputs are restored and both CAN tasks are notified directly, the falling
+ * edge that woke the ESP32 never reaches onCanInterrupt0/1(). /metrics counts
+ * the sleeps, the resume to first frame latency and receive overflows found
+ * in the first drain after wake (frames lost at wake).
+ */
+
+const uint32_t powerIdleMhz = 80;  // lowest CPU clock with an 80 MHz APB
+const uint32_t powerRunMhz = 240;
+
+
+// INT pin: level wake in light sleep, FALLING edge interrupt for the CAN tasks when running
+void powerWakePin(gpio_num_t pin, bool sleep) {
+  if (sleep) {
+    gpio_intr_disable(pin); // a level interrupt would fire until the frame is drained
+    gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL);
+  } else {
+    gpio_wakeup_disable(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_NEGEDGE); // gpio_wakeup_enable() replaced it
+    gpio_intr_enable(pin);
+  }
+}
+
+// light sleep until a MCP2515 interrupt, returns at once if anything is still busy
+void powerIdle() {
+  if (wifiActive || replayActive || traceBusy() || configStore.isDirty()) return;
+  if (digitalRead(INT0) == LOW || digitalRead(INT1) == LOW) return; // frame pending
+
+  Serial.println("Power: light sleep");
+  Serial.flush();
+  outputSuspend();
+  setCpuFrequencyMhz(powerIdleMhz);
+  powerWakePin(INT0, true);
+  powerWakePin(INT1, true);
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON); // watchdog LEDC clock
+
+  uint32_t sleepStart = (uint32_t) esp_timer_get_time();
+  esp_light_sleep_start();
+  canWakeTime = (uint32_t) esp_timer_get_time();
+
+  // resume: CPU clock first, the CAN tasks drain at full speed
+  setCpuFrequencyMhz(powerRunMhz);
+  powerWakePin(INT0, false);
+  powerWakePin(INT1, false);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+  canWake[CAN_C] = true;
+  canWake[CAN_B] = true;
+  xTaskNotifyGive(canTask0);
+  xTaskNotifyGive(canTask1);
+  outputResume();
+
+  metrics.sleeps.inc();
+  metrics.sleepMs.add((canWakeTime - sleepStart) / 1000);
+  Serial.printf("Power: wake after %u ms\r\n", (unsigned int)((canWakeTime - sleepStart) / 1000));
+}
@@ -0,0 +1,493 @@
+/*
+ * CAN replay benchmark
+ *
+ * Replays a candump log from LittleFS through the receive path in place of
+ * the MCP2515s and measures the control path end to end:
+ *
+ *   (1697040000.123456) can0 340#0000807F7F7F7F01
+ *
+ * can0 = Motor CAN-C, can1 = Interior CAN-B. Upload with POST /replay,
+ * start with GET /replay?run=1&rate=1 (rate 0 = as fast as loop() takes them),
+ * GET /replay returns the last report.
+ *
+ * GET /replay?plant=60 instead feeds a simulated level sensor for 60 s:
+ * FS_340h levels follow the PWM duties with a known slope and zero error
+ * plus +-1 mm of sensor noise, to check the closed loop and auto-calibration
+ * of Level.ino on the bench (tests/test_level.cpp does the same on the PC).
+ *
+ * &drop=340:2000:500 leaves out the frames of an ID (hex, * = all) from
+ * 2000 ms for 500 ms of log or plant time, up to 4 comma separated, to test
+ * the message deadlines of can_freshness.h. The report lists the deadline
+ * misses and how late they were detected.
+ */
+
+const char* replayFile = "/replay.log";
+
+// latency histogram 100 us buckets up to 50 ms, last bucket = overflow
+const uint32_t replayBucketUs = 100;
+const size_t replayBuckets = 500;
+
+struct ReplayHist {
+  uint32_t count[replayBuckets];
+  uint32_t n;
+  uint32_t max;
+  void clear() {
+    memset(count, 0x00, sizeof(count));
+    n = 0;
+    max = 0;
+  }
+  void add(uint32_t us) {
+    size_t i = us / replayBucketUs;
+    count[i < replayBuckets ? i : replayBuckets - 1]++;
+    n++;
+    if (us > max) max = us;
+  }
+  uint32_t percentile(uint8_t p) const {
+    if (!n) return 0;
+    uint32_t rank = ((uint64_t)n * p + 99) / 100;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < replayBuckets; i++) {
+      sum += count[i];
+      if (sum >= rank) return (i + 1) * replayBucketUs;
+    }
+    return max;
+  }
+};
+
+ReplayHist replayOutputLatency; // frame -> ledcWrite
+ReplayHist replayModeLatency;   // FS_340h LED bits -> getSettings
+uint32_t replayFrames = 0;
+uint32_t replaySkipped = 0;     // unparsable lines, unknown interface
+uint32_t replayDrops = 0;
+uint32_t replayCpuSum = 0;      // decode + queue per frame, us
+uint32_t replayCpuMax = 0;
+uint32_t replayElapsed = 0;     // ms
+uint16_t replayRate = 1;
+String replayReport = "no replay yet\n"; // written by the replay task, read by async_tcp
+SemaphoreHandle_t replayReportLock = NULL;
+
+// injected dropouts: frames of id left out from start for len ms
+struct ReplayDropout {
+  uint32_t id;    // replayAllIds = every frame
+  uint32_t start; // ms of log / plant time
+  uint32_t len;
+};
+const uint32_t replayAllIds = 0xFFFFFFFF;
+const uint8_t replayDropoutMax = 4;
+ReplayDropout replayDropouts[replayDropoutMax];
+uint8_t replayDropoutCount = 0;
+uint32_t replayLeftOut = 0;     // frames not injected
+uint32_t replayMisses[CAN_MSG_COUNT]; // deadline misses before the run
+
+// frames popped by loop(), the first replayReadyLen have their duty computed and wait for the next ledcWrite
+uint32_t replayPending[2 * CAN_QUEUE_LEN];
+size_t replayPendingLen = 0;
+size_t replayReadyLen = 0;
+portMUX_TYPE mux_replay = portMUX_INITIALIZER_UNLOCKED;
+
+// last injected FS_340h mode bits and their injection time
+volatile uint8_t replayLedBits = 0;
+volatile uint32_t replayModeTime = 0;
+
+
+// loop(): frame taken from the queue
+void replayConsumed(uint32_t rxTime) {
+  if (!replayActive) return;
+  portENTER_CRITICAL(&mux_replay);
+  if (replayPendingLen < sizeof(replayPending) / sizeof(replayPending[0])) {
+    replayPending[replayPendingLen++] = rxTime;
+  }
+  portEXIT_CRITICAL(&mux_replay);
+}
+
+// loop(): DAC duties of the consumed frames computed
+void replayOutput() {
+  portENTER_CRITICAL(&mux_replay);
+  replayReadyLen = replayPendingLen;
+  portEXIT_CRITICAL(&mux_replay);
+}
+
+// output task: DAC offset voltage written
+void replayWritten() {
+  if (!replayReadyLen) return;
+  uint32_t now = (uint32_t) esp_timer_get_time();
+  portENTER_CRITICAL(&mux_replay);
+  for (size_t i = 0; i < replayReadyLen; i++) {
+    replayOutputLatency.add(now - replayPending[i]);
+  }
+  replayPendingLen -= replayReadyLen;
+  memmove(replayPending, replayPending + replayReadyLen, replayPendingLen * sizeof(replayPending[0]));
+  replayReadyLen = 0;
+  portEXIT_CRITICAL(&mux_replay);
+}
+
+// loop(): offsets of a new mode applied
+void replayModeApplied() {
+  if (!replayActive || !replayModeTime) return;
+  replayModeLatency.add((uint32_t) esp_timer_get_time() - replayModeTime);
+  replayModeTime = 0;
+}
+
+// parse "(sec.usec) ifname ID#DATA"
+bool replayParse(const char* line, uint64_t& ts, CanBus& bus, struct can_frame& frame) {
+  unsigned long sec, usec;
+  char ifname[16];
+  char payload[40];
+  if (sscanf(line, "(%lu.%lu) %15s %39s", &sec, &usec, ifname, payload) != 4) return false;
+  ts = (uint64_t)sec * 1000000ULL + usec;
+  if (strcmp(ifname, "can0") == 0) {
+    bus = CAN_C;
+  } else if (strcmp(ifname, "can1") == 0) {
+    bus = CAN_B;
+  } else {
+    return false;
+  }
+  char* data = strchr(payload, '#');
+  if (!data) return false;
+  *data++ = '\0';
+  if (*data == 'R') return false; // remote frame
+  frame.can_id = strtoul(payload, nullptr, 16);
+  if (strlen(payload) > 3) frame.can_id |= CAN_EFF_FLAG;
+  frame.can_dlc = 0;
+  while (data[0] && data[1] && frame.can_dlc < CAN_MAX_DLEN) {
+    char hex[3] = {data[0], data[1], '\0'};
+    frame.data[frame.can_dlc++] = (uint8_t) strtoul(hex, nullptr, 16);
+    data += 2;
+  }
+  return true;
+}
+
+// "ID:START:LEN,..." -> replayDropouts, false on a bad spec
+bool replaySetDropouts(const String& spec) {
+  replayDropoutCount = 0;
+  int pos = 0;
+  while (pos < (int) spec.length()) {
+    int end = spec.indexOf(',', pos);
+    if (end < 0) end = spec.length();
+    String item = spec.substring(pos, end);
+    pos = end + 1;
+    char id[9];
+    unsigned long start, len;
+    if (replayDropoutCount >= replayDropoutMax || sscanf(item.c_str(), "%8[^:]:%lu:%lu", id, &start, &len) != 3) {
+      replayDropoutCount = 0;
+      return false;
+    }
+    ReplayDropout& d = replayDropouts[replayDropoutCount++];
+    d.id = strcmp(id, "*") == 0 ? replayAllIds : strtoul(id, nullptr, 16);
+    d.start = start;
+    d.len = len;
+  }
+  return true;
+}
+
+// frame of id at ms falls into an injected dropout
+bool replayDropped(uint32_t id, uint32_t ms) {
+  for (uint8_t i = 0; i < replayDropoutCount; i++) {
+    const ReplayDropout& d = replayDropouts[i];
+    if ((d.id == replayAllIds || d.id == (id & CAN_EFF_MASK)) && ms - d.start < d.len) return true;
+  }
+  return false;
+}
+
+// report of the finished run, also on the console
+void replaySetReport(const String& report) {
+  Serial.print(report);
+  xSemaphoreTake(replayReportLock, portMAX_DELAY);
+  replayReport = report;
+  xSemaphoreGive(replayReportLock);
+}
+
+String replayGetReport() {
+  xSemaphoreTake(replayReportLock, portMAX_DELAY);
+  String report = replayReport;
+  xSemaphoreGive(replayReportLock);
+  return report;
+}
+
+// remember the deadline misses before a run
+void replayMissesStart() {
+  replayLeftOut = 0;
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) replayMisses[i] = canFreshness.misses(i);
+}
+
+// deadline misses of the run, appended to the report
+String replayMissReport() {
+  char buf[96];
+  snprintf(buf, sizeof(buf), "dropouts: %u frames left out, deadline misses:", replayLeftOut);
+  String report = buf;
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    uint32_t misses = canFreshness.misses(i) - replayMisses[i];
+    if (!misses) continue;
+    snprintf(buf, sizeof(buf), " %s %u (deadline %u ms, detected up to %u us late)",
+      canMessages[i].name, misses, CanFreshness::deadline(i) / 1000, canFreshness.lateMax(i));
+    report += buf;
+  }
+  return report + "\n";
+}
+
+// remember when the AIRmatic mode LEDs change in the injected traffic
+void replayWatchMode(CanBus bus, const struct can_frame& frame) {
+  if (bus != CAN_C || frame.can_id != CANID_FS_340h || frame.can_dlc < 2) return;
+  uint8_t bits = (w211::FS_340h::ST2_LED_DL(frame.data) << 2) | (w211::FS_340h::ST3_LEDR_DL(frame.data) << 1) |
+    w211::FS_340h::ST3_LEDL_DL(frame.data);
+  if (bits != replayLedBits) {
+    replayLedBits = bits;
+    replayModeTime = (uint32_t) esp_timer_get_time();
+  }
+}
+
+void replayTaskFunc(void *param) {
+  File file = LittleFS.open(replayFile, "r");
+  if (!file) {
+    Serial.print("LittleFS: cannot access '");
+    Serial.print(replayFile);
+    Serial.println("': No such file or directory");
+    replaySetReport("no replay log\n");
+    replayActive = false;
+    vTaskDelete(NULL);
+  }
+
+  replayOutputLatency.clear();
+  replayModeLatency.clear();
+  replayFrames = 0;
+  replaySkipped = 0;
+  replayCpuSum = 0;
+  replayCpuMax = 0;
+  replayLedBits = 0;
+  replayModeTime = 0;
+  replayMissesStart();
+  uint32_t drops = canQueue0.dropped() + canQueue1.dropped();
+
+  // let the CAN tasks leave receiveFrame() before taking over as producer
+  delay(10);
+
+  char line[96];
+  uint64_t logStart = 0;
+  int64_t start = esp_timer_get_time();
+  int64_t yielded = start;
+  CanFrame rx;
+  CanBus bus;
+  uint64_t ts;
+  while (file.available()) {
+    size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[len] = '\0';
+    if (!replayParse(line, ts, bus, rx.frame)) {
+      replaySkipped++;
+      continue;
+    }
+    if (!logStart) logStart = ts;
+
+    // wait for the scheduled time at the selected rate
+    if (replayRate) {
+      int64_t due = start + (int64_t)((ts - logStart) / replayRate);
+      int64_t wait = due - esp_timer_get_time();
+      if (wait > 2000) {
+        delay(wait / 1000 - 1);
+        wait = due - esp_timer_get_time();
+      }
+      if (wait > 50) {
+        delay_us(wait);
+      }
+    }
+    if (replayDropped(rx.frame.can_id, (uint32_t)((ts - logStart) / 1000))) {
+      replayLeftOut++;
+      continue;
+    }
+
+    // rate 0: wait for loop() instead of dropping, block at least once per tick for IDLE0 (task watchdog)
+    FrameQueue<CanFrame, CAN_QUEUE_LEN>& queue = bus == CAN_C ? canQueue0 : canQueue1;
+    if (!replayRate) {
+      while (queue.size() >= CAN_QUEUE_LEN || esp_timer_get_time() - yielded > 1000 * portTICK_PERIOD_MS) {
+        vTaskDelay(1);
+        yielded = esp_timer_get_time();
+      }
+    }
+
+    replayWatchMode(bus, rx.frame);
+    rx.time = (uint32_t) esp_timer_get_time();
+    exportMsg(bus, rx.frame.can_id, rx.frame.data, rx.frame.can_dlc, rx.time);
+    queue.push(rx);
+    uint32_t cpu = (uint32_t) esp_timer_get_time() - rx.time;
+    replayCpuSum += cpu;
+    if (cpu > replayCpuMax) replayCpuMax = cpu;
+    replayFrames++;
+    awake(100); // prevent idle timeout
+  }
+  file.close();
+
+  // let loop() consume the tail
+  delay(50);
+  replayElapsed = (uint32_t)((esp_timer_get_time() - start) / 1000);
+  replayDrops = canQueue0.dropped() + canQueue1.dropped() - drops;
+  replayActive = false;
+
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+    "replay %s rate %ux: %u frames in %u ms, %u skipped, %u dropped\n"
+    "frame -> ledcWrite us: p50 %u p90 %u p99 %u max %u (n %u)\n"
+    "mode switch -> getSettings us: p50 %u p90 %u max %u (n %u)\n"
+    "cpu per frame us: avg %u max %u\n",
+    replayFile, replayRate, replayFrames, replayElapsed, replaySkipped, replayDrops,
+    replayOutputLatency.percentile(50), replayOutputLatency.percentile(90), replayOutputLatency.percentile(99),
+    replayOutputLatency.max, replayOutputLatency.n,
+    replayModeLatency.percentile(50), replayModeLatency.percentile(90), replayModeLatency.max, replayModeLatency.n,
+    replayFrames ? replayCpuSum / replayFrames : 0, replayCpuMax);
+  replaySetReport(String(buf) + replayMissReport());
+  vTaskDelete(NULL);
+}
+
+// simulated plant: level per output = 127 + slope * (duty - zero) + noise, HL fixed
+const float replayPlantSlope[CALIB_COUNT] = { -0.45f, 0.45f, 0.0f, -0.45f }; // mm per duty count
+const int8_t replayPlantZero[CALIB_COUNT] = { 3, -3, 0, 2 };                   // zero error, duty counts
+
+uint32_t replayPlantSeed = 1;
+
+// sensor noise, uniform +-1 mm, dithers the 1 mm resolution of FZGN_* like the real readings
+float replayPlantNoise() {
+  replayPlantSeed ^= replayPlantSeed << 13; // xorshift32, same sequence on the host
+  replayPlantSeed ^= replayPlantSeed >> 17;
+  replayPlantSeed ^= replayPlantSeed << 5;
+  return (float)(replayPlantSeed % 2001) / 1000.0f - 1.0f;
+}
+
+uint8_t replayPlantLevel(uint8_t ch, uint32_t pwm) {
+  float level = 127 + replayPlantSlope[ch] * ((float) pwm / PWM_SCALE - duty - replayPlantZero[ch]) + replayPlantNoise();
+  return level < 0 ? 0 : level > 254 ? 254 : (uint8_t) lroundf(level);
+}
+
+void replayPlantFunc(void *param) {
+  uint32_t seconds = (uint32_t)(uintptr_t) param;
+  uint8_t ezs[w211::EZS_240h::DLC] = {};
+  w211::EZS_240h::set_KL_15(ezs, true);
+  uint8_t fs[w211::FS_340h::DLC] = {};
+  w211::FS_340h::set_FS_ID(fs, 1);
+  CanFrame rx;
+
+  delay(10);
+  replayFrames = 0;
+  replayMissesStart();
+  int64_t start = esp_timer_get_time();
+  TickType_t wake = xTaskGetTickCount();
+  for (uint32_t i = 0; i < seconds * 50; i++) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(20)); // 50 Hz like the control unit
+    w211::FS_340h::set_FZGN_VL(fs, replayPlantLevel(CALIB_VL, pwmDuty_vl));
+    w211::FS_340h::set_FZGN_VR(fs, replayPlantLevel(CALIB_VR, pwmDuty_vr));
+    w211::FS_340h::set_FZGN_HL(fs, 127);
+    w211::FS_340h::set_FZGN_HR(fs, replayPlantLevel(CALIB_HR, pwmDuty_hr));
+
+    rx.time = (uint32_t) esp_timer_get_time();
+    if (!replayDropped(CANID_EZS_240h, i * 20)) {
+      rx.frame.can_id = CANID_EZS_240h;
+      rx.frame.can_dlc = sizeof(ezs);
+      memcpy(rx.frame.data, ezs, sizeof(ezs));
+      exportMsg(CAN_C, rx.frame.can_id, rx.frame.data, rx.frame.can_dlc, rx.time);
+      canQueue0.push(rx);
+      replayFrames++;
+    } else {
+      replayLeftOut++;
+    }
+
+    if (!replayDropped(CANID_FS_340h, i * 20)) {
+      rx.frame.can_id = CANID_FS_340h;
+      rx.frame.can_dlc = sizeof(fs);
+      memcpy(rx.frame.data, fs, sizeof(fs));
+      exportMsg(CAN_C, rx.frame.can_id, rx.frame.data, rx.frame.can_dlc, rx.time);
+      canQueue0.push(rx);
+      replayFrames++;
+    } else {
+      replayLeftOut++;
+    }
+    awake(100); // prevent idle timeout
+  }
+  replayElapsed = (uint32_t)((esp_timer_get_time() - start) / 1000);
+  replayActive = false;
+
+  char buf[160];
+  snprintf(buf, sizeof(buf), "plant %u s: %u frames in %u ms, zero error vl %d vr %d hr %d\n",
+    seconds, replayFrames, replayElapsed, replayPlantZero[CALIB_VL], replayPlantZero[CALIB_VR], replayPlantZero[CALIB_HR]);
+  replaySetReport(String(buf) + replayMissReport());
+  vTaskDelete(NULL);
+}
+
+// start replay task, false if already running
+bool startReplay(uint16_t rate) {
+  if (replayActive) return false;
+  replayRate = rate;
+  replayPendingLen = 0;
+  replayReadyLen = 0;
+  replayActive = true;
+  xTaskCreatePinnedToCore(
+    replayTaskFunc, // Task function
+    "Replay",       // name of task
+    4096,           // Stack size of task
+    NULL,           // parameter of the task
+    3,              // priority of the task
+    NULL,           // Task handle to keep track of created task
+    0);             // pin task to core 0
+  return true;
+}
+
+void replaySetup() {
+  replayReportLock = xSemaphoreCreateMutex();
+  server.on(
+    "/replay",
+    HTTP_GET,
+    [](AsyncWebServerRequest *request) {
+      if (request->hasParam("plant") || request->hasParam("run")) {
+        if (replayActive) {
+          request->send(409, "text/plain", "replay running");
+          return;
+        }
+        if (!replaySetDropouts(request->hasParam("drop") ? request->getParam("drop")->value() : String())) {
+          request->send(400, "text/plain", "drop=ID:START:LEN[,...] ms, at most 4");
+          return;
+        }
+      }
+      if (request->hasParam("plant")) {
+        replayActive = true;
+        xTaskCreatePinnedToCore(
+          replayPlantFunc,  // Task function
+          "Plant",          // name of task
+          4096,             // Stack size of task
+          (void*) request->getParam("plant")->value().toInt(), // parameter of the task: seconds
+          3,                // priority of the task
+          NULL,             // Task handle to keep track of created task
+          0);               // pin task to core 0
+        request->send(202, "text/plain", "plant started");
+        return;
+      }
+      if (request->hasParam("run")) {
+        if (otaFsBusy()) {
+          request->send(409, "text/plain", "LittleFS image upload");
+          return;
+        }
+        uint16_t rate = request->hasParam("rate") ? request->getParam("rate")->value().toInt() : 1;
+        if (!startReplay(rate)) {
+          request->send(409, "text/plain", "replay running");
+          return;
+        }
+        request->send(202, "text/plain", "replay started");
+        return;
+      }
+      request->send(200, "text/plain", replayActive ? String("replay running\n") : replayGetReport());
+    });
+
+  // upload candump log
+  server.on(
+    "/replay",
+    HTTP_POST,
+    [](AsyncWebServerRequest *request) {
+      if (otaFsBusy()) request->send(409, "text/plain", "LittleFS image upload");
+      else request->send(200, "text/plain", "OK");
+    },
+    NULL,
+    [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+      if (otaFsBusy()) return;
+      File file = LittleFS.open(replayFile, index ? "a" : "w");
+      if (file) {
+        file.write(data, len);
+        file.close();
+      }
+    }
+  );
+}
@@ -0,0 +1,131 @@
+/*
+ * Live telemetry
+ *
+ * Pushes level, mode and offset changes to config.html over Server-Sent
+ * Events instead of letting every client poll /config.json. A low priority
+ * task samples the state at telemetryRate, encodes the changed fields once
+ * and broadcasts the same message to all connected clients:
+ *
+ *   event: state
+ *   data: {"current_mode":"comfort","comfort":{"offset_nv":5},"level":{"fzgn_vl":127}}
+ *
+ * Keys match /config.json and /level.json, the client merges the delta
+ * into its copy. Both stay available as polling fallback.
+ */
+
+const uint32_t telemetryRate = 10;     // Hz, 10-20
+const uint32_t telemetryBacklog = 4;   // queued messages per client before skipping a tick
+
+// append "key":value, comma separated
+size_t telemetryField(char* buf, size_t pos, size_t size, bool& first, const char* key, int value) {
+  if (pos >= size) return pos;
+  pos += snprintf(buf + pos, size - pos, "%s\"%s\":%d", first ? "" : ",", key, value);
+  first = false;
+  return pos;
+}
+
+struct TelemetryState {
+  Mode mode;
+  int8_t offset_nv;
+  int8_t offset_nh;
+  uint8_t fzgn_vl;
+  uint8_t fzgn_vr;
+  uint8_t fzgn_hl;
+  uint8_t fzgn_hr;
+
+  void sample() {
+    FS_340h_t fs = FS_340h.read();
+    mode = ::mode;
+    offset_nv = ::offset_nv;
+    offset_nh = ::offset_nh;
+    fzgn_vl = w211::FS_340h::FZGN_VL(fs.data);
+    fzgn_vr = w211::FS_340h::FZGN_VR(fs.data);
+    fzgn_hl = w211::FS_340h::FZGN_HL(fs.data);
+    fzgn_hr = w211::FS_340h::FZGN_HR(fs.data);
+  }
+
+  // JSON of the fields that differ from o, 0 if nothing changed
+  size_t encode(const TelemetryState& o, bool full, char* buf, size_t size) const;
+};
+
+AsyncEventSource events("/events");
+TelemetryState telemetrySent;
+volatile bool telemetryFull = true; // next message carries all fields
+
+
+size_t TelemetryState::encode(const TelemetryState& o, bool full, char* buf, size_t size) const {
+  const TelemetryState& s = *this;
+  bool modeChanged = full || s.mode != o.mode;
+  size_t pos = snprintf(buf, size, "{");
+  bool first = true;
+
+  if (modeChanged) {
+    pos += snprintf(buf + pos, size - pos, "\"current_mode\":\"%s\"", modeNames[s.mode]);
+    first = false;
+  }
+  if (modeChanged || s.offset_nv != o.offset_nv || s.offset_nh != o.offset_nh) {
+    pos += snprintf(buf + pos, size - pos, "%s\"%s\":{", first ? "" : ",", modeNames[s.mode]);
+    bool inner = true;
+    if (modeChanged || s.offset_nv != o.offset_nv) pos = telemetryField(buf, pos, size, inner, "offset_nv", s.offset_nv);
+    if (modeChanged || s.offset_nh != o.offset_nh) pos = telemetryField(buf, pos, size, inner, "offset_nh", s.offset_nh);
+    pos += snprintf(buf + pos, size - pos, "}");
+    first = false;
+  }
+  if (full || s.fzgn_vl != o.fzgn_vl || s.fzgn_vr != o.fzgn_vr || s.fzgn_hl != o.fzgn_hl || s.fzgn_hr != o.fzgn_hr) {
+    pos += snprintf(buf + pos, size - pos, "%s\"level\":{", first ? "" : ",");
+    bool inner = true;
+    if (full || s.fzgn_vl != o.fzgn_vl) pos = telemetryField(buf, pos, size, inner, "fzgn_vl", s.fzgn_vl);
+    if (full || s.fzgn_vr != o.fzgn_vr) pos = telemetryField(buf, pos, size, inner, "fzgn_vr", s.fzgn_vr);
+    if (full || s.fzgn_hl != o.fzgn_hl) pos = telemetryField(buf, pos, size, inner, "fzgn_hl", s.fzgn_hl);
+    if (full || s.fzgn_hr != o.fzgn_hr) pos = telemetryField(buf, pos, size, inner, "fzgn_hr", s.fzgn_hr);
+    pos += snprintf(buf + pos, size - pos, "}");
+    first = false;
+  }
+  if (first || pos + 2 > size) return 0;
+  pos += snprintf(buf + pos, size - pos, "}");
+  return pos;
+}
+
+void telemetryTaskFunc(void *param) {
+  char buf[192];
+  TickType_t wake = xTaskGetTickCount();
+  while (true) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(1000 / telemetryRate));
+    if (!events.count()) {
+      telemetryFull = true;
+      continue;
+    }
+    // slow client: skip the tick, resend everything once it caught up
+    if (events.avgPacketsWaiting() > telemetryBacklog) {
+      telemetryFull = true;
+      continue;
+    }
+    bool full = telemetryFull;
+    telemetryFull = false;
+    TelemetryState s;
+    s.sample();
+    if (!s.encode(telemetrySent, full, buf, sizeof(buf))) continue;
+    telemetrySent = s;
+    events.send(buf, "state", millis());
+  }
+}
+
+void telemetrySetup() {
+  events.onConnect([](AsyncEventSourceClient *client) {
+    client->send("hello", NULL, millis(), 1000); // reconnect after 1 s
+    telemetryFull = true;
+  });
+  server.addHandler(&events);
+
+  // create a task that will be executed along the loop() function, with priority 1
+  static TaskHandle_t telemetryTask = NULL;
+  if (!telemetryTask) {
+    xTaskCreate(
+      telemetryTaskFunc, // Task function
+      "Telemetry",       // name of task
+      4096,              // Stack size of task
+      NULL,              // parameter of the task
+      1,                 // priority of the task
+      &telemetryTask);   // Task handle to keep track of created task
+  }
+}
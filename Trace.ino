@@ -0,0 +1,284 @@
+/*
+ * CAN trace recorder
+ *
+ * Records received frames into a RAM ring while armed. The ring holds the
+ * pre-trigger window, on a trigger event (mode change, go_to_sleep timeout)
+ * it is flushed to LittleFS by a low priority task together with the frames
+ * of the post-trigger window. The CAN tasks only copy into RAM.
+ *
+ * File format (little endian), convert with tools/trace2candump.py:
+ *   header  "AMTR", version u8, count u8, reserved u16, base time u32 (us),
+ *           count x (bus u8, reserved u8, id u16)
+ *   record  delta time varint (us, to previous record), index u8, dlc u8, payload
+ */
+
+const char* traceFile = "/trace.bin";
+const size_t traceRingSize = 16384;
+const size_t traceChunk = 4096;
+const size_t traceCopyStep = 64; // bytes copied out of the ring per critical section
+static_assert(CAN_MSG_COUNT <= 32, "trace id mask holds 32 messages");
+
+enum TraceState : uint8_t {
+  TRACE_IDLE,      // not recording
+  TRACE_ARMED,     // recording pre-trigger window, oldest records overwritten
+  TRACE_TRIGGERED, // recording post-trigger window, flushed to LittleFS
+  TRACE_DONE       // trace file complete
+};
+
+uint8_t traceRing[traceRingSize];
+size_t traceHead = 0;        // next byte to write
+size_t traceTail = 0;        // oldest byte not flushed
+size_t traceUsed = 0;
+uint32_t traceLast = 0;      // time of newest record
+uint32_t traceTailTime = 0;  // time of record at tail while armed
+uint32_t traceBase = 0;      // time the first flushed delta refers to
+uint32_t traceEnd = 0;       // end of post-trigger window
+uint32_t traceRecords = 0;
+uint32_t traceDrops = 0;
+uint32_t traceBytes = 0;     // written to LittleFS
+uint32_t tracePostMs = 5000;
+volatile uint32_t traceMask = 0; // captured registry indices
+volatile uint8_t traceEvents = TRACE_ON_MODE | TRACE_ON_SLEEP | TRACE_ON_USER;
+volatile TraceState traceState = TRACE_IDLE;
+const char* traceReason = "";
+
+portMUX_TYPE mux_trace = portMUX_INITIALIZER_UNLOCKED;
+
+
+// length of the record starting at ring position pos
+size_t traceRecordLen(size_t pos) {
+  size_t len = 0;
+  while (traceRing[(pos + len) % traceRingSize] & 0x80) len++;
+  len++; // last varint byte
+  uint8_t dlc = traceRing[(pos + len + 1) % traceRingSize] & 0x0F;
+  return len + 2 + dlc;
+}
+
+// delta time of the record starting at ring position pos
+uint32_t traceRecordDelta(size_t pos) {
+  uint32_t delta = 0;
+  uint8_t shift = 0;
+  uint8_t b;
+  do {
+    b = traceRing[pos];
+    delta |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+    pos = (pos + 1) % traceRingSize;
+  } while (b & 0x80);
+  return delta;
+}
+
+// CAN task: copy a received frame into the ring
+void traceFrame(CanBus bus, const CanFrame& rx) {
+  TraceState state = traceState;
+  if (state != TRACE_ARMED && state != TRACE_TRIGGERED) return;
+  uint8_t index = canMsgIndex(bus, rx.frame.can_id);
+  if (index == CAN_MSG_NONE || !(traceMask & (1UL << index))) return;
+
+  uint8_t rec[5 + 2 + CAN_MAX_DLEN];
+  uint8_t dlc = rx.frame.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : rx.frame.can_dlc;
+
+  portENTER_CRITICAL(&mux_trace);
+  uint32_t delta = rx.time - traceLast;
+  size_t len = 0;
+  do {
+    rec[len++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0x00);
+    delta >>= 7;
+  } while (delta);
+  rec[len++] = index;
+  rec[len++] = dlc;
+  memcpy(rec + len, rx.frame.data, dlc);
+  len += dlc;
+
+  if (traceState == TRACE_ARMED) {
+    // pre-trigger window: drop oldest records
+    while (traceUsed + len > traceRingSize) {
+      size_t old = traceRecordLen(traceTail);
+      traceTail = (traceTail + old) % traceRingSize;
+      traceUsed -= old;
+      if (traceUsed) traceTailTime += traceRecordDelta(traceTail);
+    }
+  } else if (traceUsed + len > traceRingSize) {
+    // post-trigger window: never overwrite unflushed data
+    traceDrops++;
+    portEXIT_CRITICAL(&mux_trace);
+    return;
+  }
+  if (!traceUsed) traceTailTime = rx.time;
+  for (size_t i = 0; i < len; i++) {
+    traceRing[traceHead] = rec[i];
+    traceHead = (traceHead + 1) % traceRingSize;
+  }
+  traceUsed += len;
+  traceLast = rx.time;
+  traceRecords++;
+  portEXIT_CRITICAL(&mux_trace);
+}
+
+// start recording the pre-trigger window
+void traceArm(uint32_t mask, uint8_t events, uint32_t postMs) {
+  portENTER_CRITICAL(&mux_trace);
+  traceHead = 0;
+  traceTail = 0;
+  traceUsed = 0;
+  traceRecords = 0;
+  traceDrops = 0;
+  traceBytes = 0;
+  traceMask = mask;
+  traceEvents = events;
+  tracePostMs = postMs;
+  traceReason = "";
+  traceState = TRACE_ARMED;
+  portEXIT_CRITICAL(&mux_trace);
+}
+
+// trigger event: keep pre-trigger window, record post-trigger window
+void traceTrigger(uint8_t event, const char* reason) {
+  if (traceState != TRACE_ARMED || !(traceEvents & event)) return;
+  portENTER_CRITICAL(&mux_trace);
+  if (traceState == TRACE_ARMED) {
+    traceBase = traceUsed ? traceTailTime - traceRecordDelta(traceTail) : traceLast;
+    traceEnd = (uint32_t) esp_timer_get_time() + tracePostMs * 1000UL;
+    traceReason = reason;
+    traceState = TRACE_TRIGGERED;
+  }
+  portEXIT_CRITICAL(&mux_trace);
+  if (traceTask) xTaskNotifyGive(traceTask);
+}
+
+// post-trigger window still recording or not yet on LittleFS
+bool traceBusy() {
+  return traceState == TRACE_TRIGGERED;
+}
+
+// low priority: flush the ring to LittleFS in traceChunk blocks
+void traceTaskFunc(void *param) {
+  static uint8_t buf[traceChunk];
+  size_t fill = 0;
+  File file;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    if (traceState != TRACE_TRIGGERED || otaFsBusy()) continue; // the ring keeps the records until LittleFS is back
+
+    if (!file) {
+      file = LittleFS.open(traceFile, "w");
+      if (!file) {
+        Serial.print("LittleFS: ");
+        Serial.print(traceFile);
+        Serial.println(": Read-only file system");
+        traceState = TRACE_IDLE;
+        continue;
+      }
+      // header goes into the first chunk, following chunks stay aligned
+      memcpy(buf, "AMTR", 4);
+      buf[4] = 1;
+      buf[5] = CAN_MSG_COUNT;
+      buf[6] = 0;
+      buf[7] = 0;
+      memcpy(buf + 8, &traceBase, 4);
+      fill = 12;
+      for (int i = 0; i < CAN_MSG_COUNT; i++) {
+        buf[fill++] = canMessages[i].bus;
+        buf[fill++] = 0;
+        buf[fill++] = canMessages[i].id & 0xFF;
+        buf[fill++] = canMessages[i].id >> 8;
+      }
+      Serial.printf("Trace: triggered by %s\r\n", traceReason);
+    }
+
+    bool finished = (int32_t)((uint32_t) esp_timer_get_time() - traceEnd) >= 0;
+    while (traceUsed + fill >= traceChunk || (finished && traceUsed + fill)) {
+      // small pieces, a CAN task waits for one piece at most, not for a whole chunk
+      while (fill < traceChunk) {
+        portENTER_CRITICAL(&mux_trace);
+        size_t n = traceChunk - fill;
+        if (n > traceCopyStep) n = traceCopyStep;
+        if (n > traceUsed) n = traceUsed;
+        if (n > traceRingSize - traceTail) n = traceRingSize - traceTail;
+        memcpy(buf + fill, traceRing + traceTail, n);
+        traceTail = (traceTail + n) % traceRingSize;
+        traceUsed -= n;
+        portEXIT_CRITICAL(&mux_trace);
+        if (!n) break;
+        fill += n;
+      }
+      traceBytes += file.write(buf, fill);
+      fill = 0;
+    }
+
+    if (finished) {
+      file.close();
+      traceState = TRACE_DONE;
+      Serial.printf("Trace: %u records, %u dropped, %u bytes written to %s\r\n", traceRecords, traceDrops, traceBytes, traceFile);
+    }
+  }
+}
+
+// state, ids and counters for /trace
+void traceStatus(AsyncWebServerRequest *request) {
+  const char* states[] = { "idle", "armed", "triggered", "done" };
+  char buf[160];
+  snprintf(buf, sizeof(buf), "trace %s, ids 0x%08X, %u records, %u dropped, %u bytes in %s\n",
+    states[traceState], traceMask, traceRecords, traceDrops, traceBytes, traceFile);
+  request->send(200, "text/plain", buf);
+}
+
+void traceSetup() {
+  server.on("/trace", HTTP_GET, traceStatus);
+
+  // arm: POST /trace?arm=1&ids=240,340&on=mode,sleep&post=5000, trigger: POST /trace?trigger=1
+  server.on("/trace", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (request->hasParam("arm")) {
+      uint32_t mask = 0;
+      if (request->hasParam("ids")) {
+        String ids = request->getParam("ids")->value();
+        int start = 0;
+        while (start < (int)ids.length()) {
+          int end = ids.indexOf(',', start);
+          if (end < 0) end = ids.length();
+          uint16_t id = strtoul(ids.substring(start, end).c_str(), nullptr, 16);
+          for (int i = 0; i < CAN_MSG_COUNT; i++) {
+            if (canMessages[i].id == id) mask |= 1UL << i;
+          }
+          start = end + 1;
+        }
+      } else {
+        mask = (1UL << CAN_MSG_COUNT) - 1;
+      }
+      uint8_t events = TRACE_ON_USER;
+      if (request->hasParam("on")) {
+        String on = request->getParam("on")->value();
+        if (on.indexOf("mode") >= 0) events |= TRACE_ON_MODE;
+        if (on.indexOf("sleep") >= 0) events |= TRACE_ON_SLEEP;
+      } else {
+        events |= TRACE_ON_MODE | TRACE_ON_SLEEP;
+      }
+      uint32_t postMs = request->hasParam("post") ? request->getParam("post")->value().toInt() : 5000;
+      traceArm(mask, events, postMs);
+    } else if (request->hasParam("trigger")) {
+      traceTrigger(TRACE_ON_USER, "user");
+    } else {
+      request->send(400, "text/plain", "arm=1 or trigger=1");
+      return;
+    }
+    traceStatus(request);
+  });
+
+  // stream trace file without loading it into RAM
+  server.on("/trace.bin", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (traceState == TRACE_TRIGGERED || otaFsBusy() || !LittleFS.exists(traceFile)) {
+      request->send(404, "text/plain", "404: File not found");
+      return;
+    }
+    std::shared_ptr<File> file = std::make_shared<File>(LittleFS.open(traceFile, "r"));
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+      [file](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        if (!*file) return 0;
+        size_t n = file->read(buffer, maxLen);
+        if (!n) file->close();
+        return n;
+      });
+    response->addHeader("Content-Disposition", "attachment; filename=\"trace.bin\"");
+    request->send(response);
+  });
+}
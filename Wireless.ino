@@ -31,10 +31,29 @@ String hash;
 String seed;
 String salt;
 
-uint8_t update = 1;
+// POST /config?update=N commands of config.html and settings.html
+const uint8_t CMD_RELOAD           = 1; // calibration from the config store
+const uint8_t CMD_CALIBRATION_SAVE = 2;
+const uint8_t CMD_OFFSET_PREVIEW   = 3; // apply calibration and offsets of the body
+const uint8_t CMD_OFFSET_SAVE      = 4;
+const uint8_t CMD_WIFI_EXCHANGE    = 5; // session key, new credentials encrypted
+const uint8_t CMD_WIFI_CONFIRM     = 6; // handshake verified: save, reboot
+const uint8_t CMD_LEVEL_OPEN       = 7; // level feedback, see Level.ino
+const uint8_t CMD_LEVEL_CLOSED     = 8;
+const uint8_t CMD_LEVEL_CALIBRATE  = 9; // started by loop(), progress in GET /level
+const uint8_t CMD_COUNT            = 10;
+
+const size_t configBodyMax = 2048;
+const uint8_t configQueueLen = 4;
+QueueHandle_t configQueue = NULL;
+portMUX_TYPE mux_config = portMUX_INITIALIZER_UNLOCKED;
+uint32_t configIssued = 0;                  // last command id queued, async_tcp
+volatile uint32_t configDone = 0;           // last command id finished, commands run in order
+ConfigResult configResults[configQueueLen * 2]; // finished commands, by id
 bool rebootPending = false;
 unsigned long rebootTime = 0;
 unsigned long ota_progress_millis = 0;
+unsigned long ota_start_millis = 0;
 
 DNSServer dnsServer;
 AsyncWebServer server(80);
@@ -44,14 +63,17 @@ std::map<IPAddress, bool> authorizedClients;
 void onOTAStart() {
   // Log when OTA has started
   Serial.println("OTA update started!");
+  ota_start_millis = millis();
   // <Add your own code here>
 }
 
 void onOTAProgress(size_t current, size_t final) {
-  // Log every 1 second
+  // Log every 1 second, with the average rate since the start
   if (millis() - ota_progress_millis > 1000) {
     ota_progress_millis = millis();
-    Serial.printf("OTA Progress Current: %u bytes, Final: %u bytes\n", current, final);
+    unsigned long elapsed = ota_progress_millis - ota_start_millis;
+    Serial.printf("OTA Progress Current: %u bytes, Final: %u bytes, %u bytes/s\n",
+      current, final, elapsed ? (unsigned int)((uint64_t) current * 1000 / elapsed) : 0);
   }
 }
 
@@ -103,6 +125,7 @@ void scheduleReboot(unsigned long delayMs) {
 void handleReboot() {
   if (rebootPending && (long)(millis() - rebootTime) > 0) {
     rebootPending = false;
+    configStore.flush(true);
     dnsServer.stop();
     server.end();
     authorizedClients.clear();
@@ -131,45 +154,130 @@ String getContentType(String filename) {
   return "text/plain";
 }
 
-// write data -> into configJson bidirectional transport JSON string processed by HTML client
+// /config.json sections, each with the version it last changed in
+// the live levels are not a section, they change at 50 Hz: SSE and /level.json
+const uint8_t SEC_CALIBRATION  = 0;
+const uint8_t SEC_MODE         = 1; // one section per Mode
+const uint8_t SEC_CURRENT_MODE = SEC_MODE + MODE_COUNT;
+const uint8_t SEC_WIFI         = SEC_CURRENT_MODE + 1;
+const uint8_t SEC_COUNT        = SEC_WIFI + 1;
+
+SemaphoreHandle_t configJsonLock = NULL;    // below, refreshed by the WiFi task only, read by async_tcp
+uint32_t configVersion = 0;                 // bumped on every section change
+uint32_t configSectionVersion[SEC_COUNT];
+uint32_t configSectionSig[SEC_COUNT];
+String configSectionJson[SEC_COUNT];        // serialized "key":{...} fragment
+String configCache;                         // full /config.json of configVersion
+
+// FNV-1a, start with h = FNV_OFFSET
+const uint32_t FNV_OFFSET = 2166136261UL;
+uint32_t fnv1a(const void* data, size_t len, uint32_t h) {
+  const uint8_t* p = (const uint8_t*) data;
+  while (len--) {
+    h ^= *p++;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+// cheap fingerprint of the values a section is built from
+uint32_t configSignature(uint8_t sec) {
+  if (sec == SEC_CALIBRATION) {
+    int8_t v[5] = { calib_vl, calib_vr, calib_hl, calib_hr, (int8_t) duty };
+    return fnv1a(v, sizeof(v), FNV_OFFSET);
+  }
+  if (sec < SEC_CURRENT_MODE) {
+    Mode m = (Mode)(sec - SEC_MODE);
+    int8_t v[3] = { (int8_t) configStore.hasOffsets(m), configStore.getOffset(m, AXLE_NV), configStore.getOffset(m, AXLE_NH) };
+    if (m == mode) {
+      v[0] = 2;
+      v[1] = offset_nv;
+      v[2] = offset_nh;
+    }
+    return fnv1a(v, sizeof(v), FNV_OFFSET);
+  }
+  if (sec == SEC_CURRENT_MODE) {
+    return fnv1a(&mode, sizeof(mode), FNV_OFFSET);
+  }
+  uint32_t h = fnv1a(hash.c_str(), hash.length() + 1, FNV_OFFSET);
+  h = fnv1a(seed.c_str(), seed.length() + 1, h);
+  return fnv1a(salt.c_str(), salt.length() + 1, h);
+}
+
+// serialize one section as "key":value, empty if not present
+String configSection(uint8_t sec) {
+  JsonDocument doc;
+  if (sec == SEC_CALIBRATION) {
+    JsonObject calibration = doc["calibration"].to<JsonObject>();
+    calibration["calib_vl"] = calib_vl;
+    calibration["calib_vr"] = calib_vr;
+    calibration["calib_hl"] = calib_hl;
+    calibration["calib_hr"] = calib_hr;
+    calibration["duty"]     = duty;
+  } else if (sec < SEC_CURRENT_MODE) {
+    Mode m = (Mode)(sec - SEC_MODE);
+    if (m == mode) {
+      JsonObject modeObj = doc[modeNames[m]].to<JsonObject>();
+      modeObj["offset_nv"] = offset_nv;
+      modeObj["offset_nh"] = offset_nh;
+    } else if (configStore.hasOffsets(m)) {
+      JsonObject modeObj = doc[modeNames[m]].to<JsonObject>();
+      modeObj["offset_nv"] = configStore.getOffset(m, AXLE_NV);
+      modeObj["offset_nh"] = configStore.getOffset(m, AXLE_NH);
+    }
+  } else if (sec == SEC_CURRENT_MODE) {
+    doc["current_mode"] = modeNames[mode];
+  } else {
+    JsonObject w = doc["wifi"].to<JsonObject>();
+    w["hash"].set(hash);
+    w["seed"].set(seed);
+    w["salt"].set(salt);
+  }
+  String json;
+  serializeJson(doc, json);
+  // strip the enclosing braces
+  return json.length() > 2 ? json.substring(1, json.length() - 1) : String();
+}
+
+// sections changed after version since, all sections for since 0
+String configJsonSince(uint32_t since) {
+  String json = "{\"version\":";
+  json += configVersion;
+  for (uint8_t sec = 0; sec < SEC_COUNT; sec++) {
+    if (configSectionVersion[sec] <= since || !configSectionJson[sec].length()) continue;
+    json += ',';
+    json += configSectionJson[sec];
+  }
+  json += '}';
+  return json;
+}
+
+// refresh the cached /config.json, only changed sections are serialized again, WiFi task
 void updateJson() {
-  DynamicJsonDocument doc(1024);
-  DeserializationError err = deserializeJson(doc, configJson);
-  if (err) {
-    Serial.print("Cannot deserialize the current JSON object: ");
-    Serial.println(err.c_str());
-    doc.to<JsonObject>();
+  xSemaphoreTake(configJsonLock, portMAX_DELAY);
+  bool changed = false;
+  for (uint8_t sec = 0; sec < SEC_COUNT; sec++) {
+    uint32_t sig = configSignature(sec);
+    if (configSectionVersion[sec] && sig == configSectionSig[sec]) continue;
+    if (!changed) configVersion++;
+    changed = true;
+    configSectionSig[sec] = sig;
+    configSectionVersion[sec] = configVersion;
+    configSectionJson[sec] = configSection(sec);
   }
-  JsonObject calibration = doc.containsKey("calibration") ? doc["calibration"].as<JsonObject>() : doc.createNestedObject("calibration");
-  calibration["calib_vl"] = calib_vl;
-  calibration["calib_vr"] = calib_vr;
-  calibration["calib_hl"] = calib_hl;
-  calibration["calib_hr"] = calib_hr;
-  calibration["duty"]     = duty;
-  JsonObject modeObj = doc.containsKey(mode) ? doc[mode].as<JsonObject>() : doc.createNestedObject(mode);
-  modeObj["offset_nv"] = offset_nv;
-  modeObj["offset_nh"] = offset_nh;
-  doc["current_mode"] = mode;
-  JsonObject level = doc.containsKey("level") ? doc["level"].as<JsonObject>() : doc.createNestedObject("level");
-  level["fzgn_vl"] = FS_340h.FZGN_VL;
-  level["fzgn_vr"] = FS_340h.FZGN_VR;
-  level["fzgn_hl"] = FS_340h.FZGN_HL;
-  level["fzgn_hr"] = FS_340h.FZGN_HR;
-  JsonObject w = doc.containsKey("wifi") ? doc["wifi"].as<JsonObject>() : doc.createNestedObject("wifi");
-  w["hash"].set(hash);
-  w["seed"].set(seed);
-  w["salt"].set(salt);
-  serializeJson(doc, configJson);
+  if (changed) configCache = configJsonSince(0);
+  xSemaphoreGive(configJsonLock);
 }
 
-// read data <- from configJson bidirectional transport JSON string processed by HTML client
-void readJson() {
+// read data <- from the JSON body of a command, empty body: nothing to apply
+bool readJson(const String& json) {
+  if (!json.length()) return true;
   DynamicJsonDocument doc(1024);
-  DeserializationError err = deserializeJson(doc, configJson);
+  DeserializationError err = deserializeJson(doc, json);
   if (err) {
     Serial.print("Cannot deserialize the current JSON object: ");
     Serial.println(err.c_str());
-    return;
+    return false;
   }
   if (doc.containsKey("calibration")) {
     JsonObject c = doc["calibration"];
@@ -178,8 +286,8 @@ void readJson() {
     if (c.containsKey("calib_hl")) calib_hl = c["calib_hl"];
     if (c.containsKey("calib_hr")) calib_hr = c["calib_hr"];
   }
-  if (doc.containsKey(mode)) {
-    JsonObject m = doc[mode];
+  if (doc.containsKey(modeNames[mode])) {
+    JsonObject m = doc[modeNames[mode]];
     if (m.containsKey("offset_nv")) offset_nv = m["offset_nv"];
     if (m.containsKey("offset_nh")) offset_nh = m["offset_nh"];
   }
@@ -191,58 +299,129 @@ void readJson() {
   }
   limitOffset(&offset_nv);
   limitOffset(&offset_nh);
+  return true;
 }
 
-// handle HTTP_POST actions
-void webConfig() {
-  // initial loading of configJson bidirectional transport JSON string
-  if (update == 1) {
-    getCalibration();
-    updateJson();
-    update = 0;
-  }
-  // save PWM Voltage Calibration to LittleFS
-  else if (update == 2) {
-    readJson();
-    updateCalibration("calib_vl", calib_vl);
-    updateCalibration("calib_vr", calib_vr);
-    updateCalibration("calib_hl", calib_hl);
-    updateCalibration("calib_hr", calib_hr);
-    update = 0;
-  }
-  // receive axle level custom offset from HTML
-  else if (update == 3) {
-    readJson();
-    update = 0;
-  }
-  // save axle level custom offset to LittleFS
-  else if (update == 4) {
-    readJson();
-    updateSettings(mode, "offset_nv", offset_nv);
-    updateSettings(mode, "offset_nh", offset_nh);
-    update = 0;
-  }
-  // send wifi credentials
-  else if (update == 5) {
-    readJson();
-    cryptUpdateWifi();
-    updateJson();
-    update = 0;
+// run one POST /config command in the WiFi task, the client polls for the result
+void runConfigCommand(ConfigCmd& cmd) {
+  cmd.status = 200;
+  cmd.result = "OK";
+  if (!readJson(cmd.body)) {
+    cmd.status = 400;
+    cmd.result = "invalid JSON";
+    return;
   }
-  // receive wifi credentials
-  else if (update == 6) {
-    readJson();
-    if(cryptGetWifi()) {
+  switch (cmd.type) {
+    case CMD_RELOAD:
+      getCalibration();
+      updateJson();
+      break;
+    // save PWM Voltage Calibration to LittleFS
+    case CMD_CALIBRATION_SAVE:
+      updateCalibration(CALIB_VL, calib_vl);
+      updateCalibration(CALIB_VR, calib_vr);
+      updateCalibration(CALIB_HL, calib_hl);
+      updateCalibration(CALIB_HR, calib_hr);
+      break;
+    // axle level custom offset from HTML, applied by loop()
+    case CMD_OFFSET_PREVIEW:
+      break;
+    // save axle level custom offset to LittleFS
+    case CMD_OFFSET_SAVE:
+      updateSettings(mode, AXLE_NV, offset_nv);
+      updateSettings(mode, AXLE_NH, offset_nh);
+      break;
+    // send wifi credentials
+    case CMD_WIFI_EXCHANGE:
+      cryptUpdateWifi();
+      updateJson();
+      if (!hash.length()) {
+        cmd.status = 403;
+        cmd.result = "key exchange failed";
+      }
+      break;
+    // receive wifi credentials
+    case CMD_WIFI_CONFIRM:
+      if (!cryptGetWifi()) {
+        cmd.status = 403;
+        cmd.result = "handshake failed";
+        break;
+      }
       updateJson();
       updateWifi(hash, seed);
+      configStore.flush(true);
       scheduleReboot(5000);
-    }
-    update = 0;
+      break;
+    // closed loop gain trim off / on
+    case CMD_LEVEL_OPEN:
+    case CMD_LEVEL_CLOSED:
+      levelClosedLoop = cmd.type == CMD_LEVEL_CLOSED;
+      break;
+    case CMD_LEVEL_CALIBRATE:
+      levelCalRequest = true;
+      break;
   }
 }
 
+// keep the result for GET /config/result, the oldest one is overwritten
+void finishConfigCommand(ConfigCmd* cmd) {
+  portENTER_CRITICAL(&mux_config);
+  ConfigResult& r = configResults[cmd->id % (sizeof(configResults) / sizeof(configResults[0]))];
+  r.id = cmd->id;
+  r.status = cmd->status;
+  r.result = cmd->result;
+  configDone = cmd->id;
+  portEXIT_CRITICAL(&mux_config);
+  delete cmd;
+}
+
+// queue a command and reply 202 with its id at once, async_tcp never waits for the WiFi task
+void sendConfigCommand(AsyncWebServerRequest *request, uint8_t type) {
+  ConfigCmd* cmd = new ConfigCmd();
+  cmd->id = configIssued + 1;
+  cmd->type = type;
+  if (request->_tempObject) cmd->body = (const char*) request->_tempObject;
+  if (xQueueSend(configQueue, &cmd, 0) != pdTRUE) {
+    delete cmd;
+    request->send(503, "text/plain", "busy");
+    return;
+  }
+  configIssued = cmd->id; // cmd may be gone already
+  char buf[24];
+  snprintf(buf, sizeof(buf), "{\"id\":%u}", (unsigned int) configIssued);
+  AsyncWebServerResponse *response = request->beginResponse(202, "application/json", buf);
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+// result of a queued command: 202 while it is queued or running, 410 once overwritten
+void sendConfigResult(AsyncWebServerRequest *request) {
+  uint32_t id = request->hasParam("id") ? request->getParam("id")->value().toInt() : 0;
+  int status = 410;
+  const char* result = "expired";
+  portENTER_CRITICAL(&mux_config);
+  const ConfigResult& r = configResults[id % (sizeof(configResults) / sizeof(configResults[0]))];
+  if (id && r.id == id) {
+    status = r.status;
+    result = r.result;
+  } else if (id > configDone && id <= configIssued) {
+    status = 202;
+    result = "pending";
+  }
+  portEXIT_CRITICAL(&mux_config);
+  if (!id || id > configIssued) {
+    status = 404;
+    result = "unknown command id";
+  }
+  AsyncWebServerResponse *response = request->beginResponse(status, "text/plain", result);
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
 void wifiSetup() {
   WiFi.persistent(false);
+  configQueue = xQueueCreate(configQueueLen, sizeof(ConfigCmd*));
+  configJsonLock = xSemaphoreCreateMutex();
 
   // read wifi credentials from LittleFS
   getWifi(hash, seed);
@@ -269,6 +448,9 @@ void wifiSetup() {
   // fake DNS server
   dnsServer.start(53, "*", WiFi.softAPIP());
 
+  // key pairs for the wifi settings handshake
+  startKeygen();
+
   // redirect captive portal detection endpoints
   // *** wikipedia.org/wiki/Captive_portal ***
   {
@@ -346,7 +528,7 @@ void wifiSetup() {
         return;
       }
       // normal index for other hosts/clients
-      req->send(LittleFS, "/index.html", "text/html");
+      if (!sendAsset(req, "/index.html")) req->send(LittleFS, "/index.html", "text/html");
     });
   }
 
@@ -358,54 +540,130 @@ void wifiSetup() {
 
   // wifi settings
   server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *req){
-    req->send(LittleFS, "/settings.html", "text/html");
+    if (!sendAsset(req, "/settings.html")) req->send(LittleFS, "/settings.html", "text/html");
   });
 
-  // generate RSA 2048-bit private.pem + public.pem key pair files
+  // RSA 2048-bit public key, generated in the background on first boot
   server.on(pubKeyFile, HTTP_GET, [](AsyncWebServerRequest *request) {
-    generateKeys();
+    if (keygenState() != KEYS_READY) {
+      AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "generating RSA key pair");
+      response->addHeader("Retry-After", "2");
+      request->send(response);
+      return;
+    }
     request->send(LittleFS, pubKeyFile, "application/x-pem-file");
   });
 
+  // ECDH P-256 public point (hex) for the fast handshake
+  server.on("/ecdh.key", HTTP_GET, [](AsyncWebServerRequest *request) {
+    String hex;
+    if (!cryptoSession.ecdhPublicKey(hex)) {
+      AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "generating ECDH key pair");
+      response->addHeader("Retry-After", "1");
+      request->send(response);
+      return;
+    }
+    request->send(200, "text/plain", hex);
+  });
+
+  // key generation status
+  server.on("/keys", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const char* states[] = { "none", "generating", "ready", "failed" };
+    char buf[96];
+    snprintf(buf, sizeof(buf), "{\"rsa\":\"%s\",\"elapsed\":%u,\"ecdh\":%s}",
+      states[keygenState()], keygenElapsed(), cryptoSession.ecdhAvailable() ? "true" : "false");
+    request->send(200, "application/json", buf);
+  });
+
+  // result of a command, before "/config": a handler also takes the URLs below its own
+  server.on("/config/result", HTTP_GET, sendConfigResult);
+
   server.on("/config", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send(LittleFS, "/config.html", "text/html");
+    if (otaFsBusy()) request->send(503, "text/plain", "LittleFS image upload");
+    else if (!sendAsset(request, "/config.html")) request->send(LittleFS, "/config.html", "text/html");
   });
 
-  // receive instructions (update flag)
+  // commands (?update=N), each request is answered with the id of its own command
   server.on(
     "/config",
     HTTP_POST,
     [](AsyncWebServerRequest *request) {
-      if (request->hasParam("update", false)) {
-        String updateParam = request->getParam("update", false)->value();
-        update = updateParam.toInt();
+      uint8_t type = request->hasParam("update", false) ? request->getParam("update", false)->value().toInt() : 0;
+      if (!type || type >= CMD_COUNT) {
+        request->send(400, "text/plain", "unknown command");
+      } else if (request->contentLength() > configBodyMax) {
+        request->send(413, "text/plain", "body too large");
+      } else {
+        sendConfigCommand(request, type);
       }
-      request->send(200, "text/plain", "OK");
     },
     NULL,
     [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-      if (len > 0) {
-        configJson = String((char*)data, len);
-      }
-      if (request->hasParam("update", false)) {
-        String updateParam = request->getParam("update", false)->value();
-        update = updateParam.toInt();
-      }
+      // collect the chunks, freed with the request
+      if (total > configBodyMax) return;
+      if (index == 0) request->_tempObject = calloc(total + 1, 1);
+      if (request->_tempObject && index + len <= total) memcpy((uint8_t*) request->_tempObject + index, data, len);
     }
   );
 
-  // bidirectional transport JSON string processed by HTML client
+  // versioned JSON processed by HTML client: ETag = version, ?since=version returns changed sections only
+  // the WiFi task keeps it current (100 ms), the request only copies it
   server.on(config, HTTP_GET, [](AsyncWebServerRequest *request){
-    updateJson();
-    request->send(200, "application/json", configJson);
+    char etag[16];
+    String body;
+    bool match;
+    xSemaphoreTake(configJsonLock, portMAX_DELAY);
+    snprintf(etag, sizeof(etag), "\"%u\"", configVersion);
+    match = request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag;
+    if (!match) body = request->hasParam("since") ? configJsonSince(request->getParam("since")->value().toInt()) : configCache;
+    xSemaphoreGive(configJsonLock);
+    AsyncWebServerResponse *response = match ? request->beginResponse(304) : request->beginResponse(200, "application/json", body);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+  });
+
+  // live levels for clients without SSE, same keys as the telemetry events
+  server.on("/level.json", HTTP_GET, [](AsyncWebServerRequest *request){
+    FS_340h_t fs = FS_340h.read();
+    char buf[96];
+    snprintf(buf, sizeof(buf), "{\"level\":{\"fzgn_vl\":%u,\"fzgn_vr\":%u,\"fzgn_hl\":%u,\"fzgn_hr\":%u}}",
+      w211::FS_340h::FZGN_VL(fs.data), w211::FS_340h::FZGN_VR(fs.data), w211::FS_340h::FZGN_HL(fs.data), w211::FS_340h::FZGN_HR(fs.data));
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", buf);
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
   });
 
+  // CAN replay benchmark
+  replaySetup();
+
+  // CAN trace recorder
+  traceSetup();
+
+  // live telemetry push
+  telemetrySetup();
+
+  // level feedback status and calibration
+  levelSetup();
+
+  // Prometheus metrics
+  metricsSetup();
+
+  // compressed, resumable firmware and LittleFS upload
+  otaSetup();
+
   // captive portal
   server.addHandler(new CaptiveRequestHandler()).setFilter(ON_AP_FILTER);
 
-  // file server
+  // file server, precompressed assets from the manifest first
+  assetsSetup();
   server.onNotFound([](AsyncWebServerRequest* request) {
     String path = request->url();
+    if (otaFsBusy()) {
+      request->send(503, "text/plain", "LittleFS image upload");
+      return;
+    }
+    if (sendAsset(request, path.c_str())) return;
     if (LittleFS.exists(path)) {
       String contentType = getContentType(path);
       AsyncWebServerResponse* response = request->beginResponse(LittleFS, path, contentType);
@@ -434,6 +692,9 @@ void wifiEvent(void *parameter) {
   static unsigned long wifi_up = 0;
   static unsigned long time = 0;
   static bool wifi = true;
+  // initial loading of /config.json
+  getCalibration();
+  updateJson();
   while (true) {
     if (millis() - time > 5000) {
       time = millis();
@@ -447,7 +708,9 @@ void wifiEvent(void *parameter) {
       if (wifi && (time - wifi_up > wifi_down )) {
         wifi = false;
         wifiConnected = false;
+        wifiActive = false;
         Serial.println("HTTP server stop");
+        otaPoll(true);               // LittleFS back for an unfinished image
         dnsServer.stop();            // stop DNS redirection
         server.end();                // stop HTTP server
         authorizedClients.clear();   // reset client list
@@ -458,10 +721,17 @@ void wifiEvent(void *parameter) {
     }
     if (wifi) {
       ElegantOTA.loop();
-      webConfig();
+      otaPoll(false);
       handleReboot();
       dnsServer.processNextRequest();
     }
-    delay(100);
+    // POST /config commands run as soon as they are queued
+    ConfigCmd* cmd;
+    if (xQueueReceive(configQueue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE) {
+      runConfigCommand(*cmd);
+      finishConfigCommand(cmd);
+    }
+    // /config.json follows loop() and the commands
+    if (wifi) updateJson();
   }
 }
@@ -0,0 +1,146 @@
+/*                                                                          *
+ * MCP2515 receive driver                                                   *
+ *                                                                          */
+#include "can_driver.h"
+
+// SPI instructions
+#define MCP_READ         0x03
+#define MCP_BITMOD       0x05
+#define MCP_READ_STATUS  0xA0
+#define MCP_READ_RX0     0x90 // READ RX BUFFER from RXB0SIDH, RXB1SIDH = 0x94
+
+// registers
+#define MCP_CANINTF      0x2C // EFLG follows at 0x2D
+#define MCP_EFLG         0x2D
+#define MCP_RXB0CTRL     0x60
+
+#define MCP_RXB0CTRL_BUKT 0x04
+#define MCP_SIDL_IDE      0x08
+#define MCP_SIDL_SRR      0x10 // standard remote frame
+#define MCP_DLC_RTR       0x40 // extended remote frame
+#define MCP_STAT_RXIF     0x03 // READ STATUS: RX0IF | RX1IF
+
+static const SPISettings canSpiSettings(CAN_SPI_CLOCK, MSBFIRST, SPI_MODE0);
+
+
+// shared SPI bus, the waiting controller goes next
+static SemaphoreHandle_t canSpiMutex = nullptr;
+static std::atomic<bool> canSpiWaiting[CAN_BUSES];
+
+static void canSpiLock(CanBus bus) {
+  canSpiWaiting[bus].store(true, std::memory_order_relaxed);
+  xSemaphoreTake(canSpiMutex, portMAX_DELAY);
+  canSpiWaiting[bus].store(false, std::memory_order_relaxed);
+}
+
+static void canSpiUnlock(CanBus bus) {
+  CanBus other = bus == CAN_C ? CAN_B : CAN_C;
+  bool handover = canSpiWaiting[other].load(std::memory_order_relaxed);
+  xSemaphoreGive(canSpiMutex);
+  // the CAN tasks run on different cores: wait (bounded) until the other one took the bus
+  uint32_t start = (uint32_t) esp_timer_get_time();
+  while (handover && canSpiWaiting[other].load(std::memory_order_relaxed) && (uint32_t) esp_timer_get_time() - start < 50) {
+  }
+}
+
+
+void CanDriver::begin() {
+  if (!canSpiMutex) canSpiMutex = xSemaphoreCreateMutex();
+  spi.beginTransaction(canSpiSettings);
+  digitalWrite(cs, LOW);
+  transfer(MCP_BITMOD);
+  transfer(MCP_RXB0CTRL);
+  transfer(MCP_RXB0CTRL_BUKT);
+  transfer(MCP_RXB0CTRL_BUKT);
+  digitalWrite(cs, HIGH);
+  spi.endTransaction();
+}
+
+// READ RX BUFFER n: header and dlc data bytes in one CS cycle, CS high clears RXnIF, returns SPI bytes
+uint8_t CanDriver::readRxBuffer(uint8_t n, struct can_frame& frame) {
+  uint8_t h[5];
+  digitalWrite(cs, LOW);
+  transfer(MCP_READ_RX0 | (n << 2));
+  for (uint8_t i = 0; i < 5; i++) {
+    h[i] = transfer(0x00);
+  }
+  uint8_t dlc = h[4] & 0x0F;
+  if (dlc > CAN_MAX_DLEN) dlc = CAN_MAX_DLEN;
+  for (uint8_t i = 0; i < dlc; i++) {
+    frame.data[i] = transfer(0x00);
+  }
+  digitalWrite(cs, HIGH);
+
+  uint32_t id = ((uint32_t) h[0] << 3) | (h[1] >> 5);
+  bool rtr;
+  if (h[1] & MCP_SIDL_IDE) {
+    id = (id << 18) | ((uint32_t)(h[1] & 0x03) << 16) | ((uint32_t) h[2] << 8) | h[3];
+    id |= CAN_EFF_FLAG;
+    rtr = h[4] & MCP_DLC_RTR;
+  } else {
+    rtr = h[1] & MCP_SIDL_SRR;
+  }
+  if (rtr) id |= CAN_RTR_FLAG;
+  frame.can_id = id;
+  frame.can_dlc = dlc;
+  return 6 + dlc;
+}
+
+void CanDriver::poll(CanPoll& result, bool checkErrors) {
+  result.count = 0;
+  result.intf = 0;
+  result.eflg = 0;
+
+  canSpiLock(bus);
+  spi.beginTransaction(canSpiSettings);
+
+  digitalWrite(cs, LOW);
+  transfer(MCP_READ_STATUS);
+  uint8_t status = transfer(0x00);
+  digitalWrite(cs, HIGH);
+  result.bytes = 2;
+
+  // oldest first: RXB0, unless RXB1 took a frame during the last RXB0 read
+  if ((status & MCP_STAT_RXIF) == MCP_STAT_RXIF && rolled) {
+    result.bytes += readRxBuffer(1, result.frame[result.count++]);
+    result.bytes += readRxBuffer(0, result.frame[result.count++]);
+  } else {
+    if (status & 0x01) result.bytes += readRxBuffer(0, result.frame[result.count++]);
+    if (status & 0x02) result.bytes += readRxBuffer(1, result.frame[result.count++]);
+  }
+  rolled = (status & MCP_STAT_RXIF) == 0x01;
+
+  if (!(status & MCP_STAT_RXIF) && checkErrors) {
+    digitalWrite(cs, LOW);
+    transfer(MCP_READ);
+    transfer(MCP_CANINTF);
+    uint8_t intf = transfer(0x00);
+    uint8_t eflg = transfer(0x00);
+    digitalWrite(cs, HIGH);
+    result.bytes += 4;
+    result.intf = intf & (MCP2515::CANINTF_ERRIF | MCP2515::CANINTF_MERRF);
+    result.eflg = eflg;
+    // clear only the error bits, a frame arriving now keeps its RXnIF
+    if (eflg & (MCP2515::EFLG_RX0OVR | MCP2515::EFLG_RX1OVR)) {
+      digitalWrite(cs, LOW);
+      transfer(MCP_BITMOD);
+      transfer(MCP_EFLG);
+      transfer(MCP2515::EFLG_RX0OVR | MCP2515::EFLG_RX1OVR);
+      transfer(0x00);
+      digitalWrite(cs, HIGH);
+      result.bytes += 4;
+    }
+    if (result.intf) {
+      digitalWrite(cs, LOW);
+      transfer(MCP_BITMOD);
+      transfer(MCP_CANINTF);
+      transfer(result.intf);
+      transfer(0x00);
+      digitalWrite(cs, HIGH);
+      result.bytes += 4;
+    }
+  }
+
+  spi.endTransaction();
+  canSpiUnlock(bus);
+}
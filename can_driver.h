@@ -0,0 +1,61 @@
+/*                                                                          *
+ * MCP2515 receive driver                                                   *
+ *                                                                          *
+ * Receive path on the shared VSPI bus without the per-register accesses    *
+ * of the MCP2515 library, which stays in use for reset, bit rate, filters  *
+ * and mode. One drain step is one SPI transaction:                         *
+ *                                                                          *
+ *   READ STATUS           2 bytes   RX0IF / RX1IF                          *
+ *   READ RX BUFFER n  6 + dlc bytes SIDH..DLC, D0..; CS high clears RXnIF  *
+ *   READ CANINTF, EFLG    4 bytes   only if INT is low without RX flags    *
+ *                                                                          *
+ * RXB0 rolls over into RXB1 (BUKT). Both controllers share one arbiter, a  *
+ * bus waiting for the SPI gets it before the other one can take it again.  *
+ *                                                                          *
+ * Frame order: RXB1 normally holds the newer frame. A frame that rolled    *
+ * into RXB1 while RXB0 was being read is older than one RXB0 receives      *
+ * after it. Steps of one drain follow each other faster than two frames,   *
+ * so both flags after a step that saw RX0IF alone mean RXB1 first.         *
+ *                                                                          */
+#ifndef CAN_DRIVER_H
+#define CAN_DRIVER_H
+
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <atomic>
+#include <mcp2515.h>
+#include "can_registry.h"
+
+// MCP2515 maximum SPI clock
+#define CAN_SPI_CLOCK 10000000 // Hz
+
+// result of one drain step
+struct CanPoll {
+  uint8_t count;               // frames read, oldest first
+  struct can_frame frame[2];
+  uint8_t intf;                // CANINTF error bits (ERRIF, MERRF), 0 if not read
+  uint8_t eflg;                // EFLG at the time of the error
+  uint8_t bytes;               // SPI bytes of this step
+};
+
+
+class CanDriver {
+  private:
+    CanBus bus;
+    uint8_t cs;
+    SPIClass& spi;
+    bool rolled = false; // the last step read RXB0 alone, a frame may have rolled into RXB1 meanwhile
+    uint8_t readRxBuffer(uint8_t n, struct can_frame& frame);
+    uint8_t transfer(uint8_t b) { return spi.transfer(b); }
+  public:
+    CanDriver(CanBus bus, uint8_t cs, SPIClass& spi = SPI) : bus(bus), cs(cs), spi(spi) {}
+
+    // after MCP2515::reset(): RXB0 -> RXB1 rollover, call before the CAN tasks start
+    void begin();
+
+    // READ STATUS, read the full buffers, errors only if checkErrors and no frame pending
+    void poll(CanPoll& result, bool checkErrors);
+};
+
+#endif /* CAN_DRIVER_H */
@@ -0,0 +1,116 @@
+/*                                                                          *
+ * CAN message freshness                                                    *
+ *                                                                          */
+#include "can_freshness.h"
+
+static const char* const busNames[CAN_BUSES] = { "can_c", "can_b" };
+
+
+// data frame without stuff bits: SOF to IFS 47 bits (extended 67) + data
+uint32_t CanFreshness::frameBits(uint32_t id, uint8_t dlc) {
+  if (dlc > CAN_MAX_DLEN) dlc = CAN_MAX_DLEN;
+  return (id & CAN_EFF_FLAG ? 67 : 47) + 8 * dlc;
+}
+
+void CanFreshness::frame(uint8_t bus, uint8_t index, uint32_t id, uint8_t dlc, uint32_t time) {
+  if (bus >= CAN_BUSES) return;
+  Bus& b = buses[bus];
+  b.frames = b.frames + 1;
+  b.bits = b.bits + frameBits(id, dlc);
+  if (index >= CAN_MSG_COUNT) return;
+
+  Msg& m = msgs[index];
+  if (m.count) {
+    uint32_t dt = time - m.last;
+    // gaps past the deadline are dropouts, counted by check(), not jitter
+    if (canMessages[index].period ? dt <= deadline(index) : dt < (1UL << 27)) {
+      int32_t sample = (int32_t)(dt << 4);
+      if (!m.interval) {
+        m.interval = sample;
+      } else {
+        int32_t mean = m.interval;
+        int32_t dev = sample - mean;
+        m.interval = mean + dev / 16;
+        int32_t jitter = m.jitter;
+        m.jitter = jitter + ((dev < 0 ? -dev : dev) - jitter) / 16;
+      }
+    }
+  }
+  m.last = time;
+  m.count = m.count + 1;
+}
+
+uint32_t CanFreshness::check(uint32_t now) {
+  uint32_t mask = 0;
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    Msg& m = msgs[i];
+    if (!canMessages[i].period) {
+      m.stale = false;
+      continue;
+    }
+    uint32_t count = m.count;
+    int32_t silence = (int32_t)(now - m.last); // < 0: frame after now was read
+    bool stale = !count || silence > (int32_t) deadline(i);
+    if (stale && !m.stale) {
+      m.misses++;
+      uint32_t late = count ? silence - deadline(i) : 0;
+      if (late > m.lateMax) m.lateMax = late;
+    }
+    m.stale = stale;
+    if (stale) mask |= 1UL << i;
+  }
+  staleMask = mask;
+
+  for (uint8_t bus = 0; bus < CAN_BUSES; bus++) {
+    Bus& b = buses[bus];
+    uint32_t span = now - b.windowStart;
+    if (span < CAN_LOAD_WINDOW * 1000UL) continue;
+    uint32_t frames = b.frames;
+    uint32_t bits = b.bits;
+    if (b.windowStart) {
+      b.rate = (uint64_t)(frames - b.windowFrames) * 1000000 / span;
+      uint64_t load = (uint64_t)(bits - b.windowBits) * 1000000 * 10000 / span / canBitrate[bus];
+      b.load = load < 10000 ? load : 10000;
+      if (b.load > b.loadPeak) b.loadPeak = b.load;
+    }
+    b.windowStart = now ? now : 1;
+    b.windowFrames = frames;
+    b.windowBits = bits;
+  }
+  return mask;
+}
+
+void CanFreshness::write(Print& out) {
+  struct { const char* name; const char* help; const char* type; } msgMetrics[] = {
+    { "airmatic_can_interval_us", "mean time between two frames", "gauge" },
+    { "airmatic_can_jitter_us", "mean deviation of the time between two frames", "gauge" },
+    { "airmatic_can_deadline_us", "silence until a message is stale, 0 = event driven", "gauge" },
+    { "airmatic_can_stale", "no frame within the deadline", "gauge" },
+    { "airmatic_can_deadline_miss_total", "messages turned stale", "counter" },
+    { "airmatic_can_stale_late_max_us", "longest stale detection past the deadline", "gauge" },
+  };
+  for (uint8_t k = 0; k < sizeof(msgMetrics) / sizeof(msgMetrics[0]); k++) {
+    out.printf("# HELP %s %s\n# TYPE %s %s\n", msgMetrics[k].name, msgMetrics[k].help, msgMetrics[k].name, msgMetrics[k].type);
+    for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+      uint32_t value[] = { interval(i), jitter(i), deadline(i), (staleMask >> i) & 1, misses(i), lateMax(i) };
+      out.printf("%s{bus=\"%s\",id=\"0x%03X\",name=\"%s\"} %u\n", msgMetrics[k].name,
+        busNames[canMessages[i].bus], canMessages[i].id, canMessages[i].name, value[k]);
+    }
+  }
+
+  out.print("# HELP airmatic_can_bus_frames_per_second frames passing the MCP2515 filters, last second\n"
+            "# TYPE airmatic_can_bus_frames_per_second gauge\n");
+  for (uint8_t b = 0; b < CAN_BUSES; b++) {
+    out.printf("airmatic_can_bus_frames_per_second{bus=\"%s\"} %u\n", busNames[b], buses[b].rate);
+  }
+  out.print("# HELP airmatic_can_bus_load_ratio bus time of the received frames without stuff bits, last second\n"
+            "# TYPE airmatic_can_bus_load_ratio gauge\n");
+  for (uint8_t b = 0; b < CAN_BUSES; b++) {
+    out.printf("airmatic_can_bus_load_ratio{bus=\"%s\"} %u.%04u\n", busNames[b], buses[b].load / 10000, buses[b].load % 10000);
+  }
+  out.print("# HELP airmatic_can_bus_load_peak_ratio highest one second bus load since boot\n"
+            "# TYPE airmatic_can_bus_load_peak_ratio gauge\n");
+  for (uint8_t b = 0; b < CAN_BUSES; b++) {
+    out.printf("airmatic_can_bus_load_peak_ratio{bus=\"%s\"} %u.%04u\n", busNames[b], buses[b].loadPeak / 10000, buses[b].loadPeak % 10000);
+  }
+}
@@ -0,0 +1,78 @@
+/*                                                                          *
+ * CAN message freshness                                                    *
+ *                                                                          *
+ * Per registered message the reception time of the newest frame, the mean *
+ * inter-arrival time and its jitter (exponential means, 1/16 weight). A    *
+ * message with a period is stale when no frame arrived for                 *
+ * CAN_DEADLINE_PERIODS periods, or none since boot. Per bus the frames and *
+ * bits received give the frame rate and bus load of the last second.      *
+ *                                                                          *
+ * frame() is O(1) and runs in the CAN task for every frame, also the ones  *
+ * dropped by the software filter. check() runs in loop(), O(messages).     *
+ * Each message belongs to one bus, so every counter has a single writer.   *
+ *                                                                          */
+#ifndef CAN_FRESHNESS_H
+#define CAN_FRESHNESS_H
+
+
+#include <Arduino.h>
+#include "can_registry.h"
+
+#define CAN_DEADLINE_PERIODS 5  // missed periods until stale
+#define CAN_LOAD_WINDOW 1000    // ms per frame rate / bus load value
+
+static_assert(CAN_MSG_COUNT <= 32, "stale mask holds 32 messages");
+
+
+class CanFreshness {
+  private:
+    struct Msg {
+      // CAN task
+      volatile uint32_t last = 0;      // us, newest frame
+      volatile uint32_t count = 0;
+      volatile uint32_t interval = 0;  // mean inter-arrival, 1/16 us
+      volatile uint32_t jitter = 0;    // mean deviation from interval, 1/16 us
+      // loop()
+      bool stale = true;
+      uint32_t misses = 0;             // fresh -> stale
+      uint32_t lateMax = 0;            // us past the deadline when detected
+    };
+    struct Bus {
+      // CAN task, since boot
+      volatile uint32_t frames = 0;
+      volatile uint32_t bits = 0;
+      // loop(), last window
+      uint32_t windowStart = 0;        // us
+      uint32_t windowFrames = 0;
+      uint32_t windowBits = 0;
+      uint32_t rate = 0;               // frames/s
+      uint16_t load = 0;               // 1/10000
+      uint16_t loadPeak = 0;
+    };
+    Msg msgs[CAN_MSG_COUNT];
+    Bus buses[CAN_BUSES];
+    uint32_t staleMask = (1UL << CAN_MSG_COUNT) - 1;
+
+    static uint32_t frameBits(uint32_t id, uint8_t dlc);
+  public:
+    // one received frame, index = canMsgIndex(), time = us of reception
+    void frame(uint8_t bus, uint8_t index, uint32_t id, uint8_t dlc, uint32_t time);
+
+    // deadlines and bus windows, returns the stale messages (bit = registry index)
+    uint32_t check(uint32_t now);
+
+    static uint32_t deadline(uint8_t index) { return (uint32_t) canMessages[index].period * CAN_DEADLINE_PERIODS * 1000; }
+    uint32_t stale() const { return staleMask; }
+    uint32_t misses(uint8_t index) const { return msgs[index].misses; }
+    uint32_t lateMax(uint8_t index) const { return msgs[index].lateMax; }
+    uint32_t interval(uint8_t index) const { return msgs[index].interval >> 4; } // us
+    uint32_t jitter(uint8_t index) const { return msgs[index].jitter >> 4; }     // us
+    uint32_t rate(uint8_t bus) const { return buses[bus].rate; }
+    uint16_t load(uint8_t bus) const { return buses[bus].load; }
+    uint16_t loadPeak(uint8_t bus) const { return buses[bus].loadPeak; }
+
+    // Prometheus text exposition format, appended to /metrics
+    void write(Print& out);
+};
+
+#endif /* CAN_FRESHNESS_H */
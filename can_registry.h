@@ -0,0 +1,232 @@
+/*                                                                          *
+ * CAN message registry                                                     *
+ *                                                                          *
+ * One list of (bus, ID, payload struct, period) generates the message      *
+ * table, the O(1) ID dispatch and the MCP2515 acceptance masks and filters *
+ *                                                                          */
+#ifndef CAN_REGISTRY_H
+#define CAN_REGISTRY_H
+
+
+#include <Arduino.h>
+#include <mcp2515.h>
+#include "w211_can_c.h"
+#include "w211_can_b.h"
+
+enum CanBus : uint8_t {
+  CAN_C = 0, // Motor CAN-C High speed
+  CAN_B = 1, // Interior CAN-B Low speed
+  CAN_BUSES
+};
+
+// bit rate per bus, see setup()
+inline constexpr uint32_t canBitrate[CAN_BUSES] = { 500000, 83333 };
+
+// X(bus, ID, NAME, PERIOD) / payload struct is NAME_t, snapshot is NAME, signals are w211::NAME
+// PERIOD = expected ms between two frames, 0 = event driven, no deadline (see can_freshness.h)
+#define CAN_MESSAGES(X) \
+  X(CAN_C, 0x0240, EZS_240h, 100) /* ECU: EZS, NAME: EZS_240h, ID: 0x0240, MSG COUNT: 31 */ \
+  X(CAN_C, 0x0340, FS_340h, 20)   /* ECU: LF_ABC, NAME: FS_340h, ID: 0x0340, MSG COUNT: 16 */ \
+  X(CAN_B, 0x01CA, KOMBI_A5, 200) /* ECU: KOMBI, NAME: KOMBI_A5, ID: 0x01CA, MSG COUNT: 25 */ \
+  X(CAN_B, 0x001A, UBF_A1, 200)   /* ECU: UBF, NAME: UBF_A1, ID: 0x001A, MSG COUNT: 9 */
+
+// message index
+#define CAN_MSG_INDEX(bus, id, name, period) MSG_##name,
+enum CanMsgIndex : uint8_t {
+  CAN_MESSAGES(CAN_MSG_INDEX)
+  CAN_MSG_COUNT,
+  CAN_MSG_NONE = 0xFF
+};
+#undef CAN_MSG_INDEX
+
+// CAN IDs
+#define CAN_MSG_ID(bus, id, name, period) inline constexpr uint16_t CANID_##name = id;
+CAN_MESSAGES(CAN_MSG_ID)
+#undef CAN_MSG_ID
+
+struct CanMsgDef {
+  CanBus bus;
+  uint16_t id;
+  uint8_t size;    // payload size, DLC
+  const char* name;
+  uint16_t period; // ms, 0 = event driven
+};
+
+#define CAN_MSG_DEF(bus, id, name, period) { bus, id, sizeof(name##_t), #name, period },
+inline constexpr CanMsgDef canMessages[CAN_MSG_COUNT] = {
+  CAN_MESSAGES(CAN_MSG_DEF)
+};
+#undef CAN_MSG_DEF
+
+
+// standard ID -> message index lookup per bus, CAN_MSG_NONE = not registered
+struct CanDispatch {
+  uint8_t index[CAN_BUSES][0x800];
+};
+
+constexpr CanDispatch makeCanDispatch() {
+  CanDispatch d{};
+  for (int b = 0; b < CAN_BUSES; b++) {
+    for (int id = 0; id < 0x800; id++) {
+      d.index[b][id] = CAN_MSG_NONE;
+    }
+  }
+  for (int i = 0; i < CAN_MSG_COUNT; i++) {
+    d.index[canMessages[i].bus][canMessages[i].id & 0x7FF] = i;
+  }
+  return d;
+}
+
+inline constexpr CanDispatch canDispatch = makeCanDispatch();
+
+// registry index of a received frame, CAN_MSG_NONE = drop (software filter)
+inline uint8_t canMsgIndex(uint8_t bus, uint32_t id) {
+  if (bus >= CAN_BUSES || id > 0x7FF) return CAN_MSG_NONE;
+  return canDispatch.index[bus][id];
+}
+
+
+/*
+ * MCP2515 acceptance filters
+ *
+ * RXB0 uses MASK0 with RXF0 and RXF1, RXB1 uses MASK1 with RXF2 to RXF5.
+ * Up to 6 IDs per bus fit exactly. More IDs are merged into groups that
+ * share a mask, the merge losing the fewest mask bits wins. Frames that
+ * pass the hardware but are not registered get dropped by canMsgIndex().
+ */
+struct CanFilterConfig {
+  uint16_t mask[2];   // MASK0, MASK1
+  uint16_t filter[6]; // RXF0 to RXF5
+  uint16_t wanted;    // registered IDs
+  uint16_t admitted;  // IDs passing the hardware filter
+};
+
+constexpr int canPopCount(uint16_t v) {
+  int n = 0;
+  for (; v; v &= v - 1) n++;
+  return n;
+}
+
+constexpr uint16_t canAdmitted(const uint16_t* mask, const uint16_t* filter) {
+  uint16_t n = 0;
+  for (int id = 0; id < 0x800; id++) {
+    for (int f = 0; f < 6; f++) {
+      uint16_t m = mask[f < 2 ? 0 : 1];
+      if ((id & m) == (filter[f] & m)) {
+        n++;
+        break;
+      }
+    }
+  }
+  return n;
+}
+
+constexpr CanFilterConfig makeCanFilters(CanBus bus) {
+  CanFilterConfig best{};
+  uint16_t value[CAN_MSG_COUNT] = {}; // group ID
+  uint16_t care[CAN_MSG_COUNT] = {};  // bits all IDs of the group agree on
+  int k = 0;
+  for (int i = 0; i < CAN_MSG_COUNT; i++) {
+    if (canMessages[i].bus != bus) continue;
+    value[k] = canMessages[i].id & 0x7FF;
+    care[k] = 0x7FF;
+    k++;
+  }
+  best.wanted = k;
+  if (k == 0) {
+    best.mask[0] = best.mask[1] = 0x7FF;
+    best.admitted = canAdmitted(best.mask, best.filter);
+    return best;
+  }
+
+  // merge groups until they fit 6 filters
+  while (k > 6) {
+    int a = 0, b = 1, keep = -1;
+    for (int i = 0; i < k; i++) {
+      for (int j = i + 1; j < k; j++) {
+        int bits = canPopCount(care[i] & care[j] & ~(value[i] ^ value[j]));
+        if (bits > keep) {
+          keep = bits;
+          a = i;
+          b = j;
+        }
+      }
+    }
+    care[a] = care[a] & care[b] & ~(value[a] ^ value[b]);
+    value[a] &= care[a];
+    value[b] = value[k - 1];
+    care[b] = care[k - 1];
+    k--;
+  }
+
+  // try every split into RXB0 (1..2 groups) and RXB1 (rest, max 4)
+  best.admitted = 0xFFFF;
+  for (int first = 0; first < k; first++) {
+    for (int second = first; second < k; second++) {
+      int rest = k - (second == first ? 1 : 2);
+      if (rest > 4) continue;
+      CanFilterConfig cfg{};
+      cfg.wanted = best.wanted;
+      cfg.mask[0] = care[first] & care[second];
+      cfg.filter[0] = value[first];
+      cfg.filter[1] = value[second];
+      int f = 2;
+      uint16_t m1 = 0x7FF;
+      for (int i = 0; i < k; i++) {
+        if (i == first || i == second) continue;
+        m1 &= care[i];
+        cfg.filter[f++] = value[i];
+      }
+      if (f == 2) {
+        // nothing left for RXB1: mirror RXB0
+        m1 = cfg.mask[0];
+        cfg.filter[f++] = value[first];
+        cfg.filter[f++] = value[second];
+      }
+      // fill unused filters with a duplicate
+      for (; f < 6; f++) {
+        cfg.filter[f] = cfg.filter[2];
+      }
+      cfg.mask[1] = m1;
+      cfg.admitted = canAdmitted(cfg.mask, cfg.filter);
+      if (cfg.admitted < best.admitted) {
+        best = cfg;
+      }
+    }
+  }
+  return best;
+}
+
+inline constexpr CanFilterConfig canFilters[CAN_BUSES] = {
+  makeCanFilters(CAN_C),
+  makeCanFilters(CAN_B)
+};
+
+// compile time report: warning shows the number of unregistered IDs passing the hardware
+template <CanBus bus, int extra>
+struct CanSoftwareFilter {
+  [[deprecated("IDs do not fit the MCP2515 filters exactly, extra = unregistered IDs admitted to SPI")]]
+  static constexpr int report() { return extra; }
+};
+template <CanBus bus>
+struct CanSoftwareFilter<bus, 0> {
+  static constexpr int report() { return 0; }
+};
+inline constexpr int canFilterExtra[CAN_BUSES] = {
+  CanSoftwareFilter<CAN_C, canFilters[CAN_C].admitted - canFilters[CAN_C].wanted>::report(),
+  CanSoftwareFilter<CAN_B, canFilters[CAN_B].admitted - canFilters[CAN_B].wanted>::report()
+};
+
+// program masks and filters, MCP2515 must be in configuration mode
+inline void setCanFilters(MCP2515& can, CanBus bus) {
+  const CanFilterConfig& cfg = canFilters[bus];
+  const MCP2515::RXF rxf[6] = { MCP2515::RXF0, MCP2515::RXF1, MCP2515::RXF2, MCP2515::RXF3, MCP2515::RXF4, MCP2515::RXF5 };
+  can.setFilterMask(MCP2515::MASK0, false, cfg.mask[0]);
+  can.setFilterMask(MCP2515::MASK1, false, cfg.mask[1]);
+  for (int f = 0; f < 6; f++) {
+    can.setFilter(rxf[f], false, cfg.filter[f]);
+  }
+}
+
+
+#endif /* CAN_REGISTRY_H */
@@ -0,0 +1,130 @@
+/*                                                                          *
+ * CAN frame transport between the CAN tasks and loop()                     *
+ *                                                                          *
+ * FrameQueue - lock-free single producer / single consumer ring            *
+ * Snapshot   - seqlock versioned copy of a decoded CAN frame               *
+ *                                                                          */
+#ifndef CANBUS_H
+#define CANBUS_H
+
+
+#include <Arduino.h>
+#include <atomic>
+#include <mcp2515.h>
+
+// CAN message queue length per bus (power of 2)
+#define CAN_QUEUE_LEN 32
+
+// timestamped CAN message
+struct CanFrame {
+  uint32_t time; // esp_timer_get_time() at reception, us
+  struct can_frame frame;
+};
+
+
+// receive path statistics, written by the CAN task only
+struct CanRxStats {
+  volatile uint32_t irqTime;    // esp_timer_get_time() of the last falling INT edge, us
+  volatile uint32_t wakeups;    // CAN task wakeups
+  volatile uint32_t frames;     // frames read from the MCP2515
+  volatile uint32_t latencySum; // ISR to decoded, us
+  volatile uint32_t latencyMax;
+  volatile uint32_t spiBytes;   // SPI bytes of the receive path
+};
+
+
+// lock-free ring buffer, one producer task and one consumer task
+template <typename T, size_t N>
+class FrameQueue {
+  static_assert((N & (N - 1)) == 0, "FrameQueue length must be a power of 2");
+  private:
+    T buf[N];
+    std::atomic<uint32_t> head{0}; // written by producer
+    std::atomic<uint32_t> tail{0}; // written by consumer
+    std::atomic<uint32_t> drops{0};
+  public:
+    // producer: returns false and counts a drop if the consumer is behind
+    bool push(const T& item) {
+      uint32_t h = head.load(std::memory_order_relaxed);
+      if (h - tail.load(std::memory_order_acquire) >= N) {
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      buf[h & (N - 1)] = item;
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+    // consumer: returns false if empty
+    bool pop(T& item) {
+      uint32_t t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire)) {
+        return false;
+      }
+      item = buf[t & (N - 1)];
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+    size_t size() const {
+      return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    uint32_t dropped() const {
+      return drops.load(std::memory_order_relaxed);
+    }
+};
+
+
+// seqlock protected copy of a frame payload, one writer task and any number of readers
+template <typename T>
+class Snapshot {
+  private:
+    T data;
+    std::atomic<uint32_t> seq{0};  // odd while a write is in progress
+    std::atomic<uint32_t> lost{0}; // versions written but never read
+    std::atomic<bool> fresh{false};
+  public:
+    Snapshot() { memset(&data, 0x00, sizeof(data)); }
+
+    // writer: copy CAN_message payload, shorter frames keep the tail of the previous one
+    void write(const uint8_t* msg, size_t len) {
+      if (len > sizeof(T)) len = sizeof(T);
+      uint32_t s = seq.load(std::memory_order_relaxed);
+      seq.store(s + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      memcpy((void*)&data, msg, len);
+      seq.store(s + 2, std::memory_order_release);
+      if (fresh.exchange(true, std::memory_order_relaxed)) {
+        lost.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    // reader: consistent copy without blocking the writer
+    T read() {
+      T copy;
+      uint32_t s1, s2;
+      unsigned int spins = 0;
+      do {
+        s1 = seq.load(std::memory_order_acquire);
+        if (s1 & 1) {
+          // writer preempted by a reader on the same core
+          if (++spins > 16) delay(1);
+          continue;
+        }
+        memcpy(&copy, (const void*)&data, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s2 = seq.load(std::memory_order_relaxed);
+      } while ((s1 & 1) || s1 != s2);
+      fresh.store(false, std::memory_order_relaxed);
+      return copy;
+    }
+
+    // number of completed writes
+    uint32_t version() const {
+      return seq.load(std::memory_order_acquire) >> 1;
+    }
+    uint32_t overwritten() const {
+      return lost.load(std::memory_order_relaxed);
+    }
+};
+
+
+#endif /* CANBUS_H */
@@ -0,0 +1,321 @@
+/*                                                                          *
+ * Cached config store                                                      *
+ *                                                                          */
+#include "config_store.h"
+#include "metrics.h"
+
+ConfigStore configStore;
+
+const char* const modeNames[MODE_COUNT] = { "default", "offroad", "comfort", "sport1", "sport2" };
+const char* const calibNames[CALIB_COUNT] = { "calib_vl", "calib_vr", "calib_hl", "calib_hr" };
+const char* const gainNames[CALIB_COUNT] = { "gain_vl", "gain_vr", "gain_hl", "gain_hr" };
+const char* const axleNames[AXLE_COUNT] = { "offset_nv", "offset_nh" };
+
+static const char* const slotFiles[2] = { CONFIG_SLOT_A, CONFIG_SLOT_B };
+
+#define CONFIG_MAGIC   0x46434D41 // "AMCF"
+#define CONFIG_VERSION 1
+
+// slot file content, little endian
+struct __attribute__((__packed__)) ConfigRecord {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;                          // sizeof(ConfigRecord)
+  uint32_t sequence;                      // +1 per write, the newer slot wins
+  int8_t calib[CALIB_COUNT];
+  int16_t gain[CALIB_COUNT];
+  uint8_t tables;                         // bit per Mode with an offset table
+  int8_t offsets[MODE_COUNT][AXLE_COUNT];
+  uint8_t hashLen;
+  uint8_t seedLen;
+  char hash[CONFIG_WIFI_HEX];             // encrypted wifi credentials, hex
+  char seed[CONFIG_WIFI_HEX];
+  uint32_t crc;                           // CRC-32 of the bytes before
+};
+
+// CRC-32 (IEEE 802.3), bitwise, runs once per boot and write
+static uint32_t crc32(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*) data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *p++;
+    for (uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static bool recordValid(const ConfigRecord& rec) {
+  return rec.magic == CONFIG_MAGIC && rec.version == CONFIG_VERSION && rec.size == sizeof(ConfigRecord)
+    && rec.hashLen <= CONFIG_WIFI_HEX && rec.seedLen <= CONFIG_WIFI_HEX
+    && rec.crc == crc32(&rec, offsetof(ConfigRecord, crc));
+}
+
+static String hexString(const char* hex, uint8_t len) {
+  char buf[CONFIG_WIFI_HEX + 1];
+  memcpy(buf, hex, len);
+  buf[len] = '\0';
+  return String(buf);
+}
+
+
+// mode by JSON key, MODE_COUNT if unknown
+Mode modeFromName(const char* name) {
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    if (strcmp(name, modeNames[m]) == 0) return (Mode)m;
+  }
+  return MODE_COUNT;
+}
+
+
+// newest valid record, the legacy config.json file on first boot
+void ConfigStore::begin(const char* file) {
+  path = file;
+  if (!lock) lock = xSemaphoreCreateMutex();
+  if (!flushLock) flushLock = xSemaphoreCreateMutex();
+  uint32_t start = micros();
+  if (loadSlots()) {
+    Serial.printf("Config: slot %c, sequence %u, loaded in %u us\r\n", 'A' + slot, sequence, micros() - start);
+  } else if (migrateJson()) {
+    Serial.printf("Config: %s migrated\r\n", path);
+    flush(true);
+  }
+}
+
+// read both slots, one read each, keep the valid one with the higher sequence
+bool ConfigStore::loadSlots() {
+  ConfigRecord rec, best = {};
+  for (int8_t i = 0; i < 2; i++) {
+    File f = LittleFS.open(slotFiles[i], "r");
+    if (!f) continue;
+    size_t n = f.read((uint8_t*) &rec, sizeof(rec));
+    f.close();
+    if (n != sizeof(rec) || !recordValid(rec)) {
+      Serial.printf("Config: slot %c invalid\r\n", 'A' + i);
+      continue;
+    }
+    if (slot < 0 || (int32_t)(rec.sequence - best.sequence) > 0) {
+      best = rec;
+      slot = i;
+    }
+  }
+  if (slot < 0) return false;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  sequence = best.sequence;
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    calib[c] = best.calib[c];
+    gain[c] = best.gain[c];
+  }
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    table[m] = best.tables & (1 << m);
+    for (uint8_t a = 0; a < AXLE_COUNT; a++) {
+      offsets[m][a] = best.offsets[m][a];
+    }
+  }
+  hash = hexString(best.hash, best.hashLen);
+  seed = hexString(best.seed, best.seedLen);
+  xSemaphoreGive(lock);
+  return true;
+}
+
+// parse the legacy config.json file
+bool ConfigStore::migrateJson() {
+  JsonDocument doc;
+  File f = LittleFS.open(path, "r");
+  if (!f) {
+    Serial.print("LittleFS: cannot access '");
+    Serial.print(path);
+    Serial.println("': No such file or directory");
+    return false;
+  }
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  if (err) {
+    Serial.print("Cannot deserialize the current JSON object: ");
+    Serial.println(err.c_str());
+    return false;
+  }
+  xSemaphoreTake(lock, portMAX_DELAY);
+  fromJson(doc);
+  touch();
+  xSemaphoreGive(lock);
+  return true;
+}
+
+void ConfigStore::fromJson(const JsonDocument& doc) {
+  if (doc.containsKey("calibration")) {
+    JsonObjectConst obj = doc["calibration"];
+    for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+      if (obj.containsKey(calibNames[c])) calib[c] = obj[calibNames[c]];
+      if (obj.containsKey(gainNames[c])) gain[c] = obj[gainNames[c]];
+    }
+  }
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    if (!doc.containsKey(modeNames[m])) continue;
+    JsonObjectConst obj = doc[modeNames[m]];
+    table[m] = true;
+    for (uint8_t a = 0; a < AXLE_COUNT; a++) {
+      if (obj.containsKey(axleNames[a])) offsets[m][a] = obj[axleNames[a]];
+    }
+  }
+  if (doc.containsKey("wifi")) {
+    JsonObjectConst obj = doc["wifi"];
+    if (obj.containsKey("hash")) hash = obj["hash"].as<String>();
+    if (obj.containsKey("seed")) seed = obj["seed"].as<String>();
+  }
+}
+
+void ConfigStore::toJsonLocked(JsonDocument& doc) {
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    if (!table[m]) continue;
+    JsonObject obj = doc[modeNames[m]].to<JsonObject>();
+    for (uint8_t a = 0; a < AXLE_COUNT; a++) {
+      obj[axleNames[a]] = offsets[m][a];
+    }
+  }
+  JsonObject obj = doc["calibration"].to<JsonObject>();
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    obj[calibNames[c]] = calib[c];
+    if (gain[c] != GAIN_ONE) obj[gainNames[c]] = gain[c];
+  }
+  if (hash.length() || seed.length()) {
+    JsonObject w = doc["wifi"].to<JsonObject>();
+    w["hash"].set(hash);
+    w["seed"].set(seed);
+  }
+}
+
+void ConfigStore::toJson(JsonDocument& doc) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  toJsonLocked(doc);
+  xSemaphoreGive(lock);
+}
+
+// caller holds lock
+void ConfigStore::touch() {
+  dirty = true;
+  changed = millis();
+}
+
+int8_t ConfigStore::getCalibration(CalibChannel ch) {
+  return calib[ch];
+}
+
+void ConfigStore::setCalibration(CalibChannel ch, int8_t value) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (calib[ch] != value) {
+    calib[ch] = value;
+    touch();
+  }
+  xSemaphoreGive(lock);
+}
+
+int16_t ConfigStore::getGain(CalibChannel ch) {
+  return gain[ch];
+}
+
+void ConfigStore::setGain(CalibChannel ch, int16_t value) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (gain[ch] != value) {
+    gain[ch] = value;
+    touch();
+  }
+  xSemaphoreGive(lock);
+}
+
+int8_t ConfigStore::getOffset(Mode mode, Axle axle) {
+  return offsets[mode][axle];
+}
+
+void ConfigStore::setOffset(Mode mode, Axle axle, int8_t value) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (!table[mode] || offsets[mode][axle] != value) {
+    table[mode] = true;
+    offsets[mode][axle] = value;
+    touch();
+  }
+  xSemaphoreGive(lock);
+}
+
+void ConfigStore::getWifi(String& hash_old, String& seed_old) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  hash_old = hash;
+  seed_old = seed;
+  xSemaphoreGive(lock);
+}
+
+void ConfigStore::setWifi(const String& hash_new, const String& seed_new) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (hash != hash_new || seed != seed_new) {
+    hash = hash_new;
+    seed = seed_new;
+    touch();
+  }
+  xSemaphoreGive(lock);
+}
+
+// write the record to the slot not holding the newest one
+void ConfigStore::flush(bool force) {
+  if (!path) return;
+  // loop() skips while another task writes, a forced flush waits for it
+  if (!xSemaphoreTake(flushLock, force ? portMAX_DELAY : 0)) return;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (!dirty || held || (!force && millis() - changed < CONFIG_FLUSH_DELAY)) {
+    xSemaphoreGive(lock);
+    xSemaphoreGive(flushLock);
+    return;
+  }
+
+  ConfigRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = CONFIG_MAGIC;
+  rec.version = CONFIG_VERSION;
+  rec.size = sizeof(rec);
+  rec.sequence = sequence + 1;
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    rec.calib[c] = calib[c];
+    rec.gain[c] = gain[c];
+  }
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    if (table[m]) rec.tables |= 1 << m;
+    for (uint8_t a = 0; a < AXLE_COUNT; a++) {
+      rec.offsets[m][a] = offsets[m][a];
+    }
+  }
+  rec.hashLen = hash.length() < CONFIG_WIFI_HEX ? hash.length() : CONFIG_WIFI_HEX;
+  rec.seedLen = seed.length() < CONFIG_WIFI_HEX ? seed.length() : CONFIG_WIFI_HEX;
+  memcpy(rec.hash, hash.c_str(), rec.hashLen);
+  memcpy(rec.seed, seed.c_str(), rec.seedLen);
+  dirty = false;
+  xSemaphoreGive(lock);
+  rec.crc = crc32(&rec, offsetof(ConfigRecord, crc));
+
+  int8_t next = slot < 0 ? 0 : slot ^ 1;
+  uint32_t start = micros();
+  File f = LittleFS.open(slotFiles[next], "w");
+  size_t n = f ? f.write((const uint8_t*) &rec, sizeof(rec)) : 0;
+  if (f) f.close();
+  if (n != sizeof(rec)) {
+    Serial.print("LittleFS: ");
+    Serial.print(slotFiles[next]);
+    Serial.println(": Read-only file system");
+    xSemaphoreTake(lock, portMAX_DELAY);
+    dirty = true;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(flushLock);
+    return;
+  }
+  metrics.flashWrite.record(micros() - start);
+  sequence = rec.sequence;
+  slot = next;
+  uint32_t count = ++writes;
+  xSemaphoreGive(flushLock);
+  Serial.printf("Config: slot %c saved, %u flash writes since boot\r\n", 'A' + next, count);
+}
+
+void ConfigStore::hold(bool on) {
+  if (!flushLock) return;
+  xSemaphoreTake(flushLock, portMAX_DELAY);
+  held = on;
+  xSemaphoreGive(flushLock);
+}
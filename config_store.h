@@ -0,0 +1,124 @@
+/*                                                                          *
+ * Cached config store                                                      *
+ *                                                                          *
+ * The persistent state is a fixed binary record with a CRC-32, written     *
+ * alternately to two slot files. Boot reads both slots once and keeps the  *
+ * valid one with the higher sequence, so a power cut during a write falls  *
+ * back to the previous record. Writes only mark the store dirty, flush()   *
+ * coalesces them into one debounced slot write. An old config.json is      *
+ * migrated on first boot, JSON is only built for the web UI.               *
+ *                                                                          */
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+
+// debounce time between last change and flash write
+#define CONFIG_FLUSH_DELAY 2000 // ms
+
+// record slots, written alternately
+#define CONFIG_SLOT_A "/config_a.bin"
+#define CONFIG_SLOT_B "/config_b.bin"
+
+// encrypted wifi credentials, hex
+#define CONFIG_WIFI_HEX 64
+
+// AIRmatic modes with their own offset table
+enum Mode : uint8_t {
+  MODE_DEFAULT,
+  MODE_OFFROAD,
+  MODE_COMFORT,
+  MODE_SPORT1,
+  MODE_SPORT2,
+  MODE_COUNT
+};
+
+// offset voltage calibration channels
+enum CalibChannel : uint8_t {
+  CALIB_VL, // NVLS1
+  CALIB_VR, // NVRS1
+  CALIB_HL, // NHLS1
+  CALIB_HR, // NHRS1
+  CALIB_COUNT
+};
+
+// offset gain, mm -> duty scale in 1/256
+#define GAIN_ONE 256
+
+// axle level custom offsets
+enum Axle : uint8_t {
+  AXLE_NV, // front
+  AXLE_NH, // rear
+  AXLE_COUNT
+};
+
+extern const char* const modeNames[MODE_COUNT];   // JSON keys
+extern const char* const calibNames[CALIB_COUNT]; // JSON keys
+extern const char* const gainNames[CALIB_COUNT];  // JSON keys
+extern const char* const axleNames[AXLE_COUNT];   // JSON keys
+
+// mode by JSON key, MODE_COUNT if unknown
+Mode modeFromName(const char* name);
+
+
+class ConfigStore {
+  private:
+    const char* path = nullptr; // legacy config.json
+    SemaphoreHandle_t lock = nullptr;
+    SemaphoreHandle_t flushLock = nullptr; // one flush() at a time, guards sequence, slot, writes
+    uint32_t sequence = 0;      // of the newest record
+    int8_t slot = -1;           // slot of the newest record, -1 = none
+    int8_t calib[CALIB_COUNT] = {0};
+    int16_t gain[CALIB_COUNT] = {GAIN_ONE, GAIN_ONE, GAIN_ONE, GAIN_ONE};
+    int8_t offsets[MODE_COUNT][AXLE_COUNT] = {{0}};
+    bool table[MODE_COUNT] = {false}; // mode has its own offset table
+    String hash;
+    String seed;
+    bool dirty = false;
+    bool held = false;          // LittleFS unmounted, flush() keeps the changes
+    unsigned long changed = 0; // millis() of last change
+    uint32_t writes = 0;       // flash writes since boot
+
+    void touch();
+    bool loadSlots();
+    bool migrateJson();
+    void fromJson(const JsonDocument& doc);
+    void toJsonLocked(JsonDocument& doc);
+  public:
+    // read the newest valid record, or migrate the legacy config.json file
+    void begin(const char* file);
+
+    int8_t getCalibration(CalibChannel ch);
+    void setCalibration(CalibChannel ch, int8_t value);
+
+    int16_t getGain(CalibChannel ch);
+    void setGain(CalibChannel ch, int16_t value);
+
+    int8_t getOffset(Mode mode, Axle axle);
+    bool hasOffsets(Mode mode) const { return table[mode]; }
+    void setOffset(Mode mode, Axle axle, int8_t value);
+
+    void getWifi(String& hash_old, String& seed_old);
+    void setWifi(const String& hash_new, const String& seed_new);
+
+    // persistent sections as JSON
+    void toJson(JsonDocument& doc);
+
+    // write the older slot once CONFIG_FLUSH_DELAY passed since the last change, force skips the delay,
+    // safe from several tasks, the setters are not blocked by the flash write
+    void flush(bool force = false);
+
+    // hold writes while LittleFS is unmounted, waits for a write in progress, false writes what is dirty later
+    void hold(bool on);
+
+    uint32_t flashWrites() const { return writes; }
+    bool isDirty() const { return dirty; }
+};
+
+extern ConfigStore configStore;
+
+
+#endif /* CONFIG_STORE_H */
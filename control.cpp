@@ -0,0 +1,44 @@
+/*                                                                          *
+ * Control path arithmetic                                                  *
+ *                                                                          */
+#include "control.h"
+#include "w211_signals.h"
+
+
+Mode detectMode(Mode current, const EZS_240h_t& ezs, const FS_340h_t& fs) {
+  if (!w211::EZS_240h::KL_15(ezs.data)) return MODE_DEFAULT;
+  if (w211::FS_340h::FS_ID(fs.data) == 2) {
+    // todo: check the KOMBI_A9 IPS Mode (Comfort/Sport)
+    return MODE_COMFORT;
+  }
+  if (w211::FS_340h::FS_ID(fs.data) == 1) {
+    // check the AIRmatic mode (Offroad/Comfort/Sport1/Sport2)
+    if (w211::FS_340h::ST2_LED_DL(fs.data)) return MODE_OFFROAD;
+    if (w211::FS_340h::ST3_LEDR_DL(fs.data)) return MODE_SPORT2;
+    if (w211::FS_340h::ST3_LEDL_DL(fs.data)) return MODE_SPORT1;
+    return MODE_COMFORT;
+  }
+  return current;
+}
+
+uint32_t pwmValue(uint8_t duty, int8_t calib, int16_t offset, int16_t gain) {
+  // 64 bit: offset * duty * 2 * gain * PWM_SCALE leaves int32 for |offset| > ~250 mm at GAIN_ONE
+  const int64_t den = 100 * GAIN_ONE;
+  int64_t num = (den * ((int32_t)duty + calib) + (int64_t)offset * duty * 2 * gain) * PWM_SCALE;
+  int64_t value = (num + (num < 0 ? -den / 2 : den / 2)) / den;
+  const int32_t top = (1 << PWM_RES) - 1;
+  return value < 0 ? 0 : value > top ? top : value;
+}
+
+int32_t rampStep(uint8_t slew, uint8_t duty, uint16_t rate) {
+  // 1 mm = duty * 2 / 100 counts at 8 bit
+  int32_t num = (int32_t) slew * duty * 2 * PWM_SCALE << RAMP_SHIFT;
+  int32_t den = 100 * (int32_t) rate;
+  return (num + den / 2) / den;
+}
+
+int32_t outputRamp(int32_t current, int32_t target, int32_t step) {
+  if (step <= 0) return target;
+  if (target > current) return target - current > step ? current + step : target;
+  return current - target > step ? current - step : target;
+}
@@ -0,0 +1,38 @@
+/*                                                                          *
+ * Control path arithmetic                                                  *
+ *                                                                          *
+ * Mode detection and the offset -> PWM duty mapping run by loop(), the     *
+ * slew rate ramp of the output task. Integer only, no heap, no globals, so *
+ * tests/ can run them on a PC.                                             *
+ *                                                                          */
+#ifndef CONTROL_H
+#define CONTROL_H
+
+
+#include <stdint.h>
+#include "config_store.h"
+#include "w211_can_c.h"
+
+// LEDC resolution of the DAC offset outputs
+#define PWM_RES 12                     // 0..4095
+#define PWM_SCALE (1 << (PWM_RES - 8)) // duty and calibration are in 8 bit counts
+#define RAMP_SHIFT 8                   // ramp position in 1/256 PWM counts
+
+
+// AIRmatic mode from EZS_240h / FS_340h, current mode is kept for unknown FS_ID
+Mode detectMode(Mode current, const EZS_240h_t& ezs, const FS_340h_t& fs);
+
+// (duty + calibration + offset * duty * 2 / 100 * gain) * PWM_SCALE, fixed point, rounded to the nearest count
+uint32_t pwmValue(uint8_t duty, int8_t calib, int16_t offset, int16_t gain);
+
+// slew mm/s -> ramp step per output tick at rate Hz, 1/256 count, rounded, 0 = step
+int32_t rampStep(uint8_t slew, uint8_t duty, uint16_t rate);
+
+// move current towards target by at most step, step <= 0: jump
+int32_t outputRamp(int32_t current, int32_t target, int32_t step);
+
+// ramp position <-> PWM duty, rounded to the nearest count
+inline int32_t rampLevel(uint32_t pwm) { return (int32_t) pwm << RAMP_SHIFT; }
+inline uint32_t rampDuty(int32_t level) { return (level + (1 << (RAMP_SHIFT - 1))) >> RAMP_SHIFT; }
+
+#endif /* CONTROL_H */
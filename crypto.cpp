@@ -11,14 +11,11 @@
 uint8_t enc_ssid[32];
 uint8_t enc_pass[32];
 uint8_t hw_key[16];
-uint8_t fw_key[256];
-uint8_t enc_seed[256];
-uint8_t pseudoKey[32];
-uint8_t challenge[33];
-size_t fwKeyLen;
-size_t seedLen;
 
-bool rsaKeys = false;
+volatile KeyState keyState = KEYS_NONE;
+unsigned long keygenStart = 0;
+
+CryptoSession cryptoSession;
 
 
 // read MAC from eFuse
@@ -67,7 +64,7 @@ String bytesToHex(const uint8_t *data, size_t len) {
   while (len-- > 0 && data[len] == 0x00) {
     continue;
   }
-  len = (++len + 15) & ~15;
+  len = (len + 1 + 15) & ~15;
 
   String hexStr;
   hexStr.reserve(len * 2);
@@ -95,12 +92,12 @@ void aes_encrypt(uint8_t *plainText, uint8_t *key, uint8_t *outputBuffer, size_t
   while (len-- > 0 && plainText[len] == 0x00) {
     continue;
   }
-  len = (++len + 15) & ~15;
+  len = (len + 1 + 15) & ~15;
 
   while (keyLen-- > 0 && key[keyLen] == 0x00) {
     continue;
   }
-  keyLen = (++keyLen + 15) & ~15;
+  keyLen = (keyLen + 1 + 15) & ~15;
 
   mbedtls_aes_context aes;
   mbedtls_aes_init(&aes);
@@ -120,12 +117,12 @@ void aes_decrypt(uint8_t *chipherText, uint8_t *key, uint8_t *outputBuffer, size
   while (cipherLen-- > 0 && chipherText[cipherLen] == 0x00) {
     continue;
   }
-  cipherLen = (++cipherLen + 15) & ~15;
+  cipherLen = (cipherLen + 1 + 15) & ~15;
 
   while (keyLen-- > 0 && key[keyLen] == 0x00) {
     continue;
   }
-  keyLen = (++keyLen + 15) & ~15;
+  keyLen = (keyLen + 1 + 15) & ~15;
 
   mbedtls_aes_context aes;
   mbedtls_aes_init(&aes);
@@ -164,27 +161,27 @@ void base64_decode(const String& b64input, uint8_t* outBuf, size_t outBufSize, s
 }
 
 
-// decrypt with private key
-void rsa_decrypt(const char* keyfile, const uint8_t* encrypted, size_t olen, uint8_t* decrypted, size_t* len) {
-  // initialize context
-  mbedtls_pk_context pk;
-
-  // prep operating context
-  mbedtls_ctr_drbg_context ctr_drbg;
-  mbedtls_entropy_context entropy;
+// seed deterministic random byte generator once
+bool CryptoSession::seedDrbg() {
+  if (seeded) return true;
   mbedtls_entropy_init(&entropy);
   mbedtls_ctr_drbg_init(&ctr_drbg);
-
-  // seed deterministic random byte generator
   int ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
   if (ret != 0) {
     Serial.print("mbedtls_ctr_drbg_seed failed: -0x");
     Serial.println(-ret, HEX);
-    return;
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    return false;
   }
+  seeded = true;
+  return true;
+}
 
-  // init for decryption
-  mbedtls_pk_init(&pk);
+// read private key
+bool CryptoSession::loadKey(const char* keyfile) {
+  if (keyLoaded) return true;
+  if (!seedDrbg()) return false;
 
   // open private PEM file
   File privateKeyFile = LittleFS.open(keyfile, "r");
@@ -192,50 +189,145 @@ void rsa_decrypt(const char* keyfile, const uint8_t* encrypted, size_t olen, uin
     Serial.print("LittleFS: cannot access '");
     Serial.print(keyfile);
     Serial.println("': No such file or directory");
-    return;
+    return false;
   }
   size_t pem_len = privateKeyFile.size();
   unsigned char *privateKey = (unsigned char*)malloc(pem_len + 1);
   if (!privateKey) {
     privateKeyFile.close();
     Serial.println("Failed to allocate memory for private key");
-    return;
+    return false;
   }
   privateKeyFile.read(privateKey, pem_len);
   privateKeyFile.close();
   privateKey[pem_len] = '\0';
 
-  // read private key
-  if ((ret = mbedtls_pk_parse_key(&pk, privateKey, pem_len + 1, NULL, 0, mbedtls_ctr_drbg_random, &ctr_drbg)) != 0) {
+  unsigned long t = micros();
+  mbedtls_pk_init(&pk);
+  int ret = mbedtls_pk_parse_key(&pk, privateKey, pem_len + 1, NULL, 0, mbedtls_ctr_drbg_random, &ctr_drbg);
+  memset(privateKey, 0x00, pem_len);
+  free(privateKey);
+  if (ret != 0) {
     Serial.print("mbedtls_pk_parse_key failed: -0x");
     Serial.println(-ret, HEX);
-    free(privateKey);
     mbedtls_pk_free(&pk);
-    return;
+    return false;
   }
-  free(privateKey);
 
   // set OAEP + SHA1 padding before decrypt
-  mbedtls_rsa_context *rsa = mbedtls_pk_rsa(pk);
-  mbedtls_rsa_set_padding(rsa, MBEDTLS_RSA_PKCS_V21, MBEDTLS_MD_SHA1);
+  mbedtls_rsa_set_padding(mbedtls_pk_rsa(pk), MBEDTLS_RSA_PKCS_V21, MBEDTLS_MD_SHA1);
+  keyLoaded = true;
+  Serial.printf("Crypto: %s parsed in %lu us\r\n", keyfile, micros() - t);
+  return true;
+}
 
-  // decypt
-  if ((ret = mbedtls_pk_decrypt(&pk, encrypted, olen, decrypted, len, olen, mbedtls_ctr_drbg_random, &ctr_drbg)) != 0) {
+void CryptoSession::unloadKey() {
+  if (!keyLoaded) return;
+  mbedtls_pk_free(&pk);
+  keyLoaded = false;
+}
+
+// decrypt with private key
+bool CryptoSession::decrypt(const uint8_t* encrypted, size_t olen, uint8_t* decrypted, size_t* len, size_t size) {
+  if (!loadKey(privKeyFile)) return false;
+  int ret = mbedtls_pk_decrypt(&pk, encrypted, olen, decrypted, len, size, mbedtls_ctr_drbg_random, &ctr_drbg);
+  if (ret != 0) {
     Serial.print("Decrypting RSA failed\nmbedtls_pk_decrypt returned -0x");
     Serial.println(-ret, HEX);
+    return false;
   }
-  mbedtls_pk_free(&pk);
-  mbedtls_ctr_drbg_free(&ctr_drbg);
-  mbedtls_entropy_free(&entropy);
+  return true;
 }
 
+// generate the ECDH key pair
+bool CryptoSession::ecdhGenerate(int (*f_rng)(void *, unsigned char *, size_t), void *p_rng) {
+  if (ecdhReady) return true;
+  mbedtls_ecp_group_init(&grp);
+  mbedtls_mpi_init(&d);
+  mbedtls_ecp_point_init(&Q);
+  int ret = mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1);
+  if (ret == 0) ret = mbedtls_ecdh_gen_public(&grp, &d, &Q, f_rng, p_rng);
+  if (ret != 0) {
+    Serial.print("mbedtls_ecdh_gen_public failed: -0x");
+    Serial.println(-ret, HEX);
+    mbedtls_ecp_point_free(&Q);
+    mbedtls_mpi_free(&d);
+    mbedtls_ecp_group_free(&grp);
+    return false;
+  }
+  ecdhReady = true;
+  return true;
+}
 
-// generate RSA 2048-bit private.pem + public.pem key pair files
-void generateKeys() {
-  if (rsaKeys) return; // already checked
-  bool keysValid = false;
+// uncompressed public point as ASCII hex
+bool CryptoSession::ecdhPublicKey(String& hex) {
+  if (!ecdhReady) return false;
+  uint8_t buf[65];
+  size_t len = 0;
+  if (mbedtls_ecp_point_write_binary(&grp, &Q, MBEDTLS_ECP_PF_UNCOMPRESSED, &len, buf, sizeof(buf)) != 0) return false;
+  hex = "";
+  hex.reserve(len * 2);
+  for (size_t i = 0; i < len; i++) {
+    if (buf[i] < 16) hex += '0';
+    hex += String(buf[i], HEX);
+  }
+  return true;
+}
+
+// session key from the peer's public point
+bool CryptoSession::ecdhDerive(const uint8_t* peer, size_t len) {
+  if (!ecdhReady || !seedDrbg()) return false;
+  mbedtls_ecp_point P;
+  mbedtls_mpi z;
+  mbedtls_ecp_point_init(&P);
+  mbedtls_mpi_init(&z);
+  uint8_t shared[32];
+  uint8_t digest[32];
+  int ret = mbedtls_ecp_point_read_binary(&grp, &P, peer, len);
+  if (ret == 0) ret = mbedtls_ecp_check_pubkey(&grp, &P);
+  if (ret == 0) ret = mbedtls_ecdh_compute_shared(&grp, &z, &P, &d, mbedtls_ctr_drbg_random, &ctr_drbg);
+  if (ret == 0) ret = mbedtls_mpi_write_binary(&z, shared, sizeof(shared));
+  if (ret == 0) ret = mbedtls_sha256(shared, sizeof(shared), digest, 0);
+  mbedtls_mpi_free(&z);
+  mbedtls_ecp_point_free(&P);
+  if (ret != 0) {
+    Serial.print("ECDH key agreement failed: -0x");
+    Serial.println(-ret, HEX);
+    return false;
+  }
+  // non-zero bytes like the random session key of the RSA handshake
+  for (uint8_t i = 0; i < 16; i++) {
+    fw_key[i] = digest[i] ? digest[i] : i + 1;
+  }
+  fwKeyLen = 16;
+  memset(shared, 0x00, sizeof(shared));
+  memset(digest, 0x00, sizeof(digest));
+  return true;
+}
+
+void CryptoSession::open() {
+  close();
+  active = true;
+  started = millis();
+}
+
+bool CryptoSession::valid() {
+  if (active && millis() - started > CRYPTO_SESSION_TIMEOUT) close();
+  return active;
+}
+
+void CryptoSession::close() {
+  active = false;
+  fwKeyLen = 0;
+  memset(fw_key, 0x00, sizeof(fw_key));
+  memset(pseudoKey, 0x00, sizeof(pseudoKey));
+  memset(challenge, 0x00, sizeof(challenge));
+}
 
-  // check first 10 bytes match "^-----BEGIN"
+
+// check first 10 bytes of both PEM files match "^-----BEGIN"
+bool keysValid() {
+  bool valid = false;
   if (LittleFS.exists(privKeyFile) && LittleFS.exists(pubKeyFile)) {
     File privFile = LittleFS.open(privKeyFile, "r");
     File pubFile  = LittleFS.open(pubKeyFile, "r");
@@ -245,127 +337,187 @@ void generateKeys() {
       if (strncmp(header, "-----BEGIN", 10) == 0) {
         pubFile.readBytes(header, 10);
         if (strncmp(header, "-----BEGIN", 10) == 0) {
-          keysValid = true;
+          valid = true;
         }
       }
     }
     privFile.close();
     pubFile.close();
   }
+  return valid;
+}
 
-  if (!keysValid) {
-    Serial.println("Generating RSA 2048-bit key pair...");
-
-    // Initialize Mbed TLS structures
-    mbedtls_pk_context pk;
-    mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_entropy_context entropy;
-    const char *pers = "rsa_gen";
-
-    mbedtls_pk_init(&pk);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_entropy_init(&entropy);
-
-    if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)pers, strlen(pers)) != 0) {
-      Serial.println("DRBG seed failed");
-      return;
-    }
-
-    if (mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA)) != 0) {
-      Serial.println("PK setup failed");
-      return;
-    }
-
-    // disable watchdog for this task
-    esp_task_wdt_delete(NULL);
-
-    if (mbedtls_rsa_gen_key(mbedtls_pk_rsa(pk), mbedtls_ctr_drbg_random, &ctr_drbg, 2048, 65537) != 0) {
-      Serial.println("RSA key generation failed");
-      esp_task_wdt_add(NULL);  // re-enable before returning
-      return;
-    }
-    // re-enable watchdog
-    esp_task_wdt_add(NULL);
-
-    // write private key to PEM
-    unsigned char privPem[1792];
-    if (mbedtls_pk_write_key_pem(&pk, privPem, sizeof(privPem)) != 0) {
-      Serial.println("Private key PEM export failed");
-      return;
-    }
+// generate RSA 2048-bit private.pem + public.pem key pair files
+bool generateRsaKeys(mbedtls_ctr_drbg_context *ctr_drbg) {
+  Serial.println("Generating RSA 2048-bit key pair...");
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+  bool ok = false;
+  // PEM buffers on the heap, the task stack stays small
+  unsigned char *privPem = (unsigned char*)malloc(1792);
+  unsigned char *pubPem = (unsigned char*)malloc(512);
+
+  if (!privPem || !pubPem) {
+    Serial.println("Failed to allocate memory for PEM export");
+  } else if (mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA)) != 0) {
+    Serial.println("PK setup failed");
+  } else if (mbedtls_rsa_gen_key(mbedtls_pk_rsa(pk), mbedtls_ctr_drbg_random, ctr_drbg, 2048, 65537) != 0) {
+    Serial.println("RSA key generation failed");
+  } else if (mbedtls_pk_write_key_pem(&pk, privPem, 1792) != 0) {
+    Serial.println("Private key PEM export failed");
+  } else if (mbedtls_pk_write_pubkey_pem(&pk, pubPem, 512) != 0) {
+    Serial.println("Public key PEM export failed");
+  } else {
+    // public key last, keysValid() requires both files
     File fPriv = LittleFS.open(privKeyFile, "w");
     fPriv.write(privPem, strlen((char*)privPem));
     fPriv.close();
-
-    // write public key to PEM
-    unsigned char pubPem[512];
-    if (mbedtls_pk_write_pubkey_pem(&pk, pubPem, sizeof(pubPem)) != 0) {
-      Serial.println("Public key PEM export failed");
-      return;
-    }
     File fPub = LittleFS.open(pubKeyFile, "w");
     fPub.write(pubPem, strlen((char*)pubPem));
     fPub.close();
 
-    mbedtls_pk_free(&pk);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
+    // new key pair, parse again on next handshake
+    cryptoSession.unloadKey();
+    cryptoSession.close();
+    ok = true;
+  }
+
+  if (privPem) {
+    memset(privPem, 0x00, 1792);
+    free(privPem);
+  }
+  free(pubPem);
+  mbedtls_pk_free(&pk);
+  return ok;
+}
+
+// low priority: key pairs without blocking the web server
+void keygenTask(void *param) {
+  mbedtls_ctr_drbg_context ctr_drbg;
+  mbedtls_entropy_context entropy;
+  const char *pers = "rsa_gen";
+  mbedtls_ctr_drbg_init(&ctr_drbg);
+  mbedtls_entropy_init(&entropy);
 
-    Serial.println("RSA key pair generated.");
+  KeyState state = KEYS_FAILED;
+  if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)pers, strlen(pers)) != 0) {
+    Serial.println("DRBG seed failed");
+  } else {
+    // ECDH first, it takes milliseconds
+    unsigned long t = millis();
+    if (cryptoSession.ecdhGenerate(mbedtls_ctr_drbg_random, &ctr_drbg)) {
+      Serial.printf("ECDH P-256 key pair generated in %lu ms.\r\n", millis() - t);
+    }
+    if (keysValid()) {
+      state = KEYS_READY;
+    } else {
+      t = millis();
+      if (generateRsaKeys(&ctr_drbg)) {
+        Serial.printf("RSA key pair generated in %lu s.\r\n", (millis() - t) / 1000);
+        state = KEYS_READY;
+      }
+    }
   }
 
-  rsaKeys = true;
+  mbedtls_ctr_drbg_free(&ctr_drbg);
+  mbedtls_entropy_free(&entropy);
+  keyState = state;
+  vTaskDelete(NULL);
+}
+
+// start key generation once
+void startKeygen() {
+  if (keyState != KEYS_NONE) return;
+  keyState = KEYS_GENERATING;
+  keygenStart = millis();
+  // priority 0, shares the CPU with the idle task so its watchdog stays fed
+  xTaskCreatePinnedToCore(
+    keygenTask,   // Task function
+    "Keygen",     // name of task
+    8192,         // Stack size of task
+    NULL,         // parameter of the task
+    0,            // priority of the task
+    NULL,         // Task handle to keep track of created task
+    0);           // pin task to core 0
+}
+
+KeyState keygenState() {
+  return keyState;
+}
+
+uint32_t keygenElapsed() {
+  return keyState == KEYS_NONE ? 0 : (millis() - keygenStart) / 1000;
 }
 
 
 // send wifi credentials to HTML client
 void cryptUpdateWifi() {
+  CryptoSession& s = cryptoSession;
+  uint8_t enc_seed[256] = {0};
+  size_t seedLen;
   uint8_t random1[32] = {0}; // encrypted challenge
   uint8_t random2[32] = {0}; // encrypted response
   uint8_t response[33] = {0};
   uint8_t pwdhash[33] = {0};
+  unsigned long t = micros();
 
   // clear keys
   memset(enc_ssid, 0x00, sizeof(enc_ssid));
   memset(enc_pass, 0x00, sizeof(enc_pass));
-  memset(fw_key, 0x00, sizeof(fw_key));
-  memset(enc_seed, 0x00, sizeof(enc_seed));
-  memset(pseudoKey, 0x00, sizeof(pseudoKey));
-  memset(challenge, 0x00, sizeof(challenge));
-
-  // decrypted salt
-  base64_decode(salt, enc_seed, sizeof(enc_seed), &seedLen);
-  rsa_decrypt(privKeyFile, enc_seed, seedLen, fw_key, &fwKeyLen);
+  s.open();
+
+  // decrypted salt, "ec:<hex>" = client ECDH public point
+  bool ok;
+  if (salt.startsWith("ec:")) {
+    uint8_t peer[65];
+    ok = salt.length() == 3 + 2 * sizeof(peer);
+    if (ok) {
+      hexToBytes(salt.substring(3), peer);
+      ok = s.ecdhDerive(peer, sizeof(peer));
+    }
+  } else {
+    base64_decode(salt, enc_seed, sizeof(enc_seed), &seedLen);
+    ok = s.decrypt(enc_seed, seedLen, s.fw_key, &s.fwKeyLen, sizeof(s.fw_key));
+  }
+  if (!ok) {
+    s.close();
+    hash.clear();
+    seed.clear();
+    salt.clear();
+    return;
+  }
 
   // decrypted challenge
   hexToBytes(seed, random1);
-  aes_decrypt(random1, fw_key, challenge);
-  challenge[32] = '\0';
+  aes_decrypt(random1, s.fw_key, s.challenge);
+  s.challenge[32] = '\0';
 
   // encrypted response
-  junkHash(fw_key, pseudoKey); // scrambled key
-  junkHash(challenge, response);
-  aes_encrypt(response, pseudoKey, random2);
+  junkHash(s.fw_key, s.pseudoKey); // scrambled key
+  junkHash(s.challenge, response);
+  aes_encrypt(response, s.pseudoKey, random2);
 
   // converted to ASCII hex
   salt.clear();
   salt = bytesToHex(random2, sizeof(random2));
 
   // encrypted credentials
-  aes_encrypt(ssid, fw_key, enc_ssid);
+  aes_encrypt(ssid, s.fw_key, enc_ssid);
   junkHash(password, pwdhash); // scrambled password
-  aes_encrypt(pwdhash, pseudoKey, enc_pass);
+  aes_encrypt(pwdhash, s.pseudoKey, enc_pass);
 
   // converted to ASCII hex
   hash.clear();
   seed.clear();
   hash = bytesToHex(enc_ssid, sizeof(enc_ssid));
   seed = bytesToHex(enc_pass, sizeof(enc_pass));
+  Serial.printf("Crypto: handshake in %lu us\r\n", micros() - t);
 }
 
 
 // receive wifi credentials from HTML client
 bool cryptGetWifi() {
+  CryptoSession& s = cryptoSession;
   uint8_t random1[32] = {0}; // encrypted challenge
   uint8_t random2[32] = {0}; // encrypted response
   uint8_t response[33] = {0};
@@ -375,36 +527,44 @@ bool cryptGetWifi() {
   memset(enc_pass, 0x00, sizeof(enc_pass));
 
   // verify session
+  if (!s.valid()) {
+    Serial.println("Session expired");
+    return false;
+  }
   hexToBytes(salt, random1);
-  aes_encrypt(challenge, pseudoKey, random2);
+  aes_encrypt(s.challenge, s.pseudoKey, random2);
   if (handshake(random1, sizeof(random1), random2, sizeof(random2))) {
 
     // decrypted credentials
     if (hash.length() > 31) {
       hexToBytes(hash, enc_ssid);
       memset(ssid, 0x00, sizeof(ssid));
-      aes_decrypt(enc_ssid, fw_key, ssid);
+      aes_decrypt(enc_ssid, s.fw_key, ssid);
       ssid[32] = '\0';
     }
     if (seed.length() > 31) {
       hexToBytes(seed, enc_pass);
       memset(password, 0x00, sizeof(password));
-      aes_decrypt(enc_pass, fw_key, password);
+      aes_decrypt(enc_pass, s.fw_key, password);
       password[32] = '\0';
     }
 
     // derived key
-    if (getMac(hw_key) != ESP_OK) return false;
+    if (getMac(hw_key) != ESP_OK) {
+      s.close();
+      return false;
+    }
     memset(enc_ssid, 0x00, sizeof(enc_ssid));
     memset(enc_pass, 0x00, sizeof(enc_pass));
 
     // encrypted credentials
-    aes_encrypt(ssid, hw_key, enc_ssid);
-    aes_encrypt(password, hw_key, enc_pass);
+    aes_encrypt(ssid, hw_key, enc_ssid, sizeof(enc_ssid), sizeof(hw_key));
+    aes_encrypt(password, hw_key, enc_pass, sizeof(enc_pass), sizeof(hw_key));
 
     // encrypted response
-    junkHash(challenge, response);
-    aes_encrypt(response, fw_key, random2);
+    junkHash(s.challenge, response);
+    aes_encrypt(response, s.fw_key, random2);
+    s.close();
 
     // converted to ASCII hex
     hash.clear();
@@ -13,7 +13,6 @@
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <esp_mac.h>
-#include <esp_task_wdt.h>
 #include <mbedtls/base64.h>
 #include <mbedtls/aes.h>
 #include <mbedtls/pk.h>
@@ -21,6 +20,8 @@
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/pem.h>
+#include <mbedtls/ecdh.h>
+#include <mbedtls/sha256.h>
 
 extern uint8_t ssid[33];
 extern uint8_t password[33];
@@ -34,6 +35,66 @@ extern String salt;
 inline constexpr const char* pubKeyFile = "/public.pem";
 inline constexpr const char* privKeyFile = "/private.pem";
 
+// handshake lifetime between cryptUpdateWifi() and cryptGetWifi()
+#define CRYPTO_SESSION_TIMEOUT 300000 // ms
+
+// background key generation
+enum KeyState : uint8_t {
+  KEYS_NONE,       // task not started
+  KEYS_GENERATING, // RSA key pair being generated
+  KEYS_READY,      // private.pem + public.pem valid
+  KEYS_FAILED
+};
+
+
+// parsed private key, seeded DRBG and handshake keys, kept across requests
+class CryptoSession {
+  private:
+    mbedtls_pk_context pk;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_entropy_context entropy;
+    bool seeded = false;    // DRBG seeded once
+    bool keyLoaded = false; // private key parsed once
+    bool active = false;    // handshake keys valid
+    unsigned long started = 0;
+    mbedtls_ecp_group grp;  // ECDH P-256, key pair per boot
+    mbedtls_mpi d;
+    mbedtls_ecp_point Q;
+    volatile bool ecdhReady = false;
+
+    bool seedDrbg();
+  public:
+    uint8_t fw_key[256];    // session key from the client
+    size_t fwKeyLen = 0;
+    uint8_t pseudoKey[32];  // scrambled session key
+    uint8_t challenge[33];
+
+    // read and parse the private key file, no-op if already parsed
+    bool loadKey(const char* keyfile);
+    // drop the parsed key, next loadKey() reads the file again
+    void unloadKey();
+
+    // decrypt with private key, RSA-OAEP SHA1
+    bool decrypt(const uint8_t* encrypted, size_t olen, uint8_t* decrypted, size_t* len, size_t size);
+
+    // generate the ECDH key pair
+    bool ecdhGenerate(int (*f_rng)(void *, unsigned char *, size_t), void *p_rng);
+    bool ecdhAvailable() const { return ecdhReady; }
+    // uncompressed public point as ASCII hex, false until generated
+    bool ecdhPublicKey(String& hex);
+    // session key = SHA-256(shared secret)[0..15] from the peer's uncompressed public point
+    bool ecdhDerive(const uint8_t* peer, size_t len);
+
+    // start handshake, clears the session keys
+    void open();
+    // handshake started and not expired
+    bool valid();
+    // end handshake, wipes the session keys
+    void close();
+};
+
+extern CryptoSession cryptoSession;
+
 
 // read MAC from eFuse
 esp_err_t getMac(uint8_t* key);
@@ -44,8 +105,12 @@ void hexToBytes(const String &hex, uint8_t *out);
 // AES-ECB decrypt
 void aes_decrypt(uint8_t *chipherText, uint8_t *key, uint8_t *outputBuffer, size_t cipherLen = 32, size_t keyLen = 32);
 
-// generate RSA 2048-bit private.pem + public.pem key pair files
-void generateKeys();
+// generate RSA 2048-bit private.pem + public.pem key pair files and ECDH key pair in a background task
+void startKeygen();
+
+// background key generation state, seconds since start
+KeyState keygenState();
+uint32_t keygenElapsed();
 
 // send wifi credentials to HTML client
 void cryptUpdateWifi();
@@ -62,8 +127,6 @@ String bytesToHex(const uint8_t *data, size_t len);
 // convert ASCII base64 string -> bytes
 void base64_decode(const String& b64input, uint8_t* outBuf, size_t outBufSize, size_t* outLen);
 
-// decrypt with private key
-void rsa_decrypt(const char* keyfile, const uint8_t* encrypted, size_t olen, uint8_t* decrypted, size_t* len);
 
 // AES-ECB encrypt
 void aes_encrypt(uint8_t *plainText, uint8_t *key, uint8_t *outputBuffer, size_t len = 32, size_t keyLen = 32);
@@ -0,0 +1,57 @@
+/*                                                                          *
+ * Steering wheel key combinations                                          *
+ *                                                                          */
+#include "key_combo.h"
+
+
+void KeyComboEngine::update(uint8_t bits, uint32_t time) {
+  // loop() may poll with a time before a frame that was queued later
+  if (started && (int32_t)(time - last) < 0) time = last;
+  started = true;
+  last = time;
+  buttons = bits;
+
+  for (uint8_t i = 0; i < count; i++) {
+    const KeyCombo& c = table[i];
+    State& s = state[i];
+    uint32_t debounce = (uint32_t) c.debounce * 1000;
+
+    // held until now, or until the start of a pending release
+    if (s.down) holdEvents(i, s.raw ? time : s.since);
+
+    // the last sample was stable for the debounce time: take it, even if this sample ends it
+    if (s.raw != s.down && time - s.since >= debounce) {
+      s.down = s.raw;
+      if (s.down) {
+        s.start = s.since;
+        s.next = s.since + (uint32_t) c.repeatDelay * 1000;
+        s.longDone = false;
+        if (c.actions & KEY_PRESS) handler(i, KEY_PRESS, s.since + debounce);
+        holdEvents(i, time);
+      }
+    }
+
+    bool held = (bits & c.mask) == c.mask;
+    if (held != s.raw) {
+      s.raw = held;
+      s.since = time;
+    }
+  }
+}
+
+// repeat and long press events of a held combo due up to time
+void KeyComboEngine::holdEvents(uint8_t i, uint32_t time) {
+  const KeyCombo& c = table[i];
+  State& s = state[i];
+  if ((c.actions & KEY_REPEAT) && c.repeatInterval) {
+    while ((int32_t)(time - s.next) >= 0) {
+      handler(i, KEY_REPEAT, s.next);
+      s.next += (uint32_t) c.repeatInterval * 1000;
+    }
+  }
+  uint32_t longPress = (uint32_t) c.longPress * 1000;
+  if ((c.actions & KEY_LONG) && !s.longDone && time - s.start >= longPress) {
+    s.longDone = true;
+    handler(i, KEY_LONG, s.start + longPress);
+  }
+}
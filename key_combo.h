@@ -0,0 +1,93 @@
+/*                                                                          *
+ * Steering wheel key combinations                                          *
+ *                                                                          *
+ * All combos of one table are evaluated in one pass over the button byte   *
+ * of a frame, timed by the frame's reception timestamp instead of the      *
+ * loop() period. A press is debounced from the frame where it starts, so   *
+ * it is reported even if it was already released when loop() runs.        *
+ *                                                                          *
+ *   KEY_PRESS   once, after debounce                                       *
+ *   KEY_REPEAT  every repeatInterval while held, first after repeatDelay   *
+ *   KEY_LONG    once, after holding longPress                              *
+ *                                                                          *
+ * The button byte is built by kombiButtons() from a KOMBI_A5 frame with    *
+ * the generated extractors, the DBC places the buttons on the bus.         *
+ *                                                                          */
+#ifndef KEY_COMBO_H
+#define KEY_COMBO_H
+
+
+#include <stdint.h>
+#include "w211_signals.h"
+
+// maximum number of combos per table
+#define KEY_COMBO_MAX 16
+
+// actions, combined in KeyCombo::actions
+#define KEY_PRESS  0x01
+#define KEY_REPEAT 0x02
+#define KEY_LONG   0x04
+
+// one combo: all buttons of mask held
+struct KeyCombo {
+  uint8_t mask;            // button bits, all must be down
+  uint8_t actions;         // KEY_PRESS | KEY_REPEAT | KEY_LONG
+  uint16_t debounce;       // ms
+  uint16_t repeatDelay;    // ms press to first repeat
+  uint16_t repeatInterval; // ms
+  uint16_t longPress;      // ms
+};
+
+// steering wheel buttons, bits of KeyCombo::mask
+#define BTN_NEXT  0x01 // BUTTON_1_1 - Nächstes Display
+#define BTN_PREV  0x02 // BUTTON_1_2 - Vorheriges Display
+#define BTN_PLUS  0x04 // BUTTON_3_1 - Taste "+"
+#define BTN_MINUS 0x08 // BUTTON_3_2 - Taste "-"
+#define BTN_SEND  0x10 // BUTTON_4_1 - Telefon Send
+#define BTN_END   0x20 // BUTTON_4_2 - Telefon End
+
+// button byte of a KOMBI_A5 frame
+inline uint8_t kombiButtons(const uint8_t* d) {
+  using namespace w211::KOMBI_A5;
+  return (BUTTON_1_1(d) ? BTN_NEXT : 0) | (BUTTON_1_2(d) ? BTN_PREV : 0) |
+    (BUTTON_3_1(d) ? BTN_PLUS : 0) | (BUTTON_3_2(d) ? BTN_MINUS : 0) |
+    (BUTTON_4_1(d) ? BTN_SEND : 0) | (BUTTON_4_2(d) ? BTN_END : 0);
+}
+
+// called for every event, time = when it happened (us, frame clock)
+typedef void (*KeyHandler)(uint8_t combo, uint8_t action, uint32_t time);
+
+
+class KeyComboEngine {
+  private:
+    struct State {
+      bool raw;            // combo held in the last sample
+      bool down;           // debounced
+      bool longDone;
+      uint32_t since;      // raw change, us
+      uint32_t start;      // debounced press, from the raw change, us
+      uint32_t next;       // next repeat, us
+    };
+    const KeyCombo* table;
+    uint8_t count;
+    KeyHandler handler;
+    State state[KEY_COMBO_MAX] = {};
+    uint8_t buttons = 0;
+    uint32_t last = 0;     // latest sample or poll time
+    bool started = false;
+    void holdEvents(uint8_t i, uint32_t time);
+  public:
+    KeyComboEngine(const KeyCombo* table, uint8_t count, KeyHandler handler)
+      : table(table), count(count < KEY_COMBO_MAX ? count : KEY_COMBO_MAX), handler(handler) {}
+
+    // new button byte received at time (us), timestamps older than the last sample count as the last
+    void update(uint8_t bits, uint32_t time);
+
+    // advance the timers without a new frame (repeat, long press, debounce of the last sample)
+    void poll(uint32_t time) { update(buttons, time); }
+
+    // debounced state of a combo
+    bool isDown(uint8_t combo) const { return combo < count && state[combo].down; }
+};
+
+#endif /* KEY_COMBO_H */
@@ -0,0 +1,231 @@
+/*                                                                          *
+ * Level history                                                            *
+ *                                                                          */
+#include "level_history.h"
+#include <string.h>
+#include <math.h>
+
+
+void LevelStats::add(uint8_t level) {
+  if (!count || level < min) min = level;
+  if (!count || level > max) max = level;
+  count++;
+  sum += level;
+  sumSq += (uint32_t) level * level;
+}
+
+float LevelStats::stddev() const {
+  if (count < 2) return 0;
+  float m = mean();
+  float var = (float) sumSq / count - m * m;
+  return var > 0 ? sqrtf(var) : 0;
+}
+
+
+void LevelHistory::Acc::start(uint32_t t) {
+  time = t;
+  count = 0;
+  memset(min, 0xFF, sizeof(min));
+  memset(max, 0x00, sizeof(max));
+  memset(sum, 0x00, sizeof(sum));
+}
+
+void LevelHistory::Acc::merge(const Acc& o) {
+  if (!o.count) return;
+  for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+    if (o.min[w] < min[w]) min[w] = o.min[w];
+    if (o.max[w] > max[w]) max[w] = o.max[w];
+    sum[w] += o.sum[w];
+  }
+  count += o.count;
+  mode = o.mode;
+}
+
+LevelHistory::Bucket LevelHistory::Acc::close() const {
+  Bucket b;
+  b.time = time;
+  b.count = count < 0xFFFF ? count : 0xFFFF;
+  b.mode = mode;
+  for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+    b.min[w] = min[w];
+    b.max[w] = max[w];
+    b.mean[w] = ((uint64_t) sum[w] * 256 + count / 2) / count;
+  }
+  return b;
+}
+
+
+size_t LevelHistory::capacity(uint8_t tier) {
+  switch (tier) {
+    case LEVEL_TIER_RAW:    return LEVEL_RAW_SAMPLES;
+    case LEVEL_TIER_SECOND: return LEVEL_SECONDS;
+    default:                return LEVEL_MINUTES;
+  }
+}
+
+void LevelHistory::push(uint8_t tier, const Bucket& b) {
+  Bucket* ring = tier == LEVEL_TIER_SECOND ? seconds : minutes;
+  size_t cap = capacity(tier);
+  ring[head[tier]] = b;
+  head[tier] = (head[tier] + 1) % cap;
+  if (used[tier] < cap) used[tier]++;
+}
+
+void LevelHistory::add(uint32_t time, const uint8_t level[LEVEL_WHEELS], uint8_t mode) {
+  if (mode >= LEVEL_MODES) return;
+  if (!started) {
+    started = true;
+    second.start(time - time % 1000);
+    minute.start(time - time % 60000);
+    lastMode = mode;
+    switchTime = time;
+  }
+
+  // close the buckets whose time is over, the second one first as it belongs to the minute
+  if (time - second.time >= 1000) {
+    if (second.count) {
+      push(LEVEL_TIER_SECOND, second.close());
+      minute.merge(second);
+    }
+    second.start(time - time % 1000);
+  }
+  if (time - minute.time >= 60000) {
+    if (minute.count) push(LEVEL_TIER_MINUTE, minute.close());
+    minute.start(time - time % 60000);
+  }
+
+  Sample& s = raw[head[LEVEL_TIER_RAW]];
+  s.time = time;
+  memcpy(s.level, level, LEVEL_WHEELS);
+  s.mode = mode;
+  head[LEVEL_TIER_RAW] = (head[LEVEL_TIER_RAW] + 1) % LEVEL_RAW_SAMPLES;
+  if (used[LEVEL_TIER_RAW] < LEVEL_RAW_SAMPLES) used[LEVEL_TIER_RAW]++;
+
+  if (mode != lastMode) {
+    lastMode = mode;
+    switchTime = time;
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) switchStats[w].clear();
+  }
+  for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+    if (level[w] < second.min[w]) second.min[w] = level[w];
+    if (level[w] > second.max[w]) second.max[w] = level[w];
+    second.sum[w] += level[w];
+    modeStats[mode][w].add(level[w]);
+    switchStats[w].add(level[w]);
+  }
+  second.count++;
+  second.mode = mode;
+}
+
+// i = 0 is the oldest entry
+uint32_t LevelHistory::timeAt(uint8_t tier, size_t i) const {
+  size_t cap = capacity(tier);
+  size_t p = (head[tier] + cap - used[tier] + i) % cap;
+  if (tier == LEVEL_TIER_RAW) return raw[p].time;
+  return tier == LEVEL_TIER_SECOND ? seconds[p].time : minutes[p].time;
+}
+
+uint8_t LevelHistory::modeAt(uint8_t tier, size_t i) const {
+  size_t cap = capacity(tier);
+  size_t p = (head[tier] + cap - used[tier] + i) % cap;
+  if (tier == LEVEL_TIER_RAW) return raw[p].mode;
+  return tier == LEVEL_TIER_SECOND ? seconds[p].mode : minutes[p].mode;
+}
+
+LevelPoint LevelHistory::point(uint8_t tier, uint8_t wheel, size_t i) const {
+  size_t cap = capacity(tier);
+  size_t p = (head[tier] + cap - used[tier] + i) % cap;
+  LevelPoint pt;
+  if (tier == LEVEL_TIER_RAW) {
+    pt.time = raw[p].time;
+    pt.mean = raw[p].level[wheel] << 8;
+    pt.min = pt.max = raw[p].level[wheel];
+  } else {
+    const Bucket& b = tier == LEVEL_TIER_SECOND ? seconds[p] : minutes[p];
+    pt.time = b.time;
+    pt.mean = b.mean[wheel];
+    pt.min = b.min[wheel];
+    pt.max = b.max[wheel];
+  }
+  return pt;
+}
+
+// first entry at or after from, binary search
+size_t LevelHistory::firstFrom(uint8_t tier, uint32_t from) const {
+  size_t lo = 0, hi = used[tier];
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if ((int32_t)(timeAt(tier, mid) - from) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+uint8_t LevelHistory::tierFor(uint32_t now, uint32_t window) const {
+  uint32_t from = now - window;
+  for (uint8_t tier = 0; tier < LEVEL_TIER_COUNT; tier++) {
+    // a ring that never wrapped holds everything since the first frame
+    if (used[tier] < capacity(tier) || (int32_t)(timeAt(tier, 0) - from) <= 0) return tier;
+  }
+  return LEVEL_TIER_MINUTE;
+}
+
+size_t LevelHistory::query(uint8_t tier, uint8_t wheel, uint32_t from, LevelPoint* out, size_t maxPoints) const {
+  size_t first = firstFrom(tier, from);
+  size_t n = used[tier] - first;
+  if (n <= maxPoints || maxPoints < 3) {
+    if (n > maxPoints) {
+      first += n - maxPoints;
+      n = maxPoints;
+    }
+    for (size_t i = 0; i < n; i++) out[i] = point(tier, wheel, first + i);
+    return n;
+  }
+
+  // LTTB: keep first and last, per bucket the point spanning the largest
+  // triangle with the last kept point and the mean of the next bucket
+  size_t m = maxPoints;
+  size_t k = 0;
+  out[k++] = point(tier, wheel, first);
+  for (size_t i = 0; i < m - 2; i++) {
+    size_t lo = 1 + i * (n - 2) / (m - 2);
+    size_t hi = 1 + (i + 1) * (n - 2) / (m - 2);
+    size_t nlo = hi;
+    size_t nhi = i == m - 3 ? n : 1 + (i + 2) * (n - 2) / (m - 2);
+    const LevelPoint& a = out[k - 1];
+    int64_t sx = 0, sy = 0;
+    for (size_t j = nlo; j < nhi; j++) {
+      LevelPoint c = point(tier, wheel, first + j);
+      sx += (int32_t)(c.time - a.time);
+      sy += c.mean;
+    }
+    int64_t cnt = nhi - nlo;
+    int64_t cx = sx / cnt;
+    int64_t cy = sy / cnt - a.mean;
+    int64_t best = -1;
+    LevelPoint pick = a;
+    for (size_t j = lo; j < hi; j++) {
+      LevelPoint b = point(tier, wheel, first + j);
+      int64_t area = (int64_t)(int32_t)(b.time - a.time) * cy - cx * ((int32_t) b.mean - a.mean);
+      if (area < 0) area = -area;
+      if (area > best) {
+        best = area;
+        pick = b;
+      }
+    }
+    out[k++] = pick;
+  }
+  out[k++] = point(tier, wheel, first + n - 1);
+  return k;
+}
+
+size_t LevelHistory::modeChanges(uint8_t tier, uint32_t from, uint32_t* time, uint8_t* mode, size_t max) const {
+  size_t k = 0;
+  for (size_t i = firstFrom(tier, from); i < used[tier] && k < max; i++) {
+    uint8_t m = modeAt(tier, i);
+    if (k && mode[k - 1] == m) continue;
+    time[k] = timeAt(tier, i);
+    mode[k++] = m;
+  }
+  return k;
+}
@@ -0,0 +1,126 @@
+/*                                                                          *
+ * Level history                                                            *
+ *                                                                          *
+ * Fixed size time series of the FS_340h vehicle levels, one ring per       *
+ * resolution:                                                              *
+ *                                                                          *
+ *   raw      every frame, the last LEVEL_RAW_SAMPLES (~10 s at 50 Hz)      *
+ *   second   1 s buckets, min / max / mean per wheel, LEVEL_SECONDS        *
+ *   minute   1 min buckets, merged from the second buckets, LEVEL_MINUTES  *
+ *                                                                          *
+ * add() is O(1): it appends the raw sample, updates the open 1 s bucket    *
+ * and the per mode statistics, and closes a bucket when its time is over.  *
+ * query() picks the finest ring covering the window and reduces it to at   *
+ * most maxPoints with largest-triangle-three-buckets (LTTB) on the mean.   *
+ *                                                                          */
+#ifndef LEVEL_HISTORY_H
+#define LEVEL_HISTORY_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LEVEL_WHEELS 4          // FZGN_VL, FZGN_VR, FZGN_HL, FZGN_HR
+#define LEVEL_MODES 5           // >= MODE_COUNT
+#define LEVEL_RAW_SAMPLES 512
+#define LEVEL_SECONDS 300       // 5 min
+#define LEVEL_MINUTES 240       // 4 h
+#define LEVEL_POINTS_MAX 150    // per wheel and query
+
+enum LevelTier : uint8_t {
+  LEVEL_TIER_RAW,
+  LEVEL_TIER_SECOND,
+  LEVEL_TIER_MINUTE,
+  LEVEL_TIER_COUNT
+};
+
+// one point of a query result
+struct LevelPoint {
+  uint32_t time;   // ms, sample or bucket start
+  uint16_t mean;   // 1/256
+  uint8_t min;
+  uint8_t max;
+};
+
+// incremental statistics of one wheel
+struct LevelStats {
+  uint32_t count;
+  uint8_t min;
+  uint8_t max;
+  uint64_t sum;
+  uint64_t sumSq;
+  void add(uint8_t level);
+  void clear() { count = 0; min = 0; max = 0; sum = 0; sumSq = 0; }
+  float mean() const { return count ? (float) sum / count : 0; }
+  float stddev() const;
+};
+
+
+class LevelHistory {
+  private:
+    struct Sample {
+      uint32_t time;
+      uint8_t level[LEVEL_WHEELS];
+      uint8_t mode;
+    };
+    struct Bucket {
+      uint32_t time;
+      uint16_t count;
+      uint8_t mode;                  // at the end of the bucket
+      uint8_t min[LEVEL_WHEELS];
+      uint8_t max[LEVEL_WHEELS];
+      uint16_t mean[LEVEL_WHEELS];   // 1/256
+    };
+    // open bucket, exact sums
+    struct Acc {
+      uint32_t time;
+      uint32_t count;
+      uint8_t mode;
+      uint8_t min[LEVEL_WHEELS];
+      uint8_t max[LEVEL_WHEELS];
+      uint32_t sum[LEVEL_WHEELS];
+      void start(uint32_t t);
+      void merge(const Acc& o);
+      Bucket close() const;
+    };
+    Sample raw[LEVEL_RAW_SAMPLES];
+    Bucket seconds[LEVEL_SECONDS];
+    Bucket minutes[LEVEL_MINUTES];
+    size_t head[LEVEL_TIER_COUNT] = {};  // next write
+    size_t used[LEVEL_TIER_COUNT] = {};
+    Acc second = {};
+    Acc minute = {};
+    bool started = false;
+    LevelStats modeStats[LEVEL_MODES][LEVEL_WHEELS] = {};
+    LevelStats switchStats[LEVEL_WHEELS] = {};
+    uint8_t lastMode = 0;
+    uint32_t switchTime = 0;
+
+    static size_t capacity(uint8_t tier);
+    LevelPoint point(uint8_t tier, uint8_t wheel, size_t i) const;
+    uint32_t timeAt(uint8_t tier, size_t i) const;
+    uint8_t modeAt(uint8_t tier, size_t i) const;
+    size_t firstFrom(uint8_t tier, uint32_t from) const;
+    void push(uint8_t tier, const Bucket& b);
+  public:
+    // one FS_340h frame, time = ms of reception, non-decreasing
+    void add(uint32_t time, const uint8_t level[LEVEL_WHEELS], uint8_t mode);
+
+    // finest tier holding the window [now - window, now]
+    uint8_t tierFor(uint32_t now, uint32_t window) const;
+
+    // one wheel from time from on, at most maxPoints (LTTB), returns the number of points
+    size_t query(uint8_t tier, uint8_t wheel, uint32_t from, LevelPoint* out, size_t maxPoints) const;
+
+    // mode changes from time from on: times and modes, returns the number written
+    size_t modeChanges(uint8_t tier, uint32_t from, uint32_t* time, uint8_t* mode, size_t max) const;
+
+    // since boot per mode, and since the last mode change
+    const LevelStats& stats(uint8_t mode, uint8_t wheel) const { return modeStats[mode][wheel]; }
+    const LevelStats& sinceSwitch(uint8_t wheel) const { return switchStats[wheel]; }
+    uint8_t currentMode() const { return lastMode; }
+    uint32_t switchedAt() const { return switchTime; }
+    size_t size(uint8_t tier) const { return used[tier]; }
+};
+
+#endif /* LEVEL_HISTORY_H */
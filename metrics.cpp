@@ -0,0 +1,105 @@
+/*                                                                          *
+ * Runtime metrics                                                          *
+ *                                                                          */
+#include "metrics.h"
+
+Metrics metrics;
+
+static const char* const busNames[CAN_BUSES] = { "can_c", "can_b" };
+
+
+void Metrics::watchTask(const char* name, TaskHandle_t* handle) {
+  if (taskCount < METRIC_TASKS) {
+    tasks[taskCount++] = { name, handle };
+  }
+}
+
+// cumulative buckets le="2^i-1", then +Inf, sum and count
+void Metrics::writeHistogram(Print& out, const char* name, const char* labels, const MetricHistogram& h) {
+  const char* sep = labels[0] ? "," : "";
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < METRIC_BUCKETS - 1; i++) {
+    total += h.count[i].load(std::memory_order_relaxed);
+    out.printf("%s_bucket{%s%sle=\"%u\"} %u\n", name, labels, sep, (unsigned int)((1UL << i) - 1), total);
+  }
+  total += h.count[METRIC_BUCKETS - 1].load(std::memory_order_relaxed);
+  out.printf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, sep, total);
+  out.printf("%s_sum{%s} %u\n", name, labels, h.sum.load(std::memory_order_relaxed));
+  out.printf("%s_count{%s} %u\n", name, labels, total);
+}
+
+void Metrics::write(Print& out) {
+  char labels[48];
+
+  out.print("# HELP airmatic_can_frames_total CAN frames received per registered message\n"
+            "# TYPE airmatic_can_frames_total counter\n");
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    out.printf("airmatic_can_frames_total{bus=\"%s\",id=\"0x%03X\",name=\"%s\"} %u\n",
+      busNames[canMessages[i].bus], canMessages[i].id, canMessages[i].name, frames[i].get());
+  }
+
+  struct { const char* name; const char* help; MetricCounter* c; } busCounters[] = {
+    { "airmatic_can_unregistered_total", "CAN frames not in the message registry", unregistered },
+    { "airmatic_can_error_irq_total", "MCP2515 ERRIF interrupts", errorIrq },
+    { "airmatic_can_message_error_total", "MCP2515 MERRF interrupts", messageError },
+    { "airmatic_can_rx_overflow_total", "MCP2515 receive buffer overflows", rxOverflow },
+    { "airmatic_can_error_passive_total", "MCP2515 error passive flags seen", errorPassive },
+    { "airmatic_can_bus_off_total", "MCP2515 bus-off flags seen", busOff },
+    { "airmatic_can_spi_bytes_total", "SPI bytes of the MCP2515 receive path", spiBytes },
+    { "airmatic_can_wake_overflow_total", "MCP2515 receive buffer overflows while in light sleep", wakeOverflow },
+  };
+  for (auto& bc : busCounters) {
+    out.printf("# HELP %s %s\n# TYPE %s counter\n", bc.name, bc.help, bc.name);
+    for (uint8_t b = 0; b < CAN_BUSES; b++) {
+      out.printf("%s{bus=\"%s\"} %u\n", bc.name, busNames[b], bc.c[b].get());
+    }
+  }
+
+  out.print("# HELP airmatic_can_latency_us CAN interrupt to decoded frame\n"
+            "# TYPE airmatic_can_latency_us histogram\n");
+  for (uint8_t b = 0; b < CAN_BUSES; b++) {
+    snprintf(labels, sizeof(labels), "bus=\"%s\"", busNames[b]);
+    writeHistogram(out, "airmatic_can_latency_us", labels, canLatency[b]);
+  }
+  out.print("# HELP airmatic_loop_period_us loop() period\n"
+            "# TYPE airmatic_loop_period_us histogram\n");
+  writeHistogram(out, "airmatic_loop_period_us", "", loopPeriod);
+  out.print("# HELP airmatic_output_period_us output task period\n"
+            "# TYPE airmatic_output_period_us histogram\n");
+  writeHistogram(out, "airmatic_output_period_us", "", outputPeriod);
+  out.print("# HELP airmatic_flash_write_us config record write duration\n"
+            "# TYPE airmatic_flash_write_us histogram\n");
+  writeHistogram(out, "airmatic_flash_write_us", "", flashWrite);
+
+  out.print("# HELP airmatic_sleeps_total light sleeps while the CAN buses were quiet\n"
+            "# TYPE airmatic_sleeps_total counter\n");
+  out.printf("airmatic_sleeps_total %u\n", sleeps.get());
+  out.print("# HELP airmatic_sleep_seconds_total time in light sleep\n"
+            "# TYPE airmatic_sleep_seconds_total counter\n");
+  out.printf("airmatic_sleep_seconds_total %u.%03u\n", sleepMs.get() / 1000, sleepMs.get() % 1000);
+  out.print("# HELP airmatic_wake_latency_us resume from light sleep to first CAN frame received\n"
+            "# TYPE airmatic_wake_latency_us histogram\n");
+  writeHistogram(out, "airmatic_wake_latency_us", "", wakeLatency);
+
+  out.print("# HELP airmatic_heap_free_bytes free heap\n"
+            "# TYPE airmatic_heap_free_bytes gauge\n");
+  out.printf("airmatic_heap_free_bytes %u\n", ESP.getFreeHeap());
+  out.print("# HELP airmatic_heap_min_free_bytes lowest free heap since boot\n"
+            "# TYPE airmatic_heap_min_free_bytes gauge\n");
+  out.printf("airmatic_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+  out.print("# HELP airmatic_heap_largest_block_bytes largest free heap block\n"
+            "# TYPE airmatic_heap_largest_block_bytes gauge\n");
+  out.printf("airmatic_heap_largest_block_bytes %u\n", ESP.getMaxAllocHeap());
+
+  out.print("# HELP airmatic_task_stack_free_bytes task stack high-water mark\n"
+            "# TYPE airmatic_task_stack_free_bytes gauge\n");
+  for (uint8_t t = 0; t < taskCount; t++) {
+    TaskHandle_t handle = *tasks[t].handle;
+    if (!handle) continue;
+    out.printf("airmatic_task_stack_free_bytes{task=\"%s\"} %u\n", tasks[t].name, uxTaskGetStackHighWaterMark(handle));
+  }
+
+  out.print("# HELP airmatic_uptime_seconds time since boot\n"
+            "# TYPE airmatic_uptime_seconds counter\n");
+  out.printf("airmatic_uptime_seconds %u\n", (uint32_t)(esp_timer_get_time() / 1000000));
+}
@@ -0,0 +1,82 @@
+/*                                                                          *
+ * Runtime metrics                                                          *
+ *                                                                          *
+ * Counters and fixed power of 2 bucket histograms, updated with relaxed    *
+ * atomics from any task or ISR, exported in Prometheus text format.        *
+ *                                                                          */
+#ifndef METRICS_H
+#define METRICS_H
+
+
+#include <Arduino.h>
+#include <atomic>
+#include "can_registry.h"
+
+// histogram buckets, bucket i counts values below 2^i us, last = overflow
+#define METRIC_BUCKETS 20 // 1 us .. 0.5 s
+
+// task stack high-water marks in the export
+#define METRIC_TASKS 8
+
+
+// event counter
+struct MetricCounter {
+  std::atomic<uint32_t> value{0};
+  void inc() { value.fetch_add(1, std::memory_order_relaxed); }
+  void add(uint32_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// latency / duration histogram in us
+struct MetricHistogram {
+  std::atomic<uint32_t> count[METRIC_BUCKETS] = {};
+  std::atomic<uint32_t> sum{0}; // wraps, seen as counter reset
+  void record(uint32_t us) {
+    uint8_t i = us ? 32 - __builtin_clz(us) : 0;
+    count[i < METRIC_BUCKETS ? i : METRIC_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(us, std::memory_order_relaxed);
+  }
+};
+
+
+class Metrics {
+  private:
+    struct Task {
+      const char* name;
+      TaskHandle_t* handle; // handle variable, the task may be created later
+    };
+    Task tasks[METRIC_TASKS];
+    uint8_t taskCount = 0;
+    void writeHistogram(Print& out, const char* name, const char* labels, const MetricHistogram& h);
+  public:
+    // CAN receive path, per bus
+    MetricCounter frames[CAN_MSG_COUNT];       // per registered message
+    MetricCounter unregistered[CAN_BUSES];     // passed the MCP2515 filters, not in the registry
+    MetricCounter errorIrq[CAN_BUSES];         // ERRIF
+    MetricCounter messageError[CAN_BUSES];     // MERRF
+    MetricCounter rxOverflow[CAN_BUSES];       // RX0OVR / RX1OVR
+    MetricCounter errorPassive[CAN_BUSES];     // RXEP / TXEP
+    MetricCounter busOff[CAN_BUSES];           // TXBO
+    MetricCounter spiBytes[CAN_BUSES];         // SPI bytes of the receive path
+    MetricHistogram canLatency[CAN_BUSES];     // ISR to decoded
+
+    MetricHistogram loopPeriod;
+    MetricHistogram outputPeriod;
+    MetricHistogram flashWrite;                // config record write duration
+
+    // light sleep while the buses are quiet, see Power.ino
+    MetricCounter sleeps;
+    MetricCounter sleepMs;                     // time in light sleep
+    MetricHistogram wakeLatency;               // resume to first frame received
+    MetricCounter wakeOverflow[CAN_BUSES];     // RX overflow in the first drain after wake
+
+    // report the stack high-water mark of a task
+    void watchTask(const char* name, TaskHandle_t* handle);
+
+    // Prometheus text exposition format
+    void write(Print& out);
+};
+
+extern Metrics metrics;
+
+#endif /* METRICS_H */
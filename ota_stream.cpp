@@ -0,0 +1,430 @@
+/*                                                                          *
+ * Streaming OTA image decompressor                                         *
+ *                                                                          */
+#include "ota_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+// CRC-32 per nibble, 64 byte table
+static const uint32_t crcTable[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// deflate length and distance codes (RFC 1951 3.2.5)
+static const uint16_t lenBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lenExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+  1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t codeOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// gzip header flags
+#define GZIP_FHCRC    0x02
+#define GZIP_FEXTRA   0x04
+#define GZIP_FNAME    0x08
+#define GZIP_FCOMMENT 0x10
+
+
+uint32_t otaCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ crcTable[crc & 15];
+    crc = (crc >> 4) ^ crcTable[crc & 15];
+  }
+  return ~crc;
+}
+
+
+OtaResult OtaStream::begin(OtaCodec codec, OtaSink sink, uint8_t windowBits, uint8_t lookaheadBits) {
+  end();
+  this->codec = codec;
+  this->sink = sink;
+  error = OTA_OK;
+  last = false;
+  gzipFlags = 0;
+  remain = 0;
+  inLen = inPos = 0;
+  bitBuf = 0;
+  bitCount = 0;
+  written = flushed = 0;
+  crc = 0;
+  if (codec == OTA_RAW) {
+    state = ST_RAW;
+    return OTA_OK;
+  }
+  if (codec == OTA_GZIP) {
+    windowBits = OTA_GZIP_WINDOW;
+  } else if (windowBits < 4 || windowBits > 15 || lookaheadBits < 3 || lookaheadBits >= windowBits) {
+    return fail(OTA_BAD_DATA);
+  }
+  hsIndex = windowBits;
+  hsCount = lookaheadBits;
+  // zeroed, heatshrink back references may reach before the start
+  window = (uint8_t*) calloc(1UL << windowBits, 1);
+  if (!window) return fail(OTA_NO_MEMORY);
+  mask = (1UL << windowBits) - 1;
+  state = codec == OTA_GZIP ? ST_GZIP_HEADER : ST_HS;
+  return OTA_OK;
+}
+
+void OtaStream::end() {
+  free(window);
+  window = nullptr;
+  state = ST_DONE;
+}
+
+OtaResult OtaStream::fail(OtaResult result) {
+  error = result;
+  state = ST_ERROR;
+  return result;
+}
+
+OtaResult OtaStream::write(const uint8_t* data, size_t len) {
+  if (state == ST_ERROR) return error;
+  if (state == ST_DONE) return OTA_DONE;
+  if (state == ST_RAW) {
+    if (len && sink((uint8_t*) data, len) != len) return fail(OTA_SINK_ERROR);
+    written += len;
+    flushed = written;
+    return OTA_OK;
+  }
+  while (len && state != ST_DONE && state != ST_ERROR) {
+    // keep the bytes of the step in progress, append new input
+    if (inPos) {
+      memmove(in, in + inPos, inLen - inPos);
+      inLen -= inPos;
+      inPos = 0;
+    }
+    size_t n = len < OTA_IN_SIZE - inLen ? len : OTA_IN_SIZE - inLen;
+    if (!n) return fail(OTA_BAD_DATA); // step larger than the buffer
+    memcpy(in + inLen, data, n);
+    inLen += n;
+    data += n;
+    len -= n;
+    run();
+  }
+  if (state != ST_ERROR) flush();
+  return state == ST_ERROR ? error : state == ST_DONE ? OTA_DONE : OTA_OK;
+}
+
+OtaResult OtaStream::finish() {
+  if (state == ST_ERROR) return error;
+  if (state == ST_RAW) state = ST_DONE;
+  run();
+  if (state == ST_HS) {
+    // heatshrink has no end marker, the last byte is padded with less than a step
+    if ((inLen - inPos) * 8 + bitCount < 8u) state = ST_DONE;
+  }
+  if (state != ST_ERROR) flush();
+  if (state == ST_ERROR) return error;
+  return state == ST_DONE ? OTA_DONE : fail(OTA_BAD_DATA);
+}
+
+// run steps until one needs more input
+void OtaStream::run() {
+  while (state != ST_DONE && state != ST_ERROR) {
+    size_t pos = inPos;
+    uint32_t buf = bitBuf;
+    uint8_t count = bitCount;
+    underrun = false;
+    if (!step()) {
+      if (state != ST_ERROR) fail(OTA_BAD_DATA);
+      return;
+    }
+    if (underrun) {
+      inPos = pos;
+      bitBuf = buf;
+      bitCount = count;
+      return;
+    }
+  }
+}
+
+// n bits, LSB first
+uint32_t OtaStream::bits(uint8_t n) {
+  while (bitCount < n) {
+    if (inPos >= inLen) {
+      underrun = true;
+      return 0;
+    }
+    bitBuf |= (uint32_t) in[inPos++] << bitCount;
+    bitCount += 8;
+  }
+  uint32_t value = bitBuf & ((1UL << n) - 1);
+  bitBuf >>= n;
+  bitCount -= n;
+  return value;
+}
+
+// n bits, MSB first
+uint32_t OtaStream::bitsMsb(uint8_t n) {
+  while (bitCount < n) {
+    if (inPos >= inLen) {
+      underrun = true;
+      return 0;
+    }
+    bitBuf = (bitBuf << 8) | in[inPos++];
+    bitCount += 8;
+  }
+  bitCount -= n;
+  return (bitBuf >> bitCount) & ((1UL << n) - 1);
+}
+
+// next symbol, -1 if out of input or invalid
+int OtaStream::decode(const Huffman& h) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (uint8_t len = 1; len < 16; len++) {
+    code |= bits(1);
+    if (underrun) return -1;
+    int count = h.count[len];
+    if (code - count < first) return h.symbol[index + (code - first)];
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+// canonical code from the code lengths, false if over-subscribed
+bool OtaStream::build(Huffman& h, const uint8_t* length, uint16_t n) {
+  uint16_t offs[16];
+  memset(h.count, 0, sizeof(h.count));
+  for (uint16_t i = 0; i < n; i++) h.count[length[i]]++;
+  h.count[0] = 0;
+  int left = 1;
+  for (uint8_t len = 1; len < 16; len++) {
+    left = (left << 1) - h.count[len];
+    if (left < 0) return false;
+  }
+  offs[1] = 0;
+  for (uint8_t len = 1; len < 15; len++) offs[len + 1] = offs[len] + h.count[len];
+  for (uint16_t i = 0; i < n; i++) {
+    if (length[i]) h.symbol[offs[length[i]]++] = i;
+  }
+  return true;
+}
+
+void OtaStream::fixedTables() {
+  uint8_t length[288];
+  memset(length, 8, 144);
+  memset(length + 144, 9, 112);
+  memset(length + 256, 7, 24);
+  memset(length + 280, 8, 8);
+  build(lencode, length, 288);
+  memset(length, 5, 30);
+  build(distcode, length, 30);
+}
+
+// code tables of a dynamic block, true on underrun (retried)
+bool OtaStream::dynamicTables() {
+  uint8_t length[286 + 30];
+  uint16_t nlen = bits(5) + 257;
+  uint16_t ndist = bits(5) + 1;
+  uint8_t ncode = bits(4) + 4;
+  if (underrun) return true;
+  if (nlen > 286 || ndist > 30) return false;
+
+  // code length code, built in lencode, replaced below
+  memset(length, 0, 19);
+  for (uint8_t i = 0; i < ncode; i++) length[codeOrder[i]] = bits(3);
+  if (underrun) return true;
+  if (!build(lencode, length, 19)) return false;
+
+  uint16_t index = 0;
+  while (index < nlen + ndist) {
+    int sym = decode(lencode);
+    if (underrun) return true;
+    if (sym < 0) return false;
+    if (sym < 16) {
+      length[index++] = sym;
+      continue;
+    }
+    uint8_t len = 0;
+    uint16_t rep;
+    if (sym == 16) {
+      if (!index) return false;
+      len = length[index - 1];
+      rep = 3 + bits(2);
+    } else if (sym == 17) {
+      rep = 3 + bits(3);
+    } else {
+      rep = 11 + bits(7);
+    }
+    if (underrun) return true;
+    if (index + rep > nlen + ndist) return false;
+    while (rep--) length[index++] = len;
+  }
+  if (!length[256]) return false; // no end of block code
+  return build(lencode, length, nlen) && build(distcode, length + nlen, ndist);
+}
+
+void OtaStream::put(uint8_t b) {
+  window[written & mask] = b;
+  written++;
+  if (!(written & mask)) flush(); // window wraps
+}
+
+bool OtaStream::copy(uint32_t dist, uint16_t len) {
+  if (dist > mask + 1 || (codec == OTA_GZIP && dist > written)) return false;
+  while (len--) put(window[(written - dist) & mask]);
+  return state != ST_ERROR;
+}
+
+// output since the last flush, contiguous as put() flushes when the window wraps
+bool OtaStream::flush() {
+  size_t n = written - flushed;
+  if (!n) return true;
+  uint8_t* p = window + (flushed & mask);
+  if (codec == OTA_GZIP) crc = otaCrc32(crc, p, n);
+  flushed = written;
+  if (sink(p, n) != n) {
+    fail(OTA_SINK_ERROR);
+    return false;
+  }
+  return true;
+}
+
+// next optional gzip header field
+void OtaStream::headerNext() {
+  if (gzipFlags & GZIP_FEXTRA) state = ST_GZIP_EXTRA;
+  else if (gzipFlags & GZIP_FNAME) state = ST_GZIP_NAME;
+  else if (gzipFlags & GZIP_FCOMMENT) state = ST_GZIP_COMMENT;
+  else if (gzipFlags & GZIP_FHCRC) state = ST_GZIP_HCRC;
+  else state = ST_BLOCK;
+}
+
+// one decoding step, state changes only once all of its input was there, false on bad data
+bool OtaStream::step() {
+  switch (state) {
+    case ST_GZIP_HEADER: {
+      uint8_t id1 = bits(8), id2 = bits(8), method = bits(8), flags = bits(8);
+      bits(16); bits(16); bits(16); // mtime, extra flags, os
+      if (underrun) return true;
+      if (id1 != 0x1F || id2 != 0x8B || method != 8 || (flags & 0xE0)) return false;
+      gzipFlags = flags;
+      headerNext();
+      return true;
+    }
+    case ST_GZIP_EXTRA: {
+      uint16_t len = bits(16);
+      if (underrun) return true;
+      gzipFlags &= ~GZIP_FEXTRA;
+      remain = len;
+      if (remain) state = ST_GZIP_SKIP;
+      else headerNext();
+      return true;
+    }
+    case ST_GZIP_SKIP:
+      bits(8);
+      if (underrun) return true;
+      if (!--remain) headerNext();
+      return true;
+    case ST_GZIP_NAME:
+    case ST_GZIP_COMMENT: {
+      uint8_t b = bits(8);
+      if (underrun) return true;
+      if (!b) {
+        gzipFlags &= state == ST_GZIP_NAME ? ~GZIP_FNAME : ~GZIP_FCOMMENT;
+        headerNext();
+      }
+      return true;
+    }
+    case ST_GZIP_HCRC:
+      bits(16);
+      if (underrun) return true;
+      gzipFlags &= ~GZIP_FHCRC;
+      headerNext();
+      return true;
+
+    case ST_BLOCK: {
+      bool final = bits(1);
+      uint8_t type = bits(2);
+      if (underrun) return true;
+      if (type == 0) {
+        bits(bitCount & 7); // to the byte boundary
+        uint16_t len = bits(16);
+        uint16_t nlen = bits(16);
+        if (underrun) return true;
+        if (len != (uint16_t) ~nlen) return false;
+        remain = len;
+        state = len ? ST_STORED : final ? ST_TRAILER : ST_BLOCK;
+      } else if (type == 1) {
+        fixedTables();
+        state = ST_CODES;
+      } else if (type == 2) {
+        if (!dynamicTables()) return false;
+        if (underrun) return true;
+        state = ST_CODES;
+      } else {
+        return false;
+      }
+      last = final;
+      return true;
+    }
+    case ST_STORED: {
+      uint8_t b = bits(8);
+      if (underrun) return true;
+      put(b);
+      if (!--remain) state = last ? ST_TRAILER : ST_BLOCK;
+      return true;
+    }
+    case ST_CODES: {
+      int sym = decode(lencode);
+      if (underrun) return true;
+      if (sym < 0) return false;
+      if (sym < 256) {
+        put(sym);
+        return true;
+      }
+      if (sym == 256) {
+        state = last ? ST_TRAILER : ST_BLOCK;
+        return true;
+      }
+      sym -= 257;
+      if (sym >= 29) return false;
+      uint16_t len = lenBase[sym] + bits(lenExtra[sym]);
+      int dsym = decode(distcode);
+      if (underrun) return true;
+      if (dsym < 0 || dsym >= 30) return false;
+      uint32_t dist = distBase[dsym] + bits(distExtra[dsym]);
+      if (underrun) return true;
+      return copy(dist, len);
+    }
+    case ST_TRAILER: {
+      bits(bitCount & 7);
+      uint32_t check = bits(16);
+      check |= bits(16) << 16;
+      uint32_t size = bits(16);
+      size |= bits(16) << 16;
+      if (underrun) return true;
+      if (!flush()) return true;
+      if (check != crc || size != written) return false;
+      state = ST_DONE;
+      return true;
+    }
+
+    case ST_HS:
+      if (bitsMsb(1)) {
+        uint8_t b = bitsMsb(8);
+        if (underrun) return true;
+        put(b);
+        return true;
+      } else {
+        uint32_t index = bitsMsb(hsIndex);
+        uint16_t count = bitsMsb(hsCount);
+        if (underrun) return true;
+        return copy(index + 1, count + 1);
+      }
+
+    default:
+      return true;
+  }
+}
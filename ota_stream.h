@@ -0,0 +1,113 @@
+/*                                                                          *
+ * Streaming OTA image decompressor                                         *
+ *                                                                          *
+ * Decompresses a gzip (deflate) or heatshrink image while it is received   *
+ * and hands the output to a sink (Update.write) in pieces of up to the     *
+ * window size. RAM is bounded by the window (gzip 32 KB, heatshrink        *
+ * 2^window bytes) and a 1 KB input buffer, independent of the image size.  *
+ *                                                                          *
+ * Input may be split anywhere: every decoding step (block header, code     *
+ * tables, one symbol) is retried from its first bit once more input has    *
+ * arrived.                                                                 *
+ *                                                                          */
+#ifndef OTA_STREAM_H
+#define OTA_STREAM_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OTA_IN_SIZE 1024 // input buffer, holds the largest step (dynamic code tables, ~560 bytes)
+#define OTA_GZIP_WINDOW 15
+
+enum OtaCodec : uint8_t {
+  OTA_RAW,        // uncompressed, passed through
+  OTA_GZIP,
+  OTA_HEATSHRINK
+};
+
+enum OtaResult : uint8_t {
+  OTA_OK,         // more input expected
+  OTA_DONE,       // end of stream
+  OTA_BAD_DATA,   // corrupt stream, wrong CRC or size
+  OTA_NO_MEMORY,
+  OTA_SINK_ERROR  // sink wrote less than it was given
+};
+
+// output of the decompressor, returns the bytes written
+typedef size_t (*OtaSink)(uint8_t* data, size_t len);
+
+// CRC-32 (IEEE 802.3) continued from crc, 0 to start
+uint32_t otaCrc32(uint32_t crc, const uint8_t* data, size_t len);
+
+
+class OtaStream {
+  private:
+    struct Huffman {
+      uint16_t count[16];  // codes per length
+      uint16_t symbol[288];
+    };
+    enum State : uint8_t {
+      ST_GZIP_HEADER, ST_GZIP_EXTRA, ST_GZIP_SKIP, ST_GZIP_NAME, ST_GZIP_COMMENT, ST_GZIP_HCRC,
+      ST_BLOCK, ST_STORED, ST_CODES, ST_TRAILER,
+      ST_HS, ST_RAW, ST_DONE, ST_ERROR
+    };
+    OtaCodec codec = OTA_RAW;
+    OtaSink sink = nullptr;
+    State state = ST_DONE;
+    OtaResult error = OTA_OK;
+    bool last = false;     // final deflate block
+    uint8_t gzipFlags = 0;
+    uint16_t remain = 0;   // bytes left of a stored block or gzip extra field
+    uint8_t hsIndex = 0;   // heatshrink window bits
+    uint8_t hsCount = 0;   // heatshrink lookahead bits
+
+    // input, bits LSB first (deflate) or MSB first (heatshrink)
+    uint8_t in[OTA_IN_SIZE];
+    size_t inLen = 0;
+    size_t inPos = 0;
+    uint32_t bitBuf = 0;
+    uint8_t bitCount = 0;
+    bool underrun = false; // a step ran out of input, it is retried
+
+    // output window, flushed to the sink before it wraps
+    uint8_t* window = nullptr;
+    uint32_t mask = 0;
+    uint32_t written = 0;  // total output
+    uint32_t flushed = 0;
+    uint32_t crc = 0;      // of the output
+
+    Huffman lencode, distcode;
+
+    uint32_t bits(uint8_t n);
+    uint32_t bitsMsb(uint8_t n);
+    int decode(const Huffman& h);
+    static bool build(Huffman& h, const uint8_t* length, uint16_t n);
+    bool dynamicTables();
+    void fixedTables();
+    void put(uint8_t b);
+    bool copy(uint32_t dist, uint16_t len);
+    bool flush();
+    bool step();
+    void run();
+    void headerNext();
+    OtaResult fail(OtaResult result);
+  public:
+    ~OtaStream() { end(); }
+
+    // start a stream, heatshrink needs its window (4..15) and lookahead (3..window-1) bits
+    OtaResult begin(OtaCodec codec, OtaSink sink, uint8_t windowBits = 0, uint8_t lookaheadBits = 0);
+
+    // decompress len bytes of input, the output is flushed to the sink before returning
+    OtaResult write(const uint8_t* data, size_t len);
+
+    // no more input: OTA_DONE if the stream is complete
+    OtaResult finish();
+
+    // free the window
+    void end();
+
+    uint32_t output() const { return written; }
+};
+
+#endif /* OTA_STREAM_H */
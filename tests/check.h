@@ -0,0 +1,38 @@
+/*                                                                          *
+ * Minimal host test checks                                                 *
+ *                                                                          *
+ * CHECK() reports a failed condition and keeps going, checkDone() prints  *
+ * the verdict and gives the exit code.                                     *
+ *                                                                          */
+#ifndef CHECK_H
+#define CHECK_H
+
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+// CHECK() with the values that matter
+#define CHECKF(cond, ...) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__); \
+      fputc('\n', stderr); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+static inline int checkDone(const char* name) {
+  printf("%s: %s\n", name, checkFailures ? "FAILED" : "ok");
+  return checkFailures ? 1 : 0;
+}
+
+
+#endif /* CHECK_H */
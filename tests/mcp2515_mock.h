@@ -0,0 +1,228 @@
+/*                                                                          *
+ * Register-level MCP2515 model on the host SPI stand-in                    *
+ *                                                                          *
+ * Decodes the SPI instructions byte by byte while its CS pin is low:       *
+ * RESET, READ, WRITE, BIT MODIFY, READ STATUS, RX STATUS, READ RX BUFFER.  *
+ * receive() is the CAN side: RXB0, rollover into RXB1 with BUKT, else      *
+ * RXnOVR in EFLG and ERRIF. CS high after READ RX BUFFER clears RXnIF.     *
+ * Several chips can share the bus, a byte with no or two chips selected    *
+ * is counted as a bus error. hook runs before each byte, tests use it to   *
+ * let frames arrive in the middle of a transaction. With spiClock() set,   *
+ * each byte advances the virtual clock by 8 bit times.                     *
+ *                                                                          */
+#ifndef MCP2515_MOCK_H
+#define MCP2515_MOCK_H
+
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <mcp2515.h>
+
+#define MOCK_RESET       0xC0
+#define MOCK_READ        0x03
+#define MOCK_WRITE       0x02
+#define MOCK_BITMOD      0x05
+#define MOCK_READ_STATUS 0xA0
+#define MOCK_RX_STATUS   0xB0
+
+#define MOCK_CANINTF     0x2C
+#define MOCK_EFLG        0x2D
+#define MOCK_RXB0CTRL    0x60
+#define MOCK_RXB1CTRL    0x70
+
+class Mcp2515Mock {
+  private:
+    uint8_t op = 0;     // instruction of the current CS cycle, 0 = none yet
+    uint8_t phase = 0;  // bytes after the instruction
+    uint8_t addr = 0;
+    uint8_t mask = 0;
+
+    static std::vector<Mcp2515Mock*>& chips() {
+      static std::vector<Mcp2515Mock*> list;
+      return list;
+    }
+
+  public:
+    // chip select, tests that watch other pins forward digitalWrite() here
+    static void chipSelect(uint8_t pin, uint8_t value) {
+      std::lock_guard<std::recursive_mutex> guard(lock());
+      for (Mcp2515Mock* chip : chips()) {
+        if (chip->cs != pin) continue;
+        if (value == LOW && !chip->selected) {
+          chip->selected = true;
+          chip->op = 0;
+          chip->phase = 0;
+          chip->transactions++;
+        } else if (value == HIGH && chip->selected) {
+          chip->selected = false;
+          chip->endCycle();
+        }
+      }
+    }
+
+  private:
+    static uint8_t transfer(uint8_t out) {
+      std::lock_guard<std::recursive_mutex> guard(lock());
+      Mcp2515Mock* target = nullptr;
+      uint8_t n = 0;
+      for (Mcp2515Mock* chip : chips()) {
+        if (chip->selected) {
+          target = chip;
+          n++;
+        }
+      }
+      if (n != 1) {
+        busErrors()++;
+        return 0xFF;
+      }
+      if (spiClock()) {
+        static uint64_t ns = 0;
+        ns += 8000000000ULL / spiClock();
+        hostAdvance(ns / 1000);
+        ns %= 1000;
+      }
+      if (target->hook) target->hook(*target);
+      target->bytes++;
+      return target->shift(out);
+    }
+
+    // RXnIF of READ RX BUFFER n clears when CS goes high
+    void endCycle() {
+      if ((op & 0xF9) == 0x90 && phase > 0) reg[MOCK_CANINTF] &= ~(op & 0x04 ? MCP2515::CANINTF_RX1IF : MCP2515::CANINTF_RX0IF);
+    }
+
+    uint8_t status() {
+      uint8_t intf = reg[MOCK_CANINTF];
+      return (intf & 0x03) | (intf & 0x04 ? 0x08 : 0) | (intf & 0x08 ? 0x20 : 0) | (intf & 0x10 ? 0x80 : 0);
+    }
+
+    uint8_t shift(uint8_t out) {
+      if (!op) {
+        op = out;
+        if ((op & 0xF9) == 0x90) addr = (op & 0x04 ? 0x71 : 0x61) + (op & 0x02 ? 5 : 0);
+        if (op == MOCK_RESET) reset();
+        return 0xFF;
+      }
+      phase++;
+      switch (op) {
+        case MOCK_READ_STATUS:
+          return status();
+        case MOCK_RX_STATUS:
+          return (reg[MOCK_CANINTF] & 0x03) << 6;
+        case MOCK_READ:
+          if (phase == 1) {
+            addr = out;
+            return 0xFF;
+          }
+          return reg[addr++ & 0x7F];
+        case MOCK_WRITE:
+          if (phase == 1) addr = out;
+          else reg[addr++ & 0x7F] = out;
+          return 0xFF;
+        case MOCK_BITMOD:
+          if (phase == 1) addr = out;
+          else if (phase == 2) mask = out;
+          else if (phase == 3) reg[addr & 0x7F] = (reg[addr & 0x7F] & ~mask) | (out & mask);
+          return 0xFF;
+        default:
+          if ((op & 0xF9) == 0x90) return reg[addr++ & 0x7F];
+          protocolErrors++;
+          return 0xFF;
+      }
+    }
+
+    // receive buffer n <- frame, SIDH..D7 as the chip stores it
+    void store(uint8_t n, const struct can_frame& frame) {
+      uint8_t* b = &reg[n ? 0x71 : 0x61];
+      uint32_t id = frame.can_id & CAN_EFF_MASK;
+      bool ext = frame.can_id & CAN_EFF_FLAG;
+      bool rtr = frame.can_id & CAN_RTR_FLAG;
+      uint32_t sid = ext ? id >> 18 : id & CAN_SFF_MASK;
+      b[0] = sid >> 3;
+      b[1] = (sid & 7) << 5 | (ext ? 0x08 | ((id >> 16) & 0x03) : 0) | (!ext && rtr ? 0x10 : 0);
+      b[2] = ext ? id >> 8 : 0;
+      b[3] = ext ? id : 0;
+      b[4] = (frame.can_dlc & 0x0F) | (ext && rtr ? 0x40 : 0);
+      memcpy(b + 5, frame.data, CAN_MAX_DLEN);
+      reg[MOCK_CANINTF] |= n ? MCP2515::CANINTF_RX1IF : MCP2515::CANINTF_RX0IF;
+    }
+
+  public:
+    uint8_t cs;
+    uint8_t reg[128];
+    bool selected = false;
+    uint32_t bytes = 0;          // SPI bytes clocked while selected
+    uint32_t transactions = 0;   // CS cycles
+    uint32_t received = 0;       // frames stored in RXB0 / RXB1
+    uint32_t lost = 0;           // frames dropped on a full receive buffer
+    uint32_t protocolErrors = 0; // unknown instruction
+    std::function<void(Mcp2515Mock&)> hook;
+
+    static std::recursive_mutex& lock() {
+      static std::recursive_mutex m;
+      return m;
+    }
+
+    // SPI clock in Hz for the virtual time of a byte, 0 = bytes take no time
+    static uint32_t& spiClock() {
+      static uint32_t hz = 0;
+      return hz;
+    }
+
+    static uint32_t& busErrors() {
+      static uint32_t n = 0;
+      return n;
+    }
+
+    explicit Mcp2515Mock(uint8_t cs) : cs(cs) {
+      reset();
+      std::lock_guard<std::recursive_mutex> guard(lock());
+      chips().push_back(this);
+      hostDigitalWrite = chipSelect;
+      hostSpiTransfer = transfer;
+    }
+
+    ~Mcp2515Mock() {
+      std::lock_guard<std::recursive_mutex> guard(lock());
+      std::vector<Mcp2515Mock*>& list = chips();
+      for (size_t i = 0; i < list.size(); i++) {
+        if (list[i] == this) list.erase(list.begin() + i);
+      }
+    }
+
+    void reset() {
+      memset(reg, 0, sizeof(reg));
+      reg[0x0E] = 0x80; // CANSTAT: configuration mode
+      reg[0x0F] = 0x87; // CANCTRL
+    }
+
+    // a frame from the bus, false if it was lost
+    bool receive(const struct can_frame& frame) {
+      std::lock_guard<std::recursive_mutex> guard(lock());
+      uint8_t intf = reg[MOCK_CANINTF];
+      if (!(intf & MCP2515::CANINTF_RX0IF)) {
+        store(0, frame);
+      } else if ((reg[MOCK_RXB0CTRL] & 0x04) && !(intf & MCP2515::CANINTF_RX1IF)) {
+        store(1, frame);
+      } else {
+        reg[MOCK_EFLG] |= (reg[MOCK_RXB0CTRL] & 0x04) ? MCP2515::EFLG_RX1OVR : MCP2515::EFLG_RX0OVR;
+        reg[MOCK_CANINTF] |= MCP2515::CANINTF_ERRIF;
+        lost++;
+        return false;
+      }
+      received++;
+      return true;
+    }
+
+    // INT pin, all interrupt sources enabled
+    bool interrupt() {
+      std::lock_guard<std::recursive_mutex> guard(lock());
+      return reg[MOCK_CANINTF] != 0;
+    }
+};
+
+
+#endif /* MCP2515_MOCK_H */
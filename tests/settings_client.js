@@ -0,0 +1,116 @@
+// settings.html in node, the device is on the other end of stdin / stdout
+//
+//   node settings_client.js <passphrase> <new ESSID> <new passphrase>
+//
+// Runs forge.min.js and the page script as the browser does over plain
+// http: window.crypto has getRandomValues() but no subtle. fetch() writes
+// one line "METHOD /url [body]" and reads the answer "status body", the
+// body as a JSON string. Loads the page, submits the form and ends with
+// "DONE {json}": ESSID shown after the exchange, output text, timings.
+'use strict';
+const fs = require('fs');
+const path = require('path');
+const readline = require('readline');
+const vm = require('vm');
+const { webcrypto } = require('crypto');
+
+const data = path.join(__dirname, '..', 'data');
+const html = fs.readFileSync(path.join(data, 'settings.html'), 'utf8');
+const page = html.match(/<script>([\s\S]*?)<\/script>/)[1];
+
+// answers from the device, in request order
+const answers = [];
+const waiting = [];
+readline.createInterface({ input: process.stdin }).on('line', line => {
+  if (waiting.length) waiting.shift()(line);
+  else answers.push(line);
+});
+
+function nextAnswer() {
+  if (answers.length) return Promise.resolve(answers.shift());
+  return new Promise(resolve => waiting.push(resolve));
+}
+
+let pending = Promise.resolve();
+function fetch(url, opts = {}) {
+  const request = (opts.method || 'GET') + ' ' + (url.startsWith('/') ? url : '/' + url)
+    + (opts.body ? ' ' + opts.body : '');
+  // one request at a time, like the device sees them
+  const answer = pending.then(() => {
+    process.stdout.write(request + '\n');
+    return nextAnswer();
+  });
+  pending = answer;
+  return answer.then(line => {
+    const sp = line.indexOf(' ');
+    const status = parseInt(line.slice(0, sp));
+    const body = JSON.parse(line.slice(sp + 1));
+    return {
+      status: status,
+      ok: status >= 200 && status < 300,
+      headers: { get: () => '1' },
+      text: async () => body,
+      json: async () => JSON.parse(body)
+    };
+  });
+}
+
+const elements = {};
+const document = {
+  getElementById: id => elements[id] || (elements[id] = { value: '', textContent: '', type: 'text', dataset: {} }),
+  querySelectorAll: () => []
+};
+
+const context = vm.createContext({
+  document: document,
+  fetch: fetch,
+  crypto: { getRandomValues: a => webcrypto.getRandomValues(a) },
+  location: { href: 'http://192.168.4.1/settings.html' },
+  addEventListener: () => {},
+  // no real waiting, the device answers at once
+  setTimeout: f => setImmediate(f),
+  console: console,
+  URL: URL,
+  URLSearchParams: URLSearchParams,
+  Blob: Blob,
+  TextEncoder: TextEncoder,
+  TextDecoder: TextDecoder
+});
+context.window = context;
+vm.runInContext(fs.readFileSync(path.join(data, 'forge.min.js'), 'utf8'), context);
+vm.runInContext(page, context);
+
+async function main() {
+  const [oldpw, ssid, pw] = process.argv.slice(2);
+  const el = id => document.getElementById(id);
+  const t0 = process.hrtime.bigint();
+  await vm.runInContext('initPage()', context);
+  const t1 = process.hrtime.bigint();
+  const shown = el('ssid').value;
+
+  el('ssid').value = ssid;
+  el('oldpw').value = oldpw;
+  el('pw1').value = pw;
+  el('pw2').value = pw;
+  await vm.runInContext('submitForm()', context);
+  const done = {
+    ssid: shown,
+    out: el('out').textContent,
+    href: context.location.href,
+    exchangeMs: Math.round(Number(t1 - t0) / 1e6)
+  };
+  await pending;
+  process.stdout.write('DONE ' + JSON.stringify(done) + '\n');
+  process.exit(0);
+}
+
+// a handshake that never verifies retries forever
+setTimeout(() => {
+  process.stdout.write('DONE {"out":"timeout"}\n');
+  process.exit(1);
+}, 30000).unref();
+
+main().catch(e => {
+  process.stdout.write('DONE ' + JSON.stringify({ out: String(e && e.stack || e) }) + '\n');
+  process.exit(1);
+});
@@ -0,0 +1,185 @@
+/*                                                                          *
+ * Host stand-in for the Arduino-ESP32 core                                 *
+ *                                                                          *
+ * Just enough of Arduino.h, FreeRTOS and esp_timer to build the firmware   *
+ * modules on a PC. Time is virtual: esp_timer_get_time() returns hostTime, *
+ * tests move it with hostAdvance(), delay() advances it and yields. A test *
+ * can hook delay() to run the other tasks of a simulation meanwhile.       *
+ *                                                                          */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define DEC 10
+#define HEX 16
+
+// virtual clock, us
+extern std::atomic<int64_t> hostTime;
+inline void hostAdvance(int64_t us) { hostTime.fetch_add(us); }
+inline int64_t esp_timer_get_time() { return hostTime.load(); }
+inline uint32_t micros() { return (uint32_t) hostTime.load(); }
+inline uint32_t millis() { return (uint32_t)(hostTime.load() / 1000); }
+// hostDelay set: delay() calls it with the end time instead, the hook advances the clock
+extern void (*hostDelay)(int64_t until);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// GPIO, tests hook digitalWrite() to watch chip selects and digitalRead() for interrupt lines
+extern void (*hostDigitalWrite)(uint8_t pin, uint8_t value);
+extern int (*hostDigitalRead)(uint8_t pin);
+inline void digitalWrite(uint8_t pin, uint8_t value) { if (hostDigitalWrite) hostDigitalWrite(pin, value); }
+inline int digitalRead(uint8_t pin) { return hostDigitalRead ? hostDigitalRead(pin) : HIGH; }
+inline void pinMode(uint8_t, uint8_t) {}
+
+
+// std::string backed String
+class String {
+  private:
+    std::string s;
+  public:
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& str) : s(str) {}
+    String(char c) : s(1, c) {}
+    String(unsigned char v, unsigned char base = DEC) { char buf[4]; snprintf(buf, sizeof(buf), base == HEX ? "%x" : "%u", v); s = buf; }
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int n) { s.reserve(n); return true; }
+    void clear() { s.clear(); }
+    char operator[](unsigned int i) const { return i < s.length() ? s[i] : 0; }
+    int indexOf(char c, unsigned int from = 0) const { size_t p = s.find(c, from); return p == std::string::npos ? -1 : (int) p; }
+    int indexOf(const char* str, unsigned int from = 0) const { size_t p = s.find(str, from); return p == std::string::npos ? -1 : (int) p; }
+    String substring(unsigned int from) const { return from < s.length() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < to && from < s.length() ? String(s.substr(from, to - from)) : String(); }
+    bool startsWith(const char* str) const { return s.compare(0, strlen(str), str) == 0; }
+    long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+    bool concat(const char* str, unsigned int n) { s.append(str, n); return true; }
+
+    String& operator+=(const String& o) { s += o.s; return *this; }
+    String& operator+=(const char* c) { s += c; return *this; }
+    String& operator+=(char c) { s += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* c) const { return s == c; }
+    bool operator!=(const String& o) const { return s != o.s; }
+    bool operator!=(const char* c) const { return s != c; }
+    bool operator<(const String& o) const { return s < o.s; }
+};
+
+
+// byte sink with the print helpers of the Arduino core
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t len) {
+      size_t n = 0;
+      while (len--) n += write(*buf++);
+      return n;
+    }
+    size_t write(const char* str) { return write((const uint8_t*) str, strlen(str)); }
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& str) { return write(str.c_str()); }
+    size_t print(char c) { return write((uint8_t) c); }
+    size_t print(long v, int base = DEC) { return base == HEX ? printf("%lx", v) : printf("%ld", v); }
+    size_t print(unsigned long v, int base = DEC) { return printf(base == HEX ? "%lx" : "%lu", v); }
+    size_t print(int v, int base = DEC) { return print((long) v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long) v, base); }
+    size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+    template <typename T> size_t println(const T& v, int base) { return print(v, base) + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+      char buf[512];
+      va_list args;
+      va_start(args, format);
+      int n = vsnprintf(buf, sizeof(buf), format, args);
+      va_end(args);
+      if (n < 0) return 0;
+      return write((const uint8_t*) buf, (size_t) n < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+};
+
+// Serial, silent unless HOST_SERIAL is set in the environment
+class HostSerial : public Print {
+  public:
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+    void flush() {}
+};
+extern HostSerial Serial;
+
+
+// FreeRTOS
+#define portMAX_DELAY 0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) (ms)
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+
+struct HostSemaphore;
+typedef HostSemaphore* SemaphoreHandle_t;
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+void vTaskDelay(TickType_t ticks);
+inline TickType_t xTaskGetTickCount() { return millis() / portTICK_PERIOD_MS; }
+void vTaskDelayUntil(TickType_t* wake, TickType_t ticks);
+void taskYIELD();
+inline uint32_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+typedef void (*TaskFunction_t)(void*);
+// the task runs on its own thread, vTaskDelete(NULL) is the return of the task function
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack, void* param,
+  uint32_t priority, TaskHandle_t* handle, BaseType_t core);
+inline void vTaskDelete(TaskHandle_t) {}
+
+struct portMUX_TYPE { std::mutex m; };
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->m.lock()
+#define portEXIT_CRITICAL(mux) (mux)->m.unlock()
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+struct EspClass {
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+  uint32_t getMaxAllocHeap() { return 0; }
+};
+extern EspClass ESP;
+
+
+#endif /* HOST_ARDUINO_H */
@@ -0,0 +1,77 @@
+/*                                                                          *
+ * Host stand-in for ArduinoJson 7                                          *
+ *                                                                          */
+#include <ArduinoJson.h>
+
+static void jsonSpace(const std::string& s, size_t& i) {
+  while (i < s.size() && strchr(" \t\r\n", s[i])) i++;
+}
+
+static bool jsonString(const std::string& s, size_t& i, std::string& out) {
+  if (i >= s.size() || s[i] != '"') return false;
+  size_t end = s.find('"', i + 1);
+  if (end == std::string::npos) return false;
+  out = s.substr(i + 1, end - i - 1);
+  i = end + 1;
+  return true;
+}
+
+bool jsonParse(const std::string& s, size_t& i, JsonNode& node) {
+  jsonSpace(s, i);
+  if (i >= s.size()) return false;
+  if (s[i] == '{') {
+    node.object = true;
+    i++;
+    jsonSpace(s, i);
+    if (i < s.size() && s[i] == '}') {
+      i++;
+      return true;
+    }
+    while (true) {
+      std::string key;
+      jsonSpace(s, i);
+      if (!jsonString(s, i, key)) return false;
+      jsonSpace(s, i);
+      if (i >= s.size() || s[i++] != ':') return false;
+      if (!jsonParse(s, i, node.members[key])) return false;
+      jsonSpace(s, i);
+      if (i >= s.size()) return false;
+      if (s[i] == '}') {
+        i++;
+        return true;
+      }
+      if (s[i++] != ',') return false;
+    }
+  }
+  if (s[i] == '"') return jsonString(s, i, node.text);
+  if (s.compare(i, 4, "true") == 0) {
+    node.number = 1;
+    i += 4;
+    return true;
+  }
+  if (s.compare(i, 5, "false") == 0) {
+    i += 5;
+    return true;
+  }
+  char* end;
+  node.number = strtol(s.c_str() + i, &end, 10);
+  if (end == s.c_str() + i) return false;
+  i = end - s.c_str();
+  return true;
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, const char* json) {
+  std::string s(json);
+  size_t i = 0;
+  doc = JsonDocument();
+  bool ok = jsonParse(s, i, doc);
+  jsonSpace(s, i);
+  return { !ok || i != s.size() };
+}
+
+DeserializationError deserializeJson(JsonDocument& doc, File& file) {
+  std::string s;
+  int c;
+  while ((c = file.read()) >= 0) s += (char) c;
+  return deserializeJson(doc, s.c_str());
+}
@@ -0,0 +1,58 @@
+/*                                                                          *
+ * Host stand-in for ArduinoJson 7                                          *
+ *                                                                          *
+ * Objects, integers and strings, enough for config_store.cpp and the       *
+ * legacy data/config.json. JsonObject is a reference into the document.   *
+ *                                                                          */
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <map>
+#include <type_traits>
+
+class JsonNode {
+  private:
+    std::map<std::string, JsonNode> members;
+    long number = 0;
+    std::string text;
+    bool object = false;
+    friend bool jsonParse(const std::string& s, size_t& i, JsonNode& node);
+  public:
+    bool containsKey(const char* key) const { return members.count(key); }
+    const JsonNode& operator[](const char* key) const {
+      static const JsonNode none;
+      auto it = members.find(key);
+      return it == members.end() ? none : it->second;
+    }
+    JsonNode& operator[](const char* key) { object = true; return members[key]; }
+
+    template <typename T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0>
+    operator T() const { return (T) number; }
+    template <typename T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0>
+    JsonNode& operator=(T value) { number = value; return *this; }
+    void set(const String& value) { text = value.c_str(); }
+
+    template <typename T> T as() const { return T(text.c_str()); }
+    template <typename T> JsonNode& to() { object = true; members.clear(); return *this; }
+    bool isObject() const { return object; }
+    size_t size() const { return members.size(); }
+};
+
+typedef JsonNode JsonDocument;
+typedef JsonNode& JsonObject;
+typedef const JsonNode& JsonObjectConst;
+
+struct DeserializationError {
+  bool failed;
+  explicit operator bool() const { return failed; }
+  const char* c_str() const { return failed ? "InvalidInput" : "Ok"; }
+};
+
+DeserializationError deserializeJson(JsonDocument& doc, const char* json);
+DeserializationError deserializeJson(JsonDocument& doc, File& file);
+
+
+#endif /* HOST_ARDUINOJSON_H */
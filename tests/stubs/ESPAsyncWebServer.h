@@ -0,0 +1,124 @@
+/*                                                                          *
+ * Host stand-in for ESPAsyncWebServer                                      *
+ *                                                                          *
+ * Keeps the handlers of server.on() and lets a test call them with query   *
+ * parameters and a body, the way async_tcp would. Paths match exactly,    *
+ * the last send() of a handler is the response, streams are collected.     *
+ *                                                                          */
+#ifndef HOST_ESPASYNCWEBSERVER_H
+#define HOST_ESPASYNCWEBSERVER_H
+
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+enum WebRequestMethod {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_ANY = 0b01111111,
+};
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebParameter {
+  private:
+    String v;
+  public:
+    AsyncWebParameter(const String& value) : v(value) {}
+    const String& value() const { return v; }
+};
+
+class AsyncWebServerResponse {
+  public:
+    int code;
+    String contentType;
+    String content;
+    AsyncWebServerResponse(int code, const char* type, const String& body) : code(code), contentType(type), content(body) {}
+    virtual ~AsyncWebServerResponse() {}
+    void addHeader(const char* name, const String& value) {}
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+  public:
+    AsyncResponseStream(const char* type) : AsyncWebServerResponse(200, type, String()) {}
+    size_t write(uint8_t c) override { content += (char) c; return 1; }
+    size_t write(const uint8_t* buf, size_t len) override { content.concat((const char*) buf, len); return len; }
+    using Print::write;
+};
+
+class AsyncWebServerRequest {
+  private:
+    std::map<std::string, AsyncWebParameter> params;
+  public:
+    WebRequestMethodComposite method;
+    int code = 0;            // response
+    String contentType;
+    String content;
+
+    AsyncWebServerRequest(WebRequestMethodComposite method, const std::map<std::string, std::string>& query) : method(method) {
+      for (const auto& p : query) params.emplace(p.first, AsyncWebParameter(String(p.second)));
+    }
+    bool hasParam(const char* name) const { return params.count(name) != 0; }
+    const AsyncWebParameter* getParam(const char* name) const {
+      auto p = params.find(name);
+      return p == params.end() ? nullptr : &p->second;
+    }
+    void send(int code, const char* type = "", const String& body = String()) {
+      this->code = code;
+      contentType = type;
+      content = body;
+    }
+    AsyncWebServerResponse* beginResponse(int code, const char* type = "", const String& body = String()) {
+      return new AsyncWebServerResponse(code, type, body);
+    }
+    AsyncResponseStream* beginResponseStream(const char* type) { return new AsyncResponseStream(type); }
+    void send(AsyncWebServerResponse* response) {
+      send(response->code, response->contentType.c_str(), response->content);
+      delete response;
+    }
+};
+
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, const String&, size_t, uint8_t*, size_t, bool)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t)> ArBodyHandlerFunction;
+
+class AsyncWebServer {
+  private:
+    struct Handler {
+      std::string path;
+      WebRequestMethodComposite method;
+      ArRequestHandlerFunction onRequest;
+      ArBodyHandlerFunction onBody;
+    };
+    std::vector<Handler> handlers;
+  public:
+    AsyncWebServer(uint16_t port = 80) {}
+    void on(const char* path, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+      ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr) {
+      handlers.push_back({ path, method, onRequest, onBody });
+    }
+
+    // test access: one request, code 404 / 405 without a handler for the path / method
+    AsyncWebServerRequest request(WebRequestMethodComposite method, const char* path,
+      const std::map<std::string, std::string>& query = {}, const std::string& body = "") {
+      AsyncWebServerRequest request(method, query);
+      request.code = 404;
+      for (Handler& h : handlers) {
+        if (h.path != path) continue;
+        if (!(h.method & method)) {
+          request.code = 405;
+          continue;
+        }
+        if (h.onBody && !body.empty()) h.onBody(&request, (uint8_t*) body.data(), body.size(), 0, body.size());
+        h.onRequest(&request);
+        return request;
+      }
+      return request;
+    }
+};
+
+
+#endif /* HOST_ESPASYNCWEBSERVER_H */
@@ -0,0 +1,111 @@
+/*                                                                          *
+ * Host stand-in for LittleFS                                               *
+ *                                                                          */
+#include <LittleFS.h>
+#include <chrono>
+#include <thread>
+
+HostFS LittleFS;
+
+
+File HostFS::open(const char* path, const char* mode) {
+  std::lock_guard<std::mutex> guard(m);
+  hostAdvance(openUs);
+  if (!mounted) return File();
+  if (mode[0] == 'r') {
+    if (!files.count(path)) return File();
+    return File(this, path, false);
+  }
+  if (writeBudget == 0) return File();
+  std::vector<uint8_t>& f = files[path];
+  if (mode[0] == 'w') f.clear();
+  writeOpens++;
+  if (++writers > writersMax) writersMax = writers;
+  File file(this, path, true);
+  return file;
+}
+
+bool HostFS::exists(const char* path) {
+  std::lock_guard<std::mutex> guard(m);
+  return mounted && files.count(path);
+}
+
+bool HostFS::remove(const char* path) {
+  std::lock_guard<std::mutex> guard(m);
+  return mounted && files.erase(path);
+}
+
+size_t HostFS::usedBytes() {
+  std::lock_guard<std::mutex> guard(m);
+  size_t n = 0;
+  for (auto& f : files) n += f.second.size();
+  return n;
+}
+
+
+size_t File::read(uint8_t* buf, size_t len) {
+  if (!fs) return 0;
+  std::lock_guard<std::mutex> guard(fs->m);
+  std::vector<uint8_t>& f = fs->files[path];
+  size_t n = pos < f.size() ? f.size() - pos : 0;
+  if (n > len) n = len;
+  if (n) memcpy(buf, f.data() + pos, n);
+  pos += n;
+  hostAdvance((int64_t) n * fs->byteUs);
+  return n;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) ? c : -1;
+}
+
+int File::peek() {
+  if (!fs) return -1;
+  std::lock_guard<std::mutex> guard(fs->m);
+  std::vector<uint8_t>& f = fs->files[path];
+  return pos < f.size() ? f[pos] : -1;
+}
+
+int File::available() {
+  if (!fs) return 0;
+  std::lock_guard<std::mutex> guard(fs->m);
+  size_t size = fs->files[path].size();
+  return pos < size ? size - pos : 0;
+}
+
+size_t File::readBytesUntil(char end, char* buf, size_t len) {
+  size_t n = 0;
+  int c;
+  while (n < len && (c = read()) >= 0 && c != end) buf[n++] = c;
+  return n;
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+  if (!fs || !writing) return 0;
+  if (fs->writeSleepUs) std::this_thread::sleep_for(std::chrono::microseconds(fs->writeSleepUs));
+  std::lock_guard<std::mutex> guard(fs->m);
+  bool cut = fs->writeBudget >= 0 && (long) len > fs->writeBudget;
+  if (cut) len = fs->writeBudget;
+  if (fs->writeBudget >= 0) fs->writeBudget -= len;
+  std::vector<uint8_t>& f = fs->files[path];
+  f.insert(f.end(), buf, buf + len);
+  if (cut && fs->tornByte >= 0) f.push_back(fs->tornByte);
+  hostAdvance((int64_t) len * fs->byteUs);
+  return len;
+}
+
+size_t File::size() {
+  if (!fs) return 0;
+  std::lock_guard<std::mutex> guard(fs->m);
+  return fs->files[path].size();
+}
+
+void File::close() {
+  if (!fs) return;
+  if (writing) {
+    std::lock_guard<std::mutex> guard(fs->m);
+    fs->writers--;
+  }
+  fs = nullptr;
+}
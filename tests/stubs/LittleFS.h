@@ -0,0 +1,79 @@
+/*                                                                          *
+ * Host stand-in for LittleFS                                               *
+ *                                                                          *
+ * Files live in memory. Worse than LittleFS on purpose: open("w")          *
+ * truncates at once and every written byte is visible right away, so a    *
+ * power cut (writeBudget bytes, then the flash stops taking writes) leaves *
+ * a short file, tornByte is the half programmed byte at the cut. Each      *
+ * access advances the virtual clock by a cost model.                       *
+ *                                                                          */
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class HostFS;
+
+class File : public Print {
+  private:
+    HostFS* fs = nullptr;
+    std::string path;
+    size_t pos = 0;
+    bool writing = false;
+  public:
+    File() {}
+    File(HostFS* fs, const std::string& path, bool writing) : fs(fs), path(path), writing(writing) {}
+    File(const File&) = default;
+    File& operator=(const File&) = default;
+    explicit operator bool() const { return fs != nullptr; }
+
+    size_t read(uint8_t* buf, size_t len);
+    int read();
+    int peek();
+    int available();
+    size_t readBytes(char* buf, size_t len) { return read((uint8_t*) buf, len); }
+    size_t readBytesUntil(char end, char* buf, size_t len);
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+    size_t size();
+    const char* name() const { return path.c_str(); }
+    void close();
+};
+
+class HostFS {
+  private:
+    friend class File;
+    std::mutex m;
+    std::map<std::string, std::vector<uint8_t>> files;
+    bool mounted = true;
+    int writers = 0;
+  public:
+    long writeBudget = -1;       // bytes until the power cut, -1 = no cut
+    int tornByte = -1;           // written after the last byte of the budget, -1 = none
+    uint32_t openUs = 0;         // virtual time per open()
+    uint32_t byteUs = 0;         // virtual time per byte read or written
+    uint32_t writeSleepUs = 0;   // real sleep per write() call, widens races
+    int writersMax = 0;          // most files open for writing at once
+    uint32_t writeOpens = 0;     // open() for writing
+
+    bool begin(bool format = false) { mounted = true; return true; }
+    void end() { mounted = false; }
+    File open(const char* path, const char* mode = "r");
+    bool exists(const char* path);
+    bool remove(const char* path);
+    size_t totalBytes() { return 0x100000; }
+    size_t usedBytes();
+
+    // test access
+    std::vector<uint8_t>& data(const char* path) { return files[path]; }
+    void clear() { files.clear(); }
+};
+
+extern HostFS LittleFS;
+
+
+#endif /* HOST_LITTLEFS_H */
@@ -0,0 +1,28 @@
+/*                                                                          *
+ * Host stand-in for the Arduino-ESP32 SPI class                            *
+ *                                                                          *
+ * transfer() goes to hostSpiTransfer, a device model set by the test.      *
+ *                                                                          */
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+
+#include <Arduino.h>
+
+struct SPISettings {
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+extern uint8_t (*hostSpiTransfer)(uint8_t out);
+
+class SPIClass {
+  public:
+    void begin() {}
+    void beginTransaction(const SPISettings&) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t b) { return hostSpiTransfer ? hostSpiTransfer(b) : 0xFF; }
+};
+extern SPIClass SPI;
+
+
+#endif /* HOST_SPI_H */
@@ -0,0 +1,18 @@
+/*                                                                          *
+ * Host stand-in for esp_mac.h                                              *
+ *                                                                          */
+#ifndef HOST_ESP_MAC_H
+#define HOST_ESP_MAC_H
+
+
+#include <Arduino.h>
+
+// fixed factory MAC
+inline esp_err_t esp_efuse_mac_get_default(uint8_t* mac) {
+  static const uint8_t factory[6] = { 0x24, 0x6f, 0x28, 0x12, 0x34, 0x56 };
+  memcpy(mac, factory, sizeof(factory));
+  return ESP_OK;
+}
+
+
+#endif /* HOST_ESP_MAC_H */
@@ -0,0 +1,95 @@
+/*                                                                          *
+ * Host stand-in for the Arduino-ESP32 core                                 *
+ *                                                                          */
+#include <Arduino.h>
+#include <SPI.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+std::atomic<int64_t> hostTime{0};
+void (*hostDigitalWrite)(uint8_t pin, uint8_t value) = nullptr;
+int (*hostDigitalRead)(uint8_t pin) = nullptr;
+void (*hostDelay)(int64_t until) = nullptr;
+HostSerial Serial;
+SPIClass SPI;
+uint8_t (*hostSpiTransfer)(uint8_t out) = nullptr;
+EspClass ESP;
+
+static bool serialOn = getenv("HOST_SERIAL") != nullptr;
+
+size_t HostSerial::write(uint8_t c) {
+  if (serialOn) fputc(c, stderr);
+  return 1;
+}
+
+size_t HostSerial::write(const uint8_t* buf, size_t len) {
+  if (serialOn) fwrite(buf, 1, len, stderr);
+  return len;
+}
+
+void delay(uint32_t ms) {
+  if (hostDelay) {
+    hostDelay(hostTime.load() + (int64_t) ms * 1000);
+    return;
+  }
+  hostAdvance((int64_t) ms * 1000);
+  std::this_thread::yield();
+}
+
+void delayMicroseconds(uint32_t us) {
+  hostAdvance(us);
+}
+
+
+struct HostSemaphore {
+  std::timed_mutex m;
+};
+
+// never freed, like the firmware objects owning them
+static std::deque<HostSemaphore> semaphores;
+static std::mutex semaphoresLock;
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  std::lock_guard<std::mutex> guard(semaphoresLock);
+  semaphores.emplace_back();
+  return &semaphores.back();
+}
+
+// ticks are real ms here, the virtual clock does not run by itself
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    sem->m.lock();
+    return pdTRUE;
+  }
+  return sem->m.try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  sem->m.unlock();
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+void vTaskDelayUntil(TickType_t* wake, TickType_t ticks) {
+  *wake += ticks;
+  int32_t left = (int32_t)(*wake - xTaskGetTickCount());
+  if (left > 0) delay(left * portTICK_PERIOD_MS);
+}
+
+void taskYIELD() {
+  std::this_thread::yield();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack, void* param,
+  uint32_t priority, TaskHandle_t* handle, BaseType_t core) {
+  std::thread(task, param).detach();
+  if (handle) *handle = nullptr;
+  return pdTRUE;
+}
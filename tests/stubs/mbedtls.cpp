@@ -0,0 +1,293 @@
+/*                                                                          *
+ * Host stand-in for Mbed TLS 3 on OpenSSL libcrypto                        *
+ *                                                                          */
+#include <mbedtls/host_mbedtls.h>
+#include <string.h>
+#include <openssl/bio.h>
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+
+int mbedtls_base64_decode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+  *olen = 0;
+  if (slen % 4) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+  size_t pad = 0;
+  while (pad < 2 && pad < slen && src[slen - 1 - pad] == '=') pad++;
+  size_t need = slen / 4 * 3 - pad;
+  if (need > dlen) return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+  unsigned char* buf = new unsigned char[slen / 4 * 3 + 1];
+  int n = EVP_DecodeBlock(buf, src, slen);
+  if (n >= 0) memcpy(dst, buf, need);
+  delete[] buf;
+  if (n < 0) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+  *olen = need;
+  return 0;
+}
+
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+static int aesSetkey(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+  if (keybits != 128 && keybits != 192 && keybits != 256) return -0x0020;
+  memcpy(ctx->key, key, keybits / 8);
+  ctx->bits = keybits;
+  return 0;
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+  return aesSetkey(ctx, key, keybits);
+}
+
+int mbedtls_aes_setkey_dec(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+  return aesSetkey(ctx, key, keybits);
+}
+
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16], unsigned char output[16]) {
+  const EVP_CIPHER* cipher = ctx->bits == 256 ? EVP_aes_256_ecb() : ctx->bits == 192 ? EVP_aes_192_ecb() : EVP_aes_128_ecb();
+  EVP_CIPHER_CTX* c = EVP_CIPHER_CTX_new();
+  int len = 0;
+  int ok = EVP_CipherInit_ex(c, cipher, NULL, ctx->key, NULL, mode == MBEDTLS_AES_ENCRYPT)
+    && EVP_CIPHER_CTX_set_padding(c, 0)
+    && EVP_CipherUpdate(c, output, &len, input, 16);
+  EVP_CIPHER_CTX_free(c);
+  return ok && len == 16 ? 0 : -0x0021;
+}
+
+
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx) {}
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx) {}
+
+int mbedtls_entropy_func(void* data, unsigned char* output, size_t len) {
+  return RAND_bytes(output, len) == 1 ? 0 : -0x003C;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx) {
+  ctx->seeded = false;
+}
+
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx) {
+  ctx->seeded = false;
+}
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*f_entropy)(void*, unsigned char*, size_t),
+  void* p_entropy, const unsigned char* custom, size_t len) {
+  unsigned char probe[16];
+  int ret = f_entropy(p_entropy, probe, sizeof(probe));
+  ctx->seeded = ret == 0;
+  return ret;
+}
+
+int mbedtls_ctr_drbg_random(void* p_rng, unsigned char* output, size_t len) {
+  if (!((mbedtls_ctr_drbg_context*) p_rng)->seeded) return -0x0034;
+  return RAND_bytes(output, len) == 1 ? 0 : -0x0034;
+}
+
+
+static const mbedtls_pk_info_t rsaInfo = { MBEDTLS_PK_RSA };
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx) {
+  ctx->key = NULL;
+  ctx->md = MBEDTLS_MD_NONE;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx) {
+  EVP_PKEY_free((EVP_PKEY*) ctx->key);
+  mbedtls_pk_init(ctx);
+}
+
+const mbedtls_pk_info_t* mbedtls_pk_info_from_type(mbedtls_pk_type_t type) {
+  return type == MBEDTLS_PK_RSA ? &rsaInfo : NULL;
+}
+
+int mbedtls_pk_setup(mbedtls_pk_context* ctx, const mbedtls_pk_info_t* info) {
+  return info && !ctx->key ? 0 : MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+}
+
+// PEM with the terminating NUL counted in keylen, like Mbed TLS wants it
+int mbedtls_pk_parse_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen, const unsigned char* pwd,
+  size_t pwdlen, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+  if (!keylen || key[keylen - 1] != '\0') return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+  BIO* bio = BIO_new_mem_buf(key, keylen - 1);
+  EVP_PKEY* pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+  BIO_free(bio);
+  if (!pkey || EVP_PKEY_get_base_id(pkey) != EVP_PKEY_RSA) {
+    EVP_PKEY_free(pkey);
+    return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+  }
+  ctx->key = pkey;
+  return 0;
+}
+
+int mbedtls_rsa_set_padding(mbedtls_rsa_context* ctx, int padding, mbedtls_md_type_t hash_id) {
+  ctx->md = hash_id;
+  return 0;
+}
+
+int mbedtls_pk_decrypt(mbedtls_pk_context* ctx, const unsigned char* input, size_t ilen, unsigned char* output,
+  size_t* olen, size_t osize, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+  if (!ctx->key || ctx->md != MBEDTLS_MD_SHA1) return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+  EVP_PKEY_CTX* c = EVP_PKEY_CTX_new((EVP_PKEY*) ctx->key, NULL);
+  *olen = osize;
+  int ok = c && EVP_PKEY_decrypt_init(c) > 0
+    && EVP_PKEY_CTX_set_rsa_padding(c, RSA_PKCS1_OAEP_PADDING) > 0
+    && EVP_PKEY_CTX_set_rsa_oaep_md(c, EVP_sha1()) > 0
+    && EVP_PKEY_CTX_set_rsa_mgf1_md(c, EVP_sha1()) > 0
+    && EVP_PKEY_decrypt(c, output, olen, input, ilen) > 0;
+  EVP_PKEY_CTX_free(c);
+  if (!ok) *olen = 0;
+  return ok ? 0 : MBEDTLS_ERR_RSA_PRIVATE_FAILED;
+}
+
+int mbedtls_rsa_gen_key(mbedtls_rsa_context* ctx, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng,
+  unsigned int nbits, int exponent) {
+  if (ctx->key || exponent != 65537) return MBEDTLS_ERR_RSA_KEY_GEN_FAILED;
+  ctx->key = EVP_RSA_gen(nbits);
+  return ctx->key ? 0 : MBEDTLS_ERR_RSA_KEY_GEN_FAILED;
+}
+
+// NUL terminated PEM in buf
+static int writePem(BIO* bio, int ok, unsigned char* buf, size_t size) {
+  char* pem = NULL;
+  long len = ok ? BIO_get_mem_data(bio, &pem) : 0;
+  int ret = 0;
+  if (!ok) {
+    ret = MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+  } else if ((size_t) len + 1 > size) {
+    ret = MBEDTLS_ERR_PK_BUFFER_TOO_SMALL;
+  } else {
+    memcpy(buf, pem, len);
+    buf[len] = '\0';
+  }
+  BIO_free(bio);
+  return ret;
+}
+
+// PKCS#1 "BEGIN RSA PRIVATE KEY", as Mbed TLS writes it
+int mbedtls_pk_write_key_pem(const mbedtls_pk_context* ctx, unsigned char* buf, size_t size) {
+  BIO* bio = BIO_new(BIO_s_mem());
+  int ok = ctx->key && PEM_write_bio_PrivateKey_traditional(bio, (EVP_PKEY*) ctx->key, NULL, NULL, 0, NULL, NULL);
+  return writePem(bio, ok, buf, size);
+}
+
+// SubjectPublicKeyInfo "BEGIN PUBLIC KEY"
+int mbedtls_pk_write_pubkey_pem(const mbedtls_pk_context* ctx, unsigned char* buf, size_t size) {
+  BIO* bio = BIO_new(BIO_s_mem());
+  int ok = ctx->key && PEM_write_bio_PUBKEY(bio, (EVP_PKEY*) ctx->key);
+  return writePem(bio, ok, buf, size);
+}
+
+
+void mbedtls_ecp_group_init(mbedtls_ecp_group* grp) {
+  grp->group = NULL;
+}
+
+void mbedtls_ecp_group_free(mbedtls_ecp_group* grp) {
+  EC_GROUP_free((EC_GROUP*) grp->group);
+  grp->group = NULL;
+}
+
+int mbedtls_ecp_group_load(mbedtls_ecp_group* grp, mbedtls_ecp_group_id id) {
+  if (id != MBEDTLS_ECP_DP_SECP256R1) return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+  grp->group = EC_GROUP_new_by_curve_name(NID_X9_62_prime256v1);
+  return grp->group ? 0 : MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+}
+
+void mbedtls_mpi_init(mbedtls_mpi* X) {
+  X->bn = BN_new();
+}
+
+void mbedtls_mpi_free(mbedtls_mpi* X) {
+  BN_clear_free((BIGNUM*) X->bn);
+  X->bn = NULL;
+}
+
+int mbedtls_mpi_write_binary(const mbedtls_mpi* X, unsigned char* buf, size_t buflen) {
+  return BN_bn2binpad((const BIGNUM*) X->bn, buf, buflen) < 0 ? MBEDTLS_ERR_MPI_BUFFER_TOO_SMALL : 0;
+}
+
+void mbedtls_ecp_point_init(mbedtls_ecp_point* pt) {
+  memset(pt, 0, sizeof(*pt));
+}
+
+void mbedtls_ecp_point_free(mbedtls_ecp_point* pt) {
+  memset(pt, 0, sizeof(*pt));
+}
+
+int mbedtls_ecp_point_write_binary(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* P, int format, size_t* olen,
+  unsigned char* buf, size_t buflen) {
+  if (format != MBEDTLS_ECP_PF_UNCOMPRESSED || !P->len) return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+  if (buflen < P->len) return -0x4F00;
+  memcpy(buf, P->raw, P->len);
+  *olen = P->len;
+  return 0;
+}
+
+int mbedtls_ecp_point_read_binary(const mbedtls_ecp_group* grp, mbedtls_ecp_point* P, const unsigned char* buf, size_t ilen) {
+  if (ilen != sizeof(P->raw) || buf[0] != 0x04) return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+  memcpy(P->raw, buf, ilen);
+  P->len = ilen;
+  return 0;
+}
+
+// on the curve and not the point at infinity
+static EC_POINT* ecPoint(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* pt) {
+  const EC_GROUP* g = (const EC_GROUP*) grp->group;
+  EC_POINT* p = EC_POINT_new(g);
+  if (!p || !pt->len || !EC_POINT_oct2point(g, p, pt->raw, pt->len, NULL)
+    || EC_POINT_is_at_infinity(g, p) || EC_POINT_is_on_curve(g, p, NULL) != 1) {
+    EC_POINT_free(p);
+    return NULL;
+  }
+  return p;
+}
+
+int mbedtls_ecp_check_pubkey(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* pt) {
+  EC_POINT* p = ecPoint(grp, pt);
+  EC_POINT_free(p);
+  return p ? 0 : MBEDTLS_ERR_ECP_INVALID_KEY;
+}
+
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q,
+  int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+  const EC_GROUP* g = (const EC_GROUP*) grp->group;
+  EC_POINT* p = EC_POINT_new(g);
+  int ok = p && BN_priv_rand_range((BIGNUM*) d->bn, EC_GROUP_get0_order(g)) && !BN_is_zero((BIGNUM*) d->bn)
+    && EC_POINT_mul(g, p, (BIGNUM*) d->bn, NULL, NULL, NULL)
+    && EC_POINT_point2oct(g, p, POINT_CONVERSION_UNCOMPRESSED, Q->raw, sizeof(Q->raw), NULL) == sizeof(Q->raw);
+  Q->len = ok ? sizeof(Q->raw) : 0;
+  EC_POINT_free(p);
+  return ok ? 0 : MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+}
+
+// z = x coordinate of d * Q
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group* grp, mbedtls_mpi* z, const mbedtls_ecp_point* Q, const mbedtls_mpi* d,
+  int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+  const EC_GROUP* g = (const EC_GROUP*) grp->group;
+  EC_POINT* q = ecPoint(grp, Q);
+  EC_POINT* r = EC_POINT_new(g);
+  int ok = q && r && EC_POINT_mul(g, r, NULL, q, (const BIGNUM*) d->bn, NULL)
+    && !EC_POINT_is_at_infinity(g, r)
+    && EC_POINT_get_affine_coordinates(g, r, (BIGNUM*) z->bn, NULL, NULL);
+  EC_POINT_free(r);
+  EC_POINT_free(q);
+  return ok ? 0 : MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+}
+
+
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char* output, int is224) {
+  if (is224) return -0x0074;
+  SHA256(input, ilen, output);
+  return 0;
+}
@@ -0,0 +1,5 @@
+/* Host stand-in for mbedtls/aes.h, see host_mbedtls.h */
+#ifndef HOST_MBEDTLS_AES_H
+#define HOST_MBEDTLS_AES_H
+#include "host_mbedtls.h"
+#endif /* HOST_MBEDTLS_AES_H */
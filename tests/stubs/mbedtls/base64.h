@@ -0,0 +1,5 @@
+/* Host stand-in for mbedtls/base64.h, see host_mbedtls.h */
+#ifndef HOST_MBEDTLS_BASE64_H
+#define HOST_MBEDTLS_BASE64_H
+#include "host_mbedtls.h"
+#endif /* HOST_MBEDTLS_BASE64_H */
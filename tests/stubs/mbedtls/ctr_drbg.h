@@ -0,0 +1,5 @@
+/* Host stand-in for mbedtls/ctr_drbg.h, see host_mbedtls.h */
+#ifndef HOST_MBEDTLS_CTR_DRBG_H
+#define HOST_MBEDTLS_CTR_DRBG_H
+#include "host_mbedtls.h"
+#endif /* HOST_MBEDTLS_CTR_DRBG_H */
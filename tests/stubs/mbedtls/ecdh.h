@@ -0,0 +1,5 @@
+/* Host stand-in for mbedtls/ecdh.h, see host_mbedtls.h */
+#ifndef HOST_MBEDTLS_ECDH_H
+#define HOST_MBEDTLS_ECDH_H
+#include "host_mbedtls.h"
+#endif /* HOST_MBEDTLS_ECDH_H */
@@ -0,0 +1,120 @@
+/*                                                                          *
+ * Host stand-in for Mbed TLS 3                                             *
+ *                                                                          *
+ * The subset crypto.cpp uses, with the Mbed TLS 3 signatures, on top of    *
+ * OpenSSL libcrypto. Same algorithms and encodings as on the device:       *
+ * RSA-OAEP SHA-1, PKCS#1 / SPKI PEM, AES-ECB, P-256 ECDH, SHA-256.         *
+ *                                                                          */
+#ifndef HOST_MBEDTLS_H
+#define HOST_MBEDTLS_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_ERR_BASE64_INVALID_CHARACTER  -0x002C
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL   -0x002A
+#define MBEDTLS_ERR_PK_KEY_INVALID_FORMAT     -0x3D00
+#define MBEDTLS_ERR_PK_BAD_INPUT_DATA         -0x3E80
+#define MBEDTLS_ERR_PK_BUFFER_TOO_SMALL       -0x3880
+#define MBEDTLS_ERR_RSA_PRIVATE_FAILED        -0x4300
+#define MBEDTLS_ERR_RSA_KEY_GEN_FAILED        -0x4180
+#define MBEDTLS_ERR_ECP_BAD_INPUT_DATA        -0x4F80
+#define MBEDTLS_ERR_ECP_INVALID_KEY           -0x4C80
+#define MBEDTLS_ERR_MPI_BUFFER_TOO_SMALL      -0x0008
+
+// base64
+int mbedtls_base64_decode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen);
+
+// AES
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+struct mbedtls_aes_context {
+  uint8_t key[32];
+  unsigned int bits;
+};
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_setkey_dec(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16], unsigned char output[16]);
+
+// random numbers, both come from the OpenSSL DRBG
+struct mbedtls_entropy_context {
+  int unused;
+};
+struct mbedtls_ctr_drbg_context {
+  bool seeded;
+};
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx);
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx);
+int mbedtls_entropy_func(void* data, unsigned char* output, size_t len);
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx);
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx);
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*f_entropy)(void*, unsigned char*, size_t),
+  void* p_entropy, const unsigned char* custom, size_t len);
+int mbedtls_ctr_drbg_random(void* p_rng, unsigned char* output, size_t len);
+
+// RSA keys, mbedtls_pk_rsa() gives the pk context itself
+#define MBEDTLS_RSA_PKCS_V21 1
+enum mbedtls_md_type_t { MBEDTLS_MD_NONE, MBEDTLS_MD_SHA1, MBEDTLS_MD_SHA256 };
+enum mbedtls_pk_type_t { MBEDTLS_PK_NONE, MBEDTLS_PK_RSA };
+struct mbedtls_pk_info_t {
+  mbedtls_pk_type_t type;
+};
+struct mbedtls_pk_context {
+  void* key; // EVP_PKEY
+  mbedtls_md_type_t md;
+};
+typedef mbedtls_pk_context mbedtls_rsa_context;
+#define mbedtls_pk_rsa(pk) (&(pk))
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+const mbedtls_pk_info_t* mbedtls_pk_info_from_type(mbedtls_pk_type_t type);
+int mbedtls_pk_setup(mbedtls_pk_context* ctx, const mbedtls_pk_info_t* info);
+int mbedtls_pk_parse_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen, const unsigned char* pwd,
+  size_t pwdlen, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+int mbedtls_pk_decrypt(mbedtls_pk_context* ctx, const unsigned char* input, size_t ilen, unsigned char* output,
+  size_t* olen, size_t osize, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+int mbedtls_pk_write_key_pem(const mbedtls_pk_context* ctx, unsigned char* buf, size_t size);
+int mbedtls_pk_write_pubkey_pem(const mbedtls_pk_context* ctx, unsigned char* buf, size_t size);
+int mbedtls_rsa_set_padding(mbedtls_rsa_context* ctx, int padding, mbedtls_md_type_t hash_id);
+int mbedtls_rsa_gen_key(mbedtls_rsa_context* ctx, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng,
+  unsigned int nbits, int exponent);
+
+// P-256 ECDH
+enum mbedtls_ecp_group_id { MBEDTLS_ECP_DP_NONE, MBEDTLS_ECP_DP_SECP256R1 };
+#define MBEDTLS_ECP_PF_UNCOMPRESSED 0
+struct mbedtls_ecp_group {
+  void* group; // EC_GROUP
+};
+struct mbedtls_mpi {
+  void* bn;    // BIGNUM
+};
+struct mbedtls_ecp_point {
+  uint8_t raw[65]; // uncompressed, raw[0] = 0x04
+  size_t len;
+};
+void mbedtls_ecp_group_init(mbedtls_ecp_group* grp);
+void mbedtls_ecp_group_free(mbedtls_ecp_group* grp);
+int mbedtls_ecp_group_load(mbedtls_ecp_group* grp, mbedtls_ecp_group_id id);
+void mbedtls_mpi_init(mbedtls_mpi* X);
+void mbedtls_mpi_free(mbedtls_mpi* X);
+int mbedtls_mpi_write_binary(const mbedtls_mpi* X, unsigned char* buf, size_t buflen);
+void mbedtls_ecp_point_init(mbedtls_ecp_point* pt);
+void mbedtls_ecp_point_free(mbedtls_ecp_point* pt);
+int mbedtls_ecp_point_write_binary(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* P, int format, size_t* olen,
+  unsigned char* buf, size_t buflen);
+int mbedtls_ecp_point_read_binary(const mbedtls_ecp_group* grp, mbedtls_ecp_point* P, const unsigned char* buf, size_t ilen);
+int mbedtls_ecp_check_pubkey(const mbedtls_ecp_group* grp, const mbedtls_ecp_point* pt);
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q,
+  int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+int mbedtls_ecdh_compute_shared(mbedtls_ecp_group* grp, mbedtls_mpi* z, const mbedtls_ecp_point* Q, const mbedtls_mpi* d,
+  int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+
+// SHA-256
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char* output, int is224);
+
+
+#endif /* HOST_MBEDTLS_H */
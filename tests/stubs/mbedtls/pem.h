@@ -0,0 +1,5 @@
+/* Host stand-in for mbedtls/pem.h, see host_mbedtls.h */
+#ifndef HOST_MBEDTLS_PEM_H
+#define HOST_MBEDTLS_PEM_H
+#include "host_mbedtls.h"
+#endif /* HOST_MBEDTLS_PEM_H */
@@ -0,0 +1,5 @@
+/* Host stand-in for mbedtls/sha256.h, see host_mbedtls.h */
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+#include "host_mbedtls.h"
+#endif /* HOST_MBEDTLS_SHA256_H */
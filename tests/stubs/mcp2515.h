@@ -0,0 +1,49 @@
+/*                                                                          *
+ * Host stand-in for the autowp MCP2515 library                             *
+ *                                                                          *
+ * Types and register bits only, the driver under test talks SPI itself.   *
+ *                                                                          */
+#ifndef HOST_MCP2515_H
+#define HOST_MCP2515_H
+
+
+#include <Arduino.h>
+
+#define CAN_EFF_FLAG 0x80000000UL
+#define CAN_RTR_FLAG 0x40000000UL
+#define CAN_ERR_FLAG 0x20000000UL
+#define CAN_SFF_MASK 0x000007FFUL
+#define CAN_EFF_MASK 0x1FFFFFFFUL
+#define CAN_MAX_DLEN 8
+
+typedef uint32_t canid_t;
+
+struct can_frame {
+  canid_t can_id;
+  uint8_t can_dlc;
+  uint8_t data[CAN_MAX_DLEN] __attribute__((aligned(8)));
+};
+
+enum CAN_CLOCK { MCP_20MHZ, MCP_16MHZ, MCP_8MHZ };
+enum CAN_SPEED { CAN_83K3BPS, CAN_125KBPS, CAN_500KBPS };
+
+class MCP2515 {
+  public:
+    enum ERROR { ERROR_OK, ERROR_FAIL, ERROR_ALLTXBUSY, ERROR_FAILINIT, ERROR_FAILTX, ERROR_NOMSG };
+    enum MASK { MASK0, MASK1 };
+    enum RXF { RXF0, RXF1, RXF2, RXF3, RXF4, RXF5 };
+    enum CANINTF : uint8_t {
+      CANINTF_RX0IF = 0x01, CANINTF_RX1IF = 0x02, CANINTF_TX0IF = 0x04, CANINTF_TX1IF = 0x08,
+      CANINTF_TX2IF = 0x10, CANINTF_ERRIF = 0x20, CANINTF_WAKIF = 0x40, CANINTF_MERRF = 0x80
+    };
+    enum EFLG : uint8_t {
+      EFLG_RX1OVR = 0x80, EFLG_RX0OVR = 0x40, EFLG_TXBO = 0x20, EFLG_TXEP = 0x10,
+      EFLG_RXEP = 0x08, EFLG_TXWAR = 0x04, EFLG_RXWAR = 0x02, EFLG_EWARN = 0x01
+    };
+
+    ERROR setFilterMask(MASK, bool, uint32_t) { return ERROR_OK; }
+    ERROR setFilter(RXF, bool, uint32_t) { return ERROR_OK; }
+};
+
+
+#endif /* HOST_MCP2515_H */
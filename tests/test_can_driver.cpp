@@ -0,0 +1,258 @@
+/*                                                                          *
+ * MCP2515 receive driver against a register-level chip model              *
+ *                                                                          *
+ * Decode of standard, extended and remote frames, SPI bytes per frame,    *
+ * RXB0 -> RXB1 rollover, receive overflow reported and cleared without    *
+ * touching RXnIF, frames arriving in the middle of a transaction, two      *
+ * controllers on one bus and the SPI limited frame rate at 10 MHz.         *
+ *                                                                          */
+#include <Arduino.h>
+#include <thread>
+#include "can_driver.h"
+#include "mcp2515_mock.h"
+#include "check.h"
+
+#define CS0 5
+#define CS1 17
+
+// MCP2515 library receive path per frame: getInterrupts 3, RXBnSIDH..DLC 2 + 5,
+// RXBnCTRL 3, data 2 + 8, clear RXnIF 4
+#define LIBRARY_BYTES 27
+
+static struct can_frame frame(uint32_t id, uint8_t dlc, uint8_t seed = 0) {
+  struct can_frame f = {};
+  f.can_id = id;
+  f.can_dlc = dlc;
+  for (uint8_t i = 0; i < CAN_MAX_DLEN; i++) {
+    f.data[i] = seed + i * 17;
+  }
+  return f;
+}
+
+static bool same(const struct can_frame& a, const struct can_frame& b) {
+  uint8_t dlc = a.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : a.can_dlc;
+  return a.can_id == b.can_id && dlc == b.can_dlc && !memcmp(a.data, b.data, dlc);
+}
+
+static void decode() {
+  Mcp2515Mock chip(CS0);
+  CanDriver can(CAN_C, CS0);
+  can.begin();
+  CHECK(chip.reg[MOCK_RXB0CTRL] == 0x04);
+  CHECK(Mcp2515Mock::busErrors() == 0);
+
+  const struct can_frame frames[] = {
+    frame(0x340, 8, 1),
+    frame(0x000, 0),
+    frame(0x7FF, 3, 2),
+    frame(CAN_EFF_FLAG | 0x12345678, 4, 3),
+    frame(CAN_EFF_FLAG | 0x1FFFFFFF, 8, 4),
+    frame(CAN_RTR_FLAG | 0x240, 0),
+    frame(CAN_EFF_FLAG | CAN_RTR_FLAG | 0x00ABCDEF, 2),
+  };
+  CanPoll poll;
+  for (const struct can_frame& f : frames) {
+    chip.receive(f);
+    uint32_t before = chip.bytes;
+    can.poll(poll, false);
+    CHECK(poll.count == 1);
+    CHECKF(same(f, poll.frame[0]), "id %08x dlc %u -> %08x %u", f.can_id, f.can_dlc, poll.frame[0].can_id, poll.frame[0].can_dlc);
+    CHECK(poll.bytes == 2 + 6 + f.can_dlc);
+    CHECK(chip.bytes - before == poll.bytes);
+    CHECK(!chip.interrupt());
+  }
+
+  // DLC 9..15 on the bus means 8 data bytes
+  chip.receive(frame(0x1CA, 15, 5));
+  can.poll(poll, false);
+  CHECK(poll.count == 1 && poll.frame[0].can_dlc == 8);
+  CHECK(poll.bytes == 2 + 6 + 8);
+
+  // nothing pending: READ STATUS only, errors only on request
+  can.poll(poll, false);
+  CHECK(poll.count == 0 && poll.bytes == 2);
+  can.poll(poll, true);
+  CHECK(poll.count == 0 && poll.bytes == 6 && poll.intf == 0 && poll.eflg == 0);
+  CHECK(chip.protocolErrors == 0);
+}
+
+static void rollover() {
+  Mcp2515Mock chip(CS0);
+  CanDriver can(CAN_C, CS0);
+  can.begin();
+  CanPoll poll;
+
+  // two frames before the drain: RXB0, then RXB1
+  CHECK(chip.receive(frame(0x240, 8, 1)));
+  CHECK(chip.receive(frame(0x340, 8, 2)));
+  can.poll(poll, false);
+  CHECK(poll.count == 2);
+  CHECK(same(poll.frame[0], frame(0x240, 8, 1)));
+  CHECK(same(poll.frame[1], frame(0x340, 8, 2)));
+  CHECK(poll.bytes == 2 + 2 * 14);
+
+  // a third one is lost: RX1OVR and ERRIF, reported once RXB0 and RXB1 are drained
+  chip.receive(frame(0x240, 8, 3));
+  chip.receive(frame(0x340, 8, 4));
+  CHECK(!chip.receive(frame(0x1CA, 8, 5)));
+  CHECK(chip.lost == 1);
+  can.poll(poll, true);
+  CHECK(poll.count == 2 && poll.intf == 0 && poll.eflg == 0);
+  CHECK(chip.interrupt());
+  can.poll(poll, true);
+  CHECK(poll.count == 0);
+  CHECK(poll.intf == MCP2515::CANINTF_ERRIF);
+  CHECK(poll.eflg == MCP2515::EFLG_RX1OVR);
+  CHECK(poll.bytes == 2 + 4 + 4 + 4);
+  CHECK(chip.reg[MOCK_EFLG] == 0 && chip.reg[MOCK_CANINTF] == 0);
+  CHECK(!chip.interrupt());
+  uint32_t at;
+
+  // rollover during the RXB0 read, then a newer frame in RXB0: RXB1 is read first
+  chip.receive(frame(0x240, 8, 7));
+  at = chip.bytes + 4;
+  chip.hook = [&](Mcp2515Mock& c) {
+    if (c.bytes == at) c.receive(frame(0x340, 8, 8));
+  };
+  can.poll(poll, false);
+  chip.hook = nullptr;
+  CHECK(poll.count == 1 && same(poll.frame[0], frame(0x240, 8, 7)));
+  chip.receive(frame(0x1CA, 8, 9));
+  can.poll(poll, false);
+  CHECK(poll.count == 2);
+  CHECK(same(poll.frame[0], frame(0x340, 8, 8)));
+  CHECK(same(poll.frame[1], frame(0x1CA, 8, 9)));
+
+  // a frame arriving during the error clear keeps its RX0IF
+  chip.reg[MOCK_CANINTF] = MCP2515::CANINTF_ERRIF;
+  chip.reg[MOCK_EFLG] = MCP2515::EFLG_RX0OVR;
+  at = chip.bytes + 8;
+  chip.hook = [&](Mcp2515Mock& c) {
+    if (c.bytes == at) c.receive(frame(0x240, 2, 6));
+  };
+  can.poll(poll, true);
+  chip.hook = nullptr;
+  CHECK(poll.intf == MCP2515::CANINTF_ERRIF && poll.eflg == MCP2515::EFLG_RX0OVR);
+  CHECK(chip.reg[MOCK_CANINTF] == MCP2515::CANINTF_RX0IF);
+  can.poll(poll, false);
+  CHECK(poll.count == 1 && same(poll.frame[0], frame(0x240, 2, 6)));
+}
+
+// frames arriving at every byte position of a drain step: none lost, none out of order
+static void midTransaction() {
+  Mcp2515Mock chip(CS0);
+  CanDriver can(CAN_C, CS0);
+  can.begin();
+  CanPoll poll;
+  uint32_t sent = 0, got = 0, swaps = 0, lastSeed = 0;
+  uint32_t at = 0;
+  bool due = false;
+  auto arrive = [&](Mcp2515Mock& c) {
+    sent++;
+    c.receive(frame(0x100 + (sent & 0xFF), 8, sent));
+    due = false;
+  };
+  chip.hook = [&](Mcp2515Mock& c) {
+    if (due && c.bytes >= at) arrive(c);
+  };
+  for (uint32_t offset = 0; offset < 4000; offset++) {
+    // one arrival per step on average, at a byte position that moves across the transactions,
+    // every third step a second one before the next READ STATUS, then a step without.
+    // At most one frame between two steps: the gap of a drain is shorter than a frame on the bus
+    at = chip.bytes + offset % 31;
+    due = offset % 3 != 1;
+    can.poll(poll, false);
+    if (due) arrive(chip);
+    else if (offset % 3 == 0) arrive(chip);
+    for (uint8_t i = 0; i < poll.count; i++) {
+      uint32_t seed = poll.frame[i].data[0];
+      if (got && seed != ((lastSeed + 1) & 0xFF)) swaps++;
+      lastSeed = seed;
+      got++;
+    }
+  }
+  chip.hook = nullptr;
+  while (chip.interrupt()) {
+    can.poll(poll, true);
+    got += poll.count;
+  }
+  CHECKF(chip.lost == 0, "lost %u", chip.lost);
+  CHECKF(got == sent, "sent %u got %u", sent, got);
+  CHECKF(swaps == 0, "%u out of order", swaps);
+  CHECK(Mcp2515Mock::busErrors() == 0);
+  printf("mid-transaction: %u frames at every byte position, %u lost, %u out of order\n", sent, chip.lost, swaps);
+}
+
+// two controllers on the shared bus, each fed and drained by its own task
+static void arbitration() {
+  Mcp2515Mock chip0(CS0), chip1(CS1);
+  CanDriver can0(CAN_C, CS0), can1(CAN_B, CS1);
+  can0.begin();
+  can1.begin();
+  const uint32_t n = 300;
+  uint32_t errors = Mcp2515Mock::busErrors();
+  auto task = [n](Mcp2515Mock* chip, CanDriver* can, uint32_t* got) {
+    CanPoll poll;
+    for (uint32_t i = 0; i < n; i++) {
+      chip->receive(frame(0x200, 8, i));
+      do {
+        can->poll(poll, false);
+        for (uint8_t k = 0; k < poll.count; k++) {
+          if (poll.frame[k].data[0] == (uint8_t) *got) (*got)++;
+        }
+        std::this_thread::yield();
+      } while (poll.count);
+    }
+  };
+  uint32_t got0 = 0, got1 = 0;
+  std::thread t0(task, &chip0, &can0, &got0);
+  std::thread t1(task, &chip1, &can1, &got1);
+  t0.join();
+  t1.join();
+  CHECKF(got0 == n && got1 == n, "%u %u of %u", got0, got1, n);
+  CHECKF(Mcp2515Mock::busErrors() == errors, "%u bytes with no or two chips selected", Mcp2515Mock::busErrors() - errors);
+  CHECK(chip0.lost == 0 && chip1.lost == 0);
+}
+
+static void throughput() {
+  Mcp2515Mock chip(CS0);
+  CanDriver can(CAN_C, CS0);
+  can.begin();
+  CanPoll poll;
+  const uint32_t n = 100000;
+
+  // one 8 byte frame per interrupt, the common case at 500 kbit/s
+  uint32_t bytes = chip.bytes, transactions = chip.transactions;
+  for (uint32_t i = 0; i < n; i++) {
+    chip.receive(frame(0x340, 8));
+    can.poll(poll, false);
+  }
+  double perFrame = (double)(chip.bytes - bytes) / n;
+  double csPerFrame = (double)(chip.transactions - transactions) / n;
+  CHECK(perFrame == 16);
+  CHECK(csPerFrame == 2);
+
+  // bursts of two, RXB1 used
+  bytes = chip.bytes;
+  for (uint32_t i = 0; i < n; i++) {
+    chip.receive(frame(0x240, 8));
+    chip.receive(frame(0x340, 8));
+    can.poll(poll, false);
+  }
+  double burst = (double)(chip.bytes - bytes) / (2 * n);
+  CHECK(burst == 15);
+
+  double spi = CAN_SPI_CLOCK / 8.0;
+  printf("SPI bytes per 8 byte frame: %.0f single, %.0f in pairs, library %d\n", perFrame, burst, LIBRARY_BYTES);
+  printf("frames/s at %u MHz SPI: %.0f single, %.0f in pairs, library %.0f (CAN-C 500 kbit/s: ~4000)\n",
+    CAN_SPI_CLOCK / 1000000, spi / perFrame, spi / burst, spi / LIBRARY_BYTES);
+}
+
+int main() {
+  decode();
+  rollover();
+  midTransaction();
+  arbitration();
+  throughput();
+  return checkDone("test_can_driver");
+}
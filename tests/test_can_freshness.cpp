@@ -0,0 +1,246 @@
+/*                                                                          *
+ * CAN deadlines and neutral outputs                                        *
+ *                                                                          *
+ * The registered messages at their periods into CanFreshness, loop() and  *
+ * the output task of AIRmatic.ino / Output.ino every 10 ms on the virtual  *
+ * clock. Messages drop out for longer than their deadline, one at a time:  *
+ *                                                                          *
+ *   FS_340h, EZS_240h  stale in the first loop() past the deadline, the   *
+ *                      duties go neutral in that loop and the output ramp  *
+ *                      reaches them at the slew rate; back with the first  *
+ *                      frame, the offsets ramp in again                    *
+ *   KOMBI_A5           stale, the outputs keep their offsets               *
+ *                                                                          *
+ * A gap shorter than the deadline changes nothing. Also checks the state   *
+ * at boot, the miss counters and the stale gauge of /metrics.              *
+ *                                                                          */
+#include <Arduino.h>
+#include <string>
+#include "can_freshness.h"
+#include "can_registry.h"
+#include "config_store.h"
+#include "control.h"
+#include "check.h"
+
+#define LOOP_PERIOD 10   // ms, loop() and the output task
+#define OUTPUT_RATE 100  // Hz
+
+// firmware state, as in AIRmatic.ino
+static CanFreshness canFreshness;
+static const uint32_t canCritical = (1UL << MSG_EZS_240h) | (1UL << MSG_FS_340h);
+static bool outputNeutral = false;
+static uint8_t duty = 115;
+static uint8_t slew = 20;
+static int8_t offset_nv = 20, offset_nh = -15;
+static int8_t calib_vl = 2, calib_vr = -3, calib_hr = 1;
+static uint32_t pwmDuty_vl = 0, pwmDuty_vr = 0, pwmDuty_hr = 0;
+static int32_t pwmSlewStep = 0;
+static int32_t outputLevel[3] = {};
+
+// updatePwmDuty() of AIRmatic.ino
+static void updatePwmDuty() {
+  int8_t nv = outputNeutral ? 0 : offset_nv;
+  int8_t nh = outputNeutral ? 0 : offset_nh;
+  pwmDuty_vl = pwmValue(duty, calib_vl, nv, GAIN_ONE);
+  pwmDuty_vr = pwmValue(duty, calib_vr, -nv, GAIN_ONE);
+  pwmDuty_hr = pwmValue(duty, calib_hr, nh, GAIN_ONE);
+  pwmSlewStep = rampStep(slew, duty, OUTPUT_RATE);
+}
+
+// what the simulation saw, times in us
+static struct {
+  uint32_t send = ~0U;           // messages on the bus
+  uint32_t last[CAN_MSG_COUNT];   // newest frame
+  uint32_t first[CAN_MSG_COUNT];  // first frame after a stale loop()
+  uint32_t staleAt[CAN_MSG_COUNT];
+  uint32_t freshAt[CAN_MSG_COUNT];
+  uint32_t stale = 0;             // mask of the last loop()
+  uint32_t neutralAt = 0, appliedAt = 0;
+  uint32_t neutralChanges = 0;
+  uint32_t targetAt = 0;          // duties changed
+  uint32_t settledAt = 0;         // output on the duties
+  bool started = false;
+  uint32_t ms = 0;
+} sim;
+
+static void frame(uint8_t index) {
+  uint32_t now = micros();
+  if (sim.stale & (1UL << index) && !sim.first[index]) sim.first[index] = now;
+  sim.last[index] = now;
+  canFreshness.frame(canMessages[index].bus, index, canMessages[index].id, 8, now);
+}
+
+// the deadline part of loop()
+static void loopOnce() {
+  uint32_t now = micros();
+  uint32_t stale = canFreshness.check(now);
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    uint32_t bit = 1UL << i;
+    if ((stale & bit) && !(sim.stale & bit)) sim.staleAt[i] = now;
+    if (!(stale & bit) && (sim.stale & bit)) sim.freshAt[i] = now;
+  }
+  sim.stale = stale;
+  bool neutral = (stale & canCritical) != 0;
+  if (neutral != outputNeutral) {
+    outputNeutral = neutral;
+    if (neutral) sim.neutralAt = now;
+    else sim.appliedAt = now;
+    sim.neutralChanges++;
+  }
+  uint32_t before[3] = { pwmDuty_vl, pwmDuty_vr, pwmDuty_hr };
+  updatePwmDuty();
+  if (before[0] != pwmDuty_vl || before[1] != pwmDuty_vr || before[2] != pwmDuty_hr) {
+    sim.targetAt = now;
+    sim.settledAt = 0;
+  }
+}
+
+// one step of the output task in Output.ino
+static void outputOnce() {
+  int32_t step = sim.started ? pwmSlewStep : 0;
+  sim.started = true;
+  outputLevel[0] = outputRamp(outputLevel[0], rampLevel(pwmDuty_vl), step);
+  outputLevel[1] = outputRamp(outputLevel[1], rampLevel(pwmDuty_vr), step);
+  outputLevel[2] = outputRamp(outputLevel[2], rampLevel(pwmDuty_hr), step);
+  bool on = rampDuty(outputLevel[0]) == pwmDuty_vl && rampDuty(outputLevel[1]) == pwmDuty_vr &&
+    rampDuty(outputLevel[2]) == pwmDuty_hr;
+  if (on && !sim.settledAt) sim.settledAt = micros();
+}
+
+// ms of traffic: FS_340h 20 ms, EZS_240h 100 ms, KOMBI_A5 and UBF_A1 200 ms
+static void run(uint32_t ms) {
+  for (uint32_t end = sim.ms + ms; sim.ms < end; sim.ms++) {
+    uint32_t t = sim.ms;
+    if (t % 20 == 0 && (sim.send & (1UL << MSG_FS_340h))) frame(MSG_FS_340h);
+    if (t % 100 == 5 && (sim.send & (1UL << MSG_EZS_240h))) frame(MSG_EZS_240h);
+    if (t % 200 == 11 && (sim.send & (1UL << MSG_KOMBI_A5))) frame(MSG_KOMBI_A5);
+    if (t % 200 == 13 && (sim.send & (1UL << MSG_UBF_A1))) frame(MSG_UBF_A1);
+    if (t % LOOP_PERIOD == 3) loopOnce();
+    if (t % LOOP_PERIOD == 7) outputOnce();
+    hostAdvance(1000);
+  }
+}
+
+// output ticks of the ramp between neutral and the offsets
+static uint32_t rampTicks() {
+  int32_t distance[3] = {
+    rampLevel(pwmValue(duty, calib_vl, offset_nv, GAIN_ONE)) - rampLevel(pwmValue(duty, calib_vl, 0, GAIN_ONE)),
+    rampLevel(pwmValue(duty, calib_vr, -offset_nv, GAIN_ONE)) - rampLevel(pwmValue(duty, calib_vr, 0, GAIN_ONE)),
+    rampLevel(pwmValue(duty, calib_hr, offset_nh, GAIN_ONE)) - rampLevel(pwmValue(duty, calib_hr, 0, GAIN_ONE)),
+  };
+  uint32_t ticks = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    uint32_t n = (abs(distance[i]) + pwmSlewStep - 1) / pwmSlewStep;
+    if (n > ticks) ticks = n;
+  }
+  return ticks;
+}
+
+static bool dutiesAre(int8_t nv, int8_t nh) {
+  return pwmDuty_vl == pwmValue(duty, calib_vl, nv, GAIN_ONE) && pwmDuty_vr == pwmValue(duty, calib_vr, -nv, GAIN_ONE) &&
+    pwmDuty_hr == pwmValue(duty, calib_hr, nh, GAIN_ONE);
+}
+
+static bool staleGauge(uint8_t index, int value) {
+  struct : Print {
+    std::string text;
+    size_t write(uint8_t c) override { text += (char) c; return 1; }
+  } out;
+  canFreshness.write(out);
+  char line[128];
+  snprintf(line, sizeof(line), "airmatic_can_stale{bus=\"%s\",id=\"0x%03X\",name=\"%s\"} %d\n",
+    canMessages[index].bus == CAN_C ? "can_c" : "can_b", canMessages[index].id, canMessages[index].name, value);
+  return out.text.find(line) != std::string::npos;
+}
+
+// before the first frame everything is stale and the outputs start neutral
+static void boot() {
+  sim.send = 0;
+  run(50);
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    CHECKF(sim.stale & (1UL << i), "%s not stale at boot", canMessages[i].name);
+    CHECK(canFreshness.misses(i) == 0); // never fresh, no miss
+  }
+  CHECK(outputNeutral && dutiesAre(0, 0) && sim.settledAt);
+
+  sim.send = ~0U;
+  run(2000);
+  CHECKF(sim.stale == 0, "stale 0x%x with all messages on the bus", sim.stale);
+  CHECK(!outputNeutral && dutiesAre(offset_nv, offset_nh));
+  CHECK(sim.settledAt && sim.settledAt - sim.appliedAt <= (rampTicks() + 1) * LOOP_PERIOD * 1000);
+}
+
+// index silent for ms, then back until the outputs settled
+static void dropout(uint8_t index, uint32_t ms) {
+  const uint32_t deadline = CanFreshness::deadline(index);
+  const bool critical = canCritical & (1UL << index);
+  const uint32_t misses = canFreshness.misses(index);
+  const uint32_t changes = sim.neutralChanges;
+  const uint32_t period = LOOP_PERIOD * 1000;
+  sim.first[index] = 0;
+  sim.send &= ~(1UL << index);
+  uint32_t lastFrame = sim.last[index];
+
+  // stale from the first loop() past the deadline
+  run(deadline / 1000 + 2 * LOOP_PERIOD);
+  CHECKF(sim.stale & (1UL << index), "%s not stale %u us after its last frame", canMessages[index].name, micros() - lastFrame);
+  uint32_t detect = sim.staleAt[index] - lastFrame;
+  CHECKF(detect > deadline && detect <= deadline + period, "%s stale %u us after its last frame, deadline %u us",
+    canMessages[index].name, detect, deadline);
+  CHECK(canFreshness.misses(index) == misses + 1 && canFreshness.lateMax(index) <= period);
+  CHECK(staleGauge(index, 1));
+
+  if (critical) {
+    // neutral duties in the detecting loop(), ramped at the slew rate
+    CHECK(outputNeutral && sim.neutralAt == sim.staleAt[index] && dutiesAre(0, 0));
+    CHECK(sim.targetAt == sim.neutralAt);
+    uint32_t ticks = rampTicks();
+    run(ms - deadline / 1000 - 2 * LOOP_PERIOD);
+    CHECKF(sim.settledAt && sim.settledAt - sim.neutralAt <= (ticks + 1) * period, "%s: neutral %u us after detection, %u ticks",
+      canMessages[index].name, sim.settledAt - sim.neutralAt, ticks);
+    CHECK(rampDuty(outputLevel[0]) == pwmValue(duty, calib_vl, 0, GAIN_ONE));
+  } else {
+    run(ms - deadline / 1000 - 2 * LOOP_PERIOD);
+    CHECK(!outputNeutral && sim.neutralChanges == changes && dutiesAre(offset_nv, offset_nh));
+  }
+
+  // back with the first frame, the offsets ramp in again
+  sim.send = ~0U;
+  run(2 * LOOP_PERIOD + canMessages[index].period);
+  CHECK(!(sim.stale & (1UL << index)) && staleGauge(index, 0));
+  CHECKF(sim.first[index] && sim.freshAt[index] - sim.first[index] <= period, "%s fresh %u us after its first frame",
+    canMessages[index].name, sim.freshAt[index] - sim.first[index]);
+  CHECK(!outputNeutral && dutiesAre(offset_nv, offset_nh));
+  if (critical) {
+    CHECK(sim.appliedAt == sim.freshAt[index] && sim.neutralChanges == changes + 2);
+    uint32_t ticks = rampTicks();
+    run((ticks + 1) * LOOP_PERIOD);
+    CHECKF(sim.settledAt && sim.settledAt - sim.appliedAt <= (ticks + 1) * period, "%s: offsets %u us after recovery",
+      canMessages[index].name, sim.settledAt - sim.appliedAt);
+  }
+  CHECK(canFreshness.misses(index) == misses + 1);
+  printf("can freshness: %-8s %4u ms out, stale after %6u us (deadline %6u us), %s\n", canMessages[index].name, ms,
+    detect, deadline, critical ? "outputs neutral" : "offsets kept");
+}
+
+// a gap below the deadline is no miss
+static void shortGap(uint8_t index) {
+  const uint32_t misses = canFreshness.misses(index);
+  const uint32_t changes = sim.neutralChanges;
+  sim.send &= ~(1UL << index);
+  run(CanFreshness::deadline(index) / 1000 - canMessages[index].period - LOOP_PERIOD);
+  sim.send = ~0U;
+  run(500);
+  CHECK(canFreshness.misses(index) == misses && sim.neutralChanges == changes && sim.stale == 0);
+}
+
+int main() {
+  hostAdvance(1000000);
+  boot();
+  shortGap(MSG_FS_340h);
+  dropout(MSG_FS_340h, 1500);
+  dropout(MSG_EZS_240h, 1500);
+  dropout(MSG_KOMBI_A5, 2500);
+  shortGap(MSG_EZS_240h);
+  return checkDone("test_can_freshness");
+}
@@ -0,0 +1,174 @@
+/*                                                                          *
+ * FrameQueue and Snapshot, one producer thread against one consumer        *
+ *                                                                          *
+ * Queue: every frame arrives once, in order and intact, or is counted as   *
+ * dropped. Snapshot: no reader ever sees a half written payload and the    *
+ * version never goes back.                                                 *
+ *                                                                          */
+#include <Arduino.h>
+#include <chrono>
+#include <thread>
+#include "canbus.h"
+#include "check.h"
+
+#define QUEUE_FRAMES 2000000
+#define SNAPSHOT_WRITES 1000000
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// payload derived from the sequence number, a torn copy does not match
+static void fill(CanFrame& f, uint32_t n) {
+  f.time = n;
+  f.frame.can_id = n & CAN_SFF_MASK;
+  f.frame.can_dlc = 8;
+  for (uint8_t i = 0; i < 8; i++) f.frame.data[i] = (uint8_t)(n * 31 + i);
+}
+
+static bool intact(const CanFrame& f) {
+  if (f.frame.can_id != (f.time & CAN_SFF_MASK) || f.frame.can_dlc != 8) return false;
+  for (uint8_t i = 0; i < 8; i++) {
+    if (f.frame.data[i] != (uint8_t)(f.time * 31 + i)) return false;
+  }
+  return true;
+}
+
+
+static void queueSingle() {
+  FrameQueue<CanFrame, CAN_QUEUE_LEN> q;
+  CanFrame f;
+  for (uint32_t n = 0; n < CAN_QUEUE_LEN; n++) {
+    fill(f, n);
+    CHECK(q.push(f));
+  }
+  CHECK(!q.push(f));
+  CHECK(q.dropped() == 1);
+  CHECK(q.size() == CAN_QUEUE_LEN);
+  for (uint32_t n = 0; n < CAN_QUEUE_LEN; n++) {
+    CHECK(q.pop(f) && f.time == n && intact(f));
+  }
+  CHECK(!q.pop(f));
+  CHECK(q.size() == 0);
+}
+
+static void queueThreads() {
+  static FrameQueue<CanFrame, CAN_QUEUE_LEN> q;
+  std::atomic<bool> done{false};
+  uint32_t pushed = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread producer([&] {
+    CanFrame f;
+    for (uint32_t n = 0; n < QUEUE_FRAMES; n++) {
+      fill(f, n);
+      if (q.push(f)) pushed++;
+      // full ring: wait for the next frame like the CAN task waits for INT
+      else std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t received = 0, broken = 0, order = 0;
+  int64_t last = -1;
+  CanFrame f;
+  while (true) {
+    if (!q.pop(f)) {
+      if (done.load(std::memory_order_acquire) && !q.size()) break;
+      std::this_thread::yield();
+      continue;
+    }
+    received++;
+    if (!intact(f)) broken++;
+    if ((int64_t) f.time <= last) order++;
+    last = f.time;
+  }
+  producer.join();
+  double s = seconds(start);
+
+  CHECKF(broken == 0, "%u torn frames", broken);
+  CHECKF(order == 0, "%u frames out of order", order);
+  CHECKF(received == pushed, "received %u, pushed %u", received, pushed);
+  CHECKF(received + q.dropped() == QUEUE_FRAMES, "received %u + dropped %u != %u", received, q.dropped(), QUEUE_FRAMES);
+  printf("FrameQueue: %u frames, %u received, %u dropped, %.1f Mframes/s\n",
+    QUEUE_FRAMES, received, q.dropped(), QUEUE_FRAMES / s / 1e6);
+}
+
+
+// larger than the 8 byte decoders so a torn copy is likely to show
+struct Payload {
+  uint32_t word[16];
+};
+
+static void snapshotSingle() {
+  Snapshot<Payload> snap;
+  uint8_t msg[sizeof(Payload)];
+  memset(msg, 0x11, sizeof(msg));
+  snap.write(msg, sizeof(msg));
+  memset(msg, 0x22, 4);
+  snap.write(msg, 4);
+  CHECK(snap.version() == 2);
+  CHECK(snap.overwritten() == 1);
+  Payload p = snap.read();
+  // shorter frame keeps the tail
+  CHECK(p.word[0] == 0x22222222 && p.word[1] == 0x11111111 && p.word[15] == 0x11111111);
+  snap.write(msg, sizeof(msg));
+  CHECK(snap.overwritten() == 1);
+}
+
+static void snapshotThreads() {
+  static Snapshot<Payload> snap;
+  std::atomic<bool> done{false};
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread writer([&] {
+    Payload p;
+    for (uint32_t n = 1; n <= SNAPSHOT_WRITES; n++) {
+      for (uint8_t i = 0; i < 16; i++) p.word[i] = n;
+      snap.write((const uint8_t*) &p, sizeof(p));
+      // single core hosts: hand over to the reader now and then
+      if ((n & 0xFF) == 0) std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t reads = 0, torn = 0, back = 0, distinct = 0, last = 0;
+  uint32_t lastVersion = 0;
+  while (!done.load(std::memory_order_acquire)) {
+    uint32_t version = snap.version();
+    Payload p = snap.read();
+    reads++;
+    for (uint8_t i = 1; i < 16; i++) {
+      if (p.word[i] != p.word[0]) {
+        torn++;
+        break;
+      }
+    }
+    if (p.word[0] < last) back++;
+    if (p.word[0] != last) distinct++;
+    // the copy is at least as new as the version read before it
+    if (p.word[0] < version) back++;
+    if (version < lastVersion) back++;
+    last = p.word[0];
+    lastVersion = version;
+  }
+  writer.join();
+  double s = seconds(start);
+
+  CHECKF(torn == 0, "%u torn reads of %u", torn, reads);
+  CHECKF(back == 0, "%u reads went back in time", back);
+  CHECK(snap.version() == SNAPSHOT_WRITES);
+  CHECK(snap.overwritten() < SNAPSHOT_WRITES);
+  CHECK(snap.read().word[15] == SNAPSHOT_WRITES);
+  printf("Snapshot: %u writes, %u reads, %u distinct, %u overwritten, %.1f Mwrites/s\n",
+    SNAPSHOT_WRITES, reads, distinct, snap.overwritten(), SNAPSHOT_WRITES / s / 1e6);
+}
+
+
+int main() {
+  queueSingle();
+  queueThreads();
+  snapshotSingle();
+  snapshotThreads();
+  return checkDone("test_canbus");
+}
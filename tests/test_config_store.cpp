@@ -0,0 +1,335 @@
+/*                                                                          *
+ * ConfigStore on the LittleFS stand-in                                     *
+ *                                                                          *
+ * Migration of the legacy data/config.json, debounced write-behind,        *
+ * flush() from loop() and the WiFi worker at the same time, a power cut    *
+ * at every byte of a slot write and of the migration, and the boot time    *
+ * of the slots against the three config.json parses they replaced.         *
+ *                                                                          */
+#include <Arduino.h>
+#include <thread>
+#include "config_store.h"
+#include "check.h"
+
+#define LEGACY "/config.json"
+
+// everything a reboot has to bring back
+struct State {
+  int8_t calib[CALIB_COUNT];
+  int16_t gain[CALIB_COUNT];
+  bool table[MODE_COUNT];
+  int8_t offsets[MODE_COUNT][AXLE_COUNT];
+  String hash, seed;
+
+  bool operator==(const State& o) const {
+    return !memcmp(calib, o.calib, sizeof(calib)) && !memcmp(gain, o.gain, sizeof(gain))
+      && !memcmp(table, o.table, sizeof(table)) && !memcmp(offsets, o.offsets, sizeof(offsets))
+      && hash == o.hash && seed == o.seed;
+  }
+  bool operator!=(const State& o) const { return !(*this == o); }
+};
+
+static State state(ConfigStore& store) {
+  State s;
+  for (uint8_t c = 0; c < CALIB_COUNT; c++) {
+    s.calib[c] = store.getCalibration((CalibChannel) c);
+    s.gain[c] = store.getGain((CalibChannel) c);
+  }
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    s.table[m] = store.hasOffsets((Mode) m);
+    for (uint8_t a = 0; a < AXLE_COUNT; a++) s.offsets[m][a] = store.getOffset((Mode) m, (Axle) a);
+  }
+  store.getWifi(s.hash, s.seed);
+  return s;
+}
+
+static State reboot() {
+  ConfigStore store;
+  store.begin(LEGACY);
+  return state(store);
+}
+
+static void legacy(const std::string& json) {
+  LittleFS.clear();
+  LittleFS.data(LEGACY).assign(json.begin(), json.end());
+}
+
+static std::string readFile(const char* path) {
+  std::string s;
+  FILE* f = fopen(path, "rb");
+  if (!f) return s;
+  char buf[256];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+  fclose(f);
+  return s;
+}
+
+
+static void migrate() {
+  // shipped default
+  std::string json = readFile("../data/config.json");
+  CHECK(!json.empty());
+  legacy(json);
+  ConfigStore store;
+  store.begin(LEGACY);
+  CHECK(LittleFS.exists(CONFIG_SLOT_A));
+  CHECK(!store.isDirty() && store.flashWrites() == 1);
+  State s = state(store);
+  CHECK(!s.table[MODE_DEFAULT] && s.table[MODE_OFFROAD] && s.table[MODE_SPORT2]);
+  CHECK(s.gain[CALIB_VL] == GAIN_ONE && s.hash.isEmpty());
+  CHECK(reboot() == s);
+
+  // every section, the slots win over config.json from now on
+  legacy("{\"comfort\":{\"offset_nv\":5,\"offset_nh\":-10},"
+    "\"calibration\":{\"calib_vl\":3,\"calib_vr\":-2,\"calib_hl\":0,\"calib_hr\":1,\"gain_vl\":250},"
+    "\"wifi\":{\"hash\":\"" + std::string(CONFIG_WIFI_HEX, 'a') + "\",\"seed\":\"0123\"}}");
+  ConfigStore full;
+  full.begin(LEGACY);
+  s = state(full);
+  CHECK(s.table[MODE_COMFORT] && s.offsets[MODE_COMFORT][AXLE_NV] == 5 && s.offsets[MODE_COMFORT][AXLE_NH] == -10);
+  CHECK(!s.table[MODE_SPORT1]);
+  CHECK(s.calib[CALIB_VL] == 3 && s.calib[CALIB_VR] == -2 && s.calib[CALIB_HR] == 1);
+  CHECK(s.gain[CALIB_VL] == 250 && s.gain[CALIB_VR] == GAIN_ONE);
+  CHECK(s.hash.length() == CONFIG_WIFI_HEX && s.seed == "0123");
+  LittleFS.data(LEGACY).clear();
+  CHECK(reboot() == s);
+
+  // broken JSON, nothing to migrate
+  legacy("{\"comfort\":{\"offset_nv\":");
+  ConfigStore broken;
+  broken.begin(LEGACY);
+  CHECK(!LittleFS.exists(CONFIG_SLOT_A) && !broken.isDirty());
+}
+
+static void writeBehind() {
+  legacy("{}");
+  ConfigStore store;
+  store.begin(LEGACY);
+  uint32_t writes = store.flashWrites();
+
+  // same value: no write
+  store.setCalibration(CALIB_HL, 0);
+  CHECK(!store.isDirty());
+
+  // changes coalesce until CONFIG_FLUSH_DELAY after the last one
+  for (int8_t v = 1; v <= 10; v++) {
+    store.setOffset(MODE_SPORT1, AXLE_NV, v);
+    hostAdvance(100 * 1000);
+    store.flush();
+  }
+  CHECK(store.isDirty() && store.flashWrites() == writes);
+  hostAdvance(CONFIG_FLUSH_DELAY * 1000);
+  store.flush();
+  CHECK(!store.isDirty() && store.flashWrites() == writes + 1);
+  store.flush(true);
+  CHECK(store.flashWrites() == writes + 1);
+  CHECK(reboot().offsets[MODE_SPORT1][AXLE_NV] == 10);
+
+  // A/B: each write goes to the other slot, the previous record stays
+  for (int16_t gain = 300; gain < 304; gain++) {
+    std::vector<uint8_t> a = LittleFS.data(CONFIG_SLOT_A);
+    std::vector<uint8_t> b = LittleFS.data(CONFIG_SLOT_B);
+    store.setGain(CALIB_HR, gain);
+    store.flush(true);
+    CHECK((LittleFS.data(CONFIG_SLOT_A) == a) != (LittleFS.data(CONFIG_SLOT_B) == b));
+  }
+  CHECK(reboot().gain[CALIB_HR] == 303);
+
+  // held while a LittleFS image is written: no write, not even forced, the change stays dirty
+  writes = store.flashWrites();
+  store.hold(true);
+  store.setGain(CALIB_HR, 310);
+  hostAdvance(CONFIG_FLUSH_DELAY * 1000);
+  store.flush();
+  store.flush(true);
+  CHECK(store.isDirty() && store.flashWrites() == writes);
+  store.hold(false);
+  store.flush();
+  CHECK(!store.isDirty() && store.flashWrites() == writes + 1);
+  CHECK(reboot().gain[CALIB_HR] == 310);
+}
+
+// loop() flushes after the debounce, the WiFi worker forces a flush after each command
+static void concurrentFlush() {
+  legacy("{}");
+  ConfigStore store;
+  store.begin(LEGACY);
+  uint32_t writes = store.flashWrites();
+  LittleFS.writersMax = 0;
+  LittleFS.writeOpens = 0;
+  LittleFS.writeSleepUs = 200;
+  std::atomic<bool> done{false};
+
+  std::thread loop([&] {
+    int8_t v = 0;
+    while (!done.load()) {
+      store.setCalibration(CALIB_VL, ++v % 20);
+      hostAdvance(CONFIG_FLUSH_DELAY * 1000);
+      store.flush();
+    }
+  });
+  for (int16_t i = 0; i < 300; i++) {
+    store.setOffset((Mode)(i % MODE_COUNT), (Axle)(i & 1), i % 60 - 30);
+    store.setGain(CALIB_HL, GAIN_ONE + i);
+    store.flush(true);
+  }
+  done.store(true);
+  loop.join();
+  store.flush(true);
+  LittleFS.writeSleepUs = 0;
+
+  CHECKF(LittleFS.writersMax == 1, "%d slot writes at once", LittleFS.writersMax);
+  CHECKF(store.flashWrites() - writes == LittleFS.writeOpens, "%u writes counted, %u done", store.flashWrites() - writes, LittleFS.writeOpens);
+  CHECK(!store.isDirty());
+  CHECK(reboot() == state(store));
+  printf("config store: %u flash writes from two tasks\n", LittleFS.writeOpens);
+}
+
+// a record that differs from the previous one in every section
+static void change(ConfigStore& store, int i) {
+  store.setCalibration((CalibChannel)(i % CALIB_COUNT), i % 50 - 25);
+  store.setGain((CalibChannel)(i % CALIB_COUNT), GAIN_ONE + i);
+  store.setOffset((Mode)(i % MODE_COUNT), (Axle)(i & 1), i % 60 - 30);
+  String hash(std::string(CONFIG_WIFI_HEX, 'a' + i % 6).c_str());
+  store.setWifi(hash, String(i));
+}
+
+// power cut after every byte of a slot write, into both slots, with and without a torn last byte:
+// the next boot has the record before the write, or the new one once all of it is written
+static void powerLoss() {
+  legacy("{}");
+  ConfigStore store;
+  store.begin(LEGACY);
+  change(store, 1);
+  store.flush(true);
+  size_t size = LittleFS.data(CONFIG_SLOT_A).size();
+  CHECK(size > 0);
+  uint32_t cuts = 0, fallbacks = 0;
+  for (int torn : { -1, 0x00, 0x5A, 0xFF }) {
+    for (long budget = 0; budget <= (long) size; budget++) {
+      for (int slot = 0; slot < 2; slot++) {
+        State before = state(store);
+        change(store, cuts + 2);
+        State after = state(store);
+        LittleFS.writeBudget = budget;
+        LittleFS.tornByte = torn;
+        store.flush(true);
+        LittleFS.writeBudget = -1;
+        LittleFS.tornByte = -1;
+        State booted = reboot();
+        bool complete = budget == (long) size;
+        CHECKF(booted == (complete ? after : before), "cut at byte %ld of %zu, torn %d: %s record", budget, size, torn,
+          booted == before ? "old" : booted == after ? "new" : "broken");
+        CHECK(store.isDirty() == !complete);
+        if (!complete) fallbacks++;
+        cuts++;
+        // power back: the store writes the same slot again, then the other one
+        store.flush(true);
+        CHECK(!store.isDirty() && reboot() == after);
+      }
+    }
+  }
+
+  // a flipped bit in the newest slot: the CRC rejects it, the older record is loaded
+  State older = state(store);
+  change(store, 999);
+  store.flush(true);
+  std::vector<uint8_t> a = LittleFS.data(CONFIG_SLOT_A), b = LittleFS.data(CONFIG_SLOT_B);
+  State current = state(store);
+  uint32_t flips = 0;
+  for (const char* slot : { CONFIG_SLOT_A, CONFIG_SLOT_B }) {
+    std::vector<uint8_t>& data = LittleFS.data(slot);
+    std::vector<uint8_t> good = data;
+    for (size_t bit = 0; bit < good.size() * 8; bit++) {
+      data = good;
+      data[bit / 8] ^= 1 << (bit % 8);
+      State booted = reboot();
+      CHECKF(booted == current || booted == older, "%s bit %zu flipped: broken record", slot, bit);
+      flips++;
+    }
+    data = good;
+  }
+  CHECK(LittleFS.data(CONFIG_SLOT_A) == a && LittleFS.data(CONFIG_SLOT_B) == b);
+  printf("config store: %u power cuts across %zu byte slot writes, %u fell back to the previous record, %u bit flips\n",
+    cuts, size, fallbacks, flips);
+
+  // cut during the migration: config.json stays, the next boot migrates again
+  std::string json = readFile("../data/config.json");
+  legacy(json);
+  State migrated = reboot();
+  for (long budget = 0; budget < (long) size; budget++) {
+    legacy(json);
+    LittleFS.writeBudget = budget;
+    ConfigStore first;
+    first.begin(LEGACY);
+    LittleFS.writeBudget = -1;
+    CHECKF(reboot() == migrated, "migration cut at byte %ld", budget);
+  }
+}
+
+// ESP32 LittleFS on 4 KB blocks: a file open walks the metadata pairs, reads go through the cache
+#define FS_OPEN_US 900
+#define FS_BYTE_US 1
+// ArduinoJson on the 240 MHz ESP32, per byte of input
+#define JSON_BYTE_US 1
+
+// setup() before the first output: config slots once, against readConfig(), getWifi() and the first
+// getSettings() each opening and parsing config.json, as before the slots
+static void bootTime() {
+  std::string json = "{\"comfort\":{\"offset_nv\":5,\"offset_nh\":-10},\"sport1\":{\"offset_nv\":-5,\"offset_nh\":-5},"
+    "\"sport2\":{\"offset_nv\":-15,\"offset_nh\":-15},\"offroad\":{\"offset_nv\":20,\"offset_nh\":20},"
+    "\"calibration\":{\"calib_vl\":3,\"calib_vr\":-2,\"calib_hl\":0,\"calib_hr\":1,"
+    "\"gain_vl\":250,\"gain_vr\":256,\"gain_hl\":256,\"gain_hr\":262},"
+    "\"wifi\":{\"hash\":\"" + std::string(CONFIG_WIFI_HEX, 'a') + "\",\"seed\":\"" + std::string(CONFIG_WIFI_HEX, 'b') + "\"}}";
+  legacy(json);
+  LittleFS.openUs = FS_OPEN_US;
+  LittleFS.byteUs = FS_BYTE_US;
+
+  uint32_t start = micros();
+  ConfigStore first;
+  first.begin(LEGACY);
+  uint32_t migration = micros() - start;
+  State older = state(first);
+  change(first, 7);
+  first.flush(true);
+  State s = state(first);
+
+  start = micros();
+  CHECK(reboot() == s);
+  uint32_t slots = micros() - start;
+
+  // newest slot torn: both are read anyway, the older record is loaded
+  std::vector<uint8_t>& b = LittleFS.data(CONFIG_SLOT_B);
+  b.resize(b.size() / 2);
+  start = micros();
+  CHECK(reboot() == older);
+  uint32_t fallback = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < 3; i++) {
+    JsonDocument doc;
+    File f = LittleFS.open(LEGACY, "r");
+    CHECK(f && !deserializeJson(doc, f));
+    f.close();
+    hostAdvance(json.size() * JSON_BYTE_US);
+  }
+  uint32_t parses = micros() - start;
+  LittleFS.openUs = 0;
+  LittleFS.byteUs = 0;
+
+  CHECKF(slots * 2 < parses, "slots %u us, config.json %u us", slots, parses);
+  CHECKF(fallback <= slots, "torn slot %u us, no JSON parsed", fallback);
+  printf("config store: boot %u us from the slots (%u us with a torn slot), %u us for 3 parses of a %zu byte config.json,"
+    " first boot migration %u us\n", slots, fallback, parses, json.size(), migration);
+}
+
+
+int main() {
+  migrate();
+  writeBehind();
+  concurrentFlush();
+  powerLoss();
+  bootTime();
+  return checkDone("test_config_store");
+}
@@ -0,0 +1,296 @@
+/*                                                                          *
+ * Control loop without heap allocations                                    *
+ *                                                                          *
+ * Runs the per frame and per loop() work of the firmware on 100 s of      *
+ * simulated traffic with mode changes and key presses, and counts every    *
+ * operator new and malloc / calloc / realloc call meanwhile: must be 0.    *
+ * Also checks detectMode(), the fixed point duty mapping and the timing    *
+ * and monotonicity of the output task's slew rate ramp.                    *
+ *                                                                          */
+#include <Arduino.h>
+#include <new>
+#include "canbus.h"
+#include "can_freshness.h"
+#include "config_store.h"
+#include "control.h"
+#include "key_combo.h"
+#include "level_history.h"
+#include "metrics.h"
+#include "w211_signals.h"
+#include "check.h"
+
+// allocation counter, malloc & co. are wrapped by the linker (see Makefile)
+static std::atomic<bool> counting{false};
+static std::atomic<uint32_t> allocations{0};
+
+static inline void counted() {
+  if (counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+void* __wrap_malloc(size_t size) { counted(); return __real_malloc(size); }
+void* __wrap_calloc(size_t n, size_t size) { counted(); return __real_calloc(n, size); }
+void* __wrap_realloc(void* p, size_t size) { counted(); return __real_realloc(p, size); }
+}
+
+void* operator new(size_t size) {
+  counted();
+  void* p = __real_malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { counted(); return __real_malloc(size ? size : 1); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { counted(); return __real_malloc(size ? size : 1); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+
+// firmware state, as in AIRmatic.ino
+static FrameQueue<CanFrame, CAN_QUEUE_LEN> canQueue0, canQueue1;
+static Snapshot<EZS_240h_t> EZS_240h;
+static Snapshot<FS_340h_t> FS_340h;
+static CanFreshness canFreshness;
+static LevelHistory levelHistory;
+static Mode mode = MODE_DEFAULT;
+static uint32_t pwmDuty[CALIB_COUNT];
+static uint32_t keyEvents = 0;
+
+static void keyAction(uint8_t combo, uint8_t action, uint32_t time) {
+  keyEvents++;
+}
+
+static const KeyCombo keyTable[] = {
+  {BTN_NEXT | BTN_PLUS, KEY_PRESS | KEY_REPEAT, 40, 1400, 600, 0},
+  {BTN_NEXT | BTN_SEND, KEY_LONG, 40, 0, 0, 1400},
+};
+static KeyComboEngine keyCombos(keyTable, 2, keyAction);
+
+// CAN task: one received frame
+static void receive(CanBus bus, FrameQueue<CanFrame, CAN_QUEUE_LEN>& queue, uint32_t id, const uint8_t* data, uint8_t dlc) {
+  CanFrame rx;
+  rx.time = micros();
+  rx.frame.can_id = id;
+  rx.frame.can_dlc = dlc;
+  memcpy(rx.frame.data, data, dlc);
+  uint8_t index = canMsgIndex(bus, id);
+  canFreshness.frame(bus, index, id, dlc, rx.time);
+  if (index != CAN_MSG_NONE) metrics.frames[index].inc();
+  if (id == CANID_EZS_240h) EZS_240h.write(data, dlc);
+  if (id == CANID_FS_340h) FS_340h.write(data, dlc);
+  queue.push(rx);
+}
+
+// one loop() iteration
+static void loopOnce() {
+  static uint32_t lastLoop = 0;
+  uint32_t now = micros();
+  if (lastLoop) metrics.loopPeriod.record(now - lastLoop);
+  lastLoop = now;
+
+  CanFrame rx;
+  bool chassis = false;
+  while (canQueue0.pop(rx)) {
+    chassis = true;
+    if (rx.frame.can_id == CANID_FS_340h) {
+      const uint8_t* d = rx.frame.data;
+      uint8_t level[LEVEL_WHEELS] = { w211::FS_340h::FZGN_VL(d), w211::FS_340h::FZGN_VR(d),
+        w211::FS_340h::FZGN_HL(d), w211::FS_340h::FZGN_HR(d) };
+      levelHistory.add(rx.time / 1000, level, mode);
+    }
+  }
+  if (chassis) mode = detectMode(mode, EZS_240h.read(), FS_340h.read());
+  while (canQueue1.pop(rx)) {
+    if (rx.frame.can_id == CANID_KOMBI_A5 && rx.frame.can_dlc >= w211::KOMBI_A5::DLC) {
+      keyCombos.update(kombiButtons(rx.frame.data), rx.time);
+    }
+  }
+  keyCombos.poll(micros());
+  canFreshness.check(now);
+
+  int8_t nv = configStore.getOffset(mode, AXLE_NV);
+  int8_t nh = configStore.getOffset(mode, AXLE_NH);
+  pwmDuty[CALIB_VL] = pwmValue(115, configStore.getCalibration(CALIB_VL), nv, configStore.getGain(CALIB_VL));
+  pwmDuty[CALIB_VR] = pwmValue(115, configStore.getCalibration(CALIB_VR), -nv, configStore.getGain(CALIB_VR));
+  pwmDuty[CALIB_HR] = pwmValue(115, configStore.getCalibration(CALIB_HR), nh, configStore.getGain(CALIB_HR));
+  pwmDuty[CALIB_HL] = pwmValue(115, configStore.getCalibration(CALIB_HL), nh, configStore.getGain(CALIB_HL));
+  configStore.flush();
+}
+
+// 10 ms of traffic: FS_340h 20 ms, EZS_240h 100 ms, KOMBI_A5 200 ms
+static void traffic(uint32_t tick) {
+  uint32_t ms = tick * 10;
+  uint8_t ezs[w211::EZS_240h::DLC] = {};
+  w211::EZS_240h::set_KL_15(ezs, true);
+  uint8_t fs[w211::FS_340h::DLC] = {};
+  w211::FS_340h::set_FS_ID(fs, 1);
+  uint8_t phase = (ms / 5000) % 4; // mode change every 5 s
+  w211::FS_340h::set_ST2_LED_DL(fs, phase == 1);
+  w211::FS_340h::set_ST3_LEDL_DL(fs, phase == 2);
+  w211::FS_340h::set_ST3_LEDR_DL(fs, phase == 3);
+  w211::FS_340h::set_FZGN_VL(fs, 120 + (ms / 20) % 16);
+  w211::FS_340h::set_FZGN_VR(fs, 121 + (ms / 20) % 16);
+  w211::FS_340h::set_FZGN_HL(fs, 122 + (ms / 20) % 16);
+  w211::FS_340h::set_FZGN_HR(fs, 123 + (ms / 20) % 16);
+
+  if (ms % 20 == 0) receive(CAN_C, canQueue0, CANID_FS_340h, fs, sizeof(fs));
+  if (ms % 100 == 0) receive(CAN_C, canQueue0, CANID_EZS_240h, ezs, sizeof(ezs));
+  if (ms % 200 == 0) {
+    // phone display, next + plus held for 3 s every 10 s
+    uint8_t kombi[w211::KOMBI_A5::DLC] = {};
+    w211::KOMBI_A5::set_KI_STAT(kombi, (uint8_t) w211::KOMBI_A5::KI_STAT_e::TEL);
+    w211::KOMBI_A5::set_BUTTON_1_1(kombi, ms % 10000 < 3000);
+    w211::KOMBI_A5::set_BUTTON_3_1(kombi, ms % 10000 < 3000);
+    receive(CAN_B, canQueue1, CANID_KOMBI_A5, kombi, sizeof(kombi));
+  }
+  hostAdvance(10000);
+}
+
+
+static void mapping() {
+  // neutral, +30 mm, -30 mm at duty 115 (45 %)
+  CHECK(pwmValue(115, 0, 0, GAIN_ONE) == 115 * PWM_SCALE);
+  CHECK(pwmValue(115, 0, 30, GAIN_ONE) == (115 + 69) * PWM_SCALE);
+  CHECK(pwmValue(115, 0, -30, GAIN_ONE) == (115 - 69) * PWM_SCALE);
+  CHECK(pwmValue(115, -3, 0, GAIN_ONE) == 112 * PWM_SCALE);
+  // 1 mm = 2.3 counts at 8 bit, 36.8 at 12 bit, rounded
+  CHECK(pwmValue(115, 0, 1, GAIN_ONE) == 1840 + 37);
+  CHECK(pwmValue(115, 0, -1, GAIN_ONE) == 1840 - 37);
+  CHECK(pwmValue(115, 0, 10, GAIN_ONE / 2) == 1840 + 184);
+  // clamped to the LEDC range
+  CHECK(pwmValue(255, 127, 1000, GAIN_ONE) == (1 << PWM_RES) - 1);
+  CHECK(pwmValue(10, -128, -1000, GAIN_ONE) == 0);
+  // monotonic in the offset, beyond MAX_OFF (30 mm)
+  for (int16_t off = -50; off < 50; off++) {
+    CHECK(pwmValue(115, 0, off, GAIN_ONE) < pwmValue(115, 0, off + 1, GAIN_ONE));
+  }
+}
+
+#define OUTPUT_RATE 100 // Hz, as AIRmatic.ino
+
+// output task ticks until level reaches target, each output count on the way checked
+static uint32_t ramp(int32_t& level, uint32_t target, int32_t step) {
+  uint32_t ticks = 0;
+  uint32_t pwm = rampDuty(level);
+  bool up = rampLevel(target) > level;
+  while (level != rampLevel(target) && ticks < 100000) {
+    level = outputRamp(level, rampLevel(target), step);
+    uint32_t next = rampDuty(level);
+    // never backwards, never past the target, at most one step per tick
+    CHECKF(up ? next >= pwm && next <= target : next <= pwm && next >= target, "tick %u: %u -> %u, target %u", ticks, pwm, next, target);
+    if (step > 0) CHECKF((uint32_t) abs((int32_t) next - (int32_t) pwm) <= (uint32_t)(step >> RAMP_SHIFT) + 1, "tick %u: %u -> %u", ticks, pwm, next);
+    pwm = next;
+    ticks++;
+  }
+  return ticks;
+}
+
+static void ramps() {
+  // 20 mm/s at duty 115: 1 mm = 36.8 counts, 7.36 counts per 10 ms tick
+  int32_t step = rampStep(20, 115, OUTPUT_RATE);
+  CHECK(step == 1884);
+  CHECK(rampStep(0, 115, OUTPUT_RATE) == 0);
+
+  // +5 mm and back take 250 ms, +-1 tick for the rounding of both ends
+  uint32_t neutral = pwmValue(115, 0, 0, GAIN_ONE);
+  int32_t level = rampLevel(neutral);
+  uint32_t up = ramp(level, pwmValue(115, 0, 5, GAIN_ONE), step);
+  uint32_t down = ramp(level, neutral, step);
+  CHECKF(up >= 24 && up <= 26 && down >= 24 && down <= 26, "+5 mm in %u ticks, back in %u", up, down);
+  CHECK(rampDuty(level) == neutral);
+  printf("ramp: +5 mm at 20 mm/s in %u ticks up, %u down, %u Hz\n", up, down, OUTPUT_RATE);
+
+  // full travel, -30 -> +30 mm in 3 s, over the slew and duty range of config.html
+  for (uint8_t slew = 5; slew <= 100; slew += 19) {
+    for (uint8_t duty = 80; duty <= 160; duty += 40) {
+      int32_t s = rampStep(slew, duty, OUTPUT_RATE);
+      level = rampLevel(pwmValue(duty, 0, -30, GAIN_ONE));
+      uint32_t ticks = ramp(level, pwmValue(duty, 0, 30, GAIN_ONE), s);
+      uint32_t nominal = 60 * OUTPUT_RATE / slew;
+      CHECKF(ticks + 1 >= nominal && ticks <= nominal + 1 + nominal / 100, "%u mm/s, duty %u: %u ticks, %u nominal", slew, duty, ticks, nominal);
+    }
+  }
+
+  // target reversed half way: turns at once, no overshoot
+  level = rampLevel(neutral);
+  int32_t mid = rampLevel(pwmValue(115, 0, 10, GAIN_ONE));
+  while (level < mid) level = outputRamp(level, rampLevel(pwmValue(115, 0, 20, GAIN_ONE)), step);
+  uint32_t turn = rampDuty(level);
+  ramp(level, pwmValue(115, 0, -10, GAIN_ONE), step);
+  CHECK(turn < pwmValue(115, 0, 20, GAIN_ONE));
+
+  // slew 0: the old step
+  level = rampLevel(neutral);
+  CHECK(ramp(level, pwmValue(115, 0, 30, GAIN_ONE), 0) == 1);
+}
+
+static void modes() {
+  EZS_240h_t ezs = {};
+  FS_340h_t fs = {};
+  CHECK(detectMode(MODE_SPORT1, ezs, fs) == MODE_DEFAULT);
+  w211::EZS_240h::set_KL_15(ezs.data, true);
+  CHECK(detectMode(MODE_SPORT1, ezs, fs) == MODE_SPORT1); // unknown FS_ID keeps the mode
+  w211::FS_340h::set_FS_ID(fs.data, 2);
+  CHECK(detectMode(MODE_DEFAULT, ezs, fs) == MODE_COMFORT);
+  w211::FS_340h::set_FS_ID(fs.data, 1);
+  CHECK(detectMode(MODE_DEFAULT, ezs, fs) == MODE_COMFORT);
+  w211::FS_340h::set_ST3_LEDL_DL(fs.data, true);
+  CHECK(detectMode(MODE_DEFAULT, ezs, fs) == MODE_SPORT1);
+  w211::FS_340h::set_ST3_LEDR_DL(fs.data, true);
+  CHECK(detectMode(MODE_DEFAULT, ezs, fs) == MODE_SPORT2);
+  w211::FS_340h::set_ST2_LED_DL(fs.data, true);
+  CHECK(detectMode(MODE_DEFAULT, ezs, fs) == MODE_OFFROAD);
+}
+
+static void noAllocations() {
+  LittleFS.data("/config.json").clear();
+  configStore.begin("/config.json");
+  configStore.setOffset(MODE_SPORT1, AXLE_NV, -20);
+  configStore.setOffset(MODE_OFFROAD, AXLE_NH, 30);
+  configStore.flush(true);
+
+  // counter works
+  counting = true;
+  String probe("a string longer than the small string buffer");
+  counting = false;
+  CHECK(allocations.load() > 0);
+
+  // first pass: function statics and lazy initialisation
+  uint32_t tick = 0;
+  for (; tick < 100; tick++) {
+    traffic(tick);
+    loopOnce();
+  }
+
+  allocations = 0;
+  counting = true;
+  uint32_t modeChanges = 0;
+  Mode last = mode;
+  for (; tick < 10100; tick++) {
+    traffic(tick);
+    loopOnce();
+    if (mode != last) modeChanges++;
+    last = mode;
+  }
+  counting = false;
+
+  CHECKF(allocations.load() == 0, "%u heap allocations in 10000 loop() iterations", allocations.load());
+  CHECK(modeChanges >= 4 && keyEvents > 0);
+  CHECK((canFreshness.stale() & ((1UL << MSG_EZS_240h) | (1UL << MSG_FS_340h) | (1UL << MSG_KOMBI_A5))) == 0);
+  printf("control loop: 10000 iterations, %u mode changes, %u key events, %u allocations\n",
+    modeChanges, keyEvents, allocations.load());
+}
+
+
+int main() {
+  mapping();
+  ramps();
+  modes();
+  noAllocations();
+  return checkDone("test_control");
+}
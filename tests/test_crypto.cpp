@@ -0,0 +1,469 @@
+/*                                                                          *
+ * Wifi credential handshake, both sides                                    *
+ *                                                                          *
+ * crypto.cpp on the Mbed TLS stand-in against a client doing what          *
+ * settings.html does, with OpenSSL: background key generation, RSA and    *
+ * ECDH session key exchange, password check, credential update, session   *
+ * expiry. Then the real settings.html in node (settings_client.js)         *
+ * against the same firmware code, both modes.                              *
+ * Benchmarks the exchange with the private key parsed per handshake (as    *
+ * rsa_decrypt() did) and with the key kept by the CryptoSession.           *
+ *                                                                          */
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <ArduinoJson.h>
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/ecdh.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include "crypto.h"
+#include "check.h"
+
+// firmware globals, Wireless.ino and AIRmatic.ino
+uint8_t ssid[33];
+uint8_t password[33];
+String hash;
+String seed;
+String salt;
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes randomSeed(size_t len = 16) {
+  Bytes b(len);
+  for (uint8_t& v : b) {
+    do { RAND_bytes(&v, 1); } while (!v);
+  }
+  return b;
+}
+
+static Bytes text(const char* s) {
+  return Bytes(s, s + strlen(s));
+}
+
+static String toHex(const Bytes& b) {
+  String s;
+  char buf[3];
+  for (uint8_t v : b) {
+    snprintf(buf, sizeof(buf), "%02x", v);
+    s += buf;
+  }
+  return s;
+}
+
+static Bytes fromHex(const String& s) {
+  Bytes b(s.length() / 2);
+  for (size_t i = 0; i < b.size(); i++) b[i] = strtoul(s.substring(i * 2, i * 2 + 2).c_str(), nullptr, 16);
+  return b;
+}
+
+// AES-128-ECB, zero padded to the block size
+static Bytes aes(const Bytes& in, const Bytes& key, bool encrypt) {
+  Bytes data(in);
+  data.resize((data.size() + 15) & ~15);
+  Bytes out(data.size());
+  int len = 0;
+  EVP_CIPHER_CTX* c = EVP_CIPHER_CTX_new();
+  EVP_CipherInit_ex(c, EVP_aes_128_ecb(), NULL, key.data(), NULL, encrypt);
+  EVP_CIPHER_CTX_set_padding(c, 0);
+  EVP_CipherUpdate(c, out.data(), &len, data.data(), data.size());
+  EVP_CIPHER_CTX_free(c);
+  return out;
+}
+
+// junkHash() of settings.html
+static Bytes junkHash(const Bytes& key) {
+  size_t len = std::max<size_t>(key.size(), 16);
+  Bytes out(len);
+  for (size_t i = 0; i < len; i++) {
+    uint8_t byte = i < key.size() ? key[i] : 0;
+    byte = ~byte;
+    byte = ((byte & 0x0F) << 4) | ((byte & 0xF0) >> 4);
+    byte ^= 0xAA;
+    byte = ((byte + i) * (byte + i)) % 256;
+    out[i] = byte ? byte : i + 1;
+  }
+  return out;
+}
+
+static String strip(const Bytes& b) {
+  std::string s(b.begin(), b.end());
+  return String(s.substr(0, s.find('\0')));
+}
+
+// session key RSA-OAEP SHA-1 encrypted with /public.pem, base64
+static String encryptSeed(const Bytes& key) {
+  std::vector<uint8_t>& pem = LittleFS.data(pubKeyFile);
+  BIO* bio = BIO_new_mem_buf(pem.data(), pem.size());
+  EVP_PKEY* pub = PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL);
+  BIO_free(bio);
+  if (!pub) return String();
+  EVP_PKEY_CTX* c = EVP_PKEY_CTX_new(pub, NULL);
+  unsigned char enc[256];
+  size_t len = sizeof(enc);
+  EVP_PKEY_encrypt_init(c);
+  EVP_PKEY_CTX_set_rsa_padding(c, RSA_PKCS1_OAEP_PADDING);
+  EVP_PKEY_CTX_set_rsa_oaep_md(c, EVP_sha1());
+  int ok = EVP_PKEY_encrypt(c, enc, &len, key.data(), key.size());
+  EVP_PKEY_CTX_free(c);
+  EVP_PKEY_free(pub);
+  if (ok <= 0) return String();
+  unsigned char b64[360];
+  EVP_EncodeBlock(b64, enc, len);
+  return String((const char*) b64);
+}
+
+
+// settings.html state of one session
+struct Client {
+  Bytes key;       // one-time session key
+  Bytes random1;   // challenge
+  Bytes pseudoKey;
+
+  // generateSessionKey(), then POST /config?update=5
+  bool exchange(const String& encSeed) {
+    random1 = randomSeed();
+    salt = encSeed;
+    seed = toHex(aes(random1, key, true));
+    hash = "";
+    cryptUpdateWifi();
+    return hash.length() > 0;
+  }
+
+  bool rsa() {
+    key = randomSeed();
+    return exchange(encryptSeed(key));
+  }
+
+  // ECDH with the point from GET /ecdh.key, peer = own point instead of ours
+  bool ecdh(const Bytes* peer = nullptr) {
+    String fwHex;
+    if (!cryptoSession.ecdhPublicKey(fwHex)) return false;
+    Bytes fw = fromHex(fwHex);
+    EC_KEY* own = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    const EC_GROUP* g = EC_KEY_get0_group(own);
+    EC_POINT* fwPoint = EC_POINT_new(g);
+    uint8_t shared[32];
+    uint8_t pub[65];
+    bool ok = EC_KEY_generate_key(own) && EC_POINT_oct2point(g, fwPoint, fw.data(), fw.size(), NULL)
+      && ECDH_compute_key(shared, sizeof(shared), fwPoint, own, NULL) == sizeof(shared)
+      && EC_POINT_point2oct(g, EC_KEY_get0_public_key(own), POINT_CONVERSION_UNCOMPRESSED, pub, sizeof(pub), NULL) == sizeof(pub);
+    EC_POINT_free(fwPoint);
+    EC_KEY_free(own);
+    if (!ok) return false;
+    uint8_t digest[32];
+    SHA256(shared, sizeof(shared), digest);
+    key.assign(digest, digest + 16);
+    for (size_t i = 0; i < key.size(); i++) {
+      if (!key[i]) key[i] = i + 1;
+    }
+    return exchange("ec:" + toHex(peer ? *peer : Bytes(pub, pub + sizeof(pub))));
+  }
+
+  // readWifi(): response to the challenge, SSID with the session key
+  bool verify(String& ssidOld) {
+    pseudoKey = junkHash(key);
+    if (aes(fromHex(salt), pseudoKey, false) != junkHash(random1)) return false;
+    ssidOld = strip(aes(fromHex(hash), key, false));
+    return true;
+  }
+
+  // readPw()
+  bool checkPassword(const char* pw) {
+    return aes(junkHash(text(pw)), pseudoKey, true) == fromHex(seed);
+  }
+
+  // updateWifi(), then POST /config?update=6 and rebootWifi()
+  bool confirm(const char* newSsid, const char* newPw) {
+    hash = toHex(aes(text(newSsid), key, true));
+    seed = toHex(aes(text(newPw), key, true));
+    salt = toHex(aes(random1, pseudoKey, true));
+    if (!cryptGetWifi()) return false;
+    return aes(fromHex(salt), key, false) == junkHash(random1);
+  }
+};
+
+
+static void setCredentials(const char* s, const char* pw) {
+  memset(ssid, 0, sizeof(ssid));
+  memset(password, 0, sizeof(password));
+  strcpy((char*) ssid, s);
+  strcpy((char*) password, pw);
+}
+
+static void keygen() {
+  LittleFS.clear();
+  CHECK(keygenState() == KEYS_NONE);
+  startKeygen();
+  CHECK(keygenState() != KEYS_NONE);
+  for (int i = 0; i < 30000 && keygenState() == KEYS_GENERATING; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  CHECK(keygenState() == KEYS_READY);
+  CHECK(LittleFS.exists(privKeyFile) && LittleFS.exists(pubKeyFile));
+  CHECK(cryptoSession.ecdhAvailable());
+}
+
+static void rsaHandshake() {
+  setCredentials("AIRmatic", "password1");
+  Client client;
+  String ssidOld;
+  CHECK(client.rsa());
+  CHECK(client.verify(ssidOld) && ssidOld == "AIRmatic");
+  CHECK(client.checkPassword("password1"));
+  CHECK(!client.checkPassword("password2"));
+  CHECK(client.confirm("W211 E55", "a much longer passphrase"));
+  CHECK(!strcmp((char*) ssid, "W211 E55") && !strcmp((char*) password, "a much longer passphrase"));
+
+  // stored with the key derived from the MAC
+  uint8_t mac[16];
+  CHECK(getMac(mac) == ESP_OK);
+  Bytes hwKey(mac, mac + 16);
+  CHECK(strip(aes(fromHex(hash), hwKey, false)) == "W211 E55");
+  CHECK(strip(aes(fromHex(seed), hwKey, false)) == "a much longer passphrase");
+
+  // the session is gone after the update
+  CHECK(!cryptGetWifi());
+}
+
+static void rsaFailures() {
+  setCredentials("AIRmatic", "password1");
+
+  // garbage instead of the encrypted session key: nothing leaves the device
+  Client client;
+  client.key = randomSeed();
+  CHECK(!client.exchange("bm90IGFuIFJTQSBibG9jaw=="));
+  CHECK(hash.isEmpty() && seed.isEmpty() && salt.isEmpty());
+  CHECK(!cryptGetWifi());
+
+  // session expires after CRYPTO_SESSION_TIMEOUT
+  CHECK(client.rsa());
+  String ssidOld;
+  CHECK(client.verify(ssidOld));
+  hostAdvance((CRYPTO_SESSION_TIMEOUT + 1) * 1000LL);
+  CHECK(!client.confirm("evil", "evilevil"));
+  CHECK(!strcmp((char*) ssid, "AIRmatic"));
+
+  // wrong challenge response
+  CHECK(client.rsa());
+  CHECK(client.verify(ssidOld));
+  client.random1 = randomSeed();
+  CHECK(!client.confirm("evil", "evilevil"));
+  CHECK(!strcmp((char*) ssid, "AIRmatic"));
+}
+
+static void ecdhHandshake() {
+  setCredentials("AIRmatic", "password1");
+  String fwHex;
+  CHECK(cryptoSession.ecdhPublicKey(fwHex) && fwHex.length() == 130 && fwHex.startsWith("04"));
+
+  Client client;
+  String ssidOld;
+  CHECK(client.ecdh());
+  CHECK(client.verify(ssidOld) && ssidOld == "AIRmatic");
+  CHECK(client.checkPassword("password1"));
+  CHECK(client.confirm("AIRmatic 2", "password2"));
+  CHECK(!strcmp((char*) ssid, "AIRmatic 2") && !strcmp((char*) password, "password2"));
+
+  // points off the curve and short points are refused
+  Bytes bad = fromHex(fwHex);
+  bad[64] ^= 1;
+  CHECK(!client.ecdh(&bad));
+  CHECK(hash.isEmpty() && !cryptGetWifi());
+  bad.resize(33);
+  CHECK(!client.ecdh(&bad));
+  CHECK(hash.isEmpty());
+}
+
+// one exchange, us
+static double timed(Client& client, bool parseKey) {
+  client.key = randomSeed();
+  String encSeed = encryptSeed(client.key);
+  if (parseKey) cryptoSession.unloadKey();
+  auto t = std::chrono::steady_clock::now();
+  bool ok = client.exchange(encSeed);
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t).count();
+  CHECK(ok);
+  return us;
+}
+
+static double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+static void benchmark() {
+  setCredentials("AIRmatic", "password1");
+  Client client;
+  std::vector<double> cold, warm;
+  for (int i = 0; i < 25; i++) {
+    cold.push_back(timed(client, true));
+    warm.push_back(timed(client, false));
+  }
+  double c = median(cold), w = median(warm);
+  CHECKF(w < c, "parsed key %.0f us, kept key %.0f us", c, w);
+  printf("crypto: RSA exchange %.0f us with key parse, %.0f us with the kept key\n", c, w);
+
+  std::vector<double> ecdh;
+  for (int i = 0; i < 25; i++) {
+    auto t = std::chrono::steady_clock::now();
+    CHECK(client.ecdh());
+    ecdh.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t).count());
+  }
+  printf("crypto: ECDH exchange %.0f us, both sides\n", median(ecdh));
+}
+
+
+// settings.html in node, this process answers its requests like Wireless.ino
+struct Page {
+  FILE* requests = nullptr; // from the page
+  FILE* answers = nullptr;  // to the page
+  pid_t pid = 0;
+  bool ecdh = true;         // GET /ecdh.key answers 503 when false
+  int exchanges = 0;
+  uint32_t issued = 0;      // POST /config command ids
+  int status = 0;           // result of the last command
+  String result;
+  int polls = 0;            // GET /config/result answered 202
+
+  bool start(const char* oldpw, const char* newSsid, const char* newPw) {
+    int toPage[2], fromPage[2];
+    if (pipe(toPage) || pipe(fromPage)) return false;
+    pid = fork();
+    if (pid == 0) {
+      dup2(toPage[0], 0);
+      dup2(fromPage[1], 1);
+      close(toPage[1]);
+      close(fromPage[0]);
+      execlp("node", "node", "settings_client.js", oldpw, newSsid, newPw, (char*) NULL);
+      _exit(127);
+    }
+    close(toPage[0]);
+    close(fromPage[1]);
+    requests = fdopen(fromPage[0], "r");
+    answers = fdopen(toPage[1], "w");
+    return pid > 0;
+  }
+
+  void answer(int status, const String& body) {
+    std::string json = "\"";
+    for (const char* c = body.c_str(); *c; c++) {
+      if (*c == '\n') json += "\\n";
+      else if (*c == '"' || *c == '\\') json += std::string("\\") + *c;
+      else json += *c;
+    }
+    fprintf(answers, "%d %s\"\n", status, json.c_str());
+    fflush(answers);
+  }
+
+  // POST /config body into the wifi strings, as readJson()
+  void readWifi(const std::string& body) {
+    JsonDocument doc;
+    if (deserializeJson(doc, body.c_str()) || !doc.containsKey("wifi")) return;
+    JsonObjectConst w = doc["wifi"];
+    if (w.containsKey("hash")) hash = w["hash"].as<String>();
+    if (w.containsKey("seed")) seed = w["seed"].as<String>();
+    if (w.containsKey("salt")) salt = w["salt"].as<String>();
+  }
+
+  // POST /config: 202 with the id, the command runs on the first poll, as in the WiFi task
+  void queue() {
+    issued++;
+    polls = 0;
+    answer(202, "{\"id\":" + String(issued) + "}");
+  }
+
+  // serve until DONE, its JSON into done
+  bool run(JsonDocument& done) {
+    char* line = nullptr;
+    size_t size = 0;
+    bool ok = false;
+    while (getline(&line, &size, requests) > 0) {
+      std::string req(line);
+      req.erase(req.find_last_not_of("\r\n") + 1);
+      if (req.compare(0, 5, "DONE ") == 0) {
+        ok = !deserializeJson(done, req.c_str() + 5);
+        break;
+      }
+      size_t start = req.find(' ') + 1;
+      size_t sp = req.find(' ', start);
+      std::string url = req.substr(start, sp == std::string::npos ? std::string::npos : sp - start);
+      std::string body = sp == std::string::npos ? "" : req.substr(sp + 1);
+      String hex;
+      if (url == "/ecdh.key") {
+        if (ecdh && cryptoSession.ecdhPublicKey(hex)) answer(200, hex);
+        else answer(503, "generating ECDH key pair");
+      } else if (url == "/public.pem") {
+        std::vector<uint8_t>& pem = LittleFS.data(pubKeyFile);
+        answer(200, String(std::string(pem.begin(), pem.end())));
+      } else if (url == "/config.json") {
+        answer(200, "{\"wifi\":{\"hash\":\"" + hash + "\",\"seed\":\"" + seed + "\",\"salt\":\"" + salt + "\"}}");
+      } else if (url == "/config?update=5") {
+        queue();
+        readWifi(body);
+        cryptUpdateWifi();
+        exchanges++;
+        status = hash.length() ? 200 : 403;
+        result = hash.length() ? "OK" : "key exchange failed";
+      } else if (url == "/config?update=6") {
+        queue();
+        readWifi(body);
+        status = cryptGetWifi() ? 200 : 403;
+        result = status == 200 ? "OK" : "handshake failed";
+      } else if (url == "/config/result?id=" + std::string(String(issued).c_str())) {
+        // still running on the first poll
+        if (polls++ == 0) answer(202, "pending");
+        else answer(status, result);
+      } else {
+        answer(404, "Not found");
+      }
+    }
+    free(line);
+    fclose(requests);
+    fclose(answers);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+};
+
+static void settingsPage() {
+  if (system("node --version > /dev/null 2>&1") != 0) {
+    printf("crypto: node not found, settings.html not run\n");
+    return;
+  }
+  for (bool ecdh : { true, false }) {
+    setCredentials("AIRmatic", "password1");
+    hash = seed = salt = "";
+    Page page;
+    page.ecdh = ecdh;
+    CHECK(page.start("password1", "W211 settings", "new passphrase"));
+    JsonDocument done;
+    CHECK(page.run(done));
+    String out = done["out"].as<String>();
+    CHECKF(done["ssid"].as<String>() == "AIRmatic", "%s: ESSID '%s'", ecdh ? "ECDH" : "RSA", done["ssid"].as<String>().c_str());
+    CHECKF(out.indexOf("wifi credentials changed") >= 0, "%s: %s", ecdh ? "ECDH" : "RSA", out.c_str());
+    CHECK(!strcmp((char*) ssid, "W211 settings") && !strcmp((char*) password, "new passphrase"));
+    CHECK(page.exchanges == 1);
+    CHECK(page.issued == 2 && page.polls == 2);
+    printf("crypto: settings.html %s exchange %d ms in node\n", ecdh ? "ECDH" : "RSA", (int) done["exchangeMs"]);
+  }
+}
+
+
+int main() {
+  keygen();
+  rsaHandshake();
+  rsaFailures();
+  ecdhHandshake();
+  benchmark();
+  settingsPage();
+  return checkDone("test_crypto");
+}
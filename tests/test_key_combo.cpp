@@ -0,0 +1,255 @@
+/*                                                                          *
+ * Steering wheel key combos on a replayed KOMBI_A5 trace                   *
+ *                                                                          *
+ * A script of button gestures (taps with staggered buttons, bounces, long  *
+ * holds, presses outside phone mode) becomes the KOMBI_A5 frames the       *
+ * cluster sends, written with the generated setters: on every change and   *
+ * every 200 ms. The frames are replayed through the queue and keyEvents()  *
+ * / loop() of AIRmatic.ino with a jittered loop period, stalls, and frames *
+ * that arrive between drain and poll. The clock wraps during the run.      *
+ * Every event is compared with the script: none missed, none extra,        *
+ * timestamps, and the detection latency.                                   *
+ *                                                                          */
+#include <Arduino.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+#include "key_combo.h"
+#include "w211_signals.h"
+#include "check.h"
+
+// the timings of keyComboTable in AIRmatic.ino
+
+static const KeyCombo keyTable[] = {
+  {BTN_NEXT | BTN_PLUS,  KEY_PRESS | KEY_REPEAT, 40, 1400, 600, 0},
+  {BTN_NEXT | BTN_MINUS, KEY_PRESS | KEY_REPEAT, 40, 1400, 600, 0},
+  {BTN_PREV | BTN_PLUS,  KEY_PRESS | KEY_REPEAT, 40, 1400, 600, 0},
+  {BTN_PREV | BTN_MINUS, KEY_PRESS | KEY_REPEAT, 40, 1400, 600, 0},
+  {BTN_NEXT | BTN_SEND,  KEY_LONG,               40, 0,    0,   1400},
+  {BTN_PREV | BTN_SEND,  KEY_LONG,               40, 0,    0,   1400},
+  {BTN_NEXT | BTN_END,   KEY_PRESS,              40, 0,    0,   0},
+  {BTN_PREV | BTN_END,   KEY_PRESS,              40, 0,    0,   0},
+};
+#define COMBOS (sizeof(keyTable) / sizeof(keyTable[0]))
+
+#define KOMBI_DELAY  3000   // us button to frame
+#define KOMBI_PERIOD 200000 // us cyclic frame
+#define MARGIN       5000   // us, scripted holds keep away from the thresholds
+
+struct Event {
+  uint8_t combo;
+  uint8_t action;
+  uint32_t time;  // event timestamp
+  uint32_t seen;  // loop time of the handler call
+};
+
+#define PHONE ((uint8_t) w211::KOMBI_A5::KI_STAT_e::TEL)
+#define AUDIO ((uint8_t) w211::KOMBI_A5::KI_STAT_e::AUDIO)
+
+struct Frame {
+  uint32_t time;
+  uint8_t stat;   // KI_STAT
+  uint8_t bits;   // BTN_*
+};
+
+static std::vector<Event> events;
+static uint32_t loopTime = 0;
+
+static void keyAction(uint8_t combo, uint8_t action, uint32_t time) {
+  events.push_back({ combo, action, time, loopTime });
+}
+
+static KeyComboEngine keyCombos(keyTable, COMBOS, keyAction);
+
+// the KOMBI_A5 frame of the cluster
+static void kombiFrame(const Frame& f, uint8_t* d) {
+  using namespace w211::KOMBI_A5;
+  memset(d, 0x00, DLC);
+  set_KI_STAT(d, f.stat);
+  set_BUTTON_1_1(d, f.bits & BTN_NEXT);
+  set_BUTTON_1_2(d, f.bits & BTN_PREV);
+  set_BUTTON_3_1(d, f.bits & BTN_PLUS);
+  set_BUTTON_3_2(d, f.bits & BTN_MINUS);
+  set_BUTTON_4_1(d, f.bits & BTN_SEND);
+  set_BUTTON_4_2(d, f.bits & BTN_END);
+}
+
+// keyEvents() in AIRmatic.ino: buttons only count while the display is in phone mode
+static void keyEvents(const Frame& f) {
+  static uint8_t ic_stat = 0;
+  uint8_t d[w211::KOMBI_A5::DLC];
+  kombiFrame(f, d);
+  uint8_t stat = w211::KOMBI_A5::KI_STAT(d);
+  if (stat) ic_stat = stat;
+  bool phone = ic_stat == PHONE;
+  keyCombos.update(phone ? kombiButtons(d) : 0, f.time);
+}
+
+// one scripted gesture and what the engine must report for it
+struct Gesture {
+  uint8_t combo;
+  bool phone;
+  uint32_t first;   // first button down
+  uint32_t start;   // both down
+  uint32_t end;     // first button up
+  uint32_t last;    // both up
+  uint32_t expected[3]; // KEY_PRESS, KEY_REPEAT, KEY_LONG count
+};
+
+int main() {
+  std::mt19937 random(19);
+  const uint32_t debounce = 40000;
+  uint32_t t = 0xFFFFFFFFu - 20000000; // wraps after 20 s
+  uint64_t duration = 0;               // the run is longer than a half wrap
+
+  // the script
+  std::vector<Gesture> gestures;
+  std::vector<Frame> changes; // button changes as the cluster sends them
+  uint8_t stat = PHONE;
+  changes.push_back({ t, stat, 0 });
+  for (uint32_t i = 0; i < 4000; i++) {
+    uint32_t before = t;
+    Gesture g = {};
+    g.combo = random() % COMBOS;
+    g.phone = random() % 10 != 0;
+    if (g.phone != (stat == PHONE)) {
+      stat = g.phone ? PHONE : AUDIO;
+      t += 50000;
+      changes.push_back({ t + KOMBI_DELAY, stat, 0 });
+    }
+    t += 150000 + random() % 450000;
+    uint32_t kind = random() % 10;
+    uint32_t hold;
+    if (kind < 2) hold = 1000 + random() % 29000;        // bounce, shorter than the debounce
+    else if (kind < 8) hold = 50000 + random() % 350000; // tap
+    else hold = 1000000 + random() % 4500000;            // hold
+    // keep away from the repeat and long press thresholds, the loop may shift a release by its work time
+    if (hold >= 1400000 - MARGIN) {
+      uint32_t phase = (hold - 1400000 + MARGIN) % 600000;
+      if (phase < 2 * MARGIN) hold += 2 * MARGIN;
+    }
+    uint8_t a = keyTable[g.combo].mask & -keyTable[g.combo].mask; // lowest button
+    uint8_t b = keyTable[g.combo].mask & ~a;
+    if (random() % 2) std::swap(a, b);
+    g.first = t;
+    g.start = t + random() % 30000;
+    g.end = g.start + hold;
+    g.last = g.end + random() % 30000;
+    changes.push_back({ g.first + KOMBI_DELAY, 0, a });
+    changes.push_back({ g.start + KOMBI_DELAY, 0, (uint8_t)(a | b) });
+    changes.push_back({ g.end + KOMBI_DELAY, 0, b });
+    changes.push_back({ g.last + KOMBI_DELAY, 0, 0 });
+    duration += g.last - before;
+    t = g.last;
+
+    const KeyCombo& c = keyTable[g.combo];
+    if (g.phone && hold >= debounce) {
+      if (c.actions & KEY_PRESS) g.expected[0] = 1;
+      if ((c.actions & KEY_REPEAT) && hold >= (uint32_t) c.repeatDelay * 1000) {
+        g.expected[1] = 1 + (hold - c.repeatDelay * 1000) / (c.repeatInterval * 1000);
+      }
+      if ((c.actions & KEY_LONG) && hold >= (uint32_t) c.longPress * 1000) g.expected[2] = 1;
+    }
+    gestures.push_back(g);
+  }
+  duration += 1000000;
+
+  // the trace: every change, and the current state every 200 ms after the last frame
+  std::vector<Frame> trace;
+  uint8_t bits = 0;
+  stat = PHONE;
+  uint32_t next = changes[0].time;
+  for (size_t i = 0; i < changes.size(); i++) {
+    while ((int32_t)(changes[i].time - next) > 0) {
+      trace.push_back({ next, stat, bits });
+      next += KOMBI_PERIOD;
+    }
+    if (changes[i].stat) stat = changes[i].stat;
+    else bits = changes[i].bits;
+    trace.push_back({ changes[i].time, stat, bits });
+    next = changes[i].time + KOMBI_PERIOD;
+  }
+
+  // replay: CAN task queue, loop() every 10 ms plus work, sometimes a 100 ms stall
+  std::deque<Frame> queue;
+  size_t sent = 0;
+  uint32_t now = changes[0].time - 10000;
+  uint32_t lastPoll = now, maxGap = 0, maxWork = 0;
+  uint32_t loops = 0;
+  for (uint64_t elapsed = 0; elapsed < duration;) {
+    uint32_t work = random() % 3000;
+    uint32_t poll = now + work;
+    // received up to the poll, the ones after the drain stay queued until the next loop
+    while (sent < trace.size() && (int32_t)(trace[sent].time - poll) <= 0) {
+      queue.push_back(trace[sent++]);
+    }
+    loopTime = poll;
+    while (!queue.empty() && (int32_t)(queue.front().time - now) <= 0) {
+      keyEvents(queue.front());
+      queue.pop_front();
+    }
+    keyCombos.poll(poll);
+    maxGap = std::max(maxGap, poll - lastPoll);
+    maxWork = std::max(maxWork, work);
+    lastPoll = poll;
+    loops++;
+    uint32_t step = work + 10000 + random() % 5000;
+    if (random() % 100 == 0) step += 100000;
+    now += step;
+    elapsed += step;
+  }
+
+  // every event belongs to the gesture around it
+  uint32_t counted[3] = {}, expected[3] = {};
+  uint32_t missed = 0, extra = 0, misplaced = 0;
+  std::vector<uint32_t> latency;
+  size_t e = 0;
+  for (const Gesture& g : gestures) {
+    uint32_t got[3] = {};
+    uint32_t frameStart = g.start + KOMBI_DELAY;
+    const KeyCombo& c = keyTable[g.combo];
+    // events up to the next gesture's first button
+    while (e < events.size() && (int32_t)(events[e].time - (g.last + KOMBI_DELAY + debounce + 15000)) <= 0) {
+      const Event& ev = events[e++];
+      uint8_t k = ev.action == KEY_PRESS ? 0 : ev.action == KEY_REPEAT ? 1 : 2;
+      if (ev.combo != g.combo) {
+        misplaced++;
+        continue;
+      }
+      uint32_t due = frameStart + (k == 0 ? debounce : k == 1 ? c.repeatDelay * 1000 + got[1] * c.repeatInterval * 1000 : c.longPress * 1000);
+      // a press frame queued behind a poll counts from that poll, later by at most the loop work
+      CHECKF(ev.time - due <= maxWork, "combo %u action %u at %d us from due", ev.combo, ev.action, (int32_t)(ev.time - due));
+      CHECKF((int32_t)(ev.seen - ev.time) >= 0, "event %u reported before its time", ev.action);
+      if (k == 0) latency.push_back(ev.seen - g.start);
+      got[k]++;
+    }
+    for (uint8_t k = 0; k < 3; k++) {
+      if (got[k] < g.expected[k]) missed += g.expected[k] - got[k];
+      if (got[k] > g.expected[k]) extra += got[k] - g.expected[k];
+      counted[k] += got[k];
+      expected[k] += g.expected[k];
+    }
+  }
+  extra += events.size() - e;
+
+  CHECKF(missed == 0, "%u events missed", missed);
+  CHECKF(extra == 0, "%u events extra", extra);
+  CHECKF(misplaced == 0, "%u events of another combo", misplaced);
+  CHECK(expected[0] > 2000 && expected[1] > 500 && expected[2] > 50);
+  // the first poll after the debounce reports it
+  std::sort(latency.begin(), latency.end());
+  uint32_t maxLatency = latency.empty() ? 0 : latency.back();
+  CHECKF(maxLatency <= KOMBI_DELAY + debounce + maxGap, "latency %u us, poll gap %u us", maxLatency, maxGap);
+  CHECK(!latency.empty() && latency.front() >= KOMBI_DELAY + debounce);
+
+  printf("key combos: %zu gestures, %zu frames, %u loops across the timer wrap\n", gestures.size(), trace.size(), loops);
+  printf("key combos: %u presses, %u repeats, %u long presses, %u missed, %u extra\n",
+    counted[0], counted[1], counted[2], missed, extra);
+  if (!latency.empty()) {
+    printf("key combos: detection latency median %u ms, p99 %u ms, max %u ms (debounce %u ms, poll gap max %u ms)\n",
+      latency[latency.size() / 2] / 1000, latency[latency.size() * 99 / 100] / 1000, maxLatency / 1000,
+      debounce / 1000, maxGap / 1000);
+  }
+  return checkDone("test_key_combo");
+}
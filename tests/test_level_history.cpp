@@ -0,0 +1,242 @@
+/*                                                                          *
+ * Level history rings, buckets, LTTB and statistics                        *
+ *                                                                          *
+ * Feeds 12 min of FS_340h levels at 50 Hz with jitter, gaps of a few       *
+ * seconds and of more than a minute, and a mode change every 45 s into a   *
+ * LevelHistory and keeps every frame. Each 1 s and 1 min bucket has to     *
+ * hold exactly the frames of its interval (start, min, max, rounded mean), *
+ * the rings wrap at their capacity, and the per mode and since-switch      *
+ * statistics match the frames. query() has to keep the first and last     *
+ * point of the window, pick one point per LTTB bucket and not lose a       *
+ * single frame spike.                                                      *
+ *                                                                          */
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <vector>
+#include "level_history.h"
+#include "check.h"
+
+struct Frame {
+  uint32_t time;
+  uint8_t level[LEVEL_WHEELS];
+  uint8_t mode;
+};
+
+static LevelHistory history;
+static std::vector<Frame> frames;
+static LevelPoint points[LEVEL_MINUTES + LEVEL_SECONDS + LEVEL_RAW_SAMPLES];
+
+static void add(uint32_t time, const uint8_t level[LEVEL_WHEELS], uint8_t mode) {
+  Frame f;
+  f.time = time;
+  memcpy(f.level, level, LEVEL_WHEELS);
+  f.mode = mode;
+  frames.push_back(f);
+  history.add(time, level, mode);
+}
+
+// the bucket [time, time + width) computed from the frames
+static bool expected(uint32_t time, uint32_t width, uint8_t wheel, LevelPoint& p) {
+  uint32_t count = 0, sum = 0;
+  p.time = time;
+  p.min = 0xFF;
+  p.max = 0;
+  for (const Frame& f : frames) {
+    if (f.time < time || f.time >= time + width) continue;
+    uint8_t l = f.level[wheel];
+    if (l < p.min) p.min = l;
+    if (l > p.max) p.max = l;
+    sum += l;
+    count++;
+  }
+  if (!count) return false;
+  p.mean = ((uint64_t) sum * 256 + count / 2) / count;
+  return true;
+}
+
+static void buckets(uint8_t tier, uint32_t width, size_t capacity) {
+  // all closed buckets, oldest first
+  size_t used = history.size(tier);
+  CHECKF(used <= capacity, "tier %u: %zu buckets", tier, used);
+  for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+    size_t n = history.query(tier, w, 0, points, used);
+    CHECK(n == used);
+    for (size_t i = 0; i < n; i++) {
+      const LevelPoint& p = points[i];
+      LevelPoint want;
+      CHECKF(p.time % width == 0, "tier %u: bucket at %u ms", tier, p.time);
+      CHECKF(i == 0 || p.time > points[i - 1].time, "tier %u: %u ms after %u ms", tier, p.time, points[i - 1].time);
+      // no empty buckets for the gaps
+      bool found = expected(p.time, width, w, want);
+      CHECKF(found, "tier %u: bucket at %u ms without frames", tier, p.time);
+      if (!found) continue;
+      CHECKF(p.min == want.min && p.max == want.max && p.mean == want.mean,
+        "tier %u wheel %u at %u ms: min %u max %u mean %u, frames %u %u %u", tier, w, p.time,
+        p.min, p.max, p.mean, want.min, want.max, want.mean);
+    }
+  }
+}
+
+// 1 s and 1 min buckets: boundaries, merging, ring wrap
+static void tiers() {
+  buckets(LEVEL_TIER_SECOND, 1000, LEVEL_SECONDS);
+  buckets(LEVEL_TIER_MINUTE, 60000, LEVEL_MINUTES);
+  CHECK(history.size(LEVEL_TIER_RAW) == LEVEL_RAW_SAMPLES);
+  CHECK(history.size(LEVEL_TIER_SECOND) == LEVEL_SECONDS);
+
+  // every closed second with frames, newest LEVEL_SECONDS of them
+  std::vector<uint32_t> seconds;
+  for (const Frame& f : frames) {
+    uint32_t t = f.time - f.time % 1000;
+    if (seconds.empty() || seconds.back() != t) seconds.push_back(t);
+  }
+  seconds.pop_back(); // still open
+  size_t n = history.query(LEVEL_TIER_SECOND, 0, 0, points, LEVEL_SECONDS);
+  CHECKF(n == LEVEL_SECONDS && points[0].time == seconds[seconds.size() - LEVEL_SECONDS],
+    "oldest second %u ms, want %u ms", points[0].time, seconds[seconds.size() - LEVEL_SECONDS]);
+
+  std::vector<uint32_t> minutes;
+  for (const Frame& f : frames) {
+    uint32_t t = f.time - f.time % 60000;
+    if (minutes.empty() || minutes.back() != t) minutes.push_back(t);
+  }
+  minutes.pop_back();
+  CHECKF(history.size(LEVEL_TIER_MINUTE) == minutes.size(), "%zu minutes, %zu with frames",
+    history.size(LEVEL_TIER_MINUTE), minutes.size());
+
+  // the finest ring covering a window
+  uint32_t now = frames.back().time;
+  CHECK(history.tierFor(now, 5000) == LEVEL_TIER_RAW);
+  CHECK(history.tierFor(now, 60000) == LEVEL_TIER_SECOND);
+  CHECK(history.tierFor(now, 400000) == LEVEL_TIER_MINUTE);
+}
+
+// LTTB on the raw ring: first and last kept, one point per bucket, the spike survives
+static void lttb(uint32_t spikeTime) {
+  const size_t window = LEVEL_RAW_SAMPLES;
+  const Frame* base = &frames[frames.size() - window];
+  const size_t m = 150;
+  size_t n = history.query(LEVEL_TIER_RAW, 0, 0, points, m);
+  CHECK(n == m);
+  CHECK(points[0].time == base[0].time && points[0].mean == base[0].level[0] << 8);
+  CHECK(points[n - 1].time == frames.back().time && points[n - 1].mean == frames.back().level[0] << 8);
+  bool spike = false;
+  size_t last = 0;
+  for (size_t i = 1; i + 1 < n; i++) {
+    // index of the point in the window, a real frame
+    size_t j = 0;
+    while (j < window && base[j].time != points[i].time) j++;
+    CHECKF(j < window && points[i].mean == base[j].level[0] << 8, "point %zu at %u ms is no frame", i, points[i].time);
+    size_t lo = 1 + (i - 1) * (window - 2) / (m - 2);
+    size_t hi = 1 + i * (window - 2) / (m - 2);
+    CHECKF(j >= lo && j < hi && j > last, "point %zu: frame %zu outside its bucket [%zu, %zu)", i, j, lo, hi);
+    last = j;
+    if (points[i].time == spikeTime) spike = true;
+  }
+  CHECKF(spike, "spike at %u ms dropped", spikeTime);
+
+  // a window starting inside the ring, fewer frames than points, and the tail for maxPoints < 3
+  uint32_t from = base[window - 100].time;
+  n = history.query(LEVEL_TIER_RAW, 1, from, points, m);
+  CHECK(n == 100 && points[0].time == from && points[99].time == frames.back().time);
+  n = history.query(LEVEL_TIER_RAW, 1, 0, points, 2);
+  CHECK(n == 2 && points[0].time == base[window - 2].time && points[1].time == frames.back().time);
+
+  // the 1 s ring reduced the same way keeps its first and last bucket
+  size_t used = history.size(LEVEL_TIER_SECOND);
+  history.query(LEVEL_TIER_SECOND, 2, 0, points + m, used);
+  LevelPoint first = points[m], lastBucket = points[m + used - 1];
+  n = history.query(LEVEL_TIER_SECOND, 2, 0, points, m);
+  CHECK(n == m && points[0].time == first.time && points[0].mean == first.mean);
+  CHECK(points[n - 1].time == lastBucket.time && points[n - 1].mean == lastBucket.mean);
+}
+
+// per mode since boot and since the last mode change
+static void stats() {
+  for (uint8_t mode = 0; mode < LEVEL_MODES; mode++) {
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+      uint32_t count = 0;
+      uint8_t min = 0xFF, max = 0;
+      double sum = 0, sumSq = 0;
+      for (const Frame& f : frames) {
+        if (f.mode != mode) continue;
+        uint8_t l = f.level[w];
+        if (l < min) min = l;
+        if (l > max) max = l;
+        sum += l;
+        sumSq += (double) l * l;
+        count++;
+      }
+      const LevelStats& s = history.stats(mode, w);
+      CHECKF(s.count == count, "mode %u wheel %u: %u frames, %u", mode, w, s.count, count);
+      if (!count) continue;
+      double mean = sum / count;
+      double sd = sqrt(sumSq / count - mean * mean);
+      CHECK(s.min == min && s.max == max);
+      CHECKF(fabs(s.mean() - mean) < 0.01 && fabs(s.stddev() - sd) < 0.01, "mode %u wheel %u: mean %.3f sd %.3f, frames %.3f %.3f",
+        mode, w, s.mean(), s.stddev(), mean, sd);
+    }
+  }
+
+  // since the last mode change
+  size_t start = frames.size() - 1;
+  while (start > 0 && frames[start - 1].mode == frames.back().mode) start--;
+  CHECK(history.currentMode() == frames.back().mode);
+  CHECK(history.switchedAt() == frames[start].time);
+  for (uint8_t w = 0; w < LEVEL_WHEELS; w++) {
+    const LevelStats& s = history.sinceSwitch(w);
+    uint32_t sum = 0;
+    for (size_t i = start; i < frames.size(); i++) sum += frames[i].level[w];
+    CHECK(s.count == frames.size() - start && s.sum == sum);
+  }
+
+  // mode changes in the raw ring
+  uint32_t time[8];
+  uint8_t mode[8];
+  size_t n = history.modeChanges(LEVEL_TIER_RAW, 0, time, mode, 8);
+  const Frame* base = &frames[frames.size() - LEVEL_RAW_SAMPLES];
+  size_t k = 0;
+  for (size_t i = 0; i < LEVEL_RAW_SAMPLES; i++) {
+    if (i && base[i].mode == base[i - 1].mode) continue;
+    CHECK(k < n && time[k] == base[i].time && mode[k] == base[i].mode);
+    k++;
+  }
+  CHECK(n == k && n >= 2);
+
+  // a mode out of range is not recorded
+  LevelStats before = history.stats(0, 0);
+  uint8_t level[LEVEL_WHEELS] = { 1, 2, 3, 4 };
+  history.add(frames.back().time + 20, level, LEVEL_MODES);
+  CHECK(history.stats(0, 0).count == before.count && history.size(LEVEL_TIER_RAW) == LEVEL_RAW_SAMPLES);
+  n = history.query(LEVEL_TIER_RAW, 0, 0, points, LEVEL_RAW_SAMPLES);
+  CHECK(points[n - 1].time == frames.back().time);
+}
+
+int main() {
+  std::mt19937 random(340);
+  uint32_t t = 1500; // starts inside a second
+  uint8_t level[LEVEL_WHEELS];
+  uint32_t spikeTime = 0;
+  for (uint32_t i = 0; t < 722000; i++) {
+    uint8_t mode = (t / 45000) % LEVEL_MODES;
+    for (uint8_t w = 0; w < LEVEL_WHEELS; w++) level[w] = 100 + w * 10 + random() % 20;
+    // one frame spike in the raw window, which also holds the mode change at 720 s
+    if (t >= 717000 && !spikeTime) {
+      level[0] = 250;
+      spikeTime = t;
+    }
+    add(t, level, mode);
+    t += 18 + random() % 5;
+    // a dropout of a few seconds, and one over a whole minute
+    if (i == 3000) t += 3500;
+    if (i == 9000) t += 130000;
+  }
+
+  tiers();
+  lttb(spikeTime);
+  stats();
+  printf("level history: %zu frames over %u s, %zu second and %zu minute buckets checked\n", frames.size(),
+    frames.back().time / 1000, history.size(LEVEL_TIER_SECOND), history.size(LEVEL_TIER_MINUTE));
+  return checkDone("test_level_history");
+}
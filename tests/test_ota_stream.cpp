@@ -0,0 +1,232 @@
+/*                                                                          *
+ * Streaming OTA decompressor into a file-backed partition                  *
+ *                                                                          *
+ * A firmware-like image (sources, machine code like words, random tables,  *
+ * erased 0xFF runs) compressed by gzip -1, -6 (with file name) and -9, and *
+ * by the heatshrink encoder of tools/ota_upload.py, goes through OtaStream *
+ * in the chunk sizes of the upload, random splits and writes of 1 to 7     *
+ * bytes into a partition file the size of the image, as Update.write().    *
+ * Truncated and corrupted streams never complete with a wrong image, a     *
+ * partition that is too small is a sink error.                             *
+ *                                                                          */
+#include <Arduino.h>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include "ota_stream.h"
+#include "check.h"
+
+#define IMAGE     "build/ota_image.bin"
+#define PARTITION "build/ota_partition.bin"
+#define UPLOAD_CHUNK 8192 // ota_upload.py --chunk default
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes readFile(const std::string& path) {
+  Bytes data;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return data;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(f);
+  return data;
+}
+
+static bool writeFile(const std::string& path, const Bytes& data) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+// app partition stand-in: erased to 0xFF, written front to back, nothing past its end
+static struct {
+  FILE* file = nullptr;
+  size_t size = 0;
+  size_t pos = 0;
+  uint32_t writes = 0;
+  size_t largest = 0;
+} partition;
+
+static void partitionBegin(size_t size) {
+  if (partition.file) fclose(partition.file);
+  partition.file = fopen(PARTITION, "w+b");
+  Bytes erased(size, 0xFF);
+  fwrite(erased.data(), 1, size, partition.file);
+  partition.size = size;
+  partition.pos = 0;
+  partition.writes = 0;
+  partition.largest = 0;
+}
+
+static size_t partitionWrite(uint8_t* data, size_t len) {
+  size_t n = partition.pos + len > partition.size ? partition.size - partition.pos : len;
+  fseek(partition.file, partition.pos, SEEK_SET);
+  n = fwrite(data, 1, n, partition.file);
+  partition.pos += n;
+  partition.writes++;
+  if (len > partition.largest) partition.largest = len;
+  return n;
+}
+
+static Bytes partitionRead() {
+  Bytes data(partition.pos);
+  fflush(partition.file);
+  fseek(partition.file, 0, SEEK_SET);
+  if (fread(data.data(), 1, data.size(), partition.file) != data.size()) data.clear();
+  return data;
+}
+
+struct Stream {
+  std::string name;
+  OtaCodec codec;
+  uint8_t window, lookahead;
+  Bytes data;
+};
+
+// one stream split by next(), the result of finish() or of the first failing write
+template <typename Split>
+static OtaResult run(const Stream& s, size_t partitionSize, Split next) {
+  partitionBegin(partitionSize);
+  OtaStream ota;
+  OtaResult result = ota.begin(s.codec, partitionWrite, s.window, s.lookahead);
+  if (result != OTA_OK) return result;
+  for (size_t pos = 0; pos < s.data.size();) {
+    size_t n = std::min(next(), s.data.size() - pos);
+    result = ota.write(s.data.data() + pos, n);
+    pos += n;
+    if (result != OTA_OK && result != OTA_DONE) return result;
+  }
+  result = ota.finish();
+  CHECK(result != OTA_DONE || ota.output() == partition.pos);
+  return result;
+}
+
+// sources, code like words from a small vocabulary, random tables, erased blocks
+static Bytes makeImage() {
+  Bytes image;
+  std::mt19937 random(23);
+  for (const char* file : { "../ota_stream.cpp", "../can_driver.cpp", "../config_store.cpp", "../Ota.ino", "../Wireless.ino" }) {
+    Bytes text = readFile(file);
+    CHECKF(!text.empty(), "%s", file);
+    image.insert(image.end(), text.begin(), text.end());
+  }
+  uint32_t words[512];
+  for (uint32_t& w : words) w = random();
+  for (uint32_t i = 0; i < 40000; i++) {
+    uint32_t w = words[random() % (i % 7 ? 64 : 512)];
+    image.insert(image.end(), (uint8_t*) &w, (uint8_t*) &w + 4);
+  }
+  for (uint32_t i = 0; i < 40000; i++) image.push_back(random());
+  image.insert(image.end(), 70000, 0xFF);
+  for (uint32_t i = 0; i < 8000; i++) image.push_back(random() % 4 ? 0 : random());
+  return image;
+}
+
+static Bytes compress(const char* command) {
+  CHECKF(system(command) == 0, "%s", command);
+  return readFile(IMAGE ".z");
+}
+
+static void roundTrip(const Stream& s, const Bytes& image) {
+  std::mt19937 random(s.data.size());
+  struct Split {
+    const char* name;
+    std::function<size_t()> next;
+  };
+  const Split splits[] = {
+    { "8 KB chunks", [] { return (size_t) UPLOAD_CHUNK; } },
+    { "random", [&] { return (size_t)(1 + random() % UPLOAD_CHUNK); } },
+    { "short", [&] { return (size_t)(1 + random() % 7); } },
+  };
+  double seconds = 0;
+  for (const Split& split : splits) {
+    auto start = std::chrono::steady_clock::now();
+    OtaResult result = run(s, image.size(), split.next);
+    if (&split == splits) seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECKF(result == OTA_DONE, "%s, %s: result %d", s.name.c_str(), split.name, result);
+    CHECKF(partitionRead() == image, "%s, %s: partition differs from the image", s.name.c_str(), split.name);
+    // heatshrink hands over up to its window per flush, gzip up to 32 KB
+    size_t window = s.codec == OTA_GZIP ? 1 << OTA_GZIP_WINDOW : (size_t) 1 << s.window;
+    CHECK(s.codec == OTA_RAW || partition.largest <= window);
+  }
+  printf("ota stream: %-15s %7zu bytes (%3.0f%%), %4u sink writes, %.0f MB/s on the host\n", s.name.c_str(), s.data.size(),
+    100.0 * s.data.size() / image.size(), partition.writes, image.size() / 1e6 / (seconds > 0 ? seconds : 1e-9));
+}
+
+// cut anywhere: never OTA_DONE. One byte changed: gzip completes only with the right image, heatshrink
+// has no check of its own (Update.end() compares the MD5) and must not write out of bounds
+static void damage(const Stream& s, const Bytes& image) {
+  std::mt19937 random(s.data.size() + 1);
+  uint32_t cuts = 0, flips = 0, detected = 0;
+  auto chunks = [] { return (size_t) 1000; };
+  for (uint32_t i = 0; i < 40; i++) {
+    Stream cut = s;
+    cut.data.resize(i < 20 ? i : random() % s.data.size());
+    OtaResult result = run(cut, image.size(), chunks);
+    // heatshrink: a cut on a step boundary is a shorter image, the MD5 rejects it
+    if (s.codec == OTA_GZIP) CHECKF(result == OTA_BAD_DATA, "%s cut at %zu: result %d", s.name.c_str(), cut.data.size(), result);
+    else CHECK(result != OTA_DONE || partition.pos < image.size());
+    cuts++;
+  }
+  for (uint32_t i = 0; i < 60; i++) {
+    Stream bad = s;
+    size_t at = i < 10 ? i : random() % s.data.size();
+    bad.data[at] ^= 1 << (random() % 8);
+    OtaResult result = run(bad, image.size(), chunks);
+    if (result != OTA_DONE) detected++;
+    if (s.codec == OTA_GZIP && result == OTA_DONE) {
+      // header fields without a check: mtime, extra flags, OS
+      CHECKF(partitionRead() == image, "%s, bit flipped at %zu: wrong image completed", s.name.c_str(), at);
+    }
+    flips++;
+  }
+  printf("ota stream: %-15s %u cuts, %u flipped bits, %u rejected by the stream\n", s.name.c_str(), cuts, flips, detected);
+}
+
+int main() {
+  Bytes image = makeImage();
+  CHECK(writeFile(IMAGE, image));
+
+  std::vector<Stream> streams;
+  streams.push_back({ "raw", OTA_RAW, 0, 0, image });
+  streams.push_back({ "gzip -1", OTA_GZIP, 0, 0, compress("gzip -1 -n -c " IMAGE " > " IMAGE ".z") });
+  streams.push_back({ "gzip -6 name", OTA_GZIP, 0, 0, compress("gzip -6 -c " IMAGE " > " IMAGE ".z") });
+  streams.push_back({ "gzip -9", OTA_GZIP, 0, 0, compress("gzip -9 -n -c " IMAGE " > " IMAGE ".z") });
+  for (uint8_t w : { 11, 8 }) {
+    // the encoder of the upload tool, default 11/4
+    char command[256];
+    snprintf(command, sizeof(command), "python3 -c 'import sys; sys.path.insert(0, \"../tools\"); import ota_upload; "
+      "sys.stdout.buffer.write(ota_upload.heatshrink(open(\"%s\", \"rb\").read(), %u, 4))' > %s.z", IMAGE, w, IMAGE);
+    streams.push_back({ "heatshrink " + std::to_string(w) + "/4", OTA_HEATSHRINK, w, 4, compress(command) });
+  }
+
+  for (const Stream& s : streams) {
+    CHECKF(!s.data.empty(), "%s: no stream", s.name.c_str());
+    if (s.data.empty()) continue;
+    roundTrip(s, image);
+    if (s.codec != OTA_RAW) damage(s, image);
+  }
+
+  // partition smaller than the image: Update.write() takes less, the stream stops
+  for (const Stream& s : streams) {
+    if (s.data.empty()) continue;
+    OtaResult result = run(s, image.size() - 1, [] { return (size_t) UPLOAD_CHUNK; });
+    CHECKF(result == OTA_SINK_ERROR, "%s into a short partition: result %d", s.name.c_str(), result);
+  }
+
+  // heatshrink parameters out of range
+  OtaStream ota;
+  CHECK(ota.begin(OTA_HEATSHRINK, partitionWrite, 3, 2) == OTA_BAD_DATA);
+  CHECK(ota.begin(OTA_HEATSHRINK, partitionWrite, 11, 11) == OTA_BAD_DATA);
+  CHECK(ota.begin(OTA_HEATSHRINK, partitionWrite, 16, 4) == OTA_BAD_DATA);
+  printf("ota stream: %zu byte image, decompressor state %zu bytes plus its window\n", image.size(), sizeof(OtaStream));
+  if (partition.file) fclose(partition.file);
+  remove(IMAGE);
+  remove(IMAGE ".z");
+  remove(PARTITION);
+  return checkDone("test_ota_stream");
+}
@@ -0,0 +1,310 @@
+/*                                                                          *
+ * Light sleep and wake of Power.ino on a sleep stand-in                    *
+ *                                                                          *
+ * Power.ino, Output.ino and CAN.ino as the firmware has them, the ESP-IDF  *
+ * calls around them are stand-ins: esp_light_sleep_start() lets the buses  *
+ * run on into the MCP2515 models until an INT line goes low, plus the      *
+ * wake-up time of the ESP32. After powerIdle() returns both CAN tasks      *
+ * drain with SPI bytes taking their 10 MHz time while frames keep coming.  *
+ *                                                                          *
+ * Checks that the DAC outputs are parked for the sleep (ON low, duty 0:    *
+ * LEDC stops with the APB clock) and restored after it, and measures the   *
+ * bus frame to first received frame latency and the frames lost at wake,   *
+ * also over a sweep of wake-up times.                                      *
+ *                                                                          */
+#include <Arduino.h>
+#include <SPI.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "canbus.h"
+#include "can_driver.h"
+#include "can_registry.h"
+#include "config_store.h"
+#include "control.h"
+#include "metrics.h"
+#include "mcp2515_mock.h"
+#include "check.h"
+
+// pins and rates of AIRmatic.ino
+typedef uint8_t gpio_num_t;
+#define CS0  5
+#define INT0 34
+#define CS1  15
+#define INT1 35
+#define ON   4
+#define PWM1 12
+#define PWM2 13
+#define PWM3 14
+#define OUTPUT_RATE 100
+
+// ESP-IDF stand-ins
+enum { GPIO_INTR_NEGEDGE = 2, GPIO_INTR_LOW_LEVEL = 4 };
+enum { ESP_PD_DOMAIN_RTC8M = 3, ESP_PD_OPTION_ON = 1, ESP_SLEEP_WAKEUP_GPIO = 7 };
+enum { ESP_TIMER_TASK = 0 };
+typedef void* esp_timer_handle_t;
+struct esp_timer_create_args_t {
+  void (*callback)(void*);
+  void* arg;
+  int dispatch_method;
+  const char* name;
+  bool skip_unhandled_events;
+};
+
+static struct {
+  bool timerRunning = true;
+  bool pinWake[40] = {};
+  bool pinIrq[40] = {};
+  bool gpioWake = false;
+  bool rtc8m = false;
+  uint32_t cpuMhz = 240;
+  uint32_t duty[40] = {};
+  uint8_t level[40] = {};
+  uint32_t notified = 0;
+} chip;
+
+static esp_err_t esp_timer_create(const esp_timer_create_args_t*, esp_timer_handle_t* timer) { *timer = &chip; return ESP_OK; }
+static esp_err_t esp_timer_start_periodic(esp_timer_handle_t, uint64_t) { chip.timerRunning = true; return ESP_OK; }
+static esp_err_t esp_timer_stop(esp_timer_handle_t) { chip.timerRunning = false; return ESP_OK; }
+static void ledcWrite(uint8_t pin, uint32_t duty) { chip.duty[pin] = duty; }
+static void setCpuFrequencyMhz(uint32_t mhz) { chip.cpuMhz = mhz; }
+static void gpio_intr_disable(gpio_num_t pin) { chip.pinIrq[pin] = false; }
+static void gpio_intr_enable(gpio_num_t pin) { chip.pinIrq[pin] = true; }
+static void gpio_set_intr_type(gpio_num_t, int) {}
+static void gpio_wakeup_enable(gpio_num_t pin, int) { chip.pinWake[pin] = true; }
+static void gpio_wakeup_disable(gpio_num_t pin) { chip.pinWake[pin] = false; }
+static void esp_sleep_enable_gpio_wakeup() { chip.gpioWake = true; }
+static void esp_sleep_disable_wakeup_source(int) { chip.gpioWake = false; }
+static void esp_sleep_pd_config(int, int option) { chip.rtc8m = option == ESP_PD_OPTION_ON; }
+static esp_err_t esp_light_sleep_start();
+static void xTaskNotifyGive(TaskHandle_t) { chip.notified++; }
+static uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+
+// firmware state, as in AIRmatic.ino
+static FrameQueue<CanFrame, CAN_QUEUE_LEN> canQueue0, canQueue1;
+static CanRxStats canStats0, canStats1;
+static CanDriver CanRx0(CAN_C, CS0), CanRx1(CAN_B, CS1);
+static volatile bool canWake[CAN_BUSES] = {false};
+static volatile uint32_t canWakeTime = 0;
+static TaskHandle_t canTask0 = nullptr, canTask1 = nullptr;
+static bool wifiActive = false;
+static bool replayActive = false;
+static volatile uint32_t pwmDuty_vl = 0, pwmDuty_vr = 0, pwmDuty_hr = 0;
+static volatile int32_t pwmSlewStep = 0;
+static bool traceBusy() { return false; }
+static void replayWritten() {}
+static void traceFrame(CanBus, const CanFrame&) {}
+static void awake(unsigned int) {}
+
+// first frame handed to loop() after a wake, per bus
+static uint32_t firstRx[CAN_BUSES];
+static bool gotFirst[CAN_BUSES];
+static void exportMsg(CanBus bus, uint32_t id, const uint8_t* data, uint8_t dlc, uint32_t time) {
+  if (!gotFirst[bus]) {
+    gotFirst[bus] = true;
+    firstRx[bus] = time;
+  }
+}
+
+#include "../Output.ino"
+#include "../CAN.ino"
+#include "../Power.ino"
+
+
+// admitted frames of both buses: the registry messages at their periods, started together
+struct BusFrame {
+  uint32_t time;
+  CanBus bus;
+  uint32_t id;
+};
+
+struct Traffic {
+  CanBus bus;
+  uint32_t id;
+  uint32_t period; // ms
+};
+
+#define CAN_MSG_TRAFFIC(bus, id, name, period) { bus, id, period },
+static const Traffic traffic[] = { CAN_MESSAGES(CAN_MSG_TRAFFIC) };
+#undef CAN_MSG_TRAFFIC
+
+static Mcp2515Mock* mcp[CAN_BUSES];
+static std::vector<BusFrame> bus;
+static size_t busNext = 0;
+static uint32_t wakeUs = 1000;   // light sleep exit until powerIdle() continues
+static uint32_t busFirst[CAN_BUSES]; // first frame per bus after the sleep
+static std::mt19937 rng(20);
+
+// frames on the bus up to now into the receive buffers
+static void busRun() {
+  uint32_t now = micros();
+  while (busNext < bus.size() && (int32_t)(bus[busNext].time - now) <= 0) {
+    struct can_frame f = {};
+    f.can_id = bus[busNext].id;
+    f.can_dlc = 8;
+    mcp[bus[busNext].bus]->receive(f);
+    busNext++;
+  }
+}
+
+// the car wakes after start: every admitted message from a random phase within 10 ms, 1 ms jitter
+static void busStart(uint32_t start, uint32_t span) {
+  bus.clear();
+  busNext = 0;
+  for (const Traffic& t : traffic) {
+    uint32_t time = start + rng() % 10000;
+    while ((int32_t)(time - (start + span)) < 0) {
+      bus.push_back({ time, t.bus, t.id });
+      time += t.period * 1000 + rng() % 2000 - 1000;
+    }
+  }
+  std::sort(bus.begin(), bus.end(), [](const BusFrame& a, const BusFrame& b) { return (int32_t)(a.time - b.time) < 0; });
+}
+
+// the ESP32 sleeps until a MCP2515 pulls INT low, the bus runs on during the wake-up
+static struct {
+  uint32_t sleeps = 0;
+  uint32_t parked = 0;
+  uint32_t wakeArmed = 0;
+} sleepCheck;
+
+static esp_err_t esp_light_sleep_start() {
+  sleepCheck.sleeps++;
+  if (!chip.timerRunning && chip.level[ON] == LOW && !chip.duty[PWM1] && !chip.duty[PWM2] && !chip.duty[PWM3]) {
+    sleepCheck.parked++;
+  }
+  if (chip.gpioWake && chip.pinWake[INT0] && chip.pinWake[INT1] && !chip.pinIrq[INT0] && !chip.pinIrq[INT1] &&
+      chip.rtc8m && chip.cpuMhz == 80) {
+    sleepCheck.wakeArmed++;
+  }
+  busStart(micros() + 1000000 + rng() % 1000000, 200000);
+  bool seen[CAN_BUSES] = {};
+  for (const BusFrame& f : bus) {
+    if (!seen[f.bus]) busFirst[f.bus] = f.time;
+    seen[f.bus] = true;
+  }
+  while (!mcp[CAN_C]->interrupt() && !mcp[CAN_B]->interrupt() && busNext < bus.size()) {
+    hostAdvance((int32_t)(bus[busNext].time - micros()));
+    busRun();
+  }
+  hostAdvance(wakeUs);
+  busRun();
+  return ESP_OK;
+}
+
+static void pinWrite(uint8_t pin, uint8_t value) {
+  chip.level[pin] = value;
+  Mcp2515Mock::chipSelect(pin, value);
+}
+
+static int pinRead(uint8_t pin) {
+  if (pin == INT0) return mcp[CAN_C]->interrupt() ? LOW : HIGH;
+  if (pin == INT1) return mcp[CAN_B]->interrupt() ? LOW : HIGH;
+  return chip.level[pin];
+}
+
+// one light sleep and the first 200 ms after it, returns frames lost
+struct Wake {
+  uint32_t latency[CAN_BUSES]; // bus frame to first frame received, us
+  uint32_t lost[CAN_BUSES];
+};
+
+static Wake sleepCycle() {
+  Wake w = {};
+  uint32_t lost[CAN_BUSES] = { mcp[CAN_C]->lost, mcp[CAN_B]->lost };
+  gotFirst[CAN_C] = gotFirst[CAN_B] = false;
+  chip.notified = 0;
+  powerIdle();
+  CHECK(chip.notified == 2);
+
+  // both CAN tasks, notified by powerIdle(), then on every INT until the buses are quiet
+  hostAdvance(20); // task switch
+  while (busNext < bus.size() || mcp[CAN_C]->interrupt() || mcp[CAN_B]->interrupt()) {
+    busRun();
+    if (mcp[CAN_C]->interrupt() || canWake[CAN_C]) drainCan(CanRx0, CAN_C, INT0, canQueue0, canStats0);
+    busRun();
+    if (mcp[CAN_B]->interrupt() || canWake[CAN_B]) drainCan(CanRx1, CAN_B, INT1, canQueue1, canStats1);
+    CanFrame rx;
+    while (canQueue0.pop(rx)) {}
+    while (canQueue1.pop(rx)) {}
+    if (busNext < bus.size() && !mcp[CAN_C]->interrupt() && !mcp[CAN_B]->interrupt()) {
+      // idle until the next frame, then ISR to task
+      hostAdvance((int32_t)(bus[busNext].time - micros()) + 20);
+    }
+  }
+  for (uint8_t b = 0; b < CAN_BUSES; b++) {
+    CHECK(gotFirst[b]);
+    w.latency[b] = firstRx[b] - busFirst[b];
+    w.lost[b] = mcp[b]->lost - lost[b];
+  }
+  return w;
+}
+
+static uint32_t percentile(std::vector<uint32_t>& v, uint32_t p) {
+  std::sort(v.begin(), v.end());
+  return v.empty() ? 0 : v[(v.size() - 1) * p / 100];
+}
+
+int main() {
+  Mcp2515Mock chip0(CS0), chip1(CS1);
+  mcp[CAN_C] = &chip0;
+  mcp[CAN_B] = &chip1;
+  Mcp2515Mock::spiClock() = CAN_SPI_CLOCK;
+  hostDigitalWrite = pinWrite;
+  hostDigitalRead = pinRead;
+  CanRx0.begin();
+  CanRx1.begin();
+  esp_timer_create(nullptr, &outputTimer);
+  chip.level[ON] = HIGH;
+
+  // outputs parked for the sleep, the duties of the last step afterwards
+  outputLevel[0] = rampLevel(1800);
+  outputLevel[1] = rampLevel(2100);
+  outputLevel[2] = rampLevel(1950);
+  Wake w = sleepCycle();
+  CHECK(sleepCheck.sleeps == 1 && sleepCheck.parked == 1 && sleepCheck.wakeArmed == 1);
+  CHECK(chip.level[ON] == HIGH && chip.timerRunning && chip.cpuMhz == 240);
+  CHECK(chip.duty[PWM1] == 1800 && chip.duty[PWM2] == 2100 && chip.duty[PWM3] == 1950);
+  CHECK(!chip.gpioWake && !chip.pinWake[INT0] && !chip.pinWake[INT1] && chip.pinIrq[INT0] && chip.pinIrq[INT1]);
+  CHECK(metrics.sleeps.get() == 1);
+
+  // ESP32 light sleep exit with the PLL and 240 MHz restore: about 0.5 .. 2 ms
+  std::vector<uint32_t> latency;
+  uint32_t lost = 0, overflowBefore = metrics.wakeOverflow[CAN_C].get() + metrics.wakeOverflow[CAN_B].get();
+  const uint32_t cycles = 300;
+  for (uint32_t i = 0; i < cycles; i++) {
+    wakeUs = 500 + rng() % 1500;
+    w = sleepCycle();
+    latency.push_back(w.latency[CAN_C]);
+    latency.push_back(w.latency[CAN_B]);
+    lost += w.lost[CAN_C] + w.lost[CAN_B];
+  }
+  uint32_t overflows = metrics.wakeOverflow[CAN_C].get() + metrics.wakeOverflow[CAN_B].get() - overflowBefore;
+  CHECK(sleepCheck.parked == sleepCheck.sleeps && sleepCheck.wakeArmed == sleepCheck.sleeps);
+  CHECKF(lost == 0, "%u frames lost at wake", lost);
+  CHECK(overflows == 0);
+  printf("power: %u sleeps, outputs parked in all, first frame on a bus to first received: median %u us, max %u us, %u frames lost\n",
+    cycles, percentile(latency, 50), percentile(latency, 100), lost);
+
+  // a slower wake: RXB0 + RXB1 hold two frames, the third one admitted before the drain is lost
+  printf("power: wake-up time -> frames lost per wake (CAN-C, CAN-B), overflows seen in the first drain\n");
+  for (uint32_t ms : { 1, 5, 10, 20, 40, 80 }) {
+    wakeUs = ms * 1000;
+    uint32_t lostC = 0, lostB = 0;
+    uint32_t before = metrics.wakeOverflow[CAN_C].get() + metrics.wakeOverflow[CAN_B].get();
+    uint32_t wakesWithLoss = 0;
+    for (uint32_t i = 0; i < 100; i++) {
+      w = sleepCycle();
+      lostC += w.lost[CAN_C];
+      lostB += w.lost[CAN_B];
+      if (w.lost[CAN_C]) wakesWithLoss++;
+      if (w.lost[CAN_B]) wakesWithLoss++;
+    }
+    uint32_t seen = metrics.wakeOverflow[CAN_C].get() + metrics.wakeOverflow[CAN_B].get() - before;
+    // every wake that lost frames shows up in airmatic_wake_overflow_total
+    CHECKF(seen == wakesWithLoss, "%u ms: %u overflows seen, %u wakes lost frames", ms, seen, wakesWithLoss);
+    if (ms <= 5) CHECK(lostC + lostB == 0);
+    printf("power:   %2u ms  %.2f, %.2f  %u\n", ms, lostC / 100.0, lostB / 100.0, seen);
+  }
+  return checkDone("test_power");
+}
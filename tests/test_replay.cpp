@@ -0,0 +1,244 @@
+/*                                                                          *
+ * CAN replay benchmark of Replay.ino on the host                           *
+ *                                                                          *
+ * A 20 s candump log of both buses (the registered messages at their       *
+ * periods, mode switches every 3 s, an unregistered ID, lines the parser   *
+ * skips) is uploaded with POST /replay and run with GET /replay?run=1 at   *
+ * 1x with an FS_340h dropout and at rate 0. The replay task runs as in     *
+ * the firmware, whenever it waits loop() (10 ms plus work) and the output  *
+ * task (100 Hz) run in between on the virtual clock.                       *
+ *                                                                          *
+ * Checks the report against the log: frames, skipped lines, no queue      *
+ * drops, a latency sample per frame and per mode switch, the deadline miss *
+ * of the dropout, and prints the frame -> ledcWrite latencies.             *
+ *                                                                          */
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ESPAsyncWebServer.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include "canbus.h"
+#include "can_freshness.h"
+#include "can_registry.h"
+#include "control.h"
+#include "w211_signals.h"
+#include "check.h"
+
+#define LOG_SECONDS 20
+#define LOOP_PERIOD 10000            // us, delay(10) of loop()
+#define OUTPUT_PERIOD (1000000 / 100) // us, OUTPUT_RATE of AIRmatic.ino
+
+// firmware state, as in AIRmatic.ino
+static FrameQueue<CanFrame, CAN_QUEUE_LEN> canQueue0, canQueue1;
+static CanFreshness canFreshness;
+static volatile bool replayActive = false;
+static AsyncWebServer server(80);
+static uint8_t duty = 115;
+static volatile uint32_t pwmDuty_vl = 0, pwmDuty_vr = 0, pwmDuty_hr = 0;
+static bool otaFsBusy() { return false; }
+static void awake(unsigned int) {}
+static void delay_us(uint32_t us) { hostDelay(esp_timer_get_time() + us); }
+
+// snapshots of the decoders, loop() reads the mode from them
+static uint8_t ezsData[8], fsData[8];
+static void exportMsg(CanBus bus, uint32_t id, const uint8_t* data, uint8_t dlc, uint32_t time) {
+  uint8_t index = canMsgIndex(bus, id);
+  canFreshness.frame(bus, index, id, dlc, time);
+  if (index == MSG_EZS_240h) memcpy(ezsData, data, dlc < 8 ? dlc : 8);
+  if (index == MSG_FS_340h) memcpy(fsData, data, dlc < 8 ? dlc : 8);
+}
+
+#include "../Replay.ino"
+
+
+// loop() and the output task around the replay task
+static struct {
+  int64_t nextLoop = 3000;
+  int64_t nextOutput = 0;
+  Mode mode = MODE_DEFAULT;
+  uint32_t loops = 0;
+  std::mt19937 rng{4};
+} sim;
+
+static void loopOnce() {
+  CanFrame rx;
+  while (canQueue0.pop(rx)) replayConsumed(rx.time);
+  while (canQueue1.pop(rx)) replayConsumed(rx.time);
+  EZS_240h_t ezs;
+  FS_340h_t fs;
+  memcpy(ezs.data, ezsData, sizeof(ezs));
+  memcpy(fs.data, fsData, sizeof(fs));
+  Mode mode = detectMode(sim.mode, ezs, fs);
+  if (mode != sim.mode) {
+    sim.mode = mode;
+    replayModeApplied();
+  }
+  canFreshness.check((uint32_t) esp_timer_get_time());
+  replayOutput();
+  sim.loops++;
+}
+
+// delay() of the replay task: the other tasks until then
+static void simulate(int64_t until) {
+  for (;;) {
+    int64_t next = std::min(sim.nextLoop, sim.nextOutput);
+    if (next > until) break;
+    if (next > hostTime.load()) hostTime.store(next);
+    if (next == sim.nextOutput) {
+      replayWritten();
+      sim.nextOutput += OUTPUT_PERIOD;
+    } else {
+      loopOnce();
+      sim.nextLoop = hostTime.load() + LOOP_PERIOD + 200 + sim.rng() % 1000;
+    }
+  }
+  if (until > hostTime.load()) hostTime.store(until);
+}
+
+
+struct Log {
+  std::string text;
+  uint32_t frames = 0;   // parsed lines
+  uint32_t skipped = 0;  // lines the parser rejects
+  uint32_t modes = 0;    // LED changes of FS_340h
+  uint32_t fsDropped = 0; // FS_340h frames in the dropout
+};
+
+static void logLine(Log& log, uint64_t us, const char* bus, const char* id, const uint8_t* data, uint8_t len) {
+  char line[96];
+  int n = snprintf(line, sizeof(line), "(%llu.%06llu) %s %s#", (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000), bus, id);
+  for (uint8_t i = 0; i < len; i++) n += snprintf(line + n, sizeof(line) - n, "%02X", data[i]);
+  log.text += line;
+  log.text += "\n";
+  log.frames++;
+}
+
+// a drive: KL_15 on, AIRmatic comfort -> sport 1 -> sport 2 -> offroad every 3 s
+static Log makeLog(uint32_t dropStart, uint32_t dropLen) {
+  Log log;
+  const uint64_t start = 1697040000ULL * 1000000;
+  const uint8_t leds[] = { 0x00, 0x01, 0x04, 0x10 }; // ST3_LEDL_DL, ST3_LEDR_DL, ST2_LED_DL
+  uint8_t ledsLast = 0;
+  std::mt19937 rng(11);
+  for (uint32_t ms = 0; ms < LOG_SECONDS * 1000; ms++) {
+    uint64_t us = start + ms * 1000ULL + rng() % 300;
+    if (ms % 20 == 0) {
+      uint8_t fs[8] = { 0x00, leds[ms / 3000 % 4], 127, 127, 127, 127, 0x00, 1 << 5 };
+      CHECK(w211::FS_340h::FS_ID(fs) == 1 && w211::FS_340h::FZGN_HR(fs) == 127);
+      logLine(log, us, "can0", "340", fs, 8);
+      if (ms - dropStart < dropLen) log.fsDropped++;
+      else if (fs[1] != ledsLast) log.modes++;
+      if (ms - dropStart >= dropLen) ledsLast = fs[1];
+    }
+    if (ms % 100 == 5) {
+      uint8_t ezs[8] = { 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+      CHECK(w211::EZS_240h::KL_15(ezs));
+      logLine(log, us, "can0", "240", ezs, 8);
+    }
+    if (ms % 50 == 7) {
+      uint8_t other[4] = { 0x12, 0x34, 0x56, 0x78 };
+      logLine(log, us, "can0", "123", other, 4); // not registered
+    }
+    if (ms % 200 == 11) {
+      uint8_t kombi[4] = { 0x05, 0x00, 0x00, 0x00 };
+      logLine(log, us, "can1", "1CA", kombi, 4);
+    }
+    if (ms % 200 == 13) {
+      uint8_t ubf[8] = {};
+      logLine(log, us, "can1", "01A", ubf, 8);
+    }
+    if (ms % 1000 == 17) {
+      uint8_t ext[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+      logLine(log, us, "can1", "18FF0017", ext, 8); // extended
+    }
+    if (ms % 5000 == 19) {
+      log.text += "(1697040000.000000) can0 340#R\n"; // remote frame
+      log.text += "(1697040000.000000) can2 340#0011\n"; // unknown interface
+      log.text += "garbage\n";
+      log.skipped += 3;
+    }
+  }
+  return log;
+}
+
+// GET /replay until the task has replaced the report of the last run
+static String waitReport(const String& last) {
+  for (;;) {
+    AsyncWebServerRequest r = server.request(HTTP_GET, "/replay");
+    if (r.content != "replay running\n" && r.content != last) return r.content;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+static uint32_t reportValue(const String& report, const char* key) {
+  int at = report.indexOf(key);
+  return at < 0 ? 0xFFFFFFFF : (uint32_t) strtoul(report.c_str() + at + strlen(key), nullptr, 10);
+}
+
+static void run(const Log& log, const char* rate, const char* drop) {
+  std::map<std::string, std::string> query = { { "run", "1" }, { "rate", rate } };
+  if (drop) query["drop"] = drop;
+  // no replay of an earlier run left: the messages of the run before go stale first
+  simulate(esp_timer_get_time() + 1000000);
+  String last = server.request(HTTP_GET, "/replay").content;
+  AsyncWebServerRequest r = server.request(HTTP_GET, "/replay", query);
+  CHECKF(r.code == 202, "run: %d %s", r.code, r.content.c_str());
+  String report = waitReport(last);
+
+  const uint32_t frames = log.frames - (drop ? log.fsDropped : 0);
+  CHECKF(replayFrames == frames, "rate %s: %u frames, %u in the log", rate, replayFrames, frames);
+  CHECKF(replaySkipped == log.skipped, "rate %s: %u skipped, %u", rate, replaySkipped, log.skipped);
+  CHECKF(replayDrops == 0, "rate %s: %u queue drops", rate, replayDrops);
+  CHECKF(replayLeftOut == (drop ? log.fsDropped : 0), "rate %s: %u left out", rate, replayLeftOut);
+  // every frame reaches an output write, a mode switch is applied in the next loop()
+  CHECKF(replayOutputLatency.n == frames, "rate %s: %u latency samples", rate, replayOutputLatency.n);
+  CHECKF(replayModeLatency.n == log.modes, "rate %s: %u mode switches, %u", rate, replayModeLatency.n, log.modes);
+  uint32_t p50 = replayOutputLatency.percentile(50), p99 = replayOutputLatency.percentile(99);
+  CHECK(p50 <= p99 && p99 <= replayOutputLatency.max + replayBucketUs);
+  CHECKF(replayOutputLatency.max <= LOOP_PERIOD + 1200 + OUTPUT_PERIOD, "rate %s: max %u us", rate, replayOutputLatency.max);
+  CHECKF(replayModeLatency.max <= LOOP_PERIOD + 1200, "rate %s: mode max %u us", rate, replayModeLatency.max);
+  if (!strcmp(rate, "1")) {
+    CHECKF(replayElapsed >= LOG_SECONDS * 1000 && replayElapsed < LOG_SECONDS * 1000 + 100, "%u ms", replayElapsed);
+  } else {
+    CHECKF(replayElapsed < LOG_SECONDS * 1000 / 2, "rate 0: %u ms", replayElapsed);
+  }
+  // the report the web server hands out
+  CHECK(reportValue(report, "frames in ") == replayElapsed);
+  CHECK(reportValue(report, "p99 ") == p99);
+
+  // dropout: FS_340h misses its deadline once, detected by the next loop()
+  for (uint8_t i = 0; i < CAN_MSG_COUNT; i++) {
+    uint32_t misses = canFreshness.misses(i) - replayMisses[i];
+    uint32_t want = drop && i == MSG_FS_340h ? 1 : 0;
+    CHECKF(misses == want, "rate %s: %s %u deadline misses", rate, canMessages[i].name, misses);
+  }
+  if (drop) CHECKF(canFreshness.lateMax(MSG_FS_340h) <= LOOP_PERIOD + 1200, "%u us late", canFreshness.lateMax(MSG_FS_340h));
+
+  printf("replay: rate %sx %5u frames in %5u ms, frame -> ledcWrite us p50 %5u p99 %5u max %5u, mode switch max %5u (n %u)\n",
+    rate, replayFrames, replayElapsed, p50, p99, replayOutputLatency.max, replayModeLatency.max, replayModeLatency.n);
+}
+
+int main() {
+  hostAdvance(1000000);
+  hostDelay = simulate;
+  replaySetup();
+
+  // before a run
+  CHECK(server.request(HTTP_GET, "/replay").content == "no replay yet\n");
+  CHECK(server.request(HTTP_GET, "/replay", { { "run", "1" }, { "drop", "340:1" } }).code == 400);
+
+  Log log = makeLog(2000, 500);
+  AsyncWebServerRequest upload = server.request(HTTP_POST, "/replay", {}, log.text);
+  CHECK(upload.code == 200);
+  CHECK(LittleFS.data(replayFile).size() == log.text.size());
+
+  run(log, "1", "340:2000:500");
+  run(log, "0", nullptr);
+  CHECK(replayPendingLen == 0);
+
+  hostDelay = nullptr;
+  return checkDone("test_replay");
+}
@@ -0,0 +1,204 @@
+/*                                                                          *
+ * Generated CAN decoders against the DBC files                             *
+ *                                                                          *
+ * Every signal of every message is read on sample frames with the shift   *
+ * extractors of w211_signals.h the firmware uses and with a plain DBC      *
+ * decoder here that reads the DBC files itself. Each setter writes the     *
+ * value of the inverted frame and has to leave the other signals alone.    *
+ * Frames: all zero, all one, a single bit at each of the 64 positions, and *
+ * random data.                                                             *
+ *                                                                          */
+#include <Arduino.h>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "can_registry.h"
+#include "w211_signals.h"
+#include "check.h"
+
+struct DbcSignal {
+  std::string name;
+  uint32_t start;
+  uint32_t length;
+  bool motorola;
+  bool sign;
+  double factor;
+  double offset;
+};
+
+struct DbcMessage {
+  uint8_t bus;
+  uint32_t id;
+  std::string name;
+  uint32_t size;
+  std::vector<DbcSignal> signals;
+};
+
+static std::vector<DbcMessage> dbc;
+
+static void loadDbc(const char* path, uint8_t bus) {
+  std::ifstream in(path);
+  CHECKF(in.good(), "%s", path);
+  std::string line;
+  DbcMessage* message = nullptr;
+  while (std::getline(in, line)) {
+    char name[64], order, sign;
+    unsigned long id;
+    uint32_t size, start, length;
+    double factor, offset;
+    if (sscanf(line.c_str(), "BO_ %lu %63[A-Za-z0-9_] : %u", &id, name, &size) == 3) {
+      dbc.push_back({ bus, (uint32_t)(id & CAN_EFF_MASK), name, size, {} });
+      message = &dbc.back();
+    } else if (message && sscanf(line.c_str(), " SG_ %63[A-Za-z0-9_] : %u|%u@%c%c (%lf,%lf)",
+        name, &start, &length, &order, &sign, &factor, &offset) == 7) {
+      message->signals.push_back({ name, start, length, order == '0', sign == '-', factor, offset });
+    } else if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      message = nullptr;
+    }
+  }
+}
+
+static const DbcMessage* findMessage(uint8_t bus, uint32_t id) {
+  for (const DbcMessage& message : dbc) {
+    if (message.bus == bus && message.id == id) return &message;
+  }
+  return nullptr;
+}
+
+static const DbcSignal* findSignal(const DbcMessage* message, const char* name) {
+  for (const DbcSignal& sig : message->signals) {
+    if (sig.name == name) return &sig;
+  }
+  return nullptr;
+}
+
+// the textbook DBC rule: Motorola starts at the MSB and walks the sawtooth, Intel starts at the LSB
+static int64_t dbcRaw(const DbcSignal& sig, const uint8_t* d) {
+  uint64_t raw = 0;
+  if (sig.motorola) {
+    uint32_t bit = sig.start;
+    for (uint32_t i = 0; i < sig.length; i++) {
+      raw = raw << 1 | ((d[bit / 8] >> (bit % 8)) & 1);
+      bit = bit % 8 == 0 ? bit + 15 : bit - 1;
+    }
+  } else {
+    for (uint32_t i = 0; i < sig.length; i++) {
+      uint32_t bit = sig.start + i;
+      raw |= (uint64_t)((d[bit / 8] >> (bit % 8)) & 1) << i;
+    }
+  }
+  if (sig.sign && (raw >> (sig.length - 1)) & 1) return (int64_t)(raw | ~0ULL << sig.length);
+  return (int64_t) raw;
+}
+
+static uint32_t compared = 0;
+static uint32_t written = 0;
+
+static void compare(const DbcMessage* message, const char* name, const uint8_t* d, double value) {
+  const DbcSignal* sig = message ? findSignal(message, name) : nullptr;
+  CHECKF(sig, "%s.%s not in the DBC", message ? message->name.c_str() : "?", name);
+  if (!sig) return;
+  int64_t raw = dbcRaw(*sig, d);
+  double scaled = raw * sig->factor + sig->offset;
+  CHECKF(value == scaled, "%s.%s on %02x %02x %02x %02x %02x %02x %02x %02x: extractor %g, DBC %lld",
+    message->name.c_str(), name, d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], value, (long long) raw);
+  compared++;
+}
+
+// c = d with signal name set to raw: the DBC reads raw there and d everywhere else
+static void compareSet(const DbcMessage* message, const char* name, const uint8_t* d, const uint8_t* c, int64_t raw) {
+  for (const DbcSignal& sig : message->signals) {
+    int64_t want = sig.name == name ? raw : dbcRaw(sig, d);
+    CHECKF(dbcRaw(sig, c) == want, "set_%s on %02x %02x %02x %02x %02x %02x %02x %02x: %s %lld, want %lld",
+      name, d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], sig.name.c_str(), (long long) dbcRaw(sig, c), (long long) want);
+  }
+  written++;
+}
+
+// one frame through extractors, setters and DBC, for each message
+#define CHECK_SIGNAL(sig) compare(message, #sig, d, (double) v.sig);
+#define CHECK_SETTER(sig) { \
+    const DbcSignal* s = findSignal(message, #sig); \
+    if (s) { \
+      uint8_t c[8]; \
+      memcpy(c, d, sizeof(c)); \
+      int64_t raw = dbcRaw(*s, inverted); \
+      set_##sig(c, raw); \
+      compareSet(message, #sig, d, c, raw); \
+    } \
+  }
+#define CHECK_MESSAGE(msg) \
+  static void check_##msg(const uint8_t* d) { \
+    using namespace w211::msg; \
+    const DbcMessage* message = findMessage(BUS, ID); \
+    const Values v = decode(d); \
+    W211_SIGNALS_##msg(CHECK_SIGNAL) \
+    if (!message) return; \
+    uint8_t inverted[8]; \
+    for (uint8_t i = 0; i < 8; i++) inverted[i] = ~d[i]; \
+    W211_SIGNALS_##msg(CHECK_SETTER) \
+  }
+W211_MESSAGES(CHECK_MESSAGE)
+
+#define CALL_MESSAGE(msg) check_##msg(d);
+static void checkFrame(const uint8_t* d) {
+  W211_MESSAGES(CALL_MESSAGE)
+}
+
+// generated headers and DBC describe the same messages and signals
+#define LAYOUT_MESSAGE(msg) { \
+    const DbcMessage* message = findMessage(w211::msg::BUS, w211::msg::ID); \
+    CHECKF(message, "%s not in the DBC", #msg); \
+    if (message) { \
+      CHECK(message->name == #msg); \
+      CHECK(message->size == w211::msg::DLC); \
+      CHECKF(message->signals.size() == w211::msg::count, "%s: %zu signals in the DBC, %zu generated", \
+        #msg, message->signals.size(), w211::msg::count); \
+      for (size_t i = 0; i < w211::msg::count && i < message->signals.size(); i++) { \
+        CHECK(message->signals[i].name == w211::msg::names[i]); \
+      } \
+    } \
+    CHECK(sizeof(msg##_t) == w211::msg::DLC); \
+    messages++; \
+  }
+
+static void layout() {
+  size_t messages = 0;
+  W211_MESSAGES(LAYOUT_MESSAGE)
+  CHECK(messages == dbc.size());
+  CHECK(messages == CAN_MSG_COUNT);
+}
+
+static void frames() {
+  uint8_t d[8];
+  memset(d, 0x00, sizeof(d));
+  checkFrame(d);
+  memset(d, 0xFF, sizeof(d));
+  checkFrame(d);
+  // a field reading the wrong bit fails on one of these
+  for (uint8_t bit = 0; bit < 64; bit++) {
+    memset(d, 0x00, sizeof(d));
+    d[bit / 8] = 1 << (bit % 8);
+    checkFrame(d);
+    memset(d, 0xFF, sizeof(d));
+    d[bit / 8] = ~(1 << (bit % 8));
+    checkFrame(d);
+  }
+  std::mt19937 random(211);
+  for (uint32_t i = 0; i < 10000; i++) {
+    for (uint8_t& b : d) {
+      b = random();
+    }
+    checkFrame(d);
+  }
+}
+
+int main() {
+  loadDbc("../dbc/w211_can_c.dbc", CAN_C);
+  loadDbc("../dbc/w211_can_b.dbc", CAN_B);
+  layout();
+  frames();
+  printf("signals: %u values compared between extractor and DBC, %u setter writes\n", compared, written);
+  return checkDone("test_signals");
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+Precompress the AIRmatic web UI assets before "Upload LittleFS".
+
+usage: build_assets.py [data_dir]   (default: data/ next to this script's parent)
+
+Writes <name>.gz next to every compressible file that shrinks by gzip and the
+manifest assets.json (path -> stored file, MIME type, size, content hash) read
+by Assets.ino at boot. Already compressed media (png, webm) is listed as is.
+The generated files are not committed, rerun after changing anything in data/.
+"""
+
+import gzip
+import hashlib
+import json
+import os
+import sys
+
+MANIFEST = "assets.json"
+
+# runtime data, not static assets
+SKIP = {"config.json", MANIFEST}
+
+MIME = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+    ".svg": "image/svg+xml",
+    ".webm": "video/webm",
+    ".mp4": "video/mp4",
+}
+
+COMPRESSIBLE = {".html", ".css", ".js", ".json", ".svg"}
+
+
+def gzip_bytes(data):
+    # mtime 0: identical input gives an identical file and hash
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def build(data_dir):
+    manifest = {}
+    for name in sorted(os.listdir(data_dir)):
+        path = os.path.join(data_dir, name)
+        ext = os.path.splitext(name)[1].lower()
+        if not os.path.isfile(path) or name in SKIP or ext == ".gz" or ext not in MIME:
+            continue
+        with open(path, "rb") as f:
+            data = f.read()
+
+        stored = name
+        packed = data
+        if ext in COMPRESSIBLE:
+            packed = gzip_bytes(data)
+            if len(packed) < len(data):
+                stored = name + ".gz"
+                with open(os.path.join(data_dir, stored), "wb") as f:
+                    f.write(packed)
+            else:
+                packed = data
+
+        manifest["/" + name] = {
+            "file": "/" + stored,
+            "mime": MIME[ext],
+            "size": len(packed),
+            "hash": hashlib.sha256(packed).hexdigest()[:16],
+            "gzip": stored != name,
+        }
+        sys.stderr.write("%-16s %8d -> %8d %s\n" % (name, len(data), len(packed), "gzip" if stored != name else ""))
+
+    with open(os.path.join(data_dir, MANIFEST), "w") as f:
+        json.dump(manifest, f, separators=(",", ":"), sort_keys=True)
+    return manifest
+
+
+def main():
+    if len(sys.argv) > 2:
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    data_dir = sys.argv[1] if len(sys.argv) == 2 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "data")
+    manifest = build(data_dir)
+    sys.stderr.write("%d assets in %s\n" % (len(manifest), os.path.join(data_dir, MANIFEST)))
+
+
+if __name__ == "__main__":
+    main()
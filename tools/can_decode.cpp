@@ -0,0 +1,146 @@
+/*
+ * Decode an AIRmatic CAN trace (/trace.bin, see Trace.ino) on the host with
+ * the generated w211_signals.h.
+ *
+ * build: g++ -O2 -std=c++17 -I.. can_decode.cpp -o can_decode
+ *
+ * usage: can_decode trace.bin              frame count and decode rate
+ *        can_decode trace.bin -m FS_340h   CSV of all signals of one message
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "w211_signals.h"
+
+
+static bool readVarint(const std::vector<uint8_t>& data, size_t& pos, uint32_t& value) {
+  value = 0;
+  for (uint8_t shift = 0; pos < data.size() && shift < 35; shift += 7) {
+    uint8_t b = data[pos++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+// trace file -> frames, stops at a truncated tail
+static bool readTrace(const char* path, std::vector<w211::Frame>& frames) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(f);
+
+  if (data.size() < 12 || memcmp(data.data(), "AMTR", 4) != 0) {
+    fprintf(stderr, "%s: not an AIRmatic trace file\n", path);
+    return false;
+  }
+  if (data[4] != 1) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", path, data[4]);
+    return false;
+  }
+  uint8_t count = data[5];
+  uint32_t time = data[8] | data[9] << 8 | data[10] << 16 | (uint32_t) data[11] << 24;
+  size_t pos = 12;
+  if (data.size() < pos + count * 4) return false;
+  std::vector<uint8_t> bus(count);
+  std::vector<uint16_t> id(count);
+  for (uint8_t i = 0; i < count; i++, pos += 4) {
+    bus[i] = data[pos];
+    id[i] = data[pos + 2] | data[pos + 3] << 8;
+  }
+
+  while (pos < data.size()) {
+    uint32_t delta;
+    if (!readVarint(data, pos, delta) || pos + 2 > data.size()) break;
+    uint8_t index = data[pos];
+    uint8_t dlc = data[pos + 1] & 0x0F;
+    pos += 2;
+    if (dlc > 8 || pos + dlc > data.size()) break;
+    time += delta;
+    if (index < count) {
+      w211::Frame frame = {time, bus[index], dlc, id[index], {}};
+      memcpy(frame.data, &data[pos], dlc);
+      frames.push_back(frame);
+    }
+    pos += dlc;
+  }
+  return true;
+}
+
+
+// counts decoded messages
+struct StatsSink {
+  uint32_t decoded = 0;
+  double checksum = 0; // keeps the decode from being optimized away
+  template <typename V>
+  void message(const w211::Frame&, const V& v) {
+    double out[64];
+    values(v, out);
+    checksum += out[0];
+    decoded++;
+  }
+};
+
+// one CSV line per frame of the selected message
+struct CsvSink {
+  const char* name;
+  bool header = false;
+  template <typename V>
+  void message(const w211::Frame& f, const V& v) {
+    if (strcmp(messageName(v), name) != 0) return;
+    size_t count = signalCount(v);
+    if (!header) {
+      printf("time");
+      for (size_t i = 0; i < count; i++) printf(",%s", signals(v)[i]);
+      printf("\n");
+      header = true;
+    }
+    double out[64];
+    values(v, out);
+    printf("%u.%06u", f.time / 1000000, f.time % 1000000);
+    for (size_t i = 0; i < count; i++) printf(",%g", out[i]);
+    printf("\n");
+  }
+};
+
+
+int main(int argc, char** argv) {
+  if (argc != 2 && !(argc == 4 && strcmp(argv[2], "-m") == 0)) {
+    fprintf(stderr, "usage: %s trace.bin [-m MESSAGE]\n", argv[0]);
+    return 1;
+  }
+  std::vector<w211::Frame> frames;
+  if (!readTrace(argv[1], frames)) return 1;
+
+  if (argc == 4) {
+    CsvSink sink{argv[3]};
+    w211::decode(frames.data(), frames.size(), sink);
+    if (!sink.header) {
+      fprintf(stderr, "no %s frames\n", argv[3]);
+      return 1;
+    }
+    return 0;
+  }
+
+  // repeat the decode until the timing is meaningful
+  StatsSink sink;
+  size_t rounds = 0;
+  auto start = std::chrono::steady_clock::now();
+  double seconds;
+  do {
+    w211::decode(frames.data(), frames.size(), sink);
+    rounds++;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (seconds < 0.2 && !frames.empty());
+  printf("%zu frames, %u decoded\n", frames.size(), (unsigned)(sink.decoded / rounds));
+  if (seconds > 0) printf("%.1f M frames/s\n", frames.size() * rounds / seconds / 1e6);
+  return 0;
+}
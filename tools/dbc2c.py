@@ -0,0 +1,336 @@
+#!/usr/bin/env python3
+"""
+Generate the W211 CAN decoder headers from DBC files.
+
+usage: dbc2c.py [can_c.dbc can_b.dbc]   (default: dbc/w211_can_c.dbc dbc/w211_can_b.dbc)
+
+The first DBC is bus 0 (Motor CAN-C), the second bus 1 (Interior CAN-B), like
+CanBus in can_registry.h. Writes next to AIRmatic.ino:
+
+  w211_can_c.h, w211_can_b.h  frame payload structs (DLC bytes), the snapshot
+                              types of can_registry.h
+  w211_signals.h              constexpr signal extractors and setters with
+                              explicit shifts, scaling and value table enums,
+                              plus a bulk decoder for host tools
+                              (tools/can_decode.cpp). The firmware reads every
+                              signal through them, the DBC is the only layout.
+
+Bit offsets in the comments are MSB first (rnd-ash W211 definitions): offset o
+is bit 7 - o % 8 of byte o / 8, the field continues towards the LSB.
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+
+class Signal:
+    def __init__(self, name, start, length, big_endian, signed, factor, offset, minimum, maximum):
+        self.name = name
+        self.start = start
+        self.length = length
+        self.big_endian = big_endian
+        self.signed = signed
+        self.factor = factor
+        self.offset = offset
+        self.minimum = minimum
+        self.maximum = maximum
+        self.comment = ""
+        self.values = []  # (value, description)
+
+    def bits(self):
+        """(byte, lsb bit, width, shift into the value) per byte, MSB chunk first"""
+        chunks = []
+        if self.big_endian:
+            first = (self.start // 8) * 8 + 7 - self.start % 8  # MSB first index of the MSB
+            last = first + self.length - 1
+            i = first
+            while i <= last:
+                byte = i // 8
+                hi = min(last, byte * 8 + 7)
+                chunks.append((byte, 7 - hi % 8, hi - i + 1, last - hi))
+                i = hi + 1
+        else:
+            i = self.start
+            end = self.start + self.length - 1
+            while i <= end:
+                byte = i // 8
+                hi = min(end, byte * 8 + 7)
+                chunks.append((byte, i % 8, hi - i + 1, i - self.start))
+                i = hi + 1
+            chunks.reverse()
+        return chunks
+
+    def msb_offset(self):
+        """MSB first bit offset as in the rnd-ash definitions"""
+        byte, lsb, width, _ = self.bits()[0]
+        return byte * 8 + 7 - (lsb + width - 1)
+
+    def raw_type(self):
+        if self.length == 1:
+            return "bool"
+        for size in (8, 16, 32, 64):
+            if self.length <= size:
+                return ("int%d_t" if self.signed else "uint%d_t") % size
+
+    def scaled(self):
+        return self.factor != 1 or self.offset != 0
+
+    def enum_items(self):
+        """(identifier, value, description) of the value table"""
+        items = []
+        for value, text in self.values:
+            parts = text.rsplit(" / ", 1)
+            ident = parts[-1].strip()
+            desc = parts[0].strip() if len(parts) == 2 else ""
+            if not re.match(r"^[A-Za-z_]\w*$", ident):
+                continue
+            items.append((ident, value, desc))
+        return items
+
+
+class Message:
+    def __init__(self, frame_id, name, size, sender):
+        self.id = frame_id
+        self.name = name
+        self.size = size
+        self.sender = sender
+        self.signals = []
+
+
+def number(text):
+    value = float(text)
+    return int(value) if value.is_integer() else value
+
+
+def parse_dbc(path):
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    messages = []
+    by_id = {}
+    message = None
+    for line in text.splitlines():
+        m = re.match(r"^BO_ (\d+) (\w+)\s*: (\d+) (\w+)", line)
+        if m:
+            message = Message(int(m.group(1)) & 0x1FFFFFFF, m.group(2), int(m.group(3)), m.group(4))
+            messages.append(message)
+            by_id[message.id] = message
+            continue
+        m = re.match(r"^\s+SG_ (\w+)\s*: (\d+)\|(\d+)@([01])([+-]) \(([^,]+),([^)]+)\) \[([^|]+)\|([^\]]+)\]", line)
+        if m and message:
+            message.signals.append(Signal(m.group(1), int(m.group(2)), int(m.group(3)), m.group(4) == "0",
+                                          m.group(5) == "-", number(m.group(6)), number(m.group(7)),
+                                          number(m.group(8)), number(m.group(9))))
+            continue
+        if not line.strip():
+            message = None
+    for m in re.finditer(r'^CM_ SG_ (\d+) (\w+) "((?:[^"\\]|\\.)*)";', text, re.M):
+        sig = find_signal(by_id, m.group(1), m.group(2))
+        if sig:
+            sig.comment = re.sub(r"\\(.)", r"\1", m.group(3))
+    for m in re.finditer(r"^VAL_ (\d+) (\w+) (.*);", text, re.M):
+        sig = find_signal(by_id, m.group(1), m.group(2))
+        if sig:
+            sig.values = [(int(v), d) for v, d in re.findall(r'(-?\d+) "([^"]*)"', m.group(3))]
+    return messages
+
+
+def find_signal(by_id, frame_id, name):
+    message = by_id.get(int(frame_id) & 0x1FFFFFFF)
+    if message:
+        for sig in message.signals:
+            if sig.name == name:
+                return sig
+    return None
+
+
+def guard(path):
+    return re.sub(r"\W", "_", os.path.basename(path)).upper()
+
+
+def literal(value):
+    return "%gf" % value if isinstance(value, float) else "%d.0f" % value
+
+
+# frame payloads, the signals are in w211_signals.h
+
+def struct_header(path, messages, source):
+    out = []
+    out.append("// generated by tools/dbc2c.py from %s, do not edit" % source)
+    out.append("#ifndef %s" % guard(path))
+    out.append("#define %s" % guard(path))
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("// frame payloads, read the signals with the extractors of w211_signals.h")
+    for msg in messages:
+        out.append("")
+        out.append("// ECU: %s, NAME: %s, ID: 0x%04X, signals: w211::%s" % (msg.sender, msg.name, msg.id, msg.name))
+        out.append("struct %s_t {" % msg.name)
+        out.append("  uint8_t data[%d];" % msg.size)
+        out.append("};")
+    out.append("")
+    out.append("")
+    out.append("#endif /* %s */" % guard(path))
+    return "\n".join(out) + "\n"
+
+
+# constexpr extractors and bulk decoder
+
+def extractor(sig):
+    typ = sig.raw_type()
+    work = "uint64_t" if sig.length > 32 else "uint32_t"
+    terms = []
+    for byte, lsb, width, shift in sig.bits():
+        term = "d[%d]" % byte
+        if lsb:
+            term = "(%s >> %d)" % (term, lsb)
+        if width < 8:
+            term = "(%s & 0x%X)" % (term, (1 << width) - 1)
+        if shift:
+            term = "((%s) %s << %d)" % (work, term, shift)
+        terms.append(term)
+    expr = " | ".join(terms)
+    if typ == "bool":
+        return "%s != 0" % expr
+    if sig.signed:
+        # sign extend from length bits
+        return "(%s) ((%s) ((%s) (%s) << %d) >> %d)" % (typ, typ.replace("u", ""), work, expr,
+                                                          int(work[4:6]) - sig.length, int(work[4:6]) - sig.length)
+    return "(%s) (%s)" % (typ, expr) if len(terms) > 1 else expr
+
+
+def setter(sig):
+    work = "uint64_t" if sig.length > 32 else "uint32_t"
+    lines = []
+    for byte, lsb, width, shift in sig.bits():
+        mask = ((1 << width) - 1) << lsb
+        value = "(%s) v" % work
+        if shift:
+            value = "(%s >> %d)" % (value, shift)
+        lines.append("d[%d] = (uint8_t) ((d[%d] & 0x%02X) | (%s & 0x%X) << %d);" % (
+            byte, byte, ~mask & 0xFF, value, (1 << width) - 1, lsb))
+    return " ".join(lines)
+
+
+def signals_header(path, buses, sources):
+    out = []
+    out.append("// generated by tools/dbc2c.py from %s, do not edit" % ", ".join(sources))
+    out.append("#ifndef %s" % guard(path))
+    out.append("#define %s" % guard(path))
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("#include <stddef.h>")
+    out.append("")
+    out.append("// W211 CAN signals with explicit shifts: d = frame data, at least DLC bytes,")
+    out.append("// set_NAME() writes the raw value of a signal and leaves the other bits")
+    out.append("namespace w211 {")
+    for bus, messages in enumerate(buses):
+        for msg in messages:
+            out.append("")
+            out.append("// %s, ID 0x%03X, %d bytes, sent by %s" % (msg.name, msg.id, msg.size, msg.sender))
+            out.append("namespace %s {" % msg.name)
+            out.append("  constexpr uint8_t BUS = %d;" % bus)
+            out.append("  constexpr uint32_t ID = 0x%03X;" % msg.id)
+            out.append("  constexpr uint8_t DLC = %d;" % msg.size)
+            out.append("  constexpr const char* NAME = \"%s\";" % msg.name)
+            for sig in msg.signals:
+                out.append("")
+                items = sig.enum_items()
+                if items:
+                    out.append("  enum class %s_e : %s {" % (sig.name, "uint8_t" if sig.length <= 8 else sig.raw_type()))
+                    for ident, value, desc in items:
+                        out.append("    %s = %d,%s" % (ident, value, " // " + desc if desc else ""))
+                    out.append("  };")
+                out.append("  // %s, MSB offset %d, %d bit%s" % (sig.comment or sig.name, sig.msb_offset(), sig.length,
+                                                              "" if sig.length == 1 else "s"))
+                name = sig.name + "_raw" if sig.scaled() else sig.name
+                out.append("  constexpr %s %s(const uint8_t* d) { return %s; }" % (sig.raw_type(), name, extractor(sig)))
+                if sig.scaled():
+                    out.append("  constexpr float %s(const uint8_t* d) { return %s_raw(d) * %s + %s; }" % (
+                        sig.name, sig.name, literal(sig.factor), literal(sig.offset)))
+                out.append("  inline void set_%s(uint8_t* d, %s v) { %s }" % (sig.name, sig.raw_type(), setter(sig)))
+            out.append("")
+            out.append("  // all signals, scaled")
+            out.append("  struct Values {")
+            for sig in msg.signals:
+                out.append("    %s %s;" % ("float" if sig.scaled() else sig.raw_type(), sig.name))
+            out.append("  };")
+            out.append("  constexpr Values decode(const uint8_t* d) {")
+            out.append("    return Values{ %s };" % ", ".join("%s(d)" % sig.name for sig in msg.signals))
+            out.append("  }")
+            out.append("  constexpr const char* names[] = { %s };" % ", ".join('"%s"' % sig.name for sig in msg.signals))
+            out.append("  constexpr size_t count = %d;" % len(msg.signals))
+            out.append("  inline void values(const Values& v, double* out) {")
+            out.append("    %s" % " ".join("out[%d] = v.%s;" % (i, sig.name) for i, sig in enumerate(msg.signals)))
+            out.append("  }")
+            out.append("  // found by ADL from a generic sink")
+            out.append("  inline const char* messageName(const Values&) { return NAME; }")
+            out.append("  inline const char* const* signals(const Values&) { return names; }")
+            out.append("  inline size_t signalCount(const Values&) { return count; }")
+            out.append("}")
+    out.append("")
+    out.append("")
+    out.append("// X(NAME) per message and per signal, in DBC order, for code that names every field")
+    out.append("#define W211_MESSAGES(X) %s" % " ".join("X(%s)" % msg.name for messages in buses for msg in messages))
+    for messages in buses:
+        for msg in messages:
+            out.append("#define W211_SIGNALS_%s(X) %s" % (msg.name, " ".join("X(%s)" % sig.name for sig in msg.signals)))
+    out.append("")
+    out.append("")
+    out.append("// bulk decoder: frames -> sink.message(frame, values), frames with a short DLC are skipped,")
+    out.append("// a generic sink uses messageName(v), signals(v), signalCount(v) and values(v, out)")
+    out.append("struct Frame {")
+    out.append("  uint32_t time; // us")
+    out.append("  uint8_t bus;")
+    out.append("  uint8_t dlc;")
+    out.append("  uint16_t id;")
+    out.append("  uint8_t data[8];")
+    out.append("};")
+    out.append("")
+    out.append("template <typename Sink>")
+    out.append("size_t decode(const Frame* frames, size_t n, Sink& sink) {")
+    out.append("  size_t decoded = 0;")
+    out.append("  for (size_t i = 0; i < n; i++) {")
+    out.append("    const Frame& f = frames[i];")
+    out.append("    switch ((uint32_t) f.bus << 16 | f.id) {")
+    for bus, messages in enumerate(buses):
+        for msg in messages:
+            out.append("      case %d << 16 | 0x%03X:" % (bus, msg.id))
+            out.append("        if (f.dlc < %s::DLC) break;" % msg.name)
+            out.append("        sink.message(f, %s::decode(f.data));" % msg.name)
+            out.append("        decoded++;")
+            out.append("        break;")
+    out.append("    }")
+    out.append("  }")
+    out.append("  return decoded;")
+    out.append("}")
+    out.append("")
+    out.append("} // namespace w211")
+    out.append("")
+    out.append("#endif /* %s */" % guard(path))
+    return "\n".join(out) + "\n"
+
+
+def write(path, text):
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    sys.stderr.write("%s\n" % os.path.relpath(path))
+
+
+def main():
+    if len(sys.argv) not in (1, 3):
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    sources = sys.argv[1:] or [os.path.join(ROOT, "dbc", "w211_can_c.dbc"), os.path.join(ROOT, "dbc", "w211_can_b.dbc")]
+    names = [os.path.relpath(s, ROOT).replace(os.sep, "/") for s in sources]
+    buses = [parse_dbc(s) for s in sources]
+    for messages, out, name in zip(buses, ("w211_can_c.h", "w211_can_b.h"), names):
+        write(os.path.join(ROOT, out), struct_header(out, messages, name))
+    write(os.path.join(ROOT, "w211_signals.h"), signals_header("w211_signals.h", buses, names))
+
+
+if __name__ == "__main__":
+    main()
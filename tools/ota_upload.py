@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""
+Upload a firmware or LittleFS image to AIRmatic compressed and resumable.
+
+usage: ota_upload.py [-t app|fs] [-c gzip|hs|raw] [--host 192.168.4.1] [--chunk 8192] image.bin
+
+app: AIRmatic.ino.bin (Sketch -> Export Compiled Binary), fs: AIRmatic.littlefs.bin
+
+The image is compressed here and sent in chunks with a CRC-32 each, the ESP32
+decompresses it straight into the OTA or LittleFS partition (see Ota.ino) and
+reboots when the MD5 of the image matches. A chunk that fails is sent again,
+after a dropped connection the upload continues at the last chunk the ESP32
+acknowledged. If this script gave up, run it again with the same image.
+
+  -c gzip  deflate, 32 KB window on the ESP32 (default)
+  -c hs    heatshrink, --window/--lookahead bits (default 11/4, 2 KB window)
+  -c raw   uncompressed
+"""
+
+import argparse
+import gzip
+import hashlib
+import json
+import sys
+import time
+import urllib.error
+import urllib.request
+import zlib
+
+RETRIES = 20
+
+
+def heatshrink(data, window, lookahead):
+    """Heatshrink compatible LZSS, greedy matching over 3 byte hash chains."""
+    out = bytearray()
+    acc = 0
+    nbits = 0
+
+    def put(value, bits):
+        nonlocal acc, nbits
+        acc = (acc << bits) | value
+        nbits += bits
+        while nbits >= 8:
+            nbits -= 8
+            out.append((acc >> nbits) & 0xFF)
+        acc &= (1 << nbits) - 1
+
+    max_dist = 1 << window
+    max_len = 1 << lookahead
+    min_len = (1 + window + lookahead) // 9 + 1  # shorter matches cost more than literals
+    chains = {}
+    pos = 0
+    n = len(data)
+    while pos < n:
+        best_len = 0
+        best_dist = 0
+        key = data[pos:pos + 3]
+        if len(key) == 3:
+            for cand in reversed(chains.get(key, ())):
+                dist = pos - cand
+                if dist > max_dist:
+                    break
+                length = 3
+                while length < max_len and pos + length < n and data[cand + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_dist = length, dist
+                    if length == max_len:
+                        break
+        step = best_len if best_len >= min_len else 1
+        if step > 1:
+            put(0, 1)
+            put(best_dist - 1, window)
+            put(best_len - 1, lookahead)
+        else:
+            put(0x100 | data[pos], 9)
+        for p in range(pos, pos + step):
+            chain = chains.setdefault(data[p:p + 3], [])
+            chain.append(p)
+            if len(chain) > 32:
+                del chain[0]
+        pos += step
+    if nbits:
+        put(0, 8 - nbits)
+    return bytes(out)
+
+
+def request(url, body=None, timeout=10):
+    req = urllib.request.Request(url, data=body, method="POST" if body is not None else "GET")
+    try:
+        with urllib.request.urlopen(req, timeout=timeout) as resp:
+            return resp.status, json.loads(resp.read() or b"{}")
+    except urllib.error.HTTPError as e:
+        text = e.read()
+        try:
+            return e.code, json.loads(text)
+        except ValueError:
+            return e.code, {"error": text.decode(errors="replace")}
+
+
+def upload(args):
+    image = open(args.image, "rb").read()
+    md5 = hashlib.md5(image).hexdigest()
+    query = "target=%s&codec=%s&image=%d&md5=%s" % (args.target, args.codec, len(image), md5)
+    start = time.time()
+    if args.codec == "gzip":
+        data = gzip.compress(image, 9, mtime=0)
+    elif args.codec == "hs":
+        data = heatshrink(image, args.window, args.lookahead)
+        query += "&window=%d&lookahead=%d" % (args.window, args.lookahead)
+    else:
+        data = image
+    query += "&size=%d" % len(data)
+    print("%s: %d bytes, %s %d bytes (%.0f%%) in %.1f s" % (args.image, len(image), args.codec,
+          len(data), 100.0 * len(data) / len(image), time.time() - start))
+
+    base = "http://%s/image" % args.host
+    start = time.time()
+    offset = None
+    failures = 0
+    while True:
+        try:
+            if offset is None:
+                status, reply = request(base + "/begin?" + query, b"")
+                if status != 200:
+                    sys.exit("begin failed: %d %s" % (status, reply.get("error", reply)))
+                offset = reply["offset"]
+                if offset:
+                    print("resuming at %d" % offset)
+            if offset >= len(data):
+                break
+            chunk = data[offset:offset + args.chunk]
+            status, reply = request("%s/chunk?offset=%d&crc=%08x" % (base, offset, zlib.crc32(chunk)), chunk)
+        except (urllib.error.URLError, OSError) as e:
+            failures += 1
+            if failures > RETRIES:
+                sys.exit("giving up: %s, run again to resume" % e)
+            print("connection lost (%s), retrying" % e)
+            time.sleep(2)
+            offset = None  # ask where the ESP32 stopped
+            continue
+        if status == 200:
+            failures = 0
+            offset = reply["offset"]
+            rate = offset / max(time.time() - start, 1e-3) / 1024
+            print("\r%d / %d bytes, %d written, %.1f kB/s " % (offset, len(data), reply["written"], rate), end="")
+            sys.stdout.flush()
+        elif status in (400, 409) and reply.get("active"):
+            failures += 1  # bad chunk or offset: continue where the ESP32 is
+            offset = reply["offset"]
+        else:
+            sys.exit("\nupload failed: %d %s" % (status, reply.get("error", reply)))
+    print("\ndone in %.1f s, rebooting" % (time.time() - start))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image")
+    parser.add_argument("-t", "--target", choices=("app", "fs"), default="app")
+    parser.add_argument("-c", "--codec", choices=("gzip", "hs", "raw"), default="gzip")
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--chunk", type=int, default=8192, help="bytes per request, at most 8192")
+    parser.add_argument("--window", type=int, default=11)
+    parser.add_argument("--lookahead", type=int, default=4)
+    args = parser.parse_args()
+    if not 0 < args.chunk <= 8192:
+        parser.error("chunk must be 1..8192")
+    upload(args)
+
+
+if __name__ == "__main__":
+    main()
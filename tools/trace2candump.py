@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Convert an AIRmatic CAN trace (/trace.bin, see Trace.ino) to candump log format.
+
+usage: trace2candump.py trace.bin [> trace.log]
+
+can0 = Motor CAN-C, can1 = Interior CAN-B, timestamps are seconds since ESP32 boot
+(wrapping after 71 minutes).
+"""
+
+import struct
+import sys
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def convert(data, out):
+    if data[:4] != b"AMTR":
+        raise ValueError("not an AIRmatic trace file")
+    version, count = data[4], data[5]
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+    (time,) = struct.unpack_from("<I", data, 8)
+    pos = 12
+    messages = []
+    for _ in range(count):
+        bus, _, can_id = struct.unpack_from("<BBH", data, pos)
+        messages.append((bus, can_id))
+        pos += 4
+
+    records = 0
+    while pos < len(data):
+        try:
+            delta, pos = read_varint(data, pos)
+            index, dlc = data[pos], data[pos + 1] & 0x0F
+        except IndexError:
+            break  # truncated tail
+        pos += 2
+        payload = data[pos:pos + dlc]
+        pos += dlc
+        if len(payload) < dlc:
+            break
+        time = (time + delta) & 0xFFFFFFFF
+        if index >= len(messages):
+            continue
+        bus, can_id = messages[index]
+        out.write("(%d.%06d) can%d %03X#%s\n" % (time // 1000000, time % 1000000, bus, can_id, payload.hex().upper()))
+        records += 1
+    return records
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    records = convert(data, sys.stdout)
+    sys.stderr.write("%d records\n" % records)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,641 @@
+// generated by tools/dbc2c.py from dbc/w211_can_c.dbc, dbc/w211_can_b.dbc, do not edit
+#ifndef W211_SIGNALS_H
+#define W211_SIGNALS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// W211 CAN signals with explicit shifts: d = frame data, at least DLC bytes,
+// set_NAME() writes the raw value of a signal and leaves the other bits
+namespace w211 {
+
+// EZS_240h, ID 0x240, 8 bytes, sent by EZS
+namespace EZS_240h {
+  constexpr uint8_t BUS = 0;
+  constexpr uint32_t ID = 0x240;
+  constexpr uint8_t DLC = 8;
+  constexpr const char* NAME = "EZS_240h";
+
+  // Terminal 50, MSB offset 15, 1 bit
+  constexpr bool KL_50(const uint8_t* d) { return (d[1] & 0x1) != 0; }
+  inline void set_KL_50(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Terminal 15, MSB offset 14, 1 bit
+  constexpr bool KL_15(const uint8_t* d) { return ((d[1] >> 1) & 0x1) != 0; }
+  inline void set_KL_15(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // Brake switch for shift lock, MSB offset 13, 1 bit
+  constexpr bool BS_SL(const uint8_t* d) { return ((d[1] >> 2) & 0x1) != 0; }
+  inline void set_BS_SL(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // reverse gear engaged (manual gearbox only), MSB offset 12, 1 bit
+  constexpr bool RG_SCHALT(const uint8_t* d) { return ((d[1] >> 3) & 0x1) != 0; }
+  inline void set_RG_SCHALT(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  enum class LL_RLC_e : uint8_t {
+    NDEF = 0, // Undefined
+    LL = 1, // Left hand drive
+    RL = 2, // Right hand drive
+    SNV = 3, // Signal not available
+  };
+  // Left Hand Drive/Right Hand Drive, MSB offset 10, 2 bits
+  constexpr uint8_t LL_RLC(const uint8_t* d) { return ((d[1] >> 4) & 0x3); }
+  inline void set_LL_RLC(uint8_t* d, uint8_t v) { d[1] = (uint8_t) ((d[1] & 0xCF) | ((uint32_t) v & 0x3) << 4); }
+
+  // Keyles Go occasion requirements met, MSB offset 9, 1 bit
+  constexpr bool KG_ALB_OK(const uint8_t* d) { return ((d[1] >> 6) & 0x1) != 0; }
+  inline void set_KG_ALB_OK(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // Keyless Go terminal control active, MSB offset 8, 1 bit
+  constexpr bool KG_KL_AKT(const uint8_t* d) { return ((d[1] >> 7) & 0x1) != 0; }
+  inline void set_KG_KL_AKT(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // Crash signal from airbag SG, MSB offset 31, 1 bit
+  constexpr bool CRASH(const uint8_t* d) { return (d[3] & 0x1) != 0; }
+  inline void set_CRASH(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // CRASH confirm bit, MSB offset 30, 1 bit
+  constexpr bool CRASH_CNF(const uint8_t* d) { return ((d[3] >> 1) & 0x1) != 0; }
+  inline void set_CRASH_CNF(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // SAM/x: EHB-ASG in fallback level, x = B (230), V (211,164,251), F (240), MSB offset 29, 1 bit
+  constexpr bool INF_RFE_SAM(const uint8_t* d) { return ((d[3] >> 2) & 0x1) != 0; }
+  inline void set_INF_RFE_SAM(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // SAM/x: v-signal from EHB-ASG, x = B (230), V (211), F ( 240), MSB offset 28, 1 bit
+  constexpr bool VSTAT_A(const uint8_t* d) { return ((d[3] >> 3) & 0x1) != 0; }
+  inline void set_VSTAT_A(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // ASG sport mode on/off actuated (ST2_LED_DL if ABC available), MSB offset 27, 1 bit
+  constexpr bool ASG_SPORT_BET(const uint8_t* d) { return ((d[3] >> 4) & 0x1) != 0; }
+  inline void set_ASG_SPORT_BET(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  // Vehicle electrical system warning: starter battery state of charge, MSB offset 26, 1 bit
+  constexpr bool BN_SOCS(const uint8_t* d) { return ((d[3] >> 5) & 0x1) != 0; }
+  inline void set_BN_SOCS(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // SAM/x: brake light switch output EHB-ASG, x = B (230), V (211), F (240), MSB offset 25, 1 bit
+  constexpr bool BLS_A(const uint8_t* d) { return ((d[3] >> 6) & 0x1) != 0; }
+  inline void set_BLS_A(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // SAM/x passive, x = Bb (230), V (211), F (240), MSB offset 24, 1 bit
+  constexpr bool SAM_PAS(const uint8_t* d) { return ((d[3] >> 7) & 0x1) != 0; }
+  inline void set_SAM_PAS(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // Turn signal left, MSB offset 39, 1 bit
+  constexpr bool BLI_LI(const uint8_t* d) { return (d[4] & 0x1) != 0; }
+  inline void set_BLI_LI(uint8_t* d, bool v) { d[4] = (uint8_t) ((d[4] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Turn signal right, MSB offset 38, 1 bit
+  constexpr bool BLI_RE(const uint8_t* d) { return ((d[4] >> 1) & 0x1) != 0; }
+  inline void set_BLI_RE(uint8_t* d, bool v) { d[4] = (uint8_t) ((d[4] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // Wiper out of park position, MSB offset 36, 1 bit
+  constexpr bool KL_31B(const uint8_t* d) { return ((d[4] >> 3) & 0x1) != 0; }
+  inline void set_KL_31B(uint8_t* d, bool v) { d[4] = (uint8_t) ((d[4] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // Handbrake applied (indicator lamp), MSB offset 35, 1 bit
+  constexpr bool HAS_KL(const uint8_t* d) { return ((d[4] >> 4) & 0x1) != 0; }
+  inline void set_HAS_KL(uint8_t* d, bool v) { d[4] = (uint8_t) ((d[4] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  enum class ESP_BET_e : uint8_t {
+    NBET = 0, // Not operated (rocker and push push)
+    AUS_BET = 1, // ESP off actuated (rocker), actuated (push push)
+    EIN_NDEF = 2, // ESP on actuated (rocker), not defined (push push)
+    SNV = 3, // No signal (rocker and push push)
+  };
+  // ESP on/off actuated, MSB offset 33, 2 bits
+  constexpr uint8_t ESP_BET(const uint8_t* d) { return ((d[4] >> 5) & 0x3); }
+  inline void set_ESP_BET(uint8_t* d, uint8_t v) { d[4] = (uint8_t) ((d[4] & 0x9F) | ((uint32_t) v & 0x3) << 5); }
+
+  // Vehicle power supply emergency mode: Prio1 and Prio2 consumers off, second battery supports, MSB offset 32, 1 bit
+  constexpr bool BN_NTLF(const uint8_t* d) { return ((d[4] >> 7) & 0x1) != 0; }
+  inline void set_BN_NTLF(uint8_t* d, bool v) { d[4] = (uint8_t) ((d[4] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // Terminal 54 hardware active, MSB offset 47, 1 bit
+  constexpr bool KL54_RM(const uint8_t* d) { return (d[5] & 0x1) != 0; }
+  inline void set_KL54_RM(uint8_t* d, bool v) { d[5] = (uint8_t) ((d[5] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Turn on low beam, MSB offset 46, 1 bit
+  constexpr bool ABL_EIN(const uint8_t* d) { return ((d[5] >> 1) & 0x1) != 0; }
+  inline void set_ABL_EIN(uint8_t* d, bool v) { d[5] = (uint8_t) ((d[5] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  enum class ART_ABW_BET_e : uint8_t {
+    NDEF_NBET = 0, // not defined (rocker), not actuated (push push)
+    AUS_NDEF = 1, // distance warning off (rocker), not defined (push push)
+    EIN_BET = 2, // Distance warning on (rocker), actuated (push push)
+    SNV = 3, // No signal (rocker and push push)
+  };
+  // ART distance warning on/off actuated, MSB offset 44, 2 bits
+  constexpr uint8_t ART_ABW_BET(const uint8_t* d) { return ((d[5] >> 2) & 0x3); }
+  inline void set_ART_ABW_BET(uint8_t* d, uint8_t v) { d[5] = (uint8_t) ((d[5] & 0xF3) | ((uint32_t) v & 0x3) << 2); }
+
+  enum class ST3_BET_e : uint8_t {
+    NBET = 0, // Not operated (rocker and push push)
+    UNBET_NDEF = 1, // Bottom Actuated (Rocker), Undefined (Push Push)
+    OBBET_BET = 2, // Top Actuated (Rocker), Actuated (Push Push)
+    NDEF = 3, // Undefined
+  };
+  // LF/ABC 3-position switch operated, MSB offset 42, 2 bits
+  constexpr uint8_t ST3_BET(const uint8_t* d) { return ((d[5] >> 4) & 0x3); }
+  inline void set_ST3_BET(uint8_t* d, uint8_t v) { d[5] = (uint8_t) ((d[5] & 0xCF) | ((uint32_t) v & 0x3) << 4); }
+
+  enum class ST2_BET_e : uint8_t {
+    NBET = 0, // Not operated (rocker and push push)
+    UNBET_NDEF = 1, // Bottom Actuated (Rocker), Undefined (Push Push)
+    OBBET_BET = 2, // Top Actuated (Rocker), Actuated (Push Push)
+    NDEF = 3, // Undefined
+  };
+  // LF/ABC 2-position switch actuated, MSB offset 40, 2 bits
+  constexpr uint8_t ST2_BET(const uint8_t* d) { return ((d[5] >> 6) & 0x3); }
+  inline void set_ST2_BET(uint8_t* d, uint8_t v) { d[5] = (uint8_t) ((d[5] & 0x3F) | ((uint32_t) v & 0x3) << 6); }
+
+  // distance factor, MSB offset 48, 8 bits
+  constexpr uint8_t ART_ABSTAND(const uint8_t* d) { return d[6]; }
+  inline void set_ART_ABSTAND(uint8_t* d, uint8_t v) { d[6] = (uint8_t) ((d[6] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  enum class LDC_e : uint8_t {
+    RDW = 0, // Rest of the world
+    USA_CAN = 1, // USA/Canada
+    NDEF = 2, // Undefined
+    SNV = 3, // Signal not available
+  };
+  // country code, MSB offset 62, 2 bits
+  constexpr uint8_t LDC(const uint8_t* d) { return (d[7] & 0x3); }
+  inline void set_LDC(uint8_t* d, uint8_t v) { d[7] = (uint8_t) ((d[7] & 0xFC) | ((uint32_t) v & 0x3) << 0); }
+
+  enum class FZGVERSN_e : uint8_t {
+    START = 0, // Status at market launch of the respective series
+    V1 = 1, // BR 220: AJ 99/X, C215: AJ 01/1, R230: AJ 02/1
+    V2 = 2, // BR 220: AJ 01/1, C215: AJ 02/X, R230: AJ 03/X
+    V3 = 3, // BR 220: ÄJ 02/X, C215: ÄJ 03/X, R230: not defined
+    V4 = 4, // BR 220: prohibited, C215/R230: not defined
+    V5 = 5, // BR 220: prohibited, C215/R230: not defined
+    V6 = 6, // BR 220: ÄJ 03/X, C215,/R230: not defined
+    V7 = 7, // BR 220/ C215,/R230: not defined
+  };
+  // Series-dependent vehicle version (only 220/215/230), MSB offset 59, 3 bits
+  constexpr uint8_t FZGVERSN(const uint8_t* d) { return ((d[7] >> 2) & 0x7); }
+  inline void set_FZGVERSN(uint8_t* d, uint8_t v) { d[7] = (uint8_t) ((d[7] & 0xE3) | ((uint32_t) v & 0x7) << 2); }
+
+  // E-suction fan: Basic ventilation off, MSB offset 57, 1 bit
+  constexpr bool GBL_AUS(const uint8_t* d) { return ((d[7] >> 6) & 0x1) != 0; }
+  inline void set_GBL_AUS(uint8_t* d, bool v) { d[7] = (uint8_t) ((d[7] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // ART available, MSB offset 56, 1 bit
+  constexpr bool ART_VH(const uint8_t* d) { return ((d[7] >> 7) & 0x1) != 0; }
+  inline void set_ART_VH(uint8_t* d, bool v) { d[7] = (uint8_t) ((d[7] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // all signals, scaled
+  struct Values {
+    bool KL_50;
+    bool KL_15;
+    bool BS_SL;
+    bool RG_SCHALT;
+    uint8_t LL_RLC;
+    bool KG_ALB_OK;
+    bool KG_KL_AKT;
+    bool CRASH;
+    bool CRASH_CNF;
+    bool INF_RFE_SAM;
+    bool VSTAT_A;
+    bool ASG_SPORT_BET;
+    bool BN_SOCS;
+    bool BLS_A;
+    bool SAM_PAS;
+    bool BLI_LI;
+    bool BLI_RE;
+    bool KL_31B;
+    bool HAS_KL;
+    uint8_t ESP_BET;
+    bool BN_NTLF;
+    bool KL54_RM;
+    bool ABL_EIN;
+    uint8_t ART_ABW_BET;
+    uint8_t ST3_BET;
+    uint8_t ST2_BET;
+    uint8_t ART_ABSTAND;
+    uint8_t LDC;
+    uint8_t FZGVERSN;
+    bool GBL_AUS;
+    bool ART_VH;
+  };
+  constexpr Values decode(const uint8_t* d) {
+    return Values{ KL_50(d), KL_15(d), BS_SL(d), RG_SCHALT(d), LL_RLC(d), KG_ALB_OK(d), KG_KL_AKT(d), CRASH(d), CRASH_CNF(d), INF_RFE_SAM(d), VSTAT_A(d), ASG_SPORT_BET(d), BN_SOCS(d), BLS_A(d), SAM_PAS(d), BLI_LI(d), BLI_RE(d), KL_31B(d), HAS_KL(d), ESP_BET(d), BN_NTLF(d), KL54_RM(d), ABL_EIN(d), ART_ABW_BET(d), ST3_BET(d), ST2_BET(d), ART_ABSTAND(d), LDC(d), FZGVERSN(d), GBL_AUS(d), ART_VH(d) };
+  }
+  constexpr const char* names[] = { "KL_50", "KL_15", "BS_SL", "RG_SCHALT", "LL_RLC", "KG_ALB_OK", "KG_KL_AKT", "CRASH", "CRASH_CNF", "INF_RFE_SAM", "VSTAT_A", "ASG_SPORT_BET", "BN_SOCS", "BLS_A", "SAM_PAS", "BLI_LI", "BLI_RE", "KL_31B", "HAS_KL", "ESP_BET", "BN_NTLF", "KL54_RM", "ABL_EIN", "ART_ABW_BET", "ST3_BET", "ST2_BET", "ART_ABSTAND", "LDC", "FZGVERSN", "GBL_AUS", "ART_VH" };
+  constexpr size_t count = 31;
+  inline void values(const Values& v, double* out) {
+    out[0] = v.KL_50; out[1] = v.KL_15; out[2] = v.BS_SL; out[3] = v.RG_SCHALT; out[4] = v.LL_RLC; out[5] = v.KG_ALB_OK; out[6] = v.KG_KL_AKT; out[7] = v.CRASH; out[8] = v.CRASH_CNF; out[9] = v.INF_RFE_SAM; out[10] = v.VSTAT_A; out[11] = v.ASG_SPORT_BET; out[12] = v.BN_SOCS; out[13] = v.BLS_A; out[14] = v.SAM_PAS; out[15] = v.BLI_LI; out[16] = v.BLI_RE; out[17] = v.KL_31B; out[18] = v.HAS_KL; out[19] = v.ESP_BET; out[20] = v.BN_NTLF; out[21] = v.KL54_RM; out[22] = v.ABL_EIN; out[23] = v.ART_ABW_BET; out[24] = v.ST3_BET; out[25] = v.ST2_BET; out[26] = v.ART_ABSTAND; out[27] = v.LDC; out[28] = v.FZGVERSN; out[29] = v.GBL_AUS; out[30] = v.ART_VH;
+  }
+  // found by ADL from a generic sink
+  inline const char* messageName(const Values&) { return NAME; }
+  inline const char* const* signals(const Values&) { return names; }
+  inline size_t signalCount(const Values&) { return count; }
+}
+
+// FS_340h, ID 0x340, 8 bytes, sent by LF_ABC
+namespace FS_340h {
+  constexpr uint8_t BUS = 0;
+  constexpr uint32_t ID = 0x340;
+  constexpr uint8_t DLC = 8;
+  constexpr const char* NAME = "FS_340h";
+
+  // Error 1: "Stop car too low", MSB offset 7, 1 bit
+  constexpr bool FM1(const uint8_t* d) { return (d[0] & 0x1) != 0; }
+  inline void set_FM1(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Error 2: "wait a moment" (LF)/ "steering oil" (only ABC), MSB offset 6, 1 bit
+  constexpr bool FM2(const uint8_t* d) { return ((d[0] >> 1) & 0x1) != 0; }
+  inline void set_FM2(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // Error 3: "Visit workshop", MSB offset 5, 1 bit
+  constexpr bool FM3(const uint8_t* d) { return ((d[0] >> 2) & 0x1) != 0; }
+  inline void set_FM3(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // Error 4: "Park vehicle", MSB offset 4, 1 bit
+  constexpr bool FM4(const uint8_t* d) { return ((d[0] >> 3) & 0x1) != 0; }
+  inline void set_FM4(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // Message 1: "Vehicle lifts", BR164/251: "Highway->Offroad", BR164 Offroad: "Highway->Offroad1", MSB offset 3, 1 bit
+  constexpr bool M1(const uint8_t* d) { return ((d[0] >> 4) & 0x1) != 0; }
+  inline void set_M1(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  // Message 2: "Level selection deleted", MSB offset 2, 1 bit
+  constexpr bool M2(const uint8_t* d) { return ((d[0] >> 5) & 0x1) != 0; }
+  inline void set_M2(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // Level calibration performed, MSB offset 1, 1 bit
+  constexpr bool NEDG(const uint8_t* d) { return ((d[0] >> 6) & 0x1) != 0; }
+  inline void set_NEDG(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // Left LED 3-position switch steady light (164/251 lower LED), MSB offset 15, 1 bit
+  constexpr bool ST3_LEDL_DL(const uint8_t* d) { return (d[1] & 0x1) != 0; }
+  inline void set_ST3_LEDL_DL(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Right LED 3-position switch steady light (164/251 top LED), MSB offset 13, 1 bit
+  constexpr bool ST3_LEDR_DL(const uint8_t* d) { return ((d[1] >> 2) & 0x1) != 0; }
+  inline void set_ST3_LEDR_DL(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // LED 2-stage switch steady light, MSB offset 11, 1 bit
+  constexpr bool ST2_LED_DL(const uint8_t* d) { return ((d[1] >> 4) & 0x1) != 0; }
+  inline void set_ST2_LED_DL(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  enum class BELAD_e : uint8_t {
+    LEER = 0, // Unloaded
+    HALB = 1, // Half loaded
+    VOLL = 2, // Fully loaded
+    SNV = 3, // Load not recognized
+  };
+  // loading, MSB offset 9, 2 bits
+  constexpr uint8_t BELAD(const uint8_t* d) { return ((d[1] >> 5) & 0x3); }
+  inline void set_BELAD(uint8_t* d, uint8_t v) { d[1] = (uint8_t) ((d[1] & 0x9F) | ((uint32_t) v & 0x3) << 5); }
+
+  // Vehicle level, front left, MSB offset 16, 8 bits
+  constexpr uint8_t FZGN_VL(const uint8_t* d) { return d[2]; }
+  inline void set_FZGN_VL(uint8_t* d, uint8_t v) { d[2] = (uint8_t) ((d[2] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  // Vehicle level, front right, MSB offset 24, 8 bits
+  constexpr uint8_t FZGN_VR(const uint8_t* d) { return d[3]; }
+  inline void set_FZGN_VR(uint8_t* d, uint8_t v) { d[3] = (uint8_t) ((d[3] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  // Rear left vehicle level, MSB offset 32, 8 bits
+  constexpr uint8_t FZGN_HL(const uint8_t* d) { return d[4]; }
+  inline void set_FZGN_HL(uint8_t* d, uint8_t v) { d[4] = (uint8_t) ((d[4] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  // Vehicle level, rear right, MSB offset 40, 8 bits
+  constexpr uint8_t FZGN_HR(const uint8_t* d) { return d[5]; }
+  inline void set_FZGN_HR(uint8_t* d, uint8_t v) { d[5] = (uint8_t) ((d[5] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  enum class FS_ID_e : uint8_t {
+    LF = 0, // Air suspension/ LF (BR164/251 NR without ADS)
+    SLF = 1, // Semi-active air suspension, SLF (BR164/251 NR+ADS)
+    EHNR = 2, // Electronic rear axle level control
+    ABC = 3, // Active Body Control 1
+  };
+  // Suspension control identification, MSB offset 56, 3 bits
+  constexpr uint8_t FS_ID(const uint8_t* d) { return ((d[7] >> 5) & 0x7); }
+  inline void set_FS_ID(uint8_t* d, uint8_t v) { d[7] = (uint8_t) ((d[7] & 0x1F) | ((uint32_t) v & 0x7) << 5); }
+
+  // all signals, scaled
+  struct Values {
+    bool FM1;
+    bool FM2;
+    bool FM3;
+    bool FM4;
+    bool M1;
+    bool M2;
+    bool NEDG;
+    bool ST3_LEDL_DL;
+    bool ST3_LEDR_DL;
+    bool ST2_LED_DL;
+    uint8_t BELAD;
+    uint8_t FZGN_VL;
+    uint8_t FZGN_VR;
+    uint8_t FZGN_HL;
+    uint8_t FZGN_HR;
+    uint8_t FS_ID;
+  };
+  constexpr Values decode(const uint8_t* d) {
+    return Values{ FM1(d), FM2(d), FM3(d), FM4(d), M1(d), M2(d), NEDG(d), ST3_LEDL_DL(d), ST3_LEDR_DL(d), ST2_LED_DL(d), BELAD(d), FZGN_VL(d), FZGN_VR(d), FZGN_HL(d), FZGN_HR(d), FS_ID(d) };
+  }
+  constexpr const char* names[] = { "FM1", "FM2", "FM3", "FM4", "M1", "M2", "NEDG", "ST3_LEDL_DL", "ST3_LEDR_DL", "ST2_LED_DL", "BELAD", "FZGN_VL", "FZGN_VR", "FZGN_HL", "FZGN_HR", "FS_ID" };
+  constexpr size_t count = 16;
+  inline void values(const Values& v, double* out) {
+    out[0] = v.FM1; out[1] = v.FM2; out[2] = v.FM3; out[3] = v.FM4; out[4] = v.M1; out[5] = v.M2; out[6] = v.NEDG; out[7] = v.ST3_LEDL_DL; out[8] = v.ST3_LEDR_DL; out[9] = v.ST2_LED_DL; out[10] = v.BELAD; out[11] = v.FZGN_VL; out[12] = v.FZGN_VR; out[13] = v.FZGN_HL; out[14] = v.FZGN_HR; out[15] = v.FS_ID;
+  }
+  // found by ADL from a generic sink
+  inline const char* messageName(const Values&) { return NAME; }
+  inline const char* const* signals(const Values&) { return names; }
+  inline size_t signalCount(const Values&) { return count; }
+}
+
+// KOMBI_A5, ID 0x1CA, 4 bytes, sent by KOMBI
+namespace KOMBI_A5 {
+  constexpr uint8_t BUS = 1;
+  constexpr uint32_t ID = 0x1CA;
+  constexpr uint8_t DLC = 4;
+  constexpr const char* NAME = "KOMBI_A5";
+
+  enum class KI_STAT_e : uint8_t {
+    Neutral = 2,
+    AUDIO = 3, // Audio
+    NAVI = 4, // Navigation
+    TEL = 5, // Telefon
+    NEU_SER = 6, // Neue Services
+    SPR_FNK_DLG_CLO = 19, // Sprachfunk-KI Dlg geschl
+    DAT_FNK_DLG_CLO = 20, // Datenfunk-KI Dlg geschl
+    SPR_FNK_DLG_OPN = 21, // Sprachfunk-KI Dlg geöffnet
+    DAT_FNK_DLG_OPN = 22, // Datenfunk-KI Dlg geöffnet
+    SNV = 255, // Signal nicht vorhanden
+  };
+  // Status Kombi, MSB offset 0, 8 bits
+  constexpr uint8_t KI_STAT(const uint8_t* d) { return d[0]; }
+  inline void set_KI_STAT(uint8_t* d, uint8_t v) { d[0] = (uint8_t) ((d[0] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  // Nächstes Display, MSB offset 15, 1 bit
+  constexpr bool BUTTON_1_1(const uint8_t* d) { return (d[1] & 0x1) != 0; }
+  inline void set_BUTTON_1_1(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Vorheriges Display, MSB offset 14, 1 bit
+  constexpr bool BUTTON_1_2(const uint8_t* d) { return ((d[1] >> 1) & 0x1) != 0; }
+  inline void set_BUTTON_1_2(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // Reserve, MSB offset 13, 1 bit
+  constexpr bool BUTTON_2_1(const uint8_t* d) { return ((d[1] >> 2) & 0x1) != 0; }
+  inline void set_BUTTON_2_1(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // Reserve, MSB offset 12, 1 bit
+  constexpr bool BUTTON_2_2(const uint8_t* d) { return ((d[1] >> 3) & 0x1) != 0; }
+  inline void set_BUTTON_2_2(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // Taste "+", MSB offset 11, 1 bit
+  constexpr bool BUTTON_3_1(const uint8_t* d) { return ((d[1] >> 4) & 0x1) != 0; }
+  inline void set_BUTTON_3_1(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  // Taste "-", MSB offset 10, 1 bit
+  constexpr bool BUTTON_3_2(const uint8_t* d) { return ((d[1] >> 5) & 0x1) != 0; }
+  inline void set_BUTTON_3_2(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // Telefon Send, MSB offset 9, 1 bit
+  constexpr bool BUTTON_4_1(const uint8_t* d) { return ((d[1] >> 6) & 0x1) != 0; }
+  inline void set_BUTTON_4_1(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // Telefon End, MSB offset 8, 1 bit
+  constexpr bool BUTTON_4_2(const uint8_t* d) { return ((d[1] >> 7) & 0x1) != 0; }
+  inline void set_BUTTON_4_2(uint8_t* d, bool v) { d[1] = (uint8_t) ((d[1] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // Reserve, MSB offset 23, 1 bit
+  constexpr bool BUTTON_5_1(const uint8_t* d) { return (d[2] & 0x1) != 0; }
+  inline void set_BUTTON_5_1(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Reserve, MSB offset 22, 1 bit
+  constexpr bool BUTTON_5_2(const uint8_t* d) { return ((d[2] >> 1) & 0x1) != 0; }
+  inline void set_BUTTON_5_2(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // Reserve, MSB offset 21, 1 bit
+  constexpr bool BUTTON_6_1(const uint8_t* d) { return ((d[2] >> 2) & 0x1) != 0; }
+  inline void set_BUTTON_6_1(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // Reserve, MSB offset 20, 1 bit
+  constexpr bool BUTTON_6_2(const uint8_t* d) { return ((d[2] >> 3) & 0x1) != 0; }
+  inline void set_BUTTON_6_2(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // Reserve, MSB offset 19, 1 bit
+  constexpr bool BUTTON_7_1(const uint8_t* d) { return ((d[2] >> 4) & 0x1) != 0; }
+  inline void set_BUTTON_7_1(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  // Reserve, MSB offset 18, 1 bit
+  constexpr bool BUTTON_7_2(const uint8_t* d) { return ((d[2] >> 5) & 0x1) != 0; }
+  inline void set_BUTTON_7_2(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // Reserve, MSB offset 17, 1 bit
+  constexpr bool BUTTON_8_1(const uint8_t* d) { return ((d[2] >> 6) & 0x1) != 0; }
+  inline void set_BUTTON_8_1(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // Reserve, MSB offset 16, 1 bit
+  constexpr bool BUTTON_8_2(const uint8_t* d) { return ((d[2] >> 7) & 0x1) != 0; }
+  inline void set_BUTTON_8_2(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // Linguatronic aktivieren, MSB offset 31, 1 bit
+  constexpr bool PTT_1_1(const uint8_t* d) { return (d[3] & 0x1) != 0; }
+  inline void set_PTT_1_1(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  // Linguatronic deaktivieren, MSB offset 30, 1 bit
+  constexpr bool PTT_1_2(const uint8_t* d) { return ((d[3] >> 1) & 0x1) != 0; }
+  inline void set_PTT_1_2(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // Reserve, MSB offset 29, 1 bit
+  constexpr bool PTT_2_1(const uint8_t* d) { return ((d[3] >> 2) & 0x1) != 0; }
+  inline void set_PTT_2_1(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xFB) | ((uint32_t) v & 0x1) << 2); }
+
+  // Reserve, MSB offset 28, 1 bit
+  constexpr bool PTT_2_2(const uint8_t* d) { return ((d[3] >> 3) & 0x1) != 0; }
+  inline void set_PTT_2_2(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // Reserve, MSB offset 27, 1 bit
+  constexpr bool PTT_3_1(const uint8_t* d) { return ((d[3] >> 4) & 0x1) != 0; }
+  inline void set_PTT_3_1(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xEF) | ((uint32_t) v & 0x1) << 4); }
+
+  // Reserve, MSB offset 26, 1 bit
+  constexpr bool PTT_3_2(const uint8_t* d) { return ((d[3] >> 5) & 0x1) != 0; }
+  inline void set_PTT_3_2(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // Reserve, MSB offset 25, 1 bit
+  constexpr bool PTT_4_1(const uint8_t* d) { return ((d[3] >> 6) & 0x1) != 0; }
+  inline void set_PTT_4_1(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xBF) | ((uint32_t) v & 0x1) << 6); }
+
+  // Reserve, MSB offset 24, 1 bit
+  constexpr bool PTT_4_2(const uint8_t* d) { return ((d[3] >> 7) & 0x1) != 0; }
+  inline void set_PTT_4_2(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // all signals, scaled
+  struct Values {
+    uint8_t KI_STAT;
+    bool BUTTON_1_1;
+    bool BUTTON_1_2;
+    bool BUTTON_2_1;
+    bool BUTTON_2_2;
+    bool BUTTON_3_1;
+    bool BUTTON_3_2;
+    bool BUTTON_4_1;
+    bool BUTTON_4_2;
+    bool BUTTON_5_1;
+    bool BUTTON_5_2;
+    bool BUTTON_6_1;
+    bool BUTTON_6_2;
+    bool BUTTON_7_1;
+    bool BUTTON_7_2;
+    bool BUTTON_8_1;
+    bool BUTTON_8_2;
+    bool PTT_1_1;
+    bool PTT_1_2;
+    bool PTT_2_1;
+    bool PTT_2_2;
+    bool PTT_3_1;
+    bool PTT_3_2;
+    bool PTT_4_1;
+    bool PTT_4_2;
+  };
+  constexpr Values decode(const uint8_t* d) {
+    return Values{ KI_STAT(d), BUTTON_1_1(d), BUTTON_1_2(d), BUTTON_2_1(d), BUTTON_2_2(d), BUTTON_3_1(d), BUTTON_3_2(d), BUTTON_4_1(d), BUTTON_4_2(d), BUTTON_5_1(d), BUTTON_5_2(d), BUTTON_6_1(d), BUTTON_6_2(d), BUTTON_7_1(d), BUTTON_7_2(d), BUTTON_8_1(d), BUTTON_8_2(d), PTT_1_1(d), PTT_1_2(d), PTT_2_1(d), PTT_2_2(d), PTT_3_1(d), PTT_3_2(d), PTT_4_1(d), PTT_4_2(d) };
+  }
+  constexpr const char* names[] = { "KI_STAT", "BUTTON_1_1", "BUTTON_1_2", "BUTTON_2_1", "BUTTON_2_2", "BUTTON_3_1", "BUTTON_3_2", "BUTTON_4_1", "BUTTON_4_2", "BUTTON_5_1", "BUTTON_5_2", "BUTTON_6_1", "BUTTON_6_2", "BUTTON_7_1", "BUTTON_7_2", "BUTTON_8_1", "BUTTON_8_2", "PTT_1_1", "PTT_1_2", "PTT_2_1", "PTT_2_2", "PTT_3_1", "PTT_3_2", "PTT_4_1", "PTT_4_2" };
+  constexpr size_t count = 25;
+  inline void values(const Values& v, double* out) {
+    out[0] = v.KI_STAT; out[1] = v.BUTTON_1_1; out[2] = v.BUTTON_1_2; out[3] = v.BUTTON_2_1; out[4] = v.BUTTON_2_2; out[5] = v.BUTTON_3_1; out[6] = v.BUTTON_3_2; out[7] = v.BUTTON_4_1; out[8] = v.BUTTON_4_2; out[9] = v.BUTTON_5_1; out[10] = v.BUTTON_5_2; out[11] = v.BUTTON_6_1; out[12] = v.BUTTON_6_2; out[13] = v.BUTTON_7_1; out[14] = v.BUTTON_7_2; out[15] = v.BUTTON_8_1; out[16] = v.BUTTON_8_2; out[17] = v.PTT_1_1; out[18] = v.PTT_1_2; out[19] = v.PTT_2_1; out[20] = v.PTT_2_2; out[21] = v.PTT_3_1; out[22] = v.PTT_3_2; out[23] = v.PTT_4_1; out[24] = v.PTT_4_2;
+  }
+  // found by ADL from a generic sink
+  inline const char* messageName(const Values&) { return NAME; }
+  inline const char* const* signals(const Values&) { return names; }
+  inline size_t signalCount(const Values&) { return count; }
+}
+
+// UBF_A1, ID 0x01A, 4 bytes, sent by UBF
+namespace UBF_A1 {
+  constexpr uint8_t BUS = 1;
+  constexpr uint32_t ID = 0x01A;
+  constexpr uint8_t DLC = 4;
+  constexpr const char* NAME = "UBF_A1";
+
+  // Taster Funkaufschaltung betätigt, MSB offset 7, 1 bit
+  constexpr bool FU_FRSP_BET(const uint8_t* d) { return (d[0] & 0x1) != 0; }
+  inline void set_FU_FRSP_BET(uint8_t* d, bool v) { d[0] = (uint8_t) ((d[0] & 0xFE) | ((uint32_t) v & 0x1) << 0); }
+
+  enum class ART_ABW_BET_e : uint8_t {
+    NDEF_NBET = 0, // nicht definiert (Wippe), Nicht betätigt (Push Push)
+    AUS_NDEF = 1, // Abstandswarnung aus (Wippe), nicht definiert (Push Push)
+    EIN_BET = 2, // Abstandswarnung ein (Wippe), Betätigt (Push Push)
+    SNV = 3, // Signal nicht vorhanden (Wippe und Push Push)
+  };
+  // ART-Abstandswarnung ein/aus betätigt, MSB offset 2, 2 bits
+  constexpr uint8_t ART_ABW_BET(const uint8_t* d) { return ((d[0] >> 4) & 0x3); }
+  inline void set_ART_ABW_BET(uint8_t* d, uint8_t v) { d[0] = (uint8_t) ((d[0] & 0xCF) | ((uint32_t) v & 0x3) << 4); }
+
+  // Abstandsfaktor, MSB offset 8, 8 bits
+  constexpr uint8_t ART_ABSTAND(const uint8_t* d) { return d[1]; }
+  inline void set_ART_ABSTAND(uint8_t* d, uint8_t v) { d[1] = (uint8_t) ((d[1] & 0x00) | ((uint32_t) v & 0xFF) << 0); }
+
+  // 3-stufiger Taster betätigt, MSB offset 22, 1 bit
+  constexpr bool ST3_BET(const uint8_t* d) { return ((d[2] >> 1) & 0x1) != 0; }
+  inline void set_ST3_BET(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xFD) | ((uint32_t) v & 0x1) << 1); }
+
+  // 2-stufiger Taster betätigt, MSB offset 20, 1 bit
+  constexpr bool ST2_BET(const uint8_t* d) { return ((d[2] >> 3) & 0x1) != 0; }
+  inline void set_ST2_BET(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xF7) | ((uint32_t) v & 0x1) << 3); }
+
+  // Taster Behördenfunk betätigt, MSB offset 18, 1 bit
+  constexpr bool BH_FUNK_BET(const uint8_t* d) { return ((d[2] >> 5) & 0x1) != 0; }
+  inline void set_BH_FUNK_BET(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // Taster Parktronic betätigt, MSB offset 16, 1 bit
+  constexpr bool PTS_BET(const uint8_t* d) { return ((d[2] >> 7) & 0x1) != 0; }
+  inline void set_PTS_BET(uint8_t* d, bool v) { d[2] = (uint8_t) ((d[2] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // LEDs für Standheizung defekt, MSB offset 26, 1 bit
+  constexpr bool LED_STH_DEF(const uint8_t* d) { return ((d[3] >> 5) & 0x1) != 0; }
+  inline void set_LED_STH_DEF(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0xDF) | ((uint32_t) v & 0x1) << 5); }
+
+  // Schalter Standheizung betätigt, MSB offset 24, 1 bit
+  constexpr bool STHL_BET(const uint8_t* d) { return ((d[3] >> 7) & 0x1) != 0; }
+  inline void set_STHL_BET(uint8_t* d, bool v) { d[3] = (uint8_t) ((d[3] & 0x7F) | ((uint32_t) v & 0x1) << 7); }
+
+  // all signals, scaled
+  struct Values {
+    bool FU_FRSP_BET;
+    uint8_t ART_ABW_BET;
+    uint8_t ART_ABSTAND;
+    bool ST3_BET;
+    bool ST2_BET;
+    bool BH_FUNK_BET;
+    bool PTS_BET;
+    bool LED_STH_DEF;
+    bool STHL_BET;
+  };
+  constexpr Values decode(const uint8_t* d) {
+    return Values{ FU_FRSP_BET(d), ART_ABW_BET(d), ART_ABSTAND(d), ST3_BET(d), ST2_BET(d), BH_FUNK_BET(d), PTS_BET(d), LED_STH_DEF(d), STHL_BET(d) };
+  }
+  constexpr const char* names[] = { "FU_FRSP_BET", "ART_ABW_BET", "ART_ABSTAND", "ST3_BET", "ST2_BET", "BH_FUNK_BET", "PTS_BET", "LED_STH_DEF", "STHL_BET" };
+  constexpr size_t count = 9;
+  inline void values(const Values& v, double* out) {
+    out[0] = v.FU_FRSP_BET; out[1] = v.ART_ABW_BET; out[2] = v.ART_ABSTAND; out[3] = v.ST3_BET; out[4] = v.ST2_BET; out[5] = v.BH_FUNK_BET; out[6] = v.PTS_BET; out[7] = v.LED_STH_DEF; out[8] = v.STHL_BET;
+  }
+  // found by ADL from a generic sink
+  inline const char* messageName(const Values&) { return NAME; }
+  inline const char* const* signals(const Values&) { return names; }
+  inline size_t signalCount(const Values&) { return count; }
+}
+
+
+// X(NAME) per message and per signal, in DBC order, for code that names every field
+#define W211_MESSAGES(X) X(EZS_240h) X(FS_340h) X(KOMBI_A5) X(UBF_A1)
+#define W211_SIGNALS_EZS_240h(X) X(KL_50) X(KL_15) X(BS_SL) X(RG_SCHALT) X(LL_RLC) X(KG_ALB_OK) X(KG_KL_AKT) X(CRASH) X(CRASH_CNF) X(INF_RFE_SAM) X(VSTAT_A) X(ASG_SPORT_BET) X(BN_SOCS) X(BLS_A) X(SAM_PAS) X(BLI_LI) X(BLI_RE) X(KL_31B) X(HAS_KL) X(ESP_BET) X(BN_NTLF) X(KL54_RM) X(ABL_EIN) X(ART_ABW_BET) X(ST3_BET) X(ST2_BET) X(ART_ABSTAND) X(LDC) X(FZGVERSN) X(GBL_AUS) X(ART_VH)
+#define W211_SIGNALS_FS_340h(X) X(FM1) X(FM2) X(FM3) X(FM4) X(M1) X(M2) X(NEDG) X(ST3_LEDL_DL) X(ST3_LEDR_DL) X(ST2_LED_DL) X(BELAD) X(FZGN_VL) X(FZGN_VR) X(FZGN_HL) X(FZGN_HR) X(FS_ID)
+#define W211_SIGNALS_KOMBI_A5(X) X(KI_STAT) X(BUTTON_1_1) X(BUTTON_1_2) X(BUTTON_2_1) X(BUTTON_2_2) X(BUTTON_3_1) X(BUTTON_3_2) X(BUTTON_4_1) X(BUTTON_4_2) X(BUTTON_5_1) X(BUTTON_5_2) X(BUTTON_6_1) X(BUTTON_6_2) X(BUTTON_7_1) X(BUTTON_7_2) X(BUTTON_8_1) X(BUTTON_8_2) X(PTT_1_1) X(PTT_1_2) X(PTT_2_1) X(PTT_2_2) X(PTT_3_1) X(PTT_3_2) X(PTT_4_1) X(PTT_4_2)
+#define W211_SIGNALS_UBF_A1(X) X(FU_FRSP_BET) X(ART_ABW_BET) X(ART_ABSTAND) X(ST3_BET) X(ST2_BET) X(BH_FUNK_BET) X(PTS_BET) X(LED_STH_DEF) X(STHL_BET)
+
+
+// bulk decoder: frames -> sink.message(frame, values), frames with a short DLC are skipped,
+// a generic sink uses messageName(v), signals(v), signalCount(v) and values(v, out)
+struct Frame {
+  uint32_t time; // us
+  uint8_t bus;
+  uint8_t dlc;
+  uint16_t id;
+  uint8_t data[8];
+};
+
+template <typename Sink>
+size_t decode(const Frame* frames, size_t n, Sink& sink) {
+  size_t decoded = 0;
+  for (size_t i = 0; i < n; i++) {
+    const Frame& f = frames[i];
+    switch ((uint32_t) f.bus << 16 | f.id) {
+      case 0 << 16 | 0x240:
+        if (f.dlc < EZS_240h::DLC) break;
+        sink.message(f, EZS_240h::decode(f.data));
+        decoded++;
+        break;
+      case 0 << 16 | 0x340:
+        if (f.dlc < FS_340h::DLC) break;
+        sink.message(f, FS_340h::decode(f.data));
+        decoded++;
+        break;
+      case 1 << 16 | 0x1CA:
+        if (f.dlc < KOMBI_A5::DLC) break;
+        sink.message(f, KOMBI_A5::decode(f.data));
+        decoded++;
+        break;
+      case 1 << 16 | 0x01A:
+        if (f.dlc < UBF_A1::DLC) break;
+        sink.message(f, UBF_A1::decode(f.data));
+        decoded++;
+        break;
+    }
+  }
+  return decoded;
+}
+
+} // namespace w211
+
+#endif /* W211_SIGNALS_H */